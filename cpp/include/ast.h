@@ -1,11 +1,16 @@
 #pragma once
 #include "asteval.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <memory> 
 #include <utility>
+#include <new>
 
 struct Env;
+struct KvazzFunction;
 struct KvazzResult;
 class AstEvaluator;
 class BaseNode;
@@ -43,6 +48,16 @@ bool is_logical_binop(BinaryOpType);
 
 std::string arg_list_to_string(std::vector<std::string> args);
 
+// operand types a BinaryOp has been evaluated with so far, see Interpreter::eval(BinaryOp*)
+enum class BinaryOpState {
+    Uninitialized, IntInt, RealReal, StringString, Generic
+};
+
+// where the scope resolver found the variable a VariableLookup refers to
+enum class Resolution {
+    Unresolved, Builtin, Global, Local
+};
+
 /*
 * Note: The value() and children() methods of AST node classes are really only used to print out
 * a readable representation of the AST, and as such are not written with much consideration to 
@@ -51,82 +66,96 @@ std::string arg_list_to_string(std::vector<std::string> args);
 class BaseNode 
 {
 public:
+    virtual ~BaseNode() = default;
     virtual NodeType              type() = 0;
     virtual std::string           value() = 0;
-    virtual const std::vector<std::shared_ptr<BaseNode>>  children() = 0;
-    virtual KvazzResult eval(class AstEvaluator &ast_eval, std::shared_ptr<Env> env);
+    virtual const std::vector<BaseNode*>  children() = 0;
+    virtual KvazzResult eval(class AstEvaluator &ast_eval, const std::shared_ptr<Env> &env);
 };
 
 class Program : public BaseNode 
 {
 private:
-    std::vector<std::shared_ptr<BaseNode>> nodes;
+    std::vector<BaseNode*> nodes;
 
 public:
+    // set by the scope resolver: size of the global frame and the slot of main, -1 if there's none
+    int num_slots = 0;
+    int main_slot = -1;
+
     virtual NodeType type() override { return NodeType::Program; }
     virtual std::string value() override { return std::string{"Program"}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { return nodes; }
+    virtual const std::vector<BaseNode*> children() override { return nodes; }
+    // the top-level statements without copying them, for the evaluators
+    const std::vector<BaseNode*> &statements() const { return nodes; }
 
-    void add_top_level_stmt( std::shared_ptr<BaseNode> node ) { nodes.push_back(node); }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    void add_top_level_stmt( BaseNode *node ) { nodes.push_back(node); }
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 
 class Block : public BaseNode 
 {
 private:
-    std::vector<std::shared_ptr<BaseNode>> stmts;
+    std::vector<BaseNode*> stmts;
 
 public:
-    Block(std::vector<std::shared_ptr<BaseNode>> stmts_)
+    // set by the scope resolver: number of variables declared directly in this block, and whether it gets
+    // an Env of its own. Blocks that declare nothing run in the enclosing Env
+    int num_slots = 0;
+    bool scoped = true;
+
+    Block(std::vector<BaseNode*> stmts_)
         : stmts { std::move(stmts_) } {}
     virtual NodeType type() override { return NodeType::Block; }
     virtual std::string value() override { return std::string{"Block"}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { return stmts; }
+    virtual const std::vector<BaseNode*> children() override { return stmts; }
+    const std::vector<BaseNode*> &statements() const { return stmts; }
 
-    void add_top_level_stmt( std::shared_ptr<BaseNode> node ) { stmts.push_back(node); }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    void add_top_level_stmt( BaseNode *node ) { stmts.push_back(node); }
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 
 class AssignOp : public BaseNode 
 {
 public:
-    std::shared_ptr<BaseNode> lvalue; 
+    BaseNode *lvalue; 
     std::string op;
     AssignOpType op_type;
-    std::shared_ptr<BaseNode> expr_node;
+    BaseNode *expr_node;
 
     /* note that having to copy objects for the children() call isn't the worst thing in the world since
      * the children() function is only used for testing/debugging of the parser. */
-    AssignOp(std::shared_ptr<BaseNode> lvalue_, std::string op_, std::shared_ptr<BaseNode> expr_node_)
+    AssignOp(BaseNode *lvalue_, std::string op_, BaseNode *expr_node_)
         : lvalue { lvalue_ }, op { op_ }, op_type { get_assign_op(op_) }, expr_node { expr_node_ } {}
 
     virtual NodeType type() override { return NodeType::AssignOp; }
     virtual std::string value() override { return std::string{"AssignOp " + op + " LValue RValue"}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local { lvalue, expr_node };
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local { lvalue, expr_node };
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class Declare : public BaseNode 
 {
 public:
     std::string identifier;
-    std::shared_ptr<BaseNode> expr_node;
+    BaseNode *expr_node;
+    int slot = -1; // set by the scope resolver
 
-    Declare(std::string identifier_, std::shared_ptr<BaseNode> expr_node_)
+    Declare(std::string identifier_, BaseNode *expr_node_)
         : identifier { identifier_ }, expr_node {expr_node_} {}
 
     virtual NodeType type() override { return NodeType::Declare; }
     virtual std::string value() override { return std::string{"Declare " + identifier}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local { expr_node };
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local { expr_node };
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class FunctionDeclare : public BaseNode 
@@ -134,89 +163,96 @@ class FunctionDeclare : public BaseNode
 public:
     std::string identifier;
     std::vector<std::string> args;
-    std::shared_ptr<BaseNode> body;
+    BaseNode *body;
+    int slot = -1; // global slot, set by the scope resolver
+    bool memo = false;     // declared as memo function
+    bool memoized = false; // memo and pure, so its results get cached. Set by the purity analysis
 
-    FunctionDeclare (std::string identifier_, std::vector<std::string> args_, std::shared_ptr<BaseNode> body_) 
+    FunctionDeclare (std::string identifier_, std::vector<std::string> args_, BaseNode *body_) 
         : identifier { identifier_ }, args { std::move(args_) }, body { body_ } {} 
     
     virtual NodeType type() override { return NodeType::FunctionDeclare; }
-    virtual std::string value() override { return std::string{"FunctionDeclare " + identifier + " with " + arg_list_to_string(args)}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local { body };
+    virtual std::string value() override {
+        return std::string{"FunctionDeclare " + std::string{memo ? "memo " : ""} + identifier + " with " + arg_list_to_string(args)};
+    }
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local { body };
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 
 class Return : public BaseNode 
 {
 public:
-    std::shared_ptr<BaseNode> expr_node;
+    BaseNode *expr_node;
+    // set by the scope resolver: expr_node is a call, which can run in the returning function's frame
+    bool tail_call = false;
 
-    Return (std::shared_ptr<BaseNode> expr_node_) 
+    Return (BaseNode *expr_node_) 
         : expr_node { expr_node_ } {}
 
     virtual NodeType type() override { return NodeType::Return; }
     virtual std::string value() override { return std::string{"Return"}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local { expr_node };
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local { expr_node };
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class IfThen : public BaseNode
 {
 public:
-    std::shared_ptr<BaseNode> condition;
-    std::shared_ptr<BaseNode> body;
+    BaseNode *condition;
+    BaseNode *body;
 
-    IfThen (std::shared_ptr<BaseNode> condition_, std::shared_ptr<BaseNode> body_)
+    IfThen (BaseNode *condition_, BaseNode *body_)
         : condition {condition_}, body { body_ } {}
 
     virtual NodeType type() override { return NodeType::IfThen; }
     virtual std::string value() override { return std::string{"If then"}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local { condition, body };
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local { condition, body };
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class IfElse : public BaseNode
 {
 public:
-    std::shared_ptr<BaseNode> condition;
-    std::shared_ptr<BaseNode> then_body;
-    std::shared_ptr<BaseNode> else_body;
+    BaseNode *condition;
+    BaseNode *then_body;
+    BaseNode *else_body;
 
-    IfElse (std::shared_ptr<BaseNode> condition_, std::shared_ptr<BaseNode> then_body_, std::shared_ptr<BaseNode> else_body_)
+    IfElse (BaseNode *condition_, BaseNode *then_body_, BaseNode *else_body_)
         : condition {condition_}, then_body { then_body_ }, else_body { else_body_ } {}
 
     virtual NodeType type() override { return NodeType::IfElse; }
     virtual std::string value() override { return std::string{"If then else"}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local { condition, then_body, else_body };
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local { condition, then_body, else_body };
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class While : public BaseNode {
 public:
-    std::shared_ptr<BaseNode> condition;
-    std::shared_ptr<BaseNode> body;
+    BaseNode *condition;
+    BaseNode *body;
 
-    While (std::shared_ptr<BaseNode> condition_, std::shared_ptr<BaseNode> body_)
+    While (BaseNode *condition_, BaseNode *body_)
             : condition {condition_}, body { body_ } {}
     virtual NodeType type() override { return NodeType::While; }
     virtual std::string value() override { return std::string{"While do"}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local { condition, body };
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local { condition, body };
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env);
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env);
 };
 
 class BinaryOp : public BaseNode 
@@ -224,19 +260,20 @@ class BinaryOp : public BaseNode
 public:
     std::string op;
     BinaryOpType op_type;
-    std::shared_ptr<BaseNode> left_expr;
-    std::shared_ptr<BaseNode> right_expr;
+    BaseNode *left_expr;
+    BaseNode *right_expr;
+    std::atomic<BinaryOpState> state { BinaryOpState::Uninitialized };
 
-    BinaryOp (std::string op_, std::shared_ptr<BaseNode> left_expr_, std::shared_ptr<BaseNode> right_expr_)
+    BinaryOp (std::string op_, BaseNode *left_expr_, BaseNode *right_expr_)
         : op { op_ }, op_type { get_binary_op(op_) }, left_expr {left_expr_}, right_expr {right_expr_} {}
 
     virtual NodeType type() override { return NodeType::BinaryOp; }
     virtual std::string value() override { return std::string{"BinaryOp " + op}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local { left_expr, right_expr };
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local { left_expr, right_expr };
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class UnaryOp : public BaseNode
@@ -245,55 +282,63 @@ private:
     std::string op;
 public:
     UnaryOpType op_type;
-    std::shared_ptr<BaseNode> right_expr;
+    BaseNode *right_expr;
 
-    UnaryOp (std::string op_, std::shared_ptr<BaseNode> right_expr_)
+    UnaryOp (std::string op_, BaseNode *right_expr_)
         : op { op_ }, op_type { get_unary_op(op_) }, right_expr {right_expr_} {}
 
     virtual NodeType type() override { return NodeType::UnaryOp; }
     virtual std::string value() override { return std::string{"UnaryOp " + op}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local { right_expr };
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local { right_expr };
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class FunctionCall : public BaseNode
 {
 public:
-    std::shared_ptr<BaseNode> callee;
-    std::vector<std::shared_ptr<BaseNode>> expr_args;
+    BaseNode *callee;
+    std::vector<BaseNode*> expr_args;
 
-    FunctionCall (std::shared_ptr<BaseNode> callee_, std::vector<std::shared_ptr<BaseNode>> expr_args_)
+    // inline cache of the declared global function this call site calls, valid while cache_epoch matches
+    // the global_epoch of the Isolate running it. nullptr means the callee is something else and has to be
+    // evaluated. Isolates running the same AST on different threads all use it, see cached_global_callee
+    std::atomic<KvazzFunction*> cached_callee { nullptr };
+    std::atomic<uint64_t> cache_epoch { 0 };
+
+    FunctionCall (BaseNode *callee_, std::vector<BaseNode*> expr_args_)
         : callee { callee_ }, expr_args { std::move(expr_args_) } {}
 
     virtual NodeType type() override { return NodeType::FunctionCall; }
     virtual std::string value() override { return std::string{"FunctionCall callee args... "}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local = expr_args;
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local = expr_args;
         local.insert(local.begin(), callee);
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class Access : public BaseNode
 {
 public:
-    std::shared_ptr<BaseNode> left_expr;
-    std::shared_ptr<BaseNode> index_expr;
+    BaseNode *left_expr;
+    // a[i, j] has two index expressions. For a Hovec they index its axes, otherwise it's a[i][j]
+    std::vector<BaseNode*> index_exprs;
 
-    Access (std::shared_ptr<BaseNode> left_expr_, std::shared_ptr<BaseNode> index_expr_)
-        : left_expr { left_expr_ }, index_expr { index_expr_ } {}
+    Access (BaseNode *left_expr_, std::vector<BaseNode*> index_exprs_)
+        : left_expr { left_expr_ }, index_exprs { index_exprs_ } {}
 
     virtual NodeType type() override { return NodeType::Access; }
     virtual std::string value() override { return std::string{"Access accessee index"}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local { left_expr, index_expr };
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local = index_exprs;
+        local.insert(local.begin(), left_expr);
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class VariableLookup : public BaseNode
@@ -302,16 +347,22 @@ public:
     std::string identifier;
     bool sigil;
 
+    // set by the scope resolver. Local variables are found depth Envs up from the current one, globals
+    // are always in global_env and for built-ins the slot is the built-in function id
+    Resolution resolution = Resolution::Unresolved;
+    int depth = 0;
+    int slot = -1;
+
     VariableLookup(std::string identifier_, bool sigil_)
         : identifier { identifier_ }, sigil { sigil_ } {}
 
     virtual NodeType type() override { return NodeType::VariableLookup; }
     virtual std::string value() override { return std::string{"VariableLookup" + std::string{sigil ? " $" : " "} + identifier}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local;
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local;
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class IntLiteral : public BaseNode
@@ -324,11 +375,11 @@ public:
 
     virtual NodeType type() override { return NodeType::IntLiteral; }
     virtual std::string value() override { return std::string{ "int-literal '" + std::to_string(literal_value) + "'" }; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local;
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local;
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class BoolLiteral : public BaseNode
@@ -341,11 +392,11 @@ public:
 
     virtual NodeType type() override { return NodeType::BoolLiteral; }
     virtual std::string value() override { return std::string{ "bool-literal " + std::string{literal_value ? "'true'" : "'false'"}}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local;
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local;
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class RealLiteral : public BaseNode 
@@ -358,11 +409,11 @@ public:
 
     virtual NodeType type() override { return NodeType::RealLiteral; }
     virtual std::string value() override { return std::string{ "real-literal '" + std::to_string(literal_value) + "'"}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local;
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local;
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
 class StringLiteral : public BaseNode 
@@ -375,24 +426,73 @@ public:
 
     virtual NodeType type() override { return NodeType::StringLiteral; }
     virtual std::string value() override { return std::string{ "string-literal '" + literal_value + "'"}; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { 
-        std::vector<std::shared_ptr<BaseNode>> local;
+    virtual const std::vector<BaseNode*> children() override { 
+        std::vector<BaseNode*> local;
         return local;
     }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
 };
 
-/*  Deal with homogeneous vectors later */
+/*  [ ... ] builds a hevec, <[ ... ]> (homogeneous) a hovec */
 class VectorLiteral : public BaseNode 
 {
 public:
-    std::vector<std::shared_ptr<BaseNode>> contents;
+    std::vector<BaseNode*> contents;
+    bool homogeneous;
 
-    VectorLiteral (std::vector<std::shared_ptr<BaseNode>> contents_)
-        : contents { std::move(contents_) } {}
+    VectorLiteral (std::vector<BaseNode*> contents_, bool homogeneous_ = false)
+        : contents { std::move(contents_) }, homogeneous { homogeneous_ } {}
 
     virtual NodeType type() override { return NodeType::VectorLiteral; }
-    virtual std::string value() override { return std::string{ "VectorLiteral" }; }
-    virtual const std::vector<std::shared_ptr<BaseNode>> children() override { return contents; }
-    virtual KvazzResult eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) override;
+    virtual std::string value() override { return std::string{ homogeneous ? "HovecLiteral" : "VectorLiteral" }; }
+    virtual const std::vector<BaseNode*> children() override { return contents; }
+    virtual KvazzResult eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) override;
+};
+
+/////////////////////////////////////////////////////////////////////////////////////
+// AST ARENA
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+*  Bump allocator the nodes of a parsed program are constructed in. Nodes point at each other with
+*  raw pointers and are all destroyed together with the arena, so nothing is reference counted and
+*  a program's nodes sit next to each other in a few large chunks.
+*/
+class AstArena
+{
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char   *next = nullptr;
+    size_t  remaining = 0;
+    // every node made, destroyed in reverse order
+    std::vector<BaseNode*> nodes;
+
+    void *allocate(size_t size, size_t alignment);
+
+public:
+    AstArena() = default;
+    AstArena(AstArena &&other) noexcept;
+    AstArena(const AstArena&) = delete;
+    AstArena &operator=(const AstArena&) = delete;
+    ~AstArena();
+
+    template <typename T, typename... Args>
+    T *make(Args&&... args) {
+        T *node = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        nodes.push_back(node);
+        return node;
+    }
+};
+
+/*
+*  Result of parsing: the root node and the arena owning every node of the tree. Passes that add
+*  nodes (the optimizer) make them in the same arena, so the whole tree lives as long as this does.
+*/
+struct ParsedProgram
+{
+    AstArena  arena;
+    BaseNode *root = nullptr;
 };
@@ -1,5 +1,7 @@
 #pragma once
 #include "ast.h"
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <variant>
 #include <vector>
@@ -13,6 +15,7 @@
 struct LValue;
 struct KvazzFunction;
 struct Env;
+class MemoCache;
 struct KvazzValue;
 
 class BaseNode;
@@ -42,32 +45,283 @@ enum class KvazzFlag {
 };
 
 enum class KvazzType {
-    Nothing, LValue, Builtin, Int, Real, Bool, String, Hevec, Function
+    Nothing, LValue, Builtin, Int, Real, Bool, String, Hevec, Hovec, Function, Future
 };
 
+// Unbound marks a slot whose declaration hasn't run yet
 enum class EnvResultType {
-    Value, Function, Builtin
+    Value, Function, Builtin, Unbound
 };
 
+// an assignment target: the variable in slot of env, or the element at indices inside it for a[i][j]
 struct LValue {
-    KvazzType type; // Nothing : env
-    std::variant<std::shared_ptr<Env>, std::vector<KvazzValue>*> lvalue;
-    std::variant<int, std::string> index;
+    Env *env;
+    int slot;
+    std::vector<int> indices;
 };
 
 struct KvazzFunction
 {
     std::string               name;
     std::vector<std::string>  args;
-    std::shared_ptr<BaseNode> body;
+    BaseNode*                 body = nullptr;
+    // the results of a memoized function, shared by every copy of it. nullptr if it isn't memoized
+    std::shared_ptr<MemoCache> memo = nullptr;
 };
 
+// the result of spawn f(x), which sync waits for. The state is shared with the task computing it
+struct FutureState;
+struct KvazzFuture
+{
+    std::shared_ptr<FutureState> state;
+};
+
+/*
+*  The elements of one or more hovecs, unboxed and contiguous. Only the vector matching the element type
+*  of the hovecs is used.
+*/
+struct HovecBuffer
+{
+    std::vector<int>     ints;
+    std::vector<double>  reals;
+    std::vector<uint8_t> bools;
+};
+
+/*
+*  An n-dimensional array of Int, Real or Bool elements. Element [i0, i1, ...] is at
+*  offset + i0 * strides[0] + i1 * strides[1] + ... in buffer, so rows, transposes and reshapes are views
+*  that share the buffer and only differ in this header. A shared buffer is copied before it's written to.
+*/
+struct Hovec
+{
+    KvazzType                    element_type;
+    std::shared_ptr<HovecBuffer> buffer;
+    std::vector<size_t>          shape;
+    std::vector<ptrdiff_t>       strides;
+    size_t                       offset = 0;
+
+    size_t rank() const { return shape.size(); }
+
+    // the number of elements
+    size_t size() const {
+        size_t size = 1;
+        for (auto dim : shape)
+            size *= dim;
+        return size;
+    }
+
+    // whether the elements are laid out in row-major order from offset, with no gaps
+    bool is_contiguous() const {
+        ptrdiff_t expected = 1;
+        for (size_t axis = shape.size(); axis-- > 0;) {
+            if (shape[axis] != 1 && strides[axis] != expected)
+                return false;
+            expected *= shape[axis];
+        }
+        return true;
+    }
+};
+
+// set while any Isolate has Kvazz code running on more than one thread. Other Isolates may flip it at any
+// time, which is harmless: values are only shared by the threads of one Isolate, which keeps it set while
+// they are
+extern bool kvazz_multithreaded;
+
+inline bool is_multithreaded() {
+    return __atomic_load_n(&kvazz_multithreaded, __ATOMIC_RELAXED);
+}
+
+/*
+*  Heap storage for the KvazzValue types that don't fit in 8 bytes, shared by copies of a KvazzValue.
+*  Strings, functions, futures and lvalues never change once created. Hevecs and hovecs are copy-on-write:
+*  anything that modifies one goes through mutable_vector() or mutable_hovec(), which clone the
+*  storage first if it's shared.
+*
+*  The refcount is only updated with atomic read-modify-writes while kvazz_multithreaded is set, the
+*  rest of the time a plain increment is enough and a lot cheaper.
+*/
+struct KvazzObject
+{
+    uint32_t refcount = 1;
+    virtual ~KvazzObject() = default;
+
+    void retain() {
+        if (is_multithreaded())
+            __atomic_fetch_add(&refcount, 1, __ATOMIC_RELAXED);
+        else
+            ++refcount;
+    }
+
+    // drops a reference, returns true if it was the last one
+    bool release() {
+        if (is_multithreaded())
+            return __atomic_sub_fetch(&refcount, 1, __ATOMIC_ACQ_REL) == 0;
+        return --refcount == 0;
+    }
+
+    bool is_shared() const {
+        if (is_multithreaded())
+            return __atomic_load_n(&refcount, __ATOMIC_ACQUIRE) != 1;
+        return refcount != 1;
+    }
+};
+
+template <typename T>
+struct KvazzBox : KvazzObject
+{
+    T value;
+    KvazzBox(T value_) : value { std::move(value_) } {}
+};
+
+/*
+*  16 bytes: the type tag and either an immediate (Int, Real, Bool, Nothing and Builtin ids) or a
+*  pointer to a refcounted KvazzObject. The as_* accessors throw std::bad_variant_access when the value
+*  doesn't hold that payload, like std::get did when this was a std::variant.
+*/
 struct KvazzValue
 {
     KvazzType type;
-    std::variant<int, double, bool, std::string, std::vector<KvazzValue>, LValue, KvazzFunction> value;
+    union {
+        int          int_value;
+        double       real_value;
+        bool         bool_value;
+        KvazzObject *object;
+    };
+
+    KvazzValue() : type { KvazzType::Nothing }, int_value { 0 } {}
+    KvazzValue(KvazzType type_, int value) : type { type_ }, int_value { value } {}
+    KvazzValue(KvazzType type_, double value) : type { type_ }, real_value { value } {}
+    KvazzValue(KvazzType type_, bool value) : type { type_ }, bool_value { value } {}
+    KvazzValue(KvazzType type_, std::string value);
+    KvazzValue(KvazzType type_, const char *value);
+    KvazzValue(KvazzType type_, std::vector<KvazzValue> value);
+    KvazzValue(KvazzType type_, Hovec value);
+    KvazzValue(KvazzType type_, LValue value);
+    KvazzValue(KvazzType type_, KvazzFunction value);
+    KvazzValue(KvazzType type_, KvazzFuture value);
+
+    KvazzValue(const KvazzValue &other);
+    // a moved-from value is a plain Nothing, without the payload an error mark has, see runtime.h
+    KvazzValue(KvazzValue &&other) noexcept : type { other.type }, real_value { other.real_value } {
+        other.type = KvazzType::Nothing;
+        other.int_value = 0;
+    }
+    KvazzValue &operator=(const KvazzValue &other);
+    KvazzValue &operator=(KvazzValue &&other) noexcept;
+    ~KvazzValue() { if (is_boxed()) release(); }
+
+    static bool is_boxed_type(KvazzType t) {
+        return t == KvazzType::String || t == KvazzType::Hevec || t == KvazzType::Hovec
+            || t == KvazzType::LValue || t == KvazzType::Function || t == KvazzType::Future;
+    }
+    bool is_boxed() const { return is_boxed_type(type); }
+
+    int as_int() const {
+        if (type != KvazzType::Int && type != KvazzType::Builtin && type != KvazzType::Nothing)
+            throw std::bad_variant_access();
+        return int_value;
+    }
+    double as_real() const {
+        if (type != KvazzType::Real)
+            throw std::bad_variant_access();
+        return real_value;
+    }
+    bool as_bool() const {
+        if (type != KvazzType::Bool)
+            throw std::bad_variant_access();
+        return bool_value;
+    }
+    const std::string &as_string() const { return unbox<std::string>(KvazzType::String); }
+    const std::vector<KvazzValue> &as_vector() const { return unbox<std::vector<KvazzValue>>(KvazzType::Hevec); }
+    std::vector<KvazzValue> &mutable_vector() { return unshare<std::vector<KvazzValue>>(KvazzType::Hevec); }
+    const Hovec &as_hovec() const { return unbox<Hovec>(KvazzType::Hovec); }
+    Hovec &mutable_hovec() { return unshare<Hovec>(KvazzType::Hovec); }
+    LValue &as_lvalue() const { return unbox<LValue>(KvazzType::LValue); }
+    KvazzFunction &as_function() const { return unbox<KvazzFunction>(KvazzType::Function); }
+    const KvazzFuture &as_future() const { return unbox<KvazzFuture>(KvazzType::Future); }
+
+private:
+    template <typename T>
+    T &unbox(KvazzType expected) const {
+        if (type != expected)
+            throw std::bad_variant_access();
+        return static_cast<KvazzBox<T>*>(object)->value;
+    }
+
+    // clones the boxed value first if other KvazzValues share it. Elements of a cloned Hevec are
+    // copied, so nested vectors stay shared until they are written to as well
+    template <typename T>
+    T &unshare(KvazzType expected) {
+        auto &value = unbox<T>(expected);
+        if (!object->is_shared())
+            return value;
+
+        auto clone = new KvazzBox<T>(value);
+        release();
+        object = clone;
+        return clone->value;
+    }
+
+    void release() {
+        if (object->release())
+            delete object;
+    }
+
+    void copy_payload(const KvazzValue &other) {
+        if (other.is_boxed()) {
+            object = other.object;
+            object->retain();
+        }
+        else {
+            real_value = other.real_value;
+        }
+    }
 };
 
+static_assert(sizeof(KvazzValue) == 16, "KvazzValue should stay a tag plus one 8 byte payload");
+
+inline KvazzValue::KvazzValue(KvazzType type_, std::string value)
+    : type { type_ }, object { new KvazzBox<std::string>(std::move(value)) } {}
+inline KvazzValue::KvazzValue(KvazzType type_, const char *value)
+    : type { type_ }, object { new KvazzBox<std::string>(std::string { value }) } {}
+inline KvazzValue::KvazzValue(KvazzType type_, std::vector<KvazzValue> value)
+    : type { type_ }, object { new KvazzBox<std::vector<KvazzValue>>(std::move(value)) } {}
+inline KvazzValue::KvazzValue(KvazzType type_, Hovec value)
+    : type { type_ }, object { new KvazzBox<Hovec>(std::move(value)) } {}
+inline KvazzValue::KvazzValue(KvazzType type_, LValue value)
+    : type { type_ }, object { new KvazzBox<LValue>(std::move(value)) } {}
+inline KvazzValue::KvazzValue(KvazzType type_, KvazzFunction value)
+    : type { type_ }, object { new KvazzBox<KvazzFunction>(std::move(value)) } {}
+inline KvazzValue::KvazzValue(KvazzType type_, KvazzFuture value)
+    : type { type_ }, object { new KvazzBox<KvazzFuture>(std::move(value)) } {}
+
+inline KvazzValue::KvazzValue(const KvazzValue &other) : type { other.type } {
+    copy_payload(other);
+}
+
+inline KvazzValue &KvazzValue::operator=(const KvazzValue &other) {
+    if (this != &other) {
+        // copy before releasing, other may live inside the object this value holds
+        KvazzValue copy { other };
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+inline KvazzValue &KvazzValue::operator=(KvazzValue &&other) noexcept {
+    if (this != &other) {
+        auto old_type = type;
+        auto old_object = object;
+        type = other.type;
+        real_value = other.real_value;
+        other.type = KvazzType::Nothing;
+        other.int_value = 0;
+        if (is_boxed_type(old_type) && old_object->release())
+            delete old_object;
+    }
+    return *this;
+}
+
 struct KvazzResult
 {
     KvazzValue kvazz_value;
@@ -83,19 +337,23 @@ struct EnvEntry
 };
 
 
+/*
+*  One frame per Block and function call, plus global_env. Variables are stored at the slots the scope
+*  resolver assigned them, so there are no names at runtime. Frames are made with make_env, which
+*  recycles the memory of destroyed ones.
+*/
 struct Env 
 {
     std::shared_ptr<Env> parent;
-    std::unordered_map<std::string, EnvEntry> table;
-    Env(std::shared_ptr<Env> _parent, std::unordered_map<std::string, EnvEntry> _table)
-        : parent { _parent }, table { std::move(_table) } {}
+    std::vector<EnvEntry> slots;
+    Env(std::shared_ptr<Env> _parent, std::vector<EnvEntry> _slots)
+        : parent { std::move(_parent) }, slots { std::move(_slots) } {}
+    // leaves the storage of slots to the next Env made on this thread
+    ~Env();
 };
 
-struct LookupResult
-{
-    EnvEntry result;
-    std::shared_ptr<Env> env;
-};
+// an Env with num_slots unbound slots under parent, made from this thread's pool of Env memory
+std::shared_ptr<Env> make_env(std::shared_ptr<Env> parent, size_t num_slots);
 
 // go into built-in header file later
 std::string built_in_function_as_string(int id);
@@ -105,24 +363,24 @@ private:
     bool lvalue_flag;
 
 public:
-    virtual KvazzResult eval(BaseNode *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(Program *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(Block *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(AssignOp *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(Declare *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(FunctionDeclare *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(Return *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(IfThen *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(IfElse *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(While *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(BinaryOp *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(UnaryOp *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(FunctionCall *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(Access *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(VariableLookup *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(IntLiteral *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(BoolLiteral *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(RealLiteral *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(StringLiteral *node, std::shared_ptr<Env> env) = 0;
-    virtual KvazzResult eval(VectorLiteral *node, std::shared_ptr<Env> env) = 0;
+    virtual KvazzResult eval(BaseNode *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(Program *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(Block *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(AssignOp *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(Declare *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(FunctionDeclare *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(Return *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(IfThen *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(IfElse *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(While *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(BinaryOp *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(UnaryOp *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(FunctionCall *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(Access *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(VariableLookup *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(IntLiteral *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(BoolLiteral *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(RealLiteral *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(StringLiteral *node, const std::shared_ptr<Env> &env) = 0;
+    virtual KvazzResult eval(VectorLiteral *node, const std::shared_ptr<Env> &env) = 0;
 };
@@ -0,0 +1,71 @@
+#pragma once
+#include "asteval.h"
+#include "ast.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+/*
+*  Bytecode representation that the AST is lowered into for the VM. Instructions are a one byte
+*  opcode followed by their operands, which are either 2 bytes (local slots, argument counts,
+*  built-in ids) or 4 bytes (constant pool indices, global indices, jump targets), little-endian.
+*/
+
+enum class OpCode : uint8_t {
+    Constant,        // u32 constant index
+    Nothing,
+    Pop,
+    LoadLocal,       // u16 slot
+    StoreLocal,      // u16 slot
+    LoadGlobal,      // u32 global index
+    StoreGlobal,     // u32 global index
+    DefineGlobal,    // u32 global index
+    StoreLocalIndex, // u16 slot, u16 number of indices
+    StoreGlobalIndex,// u32 global index, u16 number of indices
+    UpdateLocal,     // u16 slot, u16 number of indices, u16 operator opcode: a compound assignment
+    UpdateGlobal,    // u32 global index, u16 number of indices, u16 operator opcode
+    Add, Subtract, Multiply, Divide, Modulo,
+    Equals, NotEquals, LessEquals, GreaterEquals, LessThan, GreaterThan,
+    Or, And,
+    Negate, Not,
+    Jump,            // u32 target
+    JumpIfFalse,     // u32 target
+    Call,            // u16 argument count, callee is below the arguments
+    CallFunction,    // u32 function index, u16 argument count
+    TailCallFunction,// u32 function index, u16 argument count, the callee replaces the current frame
+    CallBuiltin,     // u16 built-in id, u16 argument count
+    Return,
+    MakeHevec,       // u16 number of elements
+    MakeHovec,       // u16 number of elements
+    Index,
+    MultiIndex,      // u16 number of indices, container is below the indices
+    Halt
+};
+
+std::string opcode_as_string(OpCode op);
+
+struct BytecodeFunction
+{
+    std::string              name;
+    int                      arity;
+    int                      num_locals;
+    std::vector<uint8_t>     code;
+    std::vector<KvazzValue>  constants;
+    // the results of a memoized function, shared with its Function value. nullptr if it isn't memoized
+    std::shared_ptr<MemoCache> memo = nullptr;
+};
+
+struct BytecodeProgram
+{
+    std::vector<BytecodeFunction> functions;
+    std::vector<std::string>      global_names;
+    int                           script_index;
+
+    // maps the body of every declared function to its compiled form, for calls through function values
+    std::unordered_map<BaseNode*, int> function_index;
+};
+
+BytecodeProgram compile_program(BaseNode *ast);
+void disassemble_program(BytecodeProgram &program);
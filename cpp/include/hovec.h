@@ -0,0 +1,70 @@
+#pragma once
+#include "asteval.h"
+#include "kernels.h"
+#include <string>
+#include <vector>
+
+/*
+*  Hovec construction, indexing, views and arithmetic. Built into kvazzrt with the rest of the runtime.
+*/
+
+// a contiguous hovec of the given shape, with its elements zeroed
+Hovec make_shaped_hovec(KvazzType element_type, std::vector<size_t> shape);
+// a contiguous hovec of the given shape with every element set to fill, which must fit element_type
+Hovec make_filled_hovec(KvazzType element_type, std::vector<size_t> shape, const KvazzValue &fill);
+// builds a hovec literal: Int, Real or Bool elements of one type, or hovecs of one shape stacked into rows
+KvazzResult make_hovec(const std::vector<KvazzValue> &elements);
+
+// the element at a position in the buffer
+KvazzValue hovec_element(const Hovec &hovec, size_t position);
+
+// calls f with the buffer position of every element, in row-major order
+template <typename F>
+void for_each_position(const Hovec &hovec, F f) {
+    size_t count = hovec.size();
+    std::vector<size_t> index(hovec.rank(), 0);
+    ptrdiff_t position = hovec.offset;
+    for (size_t n = 0; n < count; ++n) {
+        f(static_cast<size_t>(position));
+        // advance index like an odometer, the last axis fastest
+        for (size_t axis = hovec.rank(); axis-- > 0;) {
+            position += hovec.strides[axis];
+            if (++index[axis] < hovec.shape[axis])
+                break;
+            position -= hovec.strides[axis] * static_cast<ptrdiff_t>(hovec.shape[axis]);
+            index[axis] = 0;
+        }
+    }
+}
+
+// the elements in row-major order, pointing into the buffer if they're contiguous or gathered into scratch
+const int *hovec_ints(const Hovec &hovec, std::vector<int> &scratch);
+// the elements of an Int or Real hovec as doubles, in row-major order
+const double *hovec_reals(const Hovec &hovec, std::vector<double> &scratch);
+
+// hovec[indices...]: an element for rank indices, a view of the remaining axes for fewer
+KvazzResult hovec_index(const Hovec &hovec, KvazzValue *indices, size_t count);
+// assigns an element, or a hovec of the same shape to the view fewer indices select
+bool hovec_store_index(Hovec &hovec, KvazzValue *indices, size_t count, const KvazzValue &value);
+
+bool hovec_equals(const Hovec &left, const Hovec &right);
+std::string hovec_as_string(const Hovec &hovec);
+std::string shape_as_string(const std::vector<size_t> &shape);
+
+// a view with the axes reversed
+Hovec hovec_transpose(const Hovec &hovec);
+// a view with a new shape of the same size, which copies the elements first if they aren't contiguous
+KvazzResult hovec_reshape(const Hovec &hovec, std::vector<size_t> shape);
+
+// Int, Real, or the element type of a Hovec
+KvazzType numeric_type(const KvazzValue &kv);
+// the type name for error messages, e.g. "Hovec of Real"
+std::string describe_type(const KvazzValue &kv);
+
+// elementwise op between two numeric hovecs of the same shape, or a numeric hovec and an Int or Real
+KvazzResult hovec_arithmetic(KernelOp op, const KvazzValue &kv1, const KvazzValue &kv2);
+
+// matrix products of numeric hovecs: Int if both are Int, Real otherwise
+KvazzResult hovec_matmul(const Hovec &left, const Hovec &right);
+KvazzResult hovec_matvec(const Hovec &matrix, const Hovec &vec);
+KvazzResult hovec_outer(const Hovec &left, const Hovec &right);
@@ -1,37 +1,143 @@
 #pragma once
 #include "asteval.h"
 #include "ast.h"
+#include "runtime.h"
+#include <array>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <utility>
 
-void run_ast_interpreter(std::shared_ptr<BaseNode> ast);
+class Jit;
 
-bool is_gnr(KvazzResult &kr);
+// run the program ast on isolate, which must not have run one before
+void run_ast_interpreter(Isolate &isolate, BaseNode *ast, bool use_jit = false);
+void run_closure_interpreter(Isolate &isolate, BaseNode *ast);
 
-LookupResult lookup(std::string identifier, std::shared_ptr<Env> env);
+Env *resolve_env(Isolate &isolate, VariableLookup *node, Env *env);
+EnvEntry *lookup(Isolate &isolate, VariableLookup *node, Env *env);
+KvazzFunction *cached_global_callee(Isolate &isolate, FunctionCall *node);
+std::shared_ptr<Env> make_function_env(Isolate &isolate, KvazzFunction &fn, std::vector<KvazzValue> &arg_values);
+
+/*
+*  A call in tail position. The Return only evaluates the callee and arguments and leaves the call here,
+*  the call running the returning function then makes it in a loop instead of recursing, in the same Envs
+*  when nothing else holds on to them. So tail recursion runs in constant stack.
+*/
+struct TailCall
+{
+    bool pending = false;
+    KvazzFunction *callee = nullptr; // a declared global function's entry, or function
+    KvazzFunction function;          // the callee when it's a function value
+    std::vector<KvazzValue> args;
+};
 
 class Interpreter : public AstEvaluator {
 private:
     bool lvalue_flag = false;
+    Jit *jit = nullptr;
+    TailCall tail_call;
+
+    std::vector<KvazzValue> eval_indices(Access *node, const std::shared_ptr<Env> &env);
+    KvazzResult eval_tail_call(FunctionCall *node, const std::shared_ptr<Env> &env);
+    KvazzResult run_statements(Block *node, const std::shared_ptr<Env> &env);
 
 public:
-    virtual KvazzResult eval(BaseNode *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(Program *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(Block *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(AssignOp *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(Declare *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(FunctionDeclare *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(Return *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(IfThen *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(IfElse *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(While *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(BinaryOp *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(UnaryOp *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(FunctionCall *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(Access *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(VariableLookup *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(IntLiteral *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(BoolLiteral *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(RealLiteral *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(StringLiteral *node, std::shared_ptr<Env> env) override;
-    virtual KvazzResult eval(VectorLiteral *node, std::shared_ptr<Env> env) override;
+    Isolate &isolate;
+
+    Interpreter(Isolate &isolate_, Jit *jit_ = nullptr)
+        : jit { jit_ }, isolate { isolate_ } {}
+
+    KvazzResult run_function(KvazzFunction &fn, std::vector<KvazzValue> &arg_values);
+
+    virtual KvazzResult eval(BaseNode *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(Program *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(Block *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(AssignOp *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(Declare *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(FunctionDeclare *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(Return *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(IfThen *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(IfElse *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(While *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(BinaryOp *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(UnaryOp *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(FunctionCall *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(Access *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(VariableLookup *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(IntLiteral *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(BoolLiteral *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(RealLiteral *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(StringLiteral *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(VectorLiteral *node, const std::shared_ptr<Env> &env) override;
+};
+
+/*
+*  Closure-compiling evaluator. Every node is turned into a closure once, ahead of execution, with its
+*  operator and children fixed, so running the program is a chain of direct closure calls instead of
+*  BaseNode::eval -> AstEvaluator::eval -> Interpreter::eval on every visit. Environments and values are
+*  the same as the Interpreter's, so both produce the same output.
+*/
+using Closure = std::function<KvazzResult(const std::shared_ptr<Env>&)>;
+using LValueClosure = std::function<KvazzValue*(const std::shared_ptr<Env>&)>;
+
+class ClosureCompiler : public AstEvaluator {
+private:
+    Isolate &isolate;
+    // compiled bodies of declared functions, keyed by their body node. They run in the Env they're passed
+    std::unordered_map<BaseNode*, Closure> function_bodies;
+    std::array<std::pair<BaseNode*, Closure*>, 64> body_cache {};
+    // argument vectors of finished calls, reused so calls don't allocate one each
+    std::vector<std::vector<KvazzValue>> spare_args;
+    TailCall tail_call;
+
+    Closure compile_program(Program *node);
+    Closure compile_block(Block *node);
+    Closure compile_statements(Block *node);
+    Closure compile_tail_call(FunctionCall *node);
+    Closure compile_assign(AssignOp *node);
+    Closure compile_index_assign(AssignOp *node);
+    Closure compile_declare(Declare *node);
+    Closure compile_function_declare(FunctionDeclare *node);
+    Closure compile_binary_op(BinaryOp *node);
+    Closure compile_unary_op(UnaryOp *node);
+    Closure compile_function_call(FunctionCall *node);
+    Closure compile_access(Access *node);
+    Closure compile_variable_lookup(VariableLookup *node);
+    LValueClosure compile_lvalue(BaseNode *node);
+    Closure *function_body(KvazzFunction &fn);
+    std::vector<KvazzValue> eval_args(const std::vector<Closure> &args, const std::shared_ptr<Env> &env);
+    void recycle_args(std::vector<KvazzValue> &values);
+
+public:
+    ClosureCompiler(Isolate &isolate_)
+        : isolate { isolate_ } {}
+
+    Closure compile(BaseNode *node);
+    KvazzResult call(KvazzFunction &fn, std::vector<KvazzValue> &arg_values);
+    KvazzResult call_in_frame(KvazzFunction &fn, std::shared_ptr<Env> function_env);
+
+    virtual KvazzResult eval(BaseNode *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(Program *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(Block *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(AssignOp *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(Declare *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(FunctionDeclare *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(Return *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(IfThen *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(IfElse *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(While *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(BinaryOp *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(UnaryOp *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(FunctionCall *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(Access *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(VariableLookup *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(IntLiteral *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(BoolLiteral *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(RealLiteral *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(StringLiteral *node, const std::shared_ptr<Env> &env) override;
+    virtual KvazzResult eval(VectorLiteral *node, const std::shared_ptr<Env> &env) override;
 };
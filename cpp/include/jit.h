@@ -0,0 +1,62 @@
+#pragma once
+#include "asteval.h"
+#include "ast.h"
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+/*
+*  Baseline x86-64 JIT for integer-only functions.
+*
+*  A function is eligible when its parameters are only ever used as Ints and its body only contains
+*  Int/Bool locals, BinaryOp/UnaryOp arithmetic and comparisons, if/while, returns and calls to other
+*  eligible functions. Such functions have no side effects, so when the native code hits something it
+*  can't handle (a zero divisor, falling off the end of the function) it bails out and the call is simply
+*  re-run by the Interpreter.
+*/
+
+// number of Int-only calls after which a function gets compiled
+const int JIT_HOT_THRESHOLD = 10;
+
+// number of bailouts after which a compiled function goes back to being interpreted for good
+const int JIT_MAX_BAILOUTS = 8;
+
+enum class JitStatus {
+    Interpreted, Compiled, Ineligible
+};
+
+enum class JitType {
+    Int, Bool
+};
+
+struct JitFunction
+{
+    JitStatus status = JitStatus::Interpreted;
+    int       hot_count = 0;
+    int       bailouts = 0;
+    int       arity = 0;
+    JitType   return_type = JitType::Int;
+    void     *entry = nullptr;
+};
+
+class Jit {
+private:
+    std::shared_ptr<Env> globals;
+    std::unordered_map<BaseNode*, JitFunction> functions;
+    std::vector<std::pair<void*, size_t>> code_pages;
+
+    // set by native code that has to bail out, checked after every native call
+    uint8_t bailed = 0;
+
+    bool compile(KvazzFunction &fn);
+
+public:
+    Jit(std::shared_ptr<Env> globals_);
+    ~Jit();
+
+    bool try_call(KvazzFunction &fn, std::vector<KvazzValue> &arg_values, KvazzResult &result);
+
+    friend class JitFunctionCompiler;
+};
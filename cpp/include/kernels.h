@@ -0,0 +1,48 @@
+#pragma once
+#include "simd.h"
+#include <cstddef>
+
+/*
+*  Numeric kernels over the contiguous int and double storage of hovecs. Each kernel has AVX2 and SSE2
+*  versions, picked at runtime from what the CPU supports, and a scalar version for everything else.
+*  Setting KVAZZ_SIMD to avx2, sse2 or scalar caps the instruction set used. Large matrix products are
+*  split between threads, KVAZZ_THREADS of them if it's set and one per hardware thread otherwise.
+*
+*  Int arithmetic wraps around like two's complement. Real reductions keep 8 partial results, lane k
+*  taking elements k, k + 8, k + 16, ..., and combine them in the same order on every path, so results
+*  don't depend on which version ran.
+*/
+
+enum class KernelOp {
+    Add, Subtract, Multiply, Divide
+};
+
+// one side of an elementwise operation: an array, or a scalar used for every element
+template <typename T>
+struct KernelOperand
+{
+    const T *data;
+    T        scalar;
+};
+
+// out[i] = left[i] op right[i]. Int division truncates, the caller checks for zero divisors
+void kernel_int_op(KernelOp op, KernelOperand<int> left, KernelOperand<int> right, int *out, size_t n);
+void kernel_real_op(KernelOp op, KernelOperand<double> left, KernelOperand<double> right, double *out, size_t n);
+
+int kernel_int_sum(const int *data, size_t n);
+double kernel_real_sum(const double *data, size_t n);
+int kernel_int_dot(const int *left, const int *right, size_t n);
+double kernel_real_dot(const double *left, const double *right, size_t n);
+
+// min and max need n > 0
+int kernel_int_min(const int *data, size_t n);
+int kernel_int_max(const int *data, size_t n);
+double kernel_real_min(const double *data, size_t n);
+double kernel_real_max(const double *data, size_t n);
+
+// c = a * b for row-major a (n x k), b (k x m) and c (n x m). Int products wrap around like the other ops
+void kernel_int_matmul(const int *a, const int *b, int *c, size_t n, size_t k, size_t m);
+void kernel_real_matmul(const double *a, const double *b, double *c, size_t n, size_t k, size_t m);
+
+// the number of threads kernels and the thread pool use
+size_t kernel_thread_count();
@@ -1,11 +1,62 @@
 #pragma once
 #include "token.h"
+#include "simd.h"
 #include <vector> 
 #include <string>
+#include <string_view>
 
 
 bool is_id_char(char c);
 
-std::vector<Token> lex_string ( std::string &source );
+// where a lexer is in its source, line and line_start are kept for the positions tokens record
+struct LexPosition {
+    size_t index = 0;
+    int line = 1;
+    size_t line_start = 0;
+};
 
-void tuple_print( std::vector<Token> &tokens );
+/*
+*  Hands out the tokens of source one at a time, as the parser asks for them, so a whole file's tokens
+*  never exist at once. Like every token, they refer to source, which must outlive them.
+*/
+class Lexer
+{
+private:
+    std::string_view source;
+    LexPosition pos;
+    // lex_token for the SimdLevel, picked once
+    bool (*next_token)(std::string_view, LexPosition &, Token &);
+public:
+    explicit Lexer (std::string_view source_, SimdLevel level = simd_level());
+
+    // EOF_TOKEN once source is used up, and after an invalid character
+    Token next();
+};
+
+// all of source's tokens at once, they refer to source, which must outlive them
+std::vector<Token> lex_string ( std::string_view source );
+// lexes with the scanning loops of level, which must be supported by the CPU. For comparing them
+std::vector<Token> lex_string ( std::string_view source, SimdLevel level );
+
+/*
+*  The text of a source file. Regular files are mapped read-only instead of copied into memory, so a huge
+*  file costs address space rather than a second copy of itself. Anything else (pipes, empty files) is read
+*  into a string. A file that can't be opened reads as empty.
+*/
+class SourceFile
+{
+private:
+    void *mapping = nullptr;
+    size_t mapping_size = 0;
+    std::string contents;
+    std::string_view view;
+public:
+    explicit SourceFile (const std::string &path);
+    ~SourceFile();
+    SourceFile (const SourceFile&) = delete;
+    SourceFile &operator= (const SourceFile&) = delete;
+
+    std::string_view text() const { return view; }
+};
+
+void tuple_print( Lexer &lexer );
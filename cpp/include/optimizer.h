@@ -0,0 +1,11 @@
+#pragma once
+#include "ast.h"
+#include <memory>
+
+/*
+*  AST optimization pass, run after parsing and before scope resolution. Folds operators whose operands
+*  are all literals, replaces if/else with a constant condition by the branch that is taken, removes
+*  while loops that never run and drops statements following a return. Expressions that would fail or
+*  print an error at runtime (e.g. 1 / 0, "a" - 1) are left alone so they still do.
+*/
+void optimize_ast(ParsedProgram &program);
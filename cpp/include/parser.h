@@ -1,45 +1,63 @@
 #pragma once
 #include "token.h"
+#include "lexer.h"
 #include "ast.h"
+#include <deque>
+#include <string_view>
 #include <vector>
 #include <utility>
 
 class BaseNode;
 
+/*
+*  Tokens are pulled from the lexer as parsing reaches them, only the current one and any that were peeked
+*  at are held. Matching returns tokens by value, they're views and cheap to copy.
+*/
 class ParseState 
 {
 private:
-    std::vector<Token> tokens;
-    int index;
+    Lexer lexer;
+    AstArena &arena;
+    Token current;
+    // tokens after current that peekToken has already lexed
+    std::deque<Token> lookahead;
 public:
-    ParseState (std::vector<Token> tokens_, int index_=0)
-        : tokens { std::move(tokens_) }, index { index_ } {}
+    ParseState (Lexer lexer_, AstArena &arena_)
+        : lexer { lexer_ }, arena { arena_ }, current { lexer.next() } {}
 
-    Token currentToken();
-    Token peekToken(int n);
+    // nodes are made in the arena of the program being parsed
+    template <typename T, typename... Args>
+    T *make_node(Args&&... args) { return arena.make<T>(std::forward<Args>(args)...); }
+
+    // valid until the next advance
+    const Token &currentToken();
+    // the token n + 1 after the current one
+    const Token &peekToken(int n);
     Token advance();
-    Token matchKeyword(std::string kwrd);
+    Token matchKeyword(TokenKind kind);
     Token matchTokenType(TokenType ttype);
-    Token matchSymbol(std::string smbl);
+    Token matchSymbol(TokenKind kind);
     Token matchLiteral();
     void  parsingError();
 };
 
-std::shared_ptr<BaseNode> parse_program(ParseState &parse_state);
-std::shared_ptr<BaseNode> parse_function_declare(ParseState &parse_state);
-std::shared_ptr<BaseNode> parse_block(ParseState &parse_state);
-std::shared_ptr<BaseNode> parse_statement(ParseState &parse_state);
-std::shared_ptr<BaseNode> parse_if(ParseState &parse_state);
-std::shared_ptr<BaseNode> parse_while(ParseState &parse_state);
-std::shared_ptr<BaseNode> parse_assignment(ParseState &parse_state, std::shared_ptr<BaseNode> lvalue);
-std::shared_ptr<BaseNode> parse_declare(ParseState &parse_state);
-std::shared_ptr<BaseNode> parse_expr(ParseState &parse_state, int rbp=0);
-std::shared_ptr<BaseNode> parse_unary(ParseState &parse_state);
-std::shared_ptr<BaseNode> parse_primary(ParseState &parse_state);
-std::vector<std::shared_ptr<BaseNode>> parse_function_call(ParseState &parse_state);
-std::vector<std::shared_ptr<BaseNode>> parse_expr_list(ParseState &parse_state);
-std::shared_ptr<BaseNode> parse_literal(ParseState &parse_state);
+BaseNode *parse_program(ParseState &parse_state);
+BaseNode *parse_function_declare(ParseState &parse_state);
+BaseNode *parse_block(ParseState &parse_state);
+BaseNode *parse_statement(ParseState &parse_state);
+BaseNode *parse_if(ParseState &parse_state);
+BaseNode *parse_while(ParseState &parse_state);
+BaseNode *parse_assignment(ParseState &parse_state, BaseNode *lvalue);
+BaseNode *parse_declare(ParseState &parse_state);
+BaseNode *parse_expr(ParseState &parse_state, int rbp=0);
+BaseNode *parse_unary(ParseState &parse_state);
+BaseNode *parse_fork_join(ParseState &parse_state);
+BaseNode *parse_primary(ParseState &parse_state);
+std::vector<BaseNode*> parse_function_call(ParseState &parse_state);
+std::vector<BaseNode*> parse_expr_list(ParseState &parse_state);
+BaseNode *parse_literal(ParseState &parse_state);
 
-int  binding_power(Token tok);
-void pretty_print_ast(std::shared_ptr<BaseNode> node, std::string _prefix="", bool _last=true);
-std::shared_ptr<BaseNode> parse_tokens(std::vector<Token> tokens, bool printout=false);
+int  binding_power(const Token &tok);
+void pretty_print_ast(BaseNode *node, std::string _prefix="", bool _last=true);
+// source must outlive the parse, the AST copies what it keeps of it
+ParsedProgram parse_source(std::string_view source, bool printout=false);
@@ -0,0 +1,13 @@
+#pragma once
+#include "ast.h"
+#include <memory>
+
+/*
+*  Purity analysis, run after scope resolution. A function is pure when its result only depends on its
+*  arguments: it neither reads nor assigns global variables, calls no built-in that prints or runs code
+*  on other threads, and only calls declared functions that are pure themselves. Declared functions are
+*  fine to refer to, since they never change. Every `memo function` that is pure gets marked memoized,
+*  the others are reported and run as usual. So is a pure one that returns a call of itself: storing a
+*  result means waiting for it, so caching would cost its tail recursion the constant stack it runs in.
+*/
+void analyze_purity(BaseNode *ast);
@@ -0,0 +1,10 @@
+#pragma once
+#include "ast.h"
+#include <memory>
+
+/*
+*  Scope resolution pass, run once after parsing. Annotates every VariableLookup with where its
+*  variable lives and every Declare/FunctionDeclare/Block/Program with its slots, so the evaluators
+*  index Env::slots instead of looking names up.
+*/
+void resolve_scopes(BaseNode *ast);
@@ -0,0 +1,198 @@
+#pragma once
+#include "asteval.h"
+#include "hovec.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+/*
+*  Kvazz runtime: constants, conversions, operators and built-in functions on KvazzValues. Built
+*  into the kvazzrt library, which both the kvazz executable and transpiled programs link against.
+*/
+
+extern KvazzValue NOTHING;
+extern KvazzResult ERROR_NO_VALUE;
+extern KvazzResult GOOD_NO_VALUE;
+
+/*
+*  The VM and transpiled programs keep bare KvazzValues, without the flag of a KvazzResult, so an
+*  operation that fails leaves an error mark instead: Nothing with a payload. An operator with a marked
+*  operand fails as well, like one with an Error operand in the Interpreter. Values are unmarked where
+*  the Interpreter drops the flag, when they're stored, passed or returned.
+*/
+inline KvazzValue error_mark() { return KvazzValue { KvazzType::Nothing, 1 }; }
+inline bool is_error_mark(const KvazzValue &value) { return value.type == KvazzType::Nothing && value.int_value != 0; }
+inline void clear_error_mark(KvazzValue &value) {
+    if (value.type == KvazzType::Nothing)
+        value.int_value = 0;
+}
+// the value of result, or an error mark if it's an Error
+inline KvazzValue marked_value(KvazzResult result) {
+    return result.flag == KvazzFlag::Error ? error_mark() : std::move(result.kvazz_value);
+}
+
+std::string kvazztype_as_string(KvazzType t);
+std::string kvazzvalue_as_string(const KvazzValue &item);
+
+KvazzResult make_good_result(bool value);
+KvazzResult make_good_result(int value);
+KvazzResult make_good_result(double value);
+KvazzResult make_good_result(std::string value);
+KvazzResult make_good_result(std::vector<KvazzValue> value);
+KvazzResult make_good_result(Hovec value);
+KvazzResult make_good_result(LValue value);
+KvazzResult make_good_result(KvazzFunction value);
+KvazzResult make_good_result(KvazzValue value);
+
+bool is_gnr(KvazzResult &kr);
+bool truthy_test(KvazzValue &kv);
+bool truthy_test(KvazzResult kr);
+
+KvazzResult kvazzvalue_plus(KvazzValue &kv1, KvazzValue &kv2);
+KvazzResult kvazzvalue_minus(KvazzValue &kv1, KvazzValue &kv2);
+KvazzResult kvazzvalue_multiply(KvazzValue &kv1, KvazzValue &kv2);
+KvazzResult kvazzvalue_divide(KvazzValue &kv1, KvazzValue &kv2);
+KvazzResult kvazzvalue_modulo(KvazzValue &kv1, KvazzValue &kv2);
+bool kvazzvalue_less_equals(KvazzValue &kv1, KvazzValue &kv2);
+bool kvazzvalue_less_than(KvazzValue &kv1, KvazzValue &kv2);
+bool kvazzvalue_greater_equals(KvazzValue &kv1, KvazzValue &kv2);
+bool kvazzvalue_greater_than(KvazzValue &kv1, KvazzValue &kv2);
+bool kvazzvalue_equals(const KvazzValue &kv1, const KvazzValue &kv2);
+KvazzResult kvazzvalue_index(KvazzValue &container, KvazzValue &index_value);
+KvazzResult Kvazzvalue_unary_minus(KvazzValue &kv);
+
+extern std::unordered_map<std::string, int> built_in_function_table;
+KvazzResult call_builtin_function(int builtin_fn_id, std::vector<KvazzValue> &arg_values);
+// whether a built-in only computes its result: false for print and those that run Kvazz code or tasks
+bool built_in_is_pure(int builtin_fn_id);
+
+// the element of a Hevec container, unshared so it can be overwritten, nullptr if there is no such element
+KvazzValue *kvazzvalue_element_ref(KvazzValue &container, KvazzValue &index_value);
+// container[indices[0]][indices[1]]..., where a Hovec takes all the indices left when it's reached
+KvazzResult kvazzvalue_index(KvazzValue &container, KvazzValue *indices, size_t count);
+// assigns value to target[indices[0]][indices[1]]..., returns false if the chain doesn't lead to a vector element
+bool kvazzvalue_store_index(KvazzValue &target, KvazzValue *indices, size_t count, KvazzValue value);
+bool kvazzvalue_store_index(KvazzValue &target, std::vector<KvazzValue> &indices, KvazzValue value);
+
+/*
+*  The results of a memoized function, keyed on its arguments. Only functions analyze_purity found pure
+*  are memoized, so a cached result is what running the body again would return. Arguments match by type
+*  and contents, so f(1) and f(1.0) are cached apart. It holds up to capacity results and evicts the least
+*  recently used one first. Calls on any thread share it.
+*/
+const size_t MEMO_CACHE_CAPACITY = size_t(1) << 16;
+
+class MemoCache
+{
+public:
+    explicit MemoCache(size_t capacity_ = MEMO_CACHE_CAPACITY)
+        : capacity { capacity_ } {}
+
+    // copies the result cached for args into result, false if there is none
+    bool find(const KvazzValue *args, size_t count, KvazzValue &result);
+    // caches result for args, unless one of them is a Future or LValue, which can't be compared
+    void insert(std::vector<KvazzValue> args, KvazzValue result);
+
+private:
+    struct Entry
+    {
+        std::vector<KvazzValue> args;
+        size_t hash;
+        KvazzValue result;
+    };
+    // the arguments of an entry, or of a call being looked up
+    struct Key
+    {
+        const KvazzValue *args;
+        size_t count;
+        size_t hash;
+    };
+    struct KeyHash { size_t operator()(const Key &key) const { return key.hash; } };
+    struct KeyEqual { bool operator()(const Key &left, const Key &right) const; };
+
+    size_t capacity;
+    std::mutex mutex;
+    // most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash, KeyEqual> index;
+};
+
+/*
+*  Built-ins that take a callback call it through a FunctionCaller. Every engine sets its Isolate's
+*  function_caller_factory to make callers that run a Function value on it. Each thread makes its own
+*  caller the first time it needs one, so callbacks on worker threads get an interpreter of their own.
+*/
+using FunctionCaller = std::function<KvazzResult(KvazzValue &callee, std::vector<KvazzValue> &args)>;
+
+// a global_epoch no Isolate in this process has had before
+uint64_t next_global_epoch();
+
+/*
+*  The state of one running program: the globals of the tree-walking engines, the epoch their call caches
+*  are checked against, the callers its callbacks run on and its spawned calls. Programs in different
+*  Isolates share nothing but constants, the built-in table and the thread pool, so a host can run one
+*  program per Isolate on as many threads as it likes.
+*
+*  Runtime code works on the current Isolate, the one the innermost IsolateScope on the thread entered.
+*  Tasks of an Isolate enter it on whichever thread runs them.
+*/
+class Isolate
+{
+public:
+    Isolate();
+    // waits for the spawned calls still running
+    ~Isolate();
+    Isolate(const Isolate&) = delete;
+    Isolate &operator=(const Isolate&) = delete;
+
+    std::shared_ptr<Env> global_env;
+    // replaced by a new next_global_epoch() whenever a global slot is bound to a function or global_env's
+    // slots move, which invalidates the inline caches on FunctionCall nodes. Epochs are unique to the
+    // process, so a cache filled by another Isolate running the same AST never matches
+    uint64_t global_epoch = next_global_epoch();
+
+    // set while callbacks or spawned calls of this Isolate may run on other threads. The AST caches are
+    // left alone then, since every thread reads them
+    std::atomic<bool> multithreaded { false };
+    // spawned calls queued or running
+    std::atomic<size_t> spawned_tasks { 0 };
+
+    // replaces the factory, and the callers it made
+    void set_function_caller_factory(std::function<FunctionCaller()> factory);
+    // this thread's caller, nullptr if no engine has set a factory
+    FunctionCaller *caller();
+
+private:
+    std::mutex callers_mutex;
+    std::function<FunctionCaller()> function_caller_factory;
+    std::unordered_map<std::thread::id, FunctionCaller> callers;
+    // changes with the factory, so threads know to look up their caller again
+    std::atomic<uint64_t> callers_key;
+};
+
+// the Isolate of the innermost IsolateScope on this thread, or a default one outside of any
+Isolate &current_isolate();
+
+struct IsolateScope
+{
+    Isolate *outer;
+    explicit IsolateScope(Isolate &isolate);
+    ~IsolateScope();
+};
+
+// calls a Function or Builtin value with this thread's FunctionCaller
+KvazzResult call_function_value(KvazzValue &callee, std::vector<KvazzValue> &args);
+
+// callbacks of parallel built-ins and spawned calls may only assign their own locals: false after
+// printing an error in one of them. Anywhere else it waits for the spawned calls still running
+bool global_assignment_allowed();
+// waits until every spawned call of the current Isolate has finished. Engines call it before their
+// program's state goes away
+void wait_for_spawned_tasks();
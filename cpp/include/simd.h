@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdlib>
+#include <string>
+
+/*
+*  The instruction sets the hovec kernels and the lexer pick between at runtime. Header-only, so the
+*  lexer still builds on its own without kernels.cpp.
+*/
+
+enum class SimdLevel {
+    Scalar, SSE2, AVX2
+};
+
+inline SimdLevel detect_simd_level() {
+    auto level = SimdLevel::Scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        level = SimdLevel::AVX2;
+    else if (__builtin_cpu_supports("sse2"))
+        level = SimdLevel::SSE2;
+#endif
+
+    // KVAZZ_SIMD can only lower the level, an instruction set the CPU lacks is never used
+    auto cap = std::getenv("KVAZZ_SIMD");
+    if (cap != nullptr) {
+        std::string name = cap;
+        if (name == "scalar")
+            level = SimdLevel::Scalar;
+        else if (name == "sse2" && level == SimdLevel::AVX2)
+            level = SimdLevel::SSE2;
+    }
+    return level;
+}
+
+// the widest instruction set this CPU supports, within the KVAZZ_SIMD cap
+inline SimdLevel simd_level() {
+    static const SimdLevel level = detect_simd_level();
+    return level;
+}
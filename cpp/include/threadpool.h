@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+*  The process-wide pool of worker threads that kernels, the parallel built-ins and spawned tasks run
+*  on. It has kernel_thread_count() - 1 workers; threads outside the pool take part too while they wait
+*  for work they started.
+*
+*  Scheduling is work stealing: every thread queues the tasks it starts on a deque of its own and runs
+*  them newest first, while idle threads steal the oldest task from someone else's deque.
+*/
+class ThreadPool
+{
+public:
+    static ThreadPool &instance();
+
+    // the number of threads tasks run on, counting one outside thread
+    size_t size() const { return deques.size(); }
+
+    // calls task(i) for every i in [0, count) and returns once all of them are done
+    void run(size_t count, const std::function<void(size_t)> &task);
+
+    // queues task on this thread's deque, to be run by this thread or stolen by another
+    void spawn(std::function<void()> task);
+    // runs queued tasks on this thread until done() returns true. done() may only become true at the end
+    // of a pool task, a thread with nothing to run sleeps until one finishes
+    void help_until(const std::function<bool()> &done);
+
+    // the number of tasks waiting on this thread's deque
+    size_t queued_here();
+
+private:
+    struct WorkDeque
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    explicit ThreadPool(size_t threads);
+    void push(size_t count, std::function<void()> *tasks);
+    bool run_one(size_t self);
+    void notify_blocked();
+    void work_loop(size_t index);
+
+    // deques[0] is shared by the threads outside the pool, worker i owns deques[i]
+    std::vector<std::unique_ptr<WorkDeque>> deques;
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> queued { 0 };      // tasks waiting on any deque
+    std::atomic<size_t> sleeping { 0 };    // workers waiting on wake
+    std::atomic<size_t> blocked { 0 };     // threads in help_until waiting on progress
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::condition_variable progress;      // a task finished or was queued
+};
@@ -1,11 +1,13 @@
 #pragma once
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 
 enum class TokenType {
-    keyword, 
-    identifier, 
-    symbol, 
+    keyword,
+    identifier,
+    symbol,
     bool_literal,
     int_literal,
     real_literal,
@@ -13,13 +15,39 @@ enum class TokenType {
     eof
 };
 
+// which keyword or symbol a token is, so the parser compares enums instead of strings. none for the rest
+enum class TokenKind : uint8_t {
+    none,
+    // keywords
+    kw_var, kw_if, kw_then, kw_else, kw_for, kw_while, kw_do, kw_in, kw_function, kw_return,
+    kw_spawn, kw_sync, kw_memo,
+    // bool literals
+    lit_true, lit_false,
+    // symbols
+    lbrace, rbrace, lparen, rparen, lbracket, rbracket, less, greater,
+    plus, minus, star, slash, percent, bang, question, assign, dot, comma,
+    amper, pipe, semicolon, colon, dollar,
+    equals, not_equals, greater_equals, less_equals,
+    plus_assign, minus_assign, star_assign, slash_assign, percent_assign,
+    hovec_open, hovec_close
+};
 
 
+/*
+*  Tokens don't own their text: sval is a view into the source string that was lexed, which has to
+*  outlive them. The parser copies whatever it keeps into the AST.
+*/
 struct Token {
-    std::string sval;
+    std::string_view sval;
     TokenType type;
+    TokenKind kind = TokenKind::none;
+    // 1-based position of the token's first character
+    int line = 0;
+    int column = 0;
 };
 
 const Token EOF_TOKEN {"", TokenType::eof};
 
-std::string tokenTypeString(TokenType tt);
\ No newline at end of file
+std::string tokenTypeString(TokenType tt);
+// the source text of a keyword or symbol kind
+std::string_view tokenKindString(TokenKind kind);
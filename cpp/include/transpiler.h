@@ -0,0 +1,22 @@
+#pragma once
+#include "ast.h"
+#include <memory>
+#include <string>
+#include <string_view>
+
+/*
+*  Ahead-of-time compilation of Kvazz programs to C++.
+*
+*  Every top-level function becomes a C++ function taking and returning KvazzValues, variables become
+*  C++ locals (or slots in a global table) and operators call into the kvazzrt runtime library. The
+*  generated source is built with the system compiler and cached by a hash of the Kvazz source, so an
+*  unchanged script is only compiled once.
+*/
+
+// bumped whenever the generated code changes, so stale cache entries aren't reused
+const std::string KVAZZ_TRANSPILER_VERSION = "15";
+
+std::string transpile_program(BaseNode *ast);
+
+// builds source into a native executable at output_path, returns false if compilation failed
+bool compile_native_program(std::string_view source, const std::string &output_path);
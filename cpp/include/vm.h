@@ -0,0 +1,45 @@
+#pragma once
+#include "asteval.h"
+#include "bytecode.h"
+#include "runtime.h"
+#include <cstdint>
+#include <vector>
+
+void run_bytecode_vm(Isolate &isolate, BytecodeProgram &program);
+
+struct CallFrame
+{
+    BytecodeFunction *function;
+    const uint8_t    *ip;
+    size_t            base;      // stack index of the frame's first local
+    size_t            return_to; // stack size to restore when the frame returns
+    MemoCache        *memo;      // where the result goes when the frame returns, if it's memoized
+};
+
+// the globals of a running program, shared with the VMs that run its callbacks on other threads
+struct VMGlobals
+{
+    std::vector<KvazzValue> values;
+    std::vector<bool>       defined;
+};
+
+class VM {
+private:
+    BytecodeProgram &program;
+    VMGlobals &globals;
+    std::vector<KvazzValue> stack;
+    std::vector<CallFrame> frames;
+    // the arguments of every running memoized call, innermost last
+    std::vector<std::vector<KvazzValue>> memo_keys;
+
+    void push_frame(int function_index, int argc, size_t return_to);
+    void call_value(int argc);
+    void store_index(KvazzValue &target, int num_indices);
+    void update(KvazzValue &target, int num_indices, OpCode op);
+    void execute(size_t stop_depth);
+
+public:
+    VM(BytecodeProgram &program_, VMGlobals &globals_);
+    void run();
+    KvazzResult call(KvazzValue &callee, std::vector<KvazzValue> &args);
+};
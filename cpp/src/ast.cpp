@@ -3,6 +3,8 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <cstdint>
 
 using std::string;
 
@@ -85,85 +87,116 @@ bool is_logical_binop(BinaryOpType op) {
 }
 
 // ast eval methods
-KvazzResult BaseNode::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult BaseNode::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult Program::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult Program::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult Block::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult Block::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult AssignOp::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult AssignOp::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult Declare::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult Declare::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult FunctionDeclare::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult FunctionDeclare::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult Return::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult Return::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult IfThen::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult IfThen::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult IfElse::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult IfElse::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult While::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult While::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
 
-KvazzResult BinaryOp::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult BinaryOp::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
 
-KvazzResult UnaryOp::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult UnaryOp::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
 
-KvazzResult FunctionCall::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult FunctionCall::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult Access::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult Access::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult VariableLookup::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult VariableLookup::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult IntLiteral::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult IntLiteral::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult BoolLiteral::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult BoolLiteral::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult RealLiteral::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult RealLiteral::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult StringLiteral::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult StringLiteral::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
 
-KvazzResult VectorLiteral::eval(AstEvaluator &ast_eval, std::shared_ptr<Env> env) {
+KvazzResult VectorLiteral::eval(AstEvaluator &ast_eval, const std::shared_ptr<Env> &env) {
     return ast_eval.eval(this, env);
 }
+
+// ast arena
+void *AstArena::allocate(size_t size, size_t alignment) {
+    auto padding = (alignment - reinterpret_cast<uintptr_t>(next) % alignment) % alignment;
+    if (next == nullptr || padding + size > remaining) {
+        // nodes are far smaller than a chunk, the max is just in case
+        auto chunk_size = std::max(CHUNK_SIZE, size + alignment);
+        chunks.push_back(std::make_unique<char[]>(chunk_size));
+        next = chunks.back().get();
+        remaining = chunk_size;
+        padding = (alignment - reinterpret_cast<uintptr_t>(next) % alignment) % alignment;
+    }
+    auto memory = next + padding;
+    next += padding + size;
+    remaining -= padding + size;
+    return memory;
+}
+
+AstArena::AstArena(AstArena &&other) noexcept
+    : chunks { std::move(other.chunks) }, next { other.next }, remaining { other.remaining }, nodes { std::move(other.nodes) } {
+    other.chunks.clear();
+    other.nodes.clear();
+    other.next = nullptr;
+    other.remaining = 0;
+}
+
+AstArena::~AstArena() {
+    for (auto it = nodes.rbegin(); it != nodes.rend(); ++it)
+        (*it)->~BaseNode();
+    nodes.clear();
+}
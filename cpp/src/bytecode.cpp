@@ -0,0 +1,688 @@
+#include "bytecode.h"
+#include "interpreter.h"
+#include "ast.h"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <iomanip>
+#include <unordered_map>
+#include <unordered_set>
+
+using std::unordered_map;
+using std::unordered_set;
+using std::shared_ptr;
+using std::vector;
+using std::string;
+
+string opcode_as_string(OpCode op) {
+    switch(op) {
+        case OpCode::Constant:         return "CONSTANT";
+        case OpCode::Nothing:          return "NOTHING";
+        case OpCode::Pop:              return "POP";
+        case OpCode::LoadLocal:        return "LOAD_LOCAL";
+        case OpCode::StoreLocal:       return "STORE_LOCAL";
+        case OpCode::LoadGlobal:       return "LOAD_GLOBAL";
+        case OpCode::StoreGlobal:      return "STORE_GLOBAL";
+        case OpCode::DefineGlobal:     return "DEFINE_GLOBAL";
+        case OpCode::StoreLocalIndex:  return "STORE_LOCAL_INDEX";
+        case OpCode::StoreGlobalIndex: return "STORE_GLOBAL_INDEX";
+        case OpCode::UpdateLocal:      return "UPDATE_LOCAL";
+        case OpCode::UpdateGlobal:     return "UPDATE_GLOBAL";
+        case OpCode::Add:              return "ADD";
+        case OpCode::Subtract:         return "SUBTRACT";
+        case OpCode::Multiply:         return "MULTIPLY";
+        case OpCode::Divide:           return "DIVIDE";
+        case OpCode::Modulo:           return "MODULO";
+        case OpCode::Equals:           return "EQUALS";
+        case OpCode::NotEquals:        return "NOT_EQUALS";
+        case OpCode::LessEquals:       return "LESS_EQUALS";
+        case OpCode::GreaterEquals:    return "GREATER_EQUALS";
+        case OpCode::LessThan:         return "LESS_THAN";
+        case OpCode::GreaterThan:      return "GREATER_THAN";
+        case OpCode::Or:               return "OR";
+        case OpCode::And:              return "AND";
+        case OpCode::Negate:           return "NEGATE";
+        case OpCode::Not:              return "NOT";
+        case OpCode::Jump:             return "JUMP";
+        case OpCode::JumpIfFalse:      return "JUMP_IF_FALSE";
+        case OpCode::Call:             return "CALL";
+        case OpCode::CallFunction:     return "CALL_FUNCTION";
+        case OpCode::TailCallFunction: return "TAIL_CALL_FUNCTION";
+        case OpCode::CallBuiltin:      return "CALL_BUILTIN";
+        case OpCode::Return:           return "RETURN";
+        case OpCode::MakeHevec:        return "MAKE_HEVEC";
+        case OpCode::MakeHovec:        return "MAKE_HOVEC";
+        case OpCode::Index:            return "INDEX";
+        case OpCode::MultiIndex:       return "MULTI_INDEX";
+        case OpCode::Halt:             return "HALT";
+    }
+    return "INVALID_OPCODE";
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// COMPILER
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+class BytecodeCompiler {
+private:
+    BytecodeProgram &program;
+    unordered_map<string, int> globals;
+    unordered_map<string, int> declared_functions;
+    unordered_set<string> top_level_names;
+
+    // state of the function currently being compiled
+    int current;
+    vector<unordered_map<string, int>> scopes;
+    int next_slot;
+    unordered_map<string, int> constant_keys;
+
+    BytecodeFunction &fn() { return program.functions[current]; }
+
+    void emit_op(OpCode op) { fn().code.push_back(static_cast<uint8_t>(op)); }
+
+    void emit_u16(int value) {
+        fn().code.push_back(value & 0xff);
+        fn().code.push_back((value >> 8) & 0xff);
+    }
+
+    void emit_u32(uint32_t value) {
+        for (int i = 0; i < 4; ++i)
+            fn().code.push_back((value >> (8 * i)) & 0xff);
+    }
+
+    int offset() { return fn().code.size(); }
+
+    // emits a jump with a placeholder target and returns the position of the target to patch
+    int emit_jump(OpCode op) {
+        emit_op(op);
+        int target_position = offset();
+        emit_u32(0);
+        return target_position;
+    }
+
+    void patch_jump(int target_position, int target) {
+        for (int i = 0; i < 4; ++i)
+            fn().code[target_position + i] = (target >> (8 * i)) & 0xff;
+    }
+
+    int add_constant(KvazzValue value) {
+        // only dedupe scalar literals, functions are unique per declaration anyway. Reals are keyed on their
+        // bits, to_string rounds to 6 decimals and would merge 0.5 and 0.5000001
+        string key;
+        double real;
+        uint64_t real_bits;
+        switch(value.type) {
+            case KvazzType::Int:    key = "i" + std::to_string(value.as_int()); break;
+            case KvazzType::Real:
+                real = value.as_real();
+                std::memcpy(&real_bits, &real, sizeof real);
+                key = "r" + std::to_string(real_bits);
+                break;
+            case KvazzType::Bool:   key = value.as_bool() ? "btrue" : "bfalse"; break;
+            case KvazzType::String: key = "s" + value.as_string(); break;
+            default: {}
+        }
+        if (!key.empty()) {
+            auto found = constant_keys.find(key);
+            if (found != constant_keys.end())
+                return found->second;
+        }
+        int index = fn().constants.size();
+        fn().constants.push_back(std::move(value));
+        if (!key.empty())
+            constant_keys[key] = index;
+        return index;
+    }
+
+    void emit_constant(KvazzValue value) {
+        emit_op(OpCode::Constant);
+        emit_u32(add_constant(std::move(value)));
+    }
+
+    int global_index(const string &name) {
+        auto found = globals.find(name);
+        if (found != globals.end())
+            return found->second;
+        int index = program.global_names.size();
+        program.global_names.push_back(name);
+        globals[name] = index;
+        return index;
+    }
+
+    // returns the id of the built-in node refers to, or -1. Declared names shadow built-ins, like in the resolver
+    int builtin_id(VariableLookup *node) {
+        if ((!node->sigil && resolve_local(node->identifier) >= 0) || top_level_names.count(node->identifier))
+            return -1;
+        auto builtin = built_in_function_table.find(node->identifier);
+        return builtin != built_in_function_table.end() ? builtin->second : -1;
+    }
+
+    // returns the local slot of identifier, or -1 if it's not a local of the current function
+    int resolve_local(const string &identifier) {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+            auto found = scope->find(identifier);
+            if (found != scope->end())
+                return found->second;
+        }
+        return -1;
+    }
+
+    int declare_local(const string &identifier) {
+        int slot = next_slot++;
+        scopes.back()[identifier] = slot;
+        if (next_slot > fn().num_locals)
+            fn().num_locals = next_slot;
+        return slot;
+    }
+
+    void begin_function(int index) {
+        current = index;
+        scopes.clear();
+        scopes.emplace_back();
+        next_slot = 0;
+        constant_keys.clear();
+    }
+
+public:
+    BytecodeCompiler(BytecodeProgram &program_)
+        : program { program_ }, current { 0 }, next_slot { 0 } {}
+
+    void compile(Program *node);
+    void compile_function(FunctionDeclare *node, int index);
+    void compile_statement(BaseNode *node);
+    void compile_block(Block *node);
+    void compile_assign(AssignOp *node);
+    void compile_expr(BaseNode *node);
+    void compile_call(FunctionCall *node, bool tail_call = false);
+    void compile_variable(VariableLookup *node);
+};
+
+void BytecodeCompiler::compile(Program *node) {
+    auto &top_level = node->statements();
+
+    // the script chunk runs the top-level declarations and then calls main, like Interpreter::eval(Program*)
+    program.script_index = 0;
+    program.functions.push_back(BytecodeFunction { "<script>", 0, 0, {}, {} });
+
+    // declare every top-level name up front, so function bodies can refer to functions declared after them
+    vector<std::pair<FunctionDeclare*, int>> function_nodes;
+    for (auto &nd : top_level) {
+        if (nd->type() == NodeType::FunctionDeclare) {
+            auto fd = static_cast<FunctionDeclare*>(nd);
+            global_index(fd->identifier);
+            top_level_names.insert(fd->identifier);
+            if (declared_functions.count(fd->identifier) == 0) {
+                int index = program.functions.size();
+                program.functions.push_back(BytecodeFunction { fd->identifier, (int) fd->args.size(), 0, {}, {} });
+                if (fd->memoized)
+                    program.functions.back().memo = std::make_shared<MemoCache>();
+                program.function_index[fd->body] = index;
+                declared_functions[fd->identifier] = index;
+                function_nodes.emplace_back(fd, index);
+            }
+        }
+        else if (nd->type() == NodeType::Declare) {
+            global_index(static_cast<Declare*>(nd)->identifier);
+            top_level_names.insert(static_cast<Declare*>(nd)->identifier);
+        }
+    }
+
+    begin_function(program.script_index);
+    for (auto &nd : top_level) {
+        if (nd->type() == NodeType::FunctionDeclare) {
+            auto fd = static_cast<FunctionDeclare*>(nd);
+            auto &compiled = program.functions[program.function_index[fd->body]];
+            emit_constant(KvazzValue { KvazzType::Function, KvazzFunction { fd->identifier, fd->args, fd->body, compiled.memo } });
+            emit_op(OpCode::DefineGlobal);
+            emit_u32(global_index(fd->identifier));
+        }
+        else if (nd->type() == NodeType::Declare) {
+            auto decl = static_cast<Declare*>(nd);
+            compile_expr(decl->expr_node);
+            emit_op(OpCode::DefineGlobal);
+            emit_u32(global_index(decl->identifier));
+        }
+    }
+
+    auto main_found = declared_functions.find("main");
+    if (main_found != declared_functions.end()) {
+        emit_op(OpCode::CallFunction);
+        emit_u32(main_found->second);
+        emit_u16(0);
+        emit_op(OpCode::Pop);
+    }
+    emit_op(OpCode::Halt);
+
+    for (auto &fn_node : function_nodes)
+        compile_function(fn_node.first, fn_node.second);
+}
+
+void BytecodeCompiler::compile_function(FunctionDeclare *node, int index) {
+    begin_function(index);
+    for (auto &arg : node->args)
+        declare_local(arg);
+
+    compile_statement(node->body);
+
+    // falling off the end of a function returns Nothing
+    emit_op(OpCode::Nothing);
+    emit_op(OpCode::Return);
+}
+
+void BytecodeCompiler::compile_block(Block *node) {
+    int scope_start = next_slot;
+    scopes.emplace_back();
+    for (auto &nd : node->statements())
+        compile_statement(nd);
+    scopes.pop_back();
+
+    // slots of the block's locals can be reused by the blocks that follow it
+    next_slot = scope_start;
+}
+
+void BytecodeCompiler::compile_statement(BaseNode *node) {
+    switch(node->type()) {
+        case NodeType::Block:
+        {
+            compile_block(static_cast<Block*>(node));
+            break;
+        }
+        case NodeType::Declare:
+        {
+            auto decl = static_cast<Declare*>(node);
+            if (scopes.back().count(decl->identifier) > 0) {
+                std::cerr << "Identifier \'" << decl->identifier << "\' already defined in this scope\n";
+                break;
+            }
+            // the initializer is compiled before the name is declared, so it still sees any outer variable
+            compile_expr(decl->expr_node);
+            emit_op(OpCode::StoreLocal);
+            emit_u16(declare_local(decl->identifier));
+            break;
+        }
+        case NodeType::AssignOp:
+        {
+            compile_assign(static_cast<AssignOp*>(node));
+            break;
+        }
+        case NodeType::Return:
+        {
+            auto ret = static_cast<Return*>(node);
+            if (ret->tail_call)
+                compile_call(static_cast<FunctionCall*>(ret->expr_node), true);
+            else
+                compile_expr(ret->expr_node);
+            emit_op(OpCode::Return);
+            break;
+        }
+        case NodeType::IfThen:
+        {
+            auto if_then = static_cast<IfThen*>(node);
+            compile_expr(if_then->condition);
+            int skip_body = emit_jump(OpCode::JumpIfFalse);
+            compile_statement(if_then->body);
+            patch_jump(skip_body, offset());
+            break;
+        }
+        case NodeType::IfElse:
+        {
+            auto if_else = static_cast<IfElse*>(node);
+            compile_expr(if_else->condition);
+            int to_else = emit_jump(OpCode::JumpIfFalse);
+            compile_statement(if_else->then_body);
+            int to_end = emit_jump(OpCode::Jump);
+            patch_jump(to_else, offset());
+            compile_statement(if_else->else_body);
+            patch_jump(to_end, offset());
+            break;
+        }
+        case NodeType::While:
+        {
+            auto while_node = static_cast<While*>(node);
+            int loop_start = offset();
+            compile_expr(while_node->condition);
+            int to_end = emit_jump(OpCode::JumpIfFalse);
+            compile_statement(while_node->body);
+            int to_start = emit_jump(OpCode::Jump);
+            patch_jump(to_start, loop_start);
+            patch_jump(to_end, offset());
+            break;
+        }
+        default:
+        {
+            // expression statements (function calls), the value is discarded
+            compile_expr(node);
+            emit_op(OpCode::Pop);
+        }
+    }
+}
+
+void BytecodeCompiler::compile_assign(AssignOp *node) {
+    OpCode compound_op = OpCode::Add;
+    switch(node->op_type) {
+        case AssignOpType::plus:     compound_op = OpCode::Add; break;
+        case AssignOpType::minus:    compound_op = OpCode::Subtract; break;
+        case AssignOpType::divide:   compound_op = OpCode::Divide; break;
+        case AssignOpType::multiply: compound_op = OpCode::Multiply; break;
+        case AssignOpType::modulo:   compound_op = OpCode::Modulo; break;
+        case AssignOpType::assign:   break;
+    }
+
+    // unwind an access chain like v[i][j] down to the variable it starts from
+    vector<BaseNode*> indices;
+    BaseNode *base = node->lvalue;
+    while (base->type() == NodeType::Access) {
+        auto access = static_cast<Access*>(base);
+        for (auto it = access->index_exprs.rbegin(); it != access->index_exprs.rend(); ++it)
+            indices.insert(indices.begin(), *it);
+        base = access->left_expr;
+    }
+    if (base->type() != NodeType::VariableLookup) {
+        std::cerr << "Invalid assignment target.\n";
+        return;
+    }
+    auto variable = static_cast<VariableLookup*>(base);
+
+    // the indices run once, before the right hand side. A compound assignment reads the old value after it
+    for (auto index : indices)
+        compile_expr(index);
+    compile_expr(node->expr_node);
+
+    int slot = variable->sigil ? -1 : resolve_local(variable->identifier);
+    if (node->op_type != AssignOpType::assign) {
+        if (slot >= 0) {
+            emit_op(OpCode::UpdateLocal);
+            emit_u16(slot);
+        }
+        else {
+            emit_op(OpCode::UpdateGlobal);
+            emit_u32(global_index(variable->identifier));
+        }
+        emit_u16(indices.size());
+        emit_u16(static_cast<int>(compound_op));
+        return;
+    }
+    if (slot >= 0) {
+        emit_op(indices.empty() ? OpCode::StoreLocal : OpCode::StoreLocalIndex);
+        emit_u16(slot);
+    }
+    else {
+        emit_op(indices.empty() ? OpCode::StoreGlobal : OpCode::StoreGlobalIndex);
+        emit_u32(global_index(variable->identifier));
+    }
+    if (!indices.empty())
+        emit_u16(indices.size());
+}
+
+void BytecodeCompiler::compile_expr(BaseNode *node) {
+    switch(node->type()) {
+        case NodeType::BinaryOp:
+        {
+            auto binop = static_cast<BinaryOp*>(node);
+            compile_expr(binop->left_expr);
+            compile_expr(binop->right_expr);
+            switch(binop->op_type) {
+                case BinaryOpType::pipe:           emit_op(OpCode::Or); break;
+                case BinaryOpType::amper:          emit_op(OpCode::And); break;
+                case BinaryOpType::equals:         emit_op(OpCode::Equals); break;
+                case BinaryOpType::not_equals:     emit_op(OpCode::NotEquals); break;
+                case BinaryOpType::less_equals:    emit_op(OpCode::LessEquals); break;
+                case BinaryOpType::greater_equals: emit_op(OpCode::GreaterEquals); break;
+                case BinaryOpType::less_than:      emit_op(OpCode::LessThan); break;
+                case BinaryOpType::greater_than:   emit_op(OpCode::GreaterThan); break;
+                case BinaryOpType::plus:           emit_op(OpCode::Add); break;
+                case BinaryOpType::minus:          emit_op(OpCode::Subtract); break;
+                case BinaryOpType::multiply:       emit_op(OpCode::Multiply); break;
+                case BinaryOpType::divide:         emit_op(OpCode::Divide); break;
+                case BinaryOpType::modulo:         emit_op(OpCode::Modulo); break;
+            }
+            break;
+        }
+        case NodeType::UnaryOp:
+        {
+            auto unop = static_cast<UnaryOp*>(node);
+            compile_expr(unop->right_expr);
+            emit_op(unop->op_type == UnaryOpType::minus ? OpCode::Negate : OpCode::Not);
+            break;
+        }
+        case NodeType::FunctionCall:
+        {
+            compile_call(static_cast<FunctionCall*>(node));
+            break;
+        }
+        case NodeType::Access:
+        {
+            auto access = static_cast<Access*>(node);
+            compile_expr(access->left_expr);
+            for (auto &index_expr : access->index_exprs)
+                compile_expr(index_expr);
+            if (access->index_exprs.size() == 1) {
+                emit_op(OpCode::Index);
+            }
+            else {
+                emit_op(OpCode::MultiIndex);
+                emit_u16(access->index_exprs.size());
+            }
+            break;
+        }
+        case NodeType::VariableLookup:
+        {
+            compile_variable(static_cast<VariableLookup*>(node));
+            break;
+        }
+        case NodeType::IntLiteral:
+        {
+            emit_constant(KvazzValue { KvazzType::Int, static_cast<IntLiteral*>(node)->literal_value });
+            break;
+        }
+        case NodeType::BoolLiteral:
+        {
+            emit_constant(KvazzValue { KvazzType::Bool, static_cast<BoolLiteral*>(node)->literal_value });
+            break;
+        }
+        case NodeType::RealLiteral:
+        {
+            emit_constant(KvazzValue { KvazzType::Real, static_cast<RealLiteral*>(node)->literal_value });
+            break;
+        }
+        case NodeType::StringLiteral:
+        {
+            emit_constant(KvazzValue { KvazzType::String, static_cast<StringLiteral*>(node)->literal_value });
+            break;
+        }
+        case NodeType::VectorLiteral:
+        {
+            auto vector_literal = static_cast<VectorLiteral*>(node);
+            for (auto &element : vector_literal->contents)
+                compile_expr(element);
+            emit_op(vector_literal->homogeneous ? OpCode::MakeHovec : OpCode::MakeHevec);
+            emit_u16(vector_literal->contents.size());
+            break;
+        }
+        default:
+        {
+            std::cerr << "Cannot compile " << node->value() << " as an expression.\n";
+            emit_op(OpCode::Nothing);
+        }
+    }
+}
+
+/**
+ *  Compiles a call. A tail_call to a declared function replaces the current frame, the Return after it
+ *  is only reached when the VM has to make it as an ordinary call.
+ */
+void BytecodeCompiler::compile_call(FunctionCall *node, bool tail_call) {
+    if (node->callee->type() == NodeType::VariableLookup) {
+        auto callee = static_cast<VariableLookup*>(node->callee);
+
+        auto builtin = builtin_id(callee);
+        if (builtin >= 0) {
+            for (auto &arg : node->expr_args)
+                compile_expr(arg);
+            emit_op(OpCode::CallBuiltin);
+            emit_u16(builtin);
+            emit_u16(node->expr_args.size());
+            return;
+        }
+
+        // top-level functions can't be reassigned, so a call that resolves to one can skip the lookup
+        bool is_local = !callee->sigil && resolve_local(callee->identifier) >= 0;
+        auto declared = declared_functions.find(callee->identifier);
+        if (!is_local && declared != declared_functions.end()) {
+            for (auto &arg : node->expr_args)
+                compile_expr(arg);
+            emit_op(tail_call ? OpCode::TailCallFunction : OpCode::CallFunction);
+            emit_u32(declared->second);
+            emit_u16(node->expr_args.size());
+            return;
+        }
+    }
+
+    compile_expr(node->callee);
+    for (auto &arg : node->expr_args)
+        compile_expr(arg);
+    emit_op(OpCode::Call);
+    emit_u16(node->expr_args.size());
+}
+
+void BytecodeCompiler::compile_variable(VariableLookup *node) {
+    auto builtin = builtin_id(node);
+    if (builtin >= 0) {
+        emit_constant(KvazzValue { KvazzType::Builtin, builtin });
+        return;
+    }
+
+    int slot = node->sigil ? -1 : resolve_local(node->identifier);
+    if (slot >= 0) {
+        emit_op(OpCode::LoadLocal);
+        emit_u16(slot);
+    }
+    else {
+        emit_op(OpCode::LoadGlobal);
+        emit_u32(global_index(node->identifier));
+    }
+}
+
+// entry-point for compiling
+BytecodeProgram compile_program(BaseNode *ast) {
+    BytecodeProgram program;
+    BytecodeCompiler compiler { program };
+    compiler.compile(static_cast<Program*>(ast));
+    return program;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// DISASSEMBLER
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+static int read_u16(const vector<uint8_t> &code, int offset) {
+    return code[offset] | (code[offset + 1] << 8);
+}
+
+static uint32_t read_u32(const vector<uint8_t> &code, int offset) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+        value |= static_cast<uint32_t>(code[offset + i]) << (8 * i);
+    return value;
+}
+
+void disassemble_program(BytecodeProgram &program) {
+    for (auto &fn : program.functions) {
+        std::cout << "== " << fn.name << " (arity " << fn.arity << ", locals " << fn.num_locals
+            << (fn.memo != nullptr ? ", memoized" : "") << ") ==" << std::endl;
+        for (int i = 0; i < fn.constants.size(); ++i)
+            std::cout << "  const " << i << " : " << kvazzvalue_as_string(fn.constants[i]) << std::endl;
+
+        int offset = 0;
+        while (offset < fn.code.size()) {
+            auto op = static_cast<OpCode>(fn.code[offset]);
+            std::cout << "  " << std::setw(4) << std::setfill('0') << offset << std::setfill(' ')
+                << "  " << std::left << std::setw(20) << opcode_as_string(op) << std::right;
+            ++offset;
+            switch(op) {
+                case OpCode::Constant:
+                {
+                    auto index = read_u32(fn.code, offset);
+                    std::cout << index << " (" << kvazzvalue_as_string(fn.constants[index]) << ")";
+                    offset += 4;
+                    break;
+                }
+                case OpCode::LoadLocal:
+                case OpCode::StoreLocal:
+                case OpCode::Call:
+                case OpCode::MakeHevec:
+                case OpCode::MakeHovec:
+                case OpCode::MultiIndex:
+                {
+                    std::cout << read_u16(fn.code, offset);
+                    offset += 2;
+                    break;
+                }
+                case OpCode::LoadGlobal:
+                case OpCode::StoreGlobal:
+                case OpCode::DefineGlobal:
+                {
+                    auto index = read_u32(fn.code, offset);
+                    std::cout << index << " (" << program.global_names[index] << ")";
+                    offset += 4;
+                    break;
+                }
+                case OpCode::Jump:
+                case OpCode::JumpIfFalse:
+                {
+                    std::cout << "-> " << read_u32(fn.code, offset);
+                    offset += 4;
+                    break;
+                }
+                case OpCode::StoreLocalIndex:
+                case OpCode::CallBuiltin:
+                {
+                    std::cout << read_u16(fn.code, offset) << " " << read_u16(fn.code, offset + 2);
+                    if (op == OpCode::CallBuiltin)
+                        std::cout << " (" << built_in_function_as_string(read_u16(fn.code, offset)) << ")";
+                    offset += 4;
+                    break;
+                }
+                case OpCode::StoreGlobalIndex:
+                {
+                    auto index = read_u32(fn.code, offset);
+                    std::cout << index << " " << read_u16(fn.code, offset + 4) << " (" << program.global_names[index] << ")";
+                    offset += 6;
+                    break;
+                }
+                case OpCode::UpdateLocal:
+                {
+                    std::cout << read_u16(fn.code, offset) << " " << read_u16(fn.code, offset + 2) << " "
+                        << opcode_as_string(static_cast<OpCode>(read_u16(fn.code, offset + 4)));
+                    offset += 6;
+                    break;
+                }
+                case OpCode::UpdateGlobal:
+                {
+                    auto index = read_u32(fn.code, offset);
+                    std::cout << index << " " << read_u16(fn.code, offset + 4) << " "
+                        << opcode_as_string(static_cast<OpCode>(read_u16(fn.code, offset + 6)))
+                        << " (" << program.global_names[index] << ")";
+                    offset += 8;
+                    break;
+                }
+                case OpCode::CallFunction:
+                case OpCode::TailCallFunction:
+                {
+                    auto index = read_u32(fn.code, offset);
+                    std::cout << index << " " << read_u16(fn.code, offset + 4) << " (" << program.functions[index].name << ")";
+                    offset += 6;
+                    break;
+                }
+                default: {}
+            }
+            std::cout << std::endl;
+        }
+        std::cout << std::endl;
+    }
+}
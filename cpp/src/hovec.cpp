@@ -0,0 +1,535 @@
+#include "hovec.h"
+#include "runtime.h"
+#include "asteval.h"
+#include "kernels.h"
+#include <algorithm>
+#include <climits>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <sstream>
+
+using std::vector;
+using std::string;
+
+/*
+*  Hovecs are a header (shape, strides, offset) over a HovecBuffer that views share. Readers go through
+*  for_each_position or gather the elements into a contiguous array for the kernels; writers unshare the
+*  buffer first, so a write through one hovec is never seen through another.
+*/
+
+/////////////////////////////////////////////////////////////////////////////////////
+// STORAGE
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+template <typename T> vector<T> &typed_storage(HovecBuffer &buffer);
+template <> vector<int> &typed_storage<int>(HovecBuffer &buffer) { return buffer.ints; }
+template <> vector<double> &typed_storage<double>(HovecBuffer &buffer) { return buffer.reals; }
+template <> vector<uint8_t> &typed_storage<uint8_t>(HovecBuffer &buffer) { return buffer.bools; }
+
+// the strides of a contiguous row-major array of the given shape
+vector<ptrdiff_t> row_major_strides(const vector<size_t> &shape) {
+    vector<ptrdiff_t> strides(shape.size());
+    ptrdiff_t stride = 1;
+    for (size_t axis = shape.size(); axis-- > 0;) {
+        strides[axis] = stride;
+        stride *= shape[axis];
+    }
+    return strides;
+}
+
+Hovec make_shaped_hovec(KvazzType element_type, vector<size_t> shape) {
+    Hovec hovec { element_type, std::make_shared<HovecBuffer>(), std::move(shape), {}, 0 };
+    hovec.strides = row_major_strides(hovec.shape);
+    switch (element_type) {
+        case KvazzType::Real: hovec.buffer->reals.resize(hovec.size()); break;
+        case KvazzType::Bool: hovec.buffer->bools.resize(hovec.size()); break;
+        default:              hovec.buffer->ints.resize(hovec.size());
+    }
+    return hovec;
+}
+
+// copies the elements of hovec, in row-major order, to out
+template <typename T>
+void gather_elements(const Hovec &hovec, T *out) {
+    auto &storage = typed_storage<T>(*hovec.buffer);
+    size_t n = 0;
+    for_each_position(hovec, [&](size_t position) { out[n++] = storage[position]; });
+}
+
+template <typename T>
+const T *contiguous_elements(const Hovec &hovec, vector<T> &scratch) {
+    auto &storage = typed_storage<T>(*hovec.buffer);
+    if (hovec.is_contiguous())
+        return storage.data() + hovec.offset;
+    scratch.resize(hovec.size());
+    gather_elements(hovec, scratch.data());
+    return scratch.data();
+}
+
+const int *hovec_ints(const Hovec &hovec, vector<int> &scratch) {
+    return contiguous_elements(hovec, scratch);
+}
+
+const double *hovec_reals(const Hovec &hovec, vector<double> &scratch) {
+    if (hovec.element_type == KvazzType::Real)
+        return contiguous_elements(hovec, scratch);
+    auto &ints = hovec.buffer->ints;
+    scratch.resize(hovec.size());
+    size_t n = 0;
+    for_each_position(hovec, [&](size_t position) { scratch[n++] = ints[position]; });
+    return scratch.data();
+}
+
+// a contiguous copy of hovec with its own buffer
+Hovec compact_copy(const Hovec &hovec) {
+    auto copy = make_shaped_hovec(hovec.element_type, hovec.shape);
+    switch (hovec.element_type) {
+        case KvazzType::Real: gather_elements(hovec, copy.buffer->reals.data()); break;
+        case KvazzType::Bool: gather_elements(hovec, copy.buffer->bools.data()); break;
+        default:              gather_elements(hovec, copy.buffer->ints.data());
+    }
+    return copy;
+}
+
+/**
+ *  Gives hovec a buffer of its own before it's written to. Views sharing the old buffer keep it, and
+ *  the copy only holds the elements hovec can reach, so its strides and offset change.
+ */
+void unshare_buffer(Hovec &hovec) {
+    if (hovec.buffer.use_count() > 1)
+        hovec = compact_copy(hovec);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// ELEMENTS
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+// whether a value of value_type can be stored in a hovec of element_type, Ints are widened to Reals
+bool hovec_accepts(KvazzType element_type, KvazzType value_type) {
+    return value_type == element_type || (element_type == KvazzType::Real && value_type == KvazzType::Int);
+}
+
+KvazzValue hovec_element(const Hovec &hovec, size_t position) {
+    switch (hovec.element_type) {
+        case KvazzType::Real: return KvazzValue { KvazzType::Real, hovec.buffer->reals[position] };
+        case KvazzType::Bool: return KvazzValue { KvazzType::Bool, hovec.buffer->bools[position] != 0 };
+        default:              return KvazzValue { KvazzType::Int, hovec.buffer->ints[position] };
+    }
+}
+
+// stores value at a position of a buffer nothing else shares
+bool store_element(Hovec &hovec, size_t position, const KvazzValue &value) {
+    if (!hovec_accepts(hovec.element_type, value.type)) {
+        std::cerr
+            << "Cannot store " << kvazztype_as_string(value.type) << " in a Hovec of "
+            << kvazztype_as_string(hovec.element_type) << "\n";
+        return false;
+    }
+    switch (hovec.element_type) {
+        case KvazzType::Real:
+            hovec.buffer->reals[position] = value.type == KvazzType::Int ? value.as_int() : value.as_real();
+            break;
+        case KvazzType::Bool:
+            hovec.buffer->bools[position] = value.as_bool();
+            break;
+        default:
+            hovec.buffer->ints[position] = value.as_int();
+    }
+    return true;
+}
+
+Hovec make_filled_hovec(KvazzType element_type, vector<size_t> shape, const KvazzValue &fill) {
+    auto hovec = make_shaped_hovec(element_type, std::move(shape));
+    switch (element_type) {
+        case KvazzType::Real:
+            std::fill(hovec.buffer->reals.begin(), hovec.buffer->reals.end(),
+                      fill.type == KvazzType::Int ? fill.as_int() : fill.as_real());
+            break;
+        case KvazzType::Bool:
+            std::fill(hovec.buffer->bools.begin(), hovec.buffer->bools.end(), fill.as_bool());
+            break;
+        default:
+            std::fill(hovec.buffer->ints.begin(), hovec.buffer->ints.end(), fill.as_int());
+    }
+    return hovec;
+}
+
+// <[<[1, 2]>, <[3, 4]>]>: hovecs of one shape stacked along a new first axis
+KvazzResult stack_hovecs(const vector<KvazzValue> &rows) {
+    auto &first = rows[0].as_hovec();
+    auto element_type = first.element_type;
+    for (auto &row : rows) {
+        if (row.type != KvazzType::Hovec || row.as_hovec().shape != first.shape) {
+            std::cerr << "Hovec rows must all be Hovecs of shape " << shape_as_string(first.shape) << "\n";
+            return ERROR_NO_VALUE;
+        }
+        if (row.as_hovec().element_type == KvazzType::Real && element_type == KvazzType::Int)
+            element_type = KvazzType::Real;
+    }
+
+    vector<size_t> shape { rows.size() };
+    shape.insert(shape.end(), first.shape.begin(), first.shape.end());
+    auto hovec = make_shaped_hovec(element_type, std::move(shape));
+    size_t position = 0;
+    bool stored = true;
+    for (auto &row : rows) {
+        auto &source = row.as_hovec();
+        for_each_position(source, [&](size_t source_position) {
+            stored = stored && store_element(hovec, position++, hovec_element(source, source_position));
+        });
+    }
+    if (!stored)
+        return ERROR_NO_VALUE;
+    return make_good_result(std::move(hovec));
+}
+
+KvazzResult make_hovec(const vector<KvazzValue> &elements) {
+    if (!elements.empty() && elements[0].type == KvazzType::Hovec)
+        return stack_hovecs(elements);
+
+    // the element type is that of the elements, or Real when Ints and Reals are mixed
+    auto element_type = elements.empty() ? KvazzType::Int : elements[0].type;
+    for (auto &element : elements) {
+        if (element.type == KvazzType::Real && element_type == KvazzType::Int)
+            element_type = KvazzType::Real;
+    }
+    if (element_type != KvazzType::Int && element_type != KvazzType::Real && element_type != KvazzType::Bool) {
+        std::cerr
+            << "Invalid Hovec element type. Expected: Int, Real or Bool, Received: "
+            << kvazztype_as_string(element_type) << "\n";
+        return ERROR_NO_VALUE;
+    }
+
+    auto hovec = make_shaped_hovec(element_type, { elements.size() });
+    for (size_t i = 0; i < elements.size(); ++i) {
+        if (!store_element(hovec, i, elements[i]))
+            return ERROR_NO_VALUE;
+    }
+    return make_good_result(std::move(hovec));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// INDEXING AND VIEWS
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  Finds the buffer position of hovec[indices[0], ..., indices[count - 1]] for count up to the rank.
+ *  Returns false, after printing why, if the indices don't select anything.
+ */
+bool index_position(const Hovec &hovec, KvazzValue *indices, size_t count, size_t &position) {
+    if (count > hovec.rank()) {
+        std::cerr << "Too many indices for a Hovec of shape " << shape_as_string(hovec.shape) << ": " << count << "\n";
+        return false;
+    }
+    ptrdiff_t result = hovec.offset;
+    for (size_t axis = 0; axis < count; ++axis) {
+        if (indices[axis].type != KvazzType::Int)
+            return false;
+        auto index = indices[axis].as_int();
+        if (index < 0 || static_cast<size_t>(index) >= hovec.shape[axis]) {
+            std::cerr << "Index " << index << " out of bounds for vector" << std::endl;
+            return false;
+        }
+        result += index * hovec.strides[axis];
+    }
+    position = result;
+    return true;
+}
+
+// the view of hovec with its first count axes fixed, starting at position
+Hovec subview(const Hovec &hovec, size_t count, size_t position) {
+    return Hovec {
+        hovec.element_type,
+        hovec.buffer,
+        vector<size_t>(hovec.shape.begin() + count, hovec.shape.end()),
+        vector<ptrdiff_t>(hovec.strides.begin() + count, hovec.strides.end()),
+        position
+    };
+}
+
+KvazzResult hovec_index(const Hovec &hovec, KvazzValue *indices, size_t count) {
+    size_t position;
+    if (!index_position(hovec, indices, count, position))
+        return ERROR_NO_VALUE;
+    if (count == hovec.rank())
+        return make_good_result(hovec_element(hovec, position));
+    return make_good_result(subview(hovec, count, position));
+}
+
+bool hovec_store_index(Hovec &hovec, KvazzValue *indices, size_t count, const KvazzValue &value) {
+    size_t position;
+    // validate before unsharing so a bad index doesn't copy the buffer, then find the position again
+    // since unsharing compacts the layout
+    if (!index_position(hovec, indices, count, position))
+        return false;
+    unshare_buffer(hovec);
+    index_position(hovec, indices, count, position);
+    if (count == hovec.rank())
+        return store_element(hovec, position, value);
+
+    // a[i] = row: value must have the shape of the view and is copied into it. It can't share the buffer
+    // being written, that was unshared above
+    auto target = subview(hovec, count, position);
+    if (value.type != KvazzType::Hovec || value.as_hovec().shape != target.shape) {
+        std::cerr
+            << "Cannot assign " << describe_type(value) << " to a Hovec view of shape "
+            << shape_as_string(target.shape) << "\n";
+        return false;
+    }
+    auto &source = value.as_hovec();
+    vector<size_t> target_positions;
+    target_positions.reserve(target.size());
+    for_each_position(target, [&](size_t target_position) { target_positions.push_back(target_position); });
+
+    size_t n = 0;
+    bool stored = true;
+    for_each_position(source, [&](size_t source_position) {
+        stored = stored && store_element(hovec, target_positions[n++], hovec_element(source, source_position));
+    });
+    return stored;
+}
+
+Hovec hovec_transpose(const Hovec &hovec) {
+    auto view = hovec;
+    std::reverse(view.shape.begin(), view.shape.end());
+    std::reverse(view.strides.begin(), view.strides.end());
+    return view;
+}
+
+KvazzResult hovec_reshape(const Hovec &hovec, vector<size_t> shape) {
+    size_t size = 1;
+    for (auto dim : shape)
+        size *= dim;
+    if (shape.empty() || size != hovec.size()) {
+        std::cerr
+            << "Cannot reshape a Hovec of shape " << shape_as_string(hovec.shape) << " to "
+            << shape_as_string(shape) << "\n";
+        return ERROR_NO_VALUE;
+    }
+    auto view = hovec.is_contiguous() ? hovec : compact_copy(hovec);
+    view.strides = row_major_strides(shape);
+    view.shape = std::move(shape);
+    return make_good_result(std::move(view));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// COMPARISON AND PRINTING
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+bool hovec_equals(const Hovec &left, const Hovec &right) {
+    if (left.shape != right.shape)
+        return false;
+    vector<size_t> right_positions;
+    right_positions.reserve(right.size());
+    for_each_position(right, [&](size_t position) { right_positions.push_back(position); });
+
+    size_t n = 0;
+    bool equal = true;
+    for_each_position(left, [&](size_t position) {
+        equal = equal && kvazzvalue_equals(hovec_element(left, position), hovec_element(right, right_positions[n++]));
+    });
+    return equal;
+}
+
+// prints the elements along axis, starting at position, as a hovec literal
+void print_axis(std::stringstream &result, const Hovec &hovec, size_t axis, ptrdiff_t position) {
+    result << "<[";
+    for (size_t i = 0; i < hovec.shape[axis]; ++i) {
+        if (i > 0)
+            result << ", ";
+        auto element_position = position + static_cast<ptrdiff_t>(i) * hovec.strides[axis];
+        if (axis + 1 == hovec.rank())
+            result << kvazzvalue_as_string(hovec_element(hovec, element_position));
+        else
+            print_axis(result, hovec, axis + 1, element_position);
+    }
+    result << "]>";
+}
+
+string hovec_as_string(const Hovec &hovec) {
+    std::stringstream result;
+    print_axis(result, hovec, 0, hovec.offset);
+    return result.str();
+}
+
+string shape_as_string(const vector<size_t> &shape) {
+    std::stringstream result;
+    result << "(";
+    for (size_t axis = 0; axis < shape.size(); ++axis) {
+        if (axis > 0)
+            result << ", ";
+        result << shape[axis];
+    }
+    result << ")";
+    return result.str();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// ARITHMETIC
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+KvazzType numeric_type(const KvazzValue &kv) {
+    return kv.type == KvazzType::Hovec ? kv.as_hovec().element_type : kv.type;
+}
+
+string describe_type(const KvazzValue &kv) {
+    if (kv.type == KvazzType::Hovec)
+        return "Hovec of " + kvazztype_as_string(kv.as_hovec().element_type);
+    return kvazztype_as_string(kv.type);
+}
+
+KernelOperand<int> int_operand(const KvazzValue &kv, vector<int> &scratch) {
+    if (kv.type == KvazzType::Hovec)
+        return KernelOperand<int> { hovec_ints(kv.as_hovec(), scratch), 0 };
+    return KernelOperand<int> { nullptr, kv.as_int() };
+}
+
+KernelOperand<double> real_operand(const KvazzValue &kv, vector<double> &scratch) {
+    if (kv.type == KvazzType::Hovec)
+        return KernelOperand<double> { hovec_reals(kv.as_hovec(), scratch), 0.0 };
+    return KernelOperand<double> { nullptr, kv.type == KvazzType::Int ? kv.as_int() : kv.as_real() };
+}
+
+KvazzResult hovec_arithmetic(KernelOp op, const KvazzValue &kv1, const KvazzValue &kv2) {
+    auto left_type = numeric_type(kv1);
+    auto right_type = numeric_type(kv2);
+    if ((left_type != KvazzType::Int && left_type != KvazzType::Real)
+        || (right_type != KvazzType::Int && right_type != KvazzType::Real)) {
+        std::cerr
+            << "Unsupported operands for Hovec arithmetic: "
+            << describe_type(kv1) << " and " << describe_type(kv2) << "\n";
+        return ERROR_NO_VALUE;
+    }
+
+    auto &shape = kv1.type == KvazzType::Hovec ? kv1.as_hovec().shape : kv2.as_hovec().shape;
+    if (kv1.type == KvazzType::Hovec && kv2.type == KvazzType::Hovec && kv2.as_hovec().shape != shape) {
+        std::cerr
+            << "Hovec shapes differ: " << shape_as_string(shape) << " and "
+            << shape_as_string(kv2.as_hovec().shape) << "\n";
+        return ERROR_NO_VALUE;
+    }
+
+    if (left_type == KvazzType::Int && right_type == KvazzType::Int) {
+        auto result = make_shaped_hovec(KvazzType::Int, shape);
+        auto length = result.size();
+        vector<int> left_scratch, right_scratch;
+        auto left = int_operand(kv1, left_scratch);
+        auto right = int_operand(kv2, right_scratch);
+        if (op == KernelOp::Divide) {
+            for (size_t i = 0; i < length; ++i) {
+                int divisor = right.data != nullptr ? right.data[i] : right.scalar;
+                int dividend = left.data != nullptr ? left.data[i] : left.scalar;
+                if (divisor == 0 || (dividend == INT_MIN && divisor == -1)) {
+                    std::cerr << "Invalid Hovec division: " << dividend << " / " << divisor << "\n";
+                    return ERROR_NO_VALUE;
+                }
+            }
+        }
+        kernel_int_op(op, left, right, result.buffer->ints.data(), length);
+        return make_good_result(std::move(result));
+    }
+
+    auto result = make_shaped_hovec(KvazzType::Real, shape);
+    vector<double> left_scratch, right_scratch;
+    auto left = real_operand(kv1, left_scratch);
+    auto right = real_operand(kv2, right_scratch);
+    kernel_real_op(op, left, right, result.buffer->reals.data(), result.size());
+    return make_good_result(std::move(result));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// LINEAR ALGEBRA
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+bool both_int(const Hovec &left, const Hovec &right) {
+    return left.element_type == KvazzType::Int && right.element_type == KvazzType::Int;
+}
+
+KvazzResult hovec_matmul(const Hovec &left, const Hovec &right) {
+    if (left.rank() != 2 || right.rank() != 2 || left.shape[1] != right.shape[0]) {
+        std::cerr
+            << "Cannot multiply matrices of shapes " << shape_as_string(left.shape) << " and "
+            << shape_as_string(right.shape) << "\n";
+        return ERROR_NO_VALUE;
+    }
+    size_t n = left.shape[0], k = left.shape[1], m = right.shape[1];
+
+    if (both_int(left, right)) {
+        auto result = make_shaped_hovec(KvazzType::Int, { n, m });
+        vector<int> left_scratch, right_scratch;
+        auto a = hovec_ints(left, left_scratch);
+        auto b = hovec_ints(right, right_scratch);
+        kernel_int_matmul(a, b, result.buffer->ints.data(), n, k, m);
+        return make_good_result(std::move(result));
+    }
+    auto result = make_shaped_hovec(KvazzType::Real, { n, m });
+    vector<double> left_scratch, right_scratch;
+    auto a = hovec_reals(left, left_scratch);
+    auto b = hovec_reals(right, right_scratch);
+    kernel_real_matmul(a, b, result.buffer->reals.data(), n, k, m);
+    return make_good_result(std::move(result));
+}
+
+KvazzResult hovec_matvec(const Hovec &matrix, const Hovec &vec) {
+    if (matrix.rank() != 2 || vec.rank() != 1 || matrix.shape[1] != vec.shape[0]) {
+        std::cerr
+            << "Cannot multiply a matrix of shape " << shape_as_string(matrix.shape) << " by a vector of shape "
+            << shape_as_string(vec.shape) << "\n";
+        return ERROR_NO_VALUE;
+    }
+    size_t n = matrix.shape[0], k = matrix.shape[1];
+
+    // each element is the dot product of a row with vec
+    if (both_int(matrix, vec)) {
+        auto result = make_shaped_hovec(KvazzType::Int, { n });
+        vector<int> matrix_scratch, vec_scratch;
+        auto a = hovec_ints(matrix, matrix_scratch);
+        auto x = hovec_ints(vec, vec_scratch);
+        for (size_t i = 0; i < n; ++i)
+            result.buffer->ints[i] = kernel_int_dot(a + i * k, x, k);
+        return make_good_result(std::move(result));
+    }
+    auto result = make_shaped_hovec(KvazzType::Real, { n });
+    vector<double> matrix_scratch, vec_scratch;
+    auto a = hovec_reals(matrix, matrix_scratch);
+    auto x = hovec_reals(vec, vec_scratch);
+    for (size_t i = 0; i < n; ++i)
+        result.buffer->reals[i] = kernel_real_dot(a + i * k, x, k);
+    return make_good_result(std::move(result));
+}
+
+KvazzResult hovec_outer(const Hovec &left, const Hovec &right) {
+    if (left.rank() != 1 || right.rank() != 1) {
+        std::cerr
+            << "outer expects two vectors, Received shapes: " << shape_as_string(left.shape) << " and "
+            << shape_as_string(right.shape) << "\n";
+        return ERROR_NO_VALUE;
+    }
+    size_t n = left.shape[0], m = right.shape[0];
+
+    // row i is left[i] * right
+    if (both_int(left, right)) {
+        auto result = make_shaped_hovec(KvazzType::Int, { n, m });
+        vector<int> left_scratch, right_scratch;
+        auto x = hovec_ints(left, left_scratch);
+        auto y = hovec_ints(right, right_scratch);
+        for (size_t i = 0; i < n; ++i)
+            kernel_int_op(KernelOp::Multiply, { nullptr, x[i] }, { y, 0 }, result.buffer->ints.data() + i * m, m);
+        return make_good_result(std::move(result));
+    }
+    auto result = make_shaped_hovec(KvazzType::Real, { n, m });
+    vector<double> left_scratch, right_scratch;
+    auto x = hovec_reals(left, left_scratch);
+    auto y = hovec_reals(right, right_scratch);
+    for (size_t i = 0; i < n; ++i)
+        kernel_real_op(KernelOp::Multiply, { nullptr, x[i] }, { y, 0.0 }, result.buffer->reals.data() + i * m, m);
+    return make_good_result(std::move(result));
+}
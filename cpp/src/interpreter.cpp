@@ -1,6 +1,7 @@
 #include "ast.h"
 #include "asteval.h"
 #include "interpreter.h"
+#include "jit.h"
 #include <string>
 #include <variant>
 #include <vector>
@@ -15,963 +16,443 @@ using std::vector;
 using std::string;
 
 /////////////////////////////////////////////////////////////////////////////////////
-// USEFUL CONSTANTS
+// INTERPRETER
 //
 /////////////////////////////////////////////////////////////////////////////////////
-KvazzValue NOTHING = KvazzValue { KvazzType::Nothing, 0 };
 
-KvazzResult ERROR_NO_VALUE = KvazzResult { NOTHING, KvazzFlag::Error };
+EnvEntry UNBOUND_ENTRY = EnvEntry { EnvResultType::Unbound, NOTHING };
 
-KvazzResult GOOD_NO_VALUE = KvazzResult { NOTHING, KvazzFlag::Good };
+/**
+ *  Finds the Env holding the variable node was resolved to, nullptr for built-ins and unresolved names
+ */
+Env *resolve_env(Isolate &isolate, VariableLookup *node, Env *env) {
+    if (node->resolution == Resolution::Global)
+        return isolate.global_env.get();
+    if (node->resolution != Resolution::Local)
+        return nullptr;
+    for (int i = 0; i < node->depth; ++i)
+        env = env->parent.get();
+    return env;
+}
 
-KvazzResult GOOD_BOOL_TRUE = KvazzResult {
-    KvazzValue {
-        KvazzType::Bool,
-        true
-    },
-    KvazzFlag::Good
-};
+/**
+ *  Finds the entry of the variable node refers to, or prints the lookup error and returns nullptr if it
+ *  isn't declared (yet)
+ */
+EnvEntry *lookup(Isolate &isolate, VariableLookup *node, Env *env) {
+    auto the_env = resolve_env(isolate, node, env);
+    if (the_env != nullptr) {
+        auto &entry = the_env->slots[node->slot];
+        if (entry.type != EnvResultType::Unbound)
+            return &entry;
+    }
+    std::cerr << "Lookup of identifier " << node->identifier << " failed." << std::endl;
+    return nullptr;
+}
 
-KvazzResult GOOD_BOOL_FALSE = KvazzResult {
-    KvazzValue {
-        KvazzType::Bool,
-        false
-    },
-    KvazzFlag::Good
-};
+// the cache_epoch of a call site while some thread is filling its cache
+const uint64_t CACHE_BUSY = UINT64_MAX;
 
-// enum-to-string function for KvazzType
-string kvazztype_as_string(KvazzType t) {
-    // could probably be rewritten into table lookup
-    switch(t) {
-        case KvazzType::Bool:
-        {
-           return "Bool";
-        }
-        case KvazzType::Nothing:
-        {
-            return "Nothing";
-        }
-        case KvazzType::Int:
-        {
-            return "Int";
-        }
-        case KvazzType::Real:
-        {
-            return "Real";
-        }
-        case KvazzType::String:
-        {
-            return "String";
-        }
-        case KvazzType::Hevec:
-        {
-            return "Hevec";
-        }
-        case KvazzType::LValue:
-        {
-            return "LValue";
-        }
-        case KvazzType::Function:
-        {
-            return "Function";
-        }
-        case KvazzType::Builtin:
-        {
-            return "Builtin";
+/**
+ *  Returns the declared global function node calls, or nullptr if its callee is anything else. Function
+ *  entries are never reassigned, so the pointer stays good until the Isolate's global_epoch changes.
+ *
+ *  Threads of every Isolate running node's AST share its cache, so it's a seqlock: a writer claims it by
+ *  setting cache_epoch to CACHE_BUSY, stores the callee and publishes its epoch, a reader only trusts the
+ *  callee it read if cache_epoch was its own epoch both before and after. Epochs are unique to an Isolate
+ *  state, so a matching one always comes with a callee from this Isolate's global_env.
+ */
+KvazzFunction *cached_global_callee(Isolate &isolate, FunctionCall *node) {
+    auto epoch = node->cache_epoch.load(std::memory_order_acquire);
+    if (epoch == isolate.global_epoch) {
+        auto cached = node->cached_callee.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (node->cache_epoch.load(std::memory_order_relaxed) == epoch)
+            return cached;
+    }
+
+    KvazzFunction *callee = nullptr;
+    if (node->callee->type() == NodeType::VariableLookup) {
+        auto variable = static_cast<VariableLookup*>(node->callee);
+        if (variable->resolution == Resolution::Global) {
+            auto &entry = isolate.global_env->slots[variable->slot];
+            if (entry.type == EnvResultType::Function)
+                callee = &std::get<KvazzFunction>(entry.contents);
         }
     }
-    return "";
+    // worker threads of this Isolate leave the cache to it, another thread filling it just means a miss
+    if (isolate.multithreaded.load(std::memory_order_relaxed) || epoch == CACHE_BUSY)
+        return callee;
+    if (!node->cache_epoch.compare_exchange_strong(epoch, CACHE_BUSY, std::memory_order_relaxed))
+        return callee;
+    std::atomic_thread_fence(std::memory_order_release);
+    node->cached_callee.store(callee, std::memory_order_relaxed);
+    node->cache_epoch.store(isolate.global_epoch, std::memory_order_release);
+    return callee;
+}
+
+/**
+ *  Creates the Env a call to fn runs in. Missing arguments are Nothing, extra ones are dropped.
+ */
+shared_ptr<Env> make_function_env(Isolate &isolate, KvazzFunction &fn, vector<KvazzValue> &arg_values) {
+    // the slots are appended to an empty frame rather than filled with unbound entries and overwritten
+    auto env = make_env(isolate.global_env, 0);
+    for (size_t i = 0; i < fn.args.size(); ++i) {
+        if (i < arg_values.size())
+            env->slots.push_back(EnvEntry { EnvResultType::Value, std::move(arg_values[i]) });
+        else
+            env->slots.push_back(EnvEntry { EnvResultType::Value, NOTHING });
+    }
+    return env;
 }
 
-string kvazzvalue_as_string(KvazzValue &item) {
-    std::stringstream result;
+/**
+ *  Calls a memoized fn through its cache, run_body only runs on a miss. Calls that error aren't cached.
+ */
+template <typename RunBody>
+KvazzResult call_memoized(KvazzFunction &fn, vector<KvazzValue> &arg_values, RunBody run_body) {
+    // the cache is held by a raw pointer, the function may be copied or rebound while its body runs
+    auto memo = fn.memo.get();
+    arg_values.resize(fn.args.size(), NOTHING);
+    KvazzValue cached;
+    if (memo->find(arg_values.data(), arg_values.size(), cached))
+        return make_good_result(std::move(cached));
+
+    auto key = arg_values;
+    auto result = run_body(arg_values);
+    if (result.flag == KvazzFlag::Good)
+        memo->insert(std::move(key), result.kvazz_value);
+    return result;
+}
 
-    switch(item.type) {
-        case KvazzType::Bool:
-        {
-            result << (std::get<bool>(item.value) ? "true" : "false");
-            break;
-        }
-        case KvazzType::Nothing:
-        {
-            result << "Nothing";
-            break;
-        }
-        case KvazzType::Int:
-        {
-            result << std::get<int>(item.value);
-            break;
-        }
-        case KvazzType::Real:
-        {
-            result << std::get<double>(item.value);
-            break;
-        }
-        case KvazzType::String:
-        {
-            result << std::get<string>(item.value);
-            break;
-        }
-        case KvazzType::Hevec:
-        {
-            auto v = std::get<vector<KvazzValue>>(item.value);
-            result << "[";
-            for(int i = 0; i < v.size(); ++i) {
-                result << kvazzvalue_as_string(v[i]);
-                if (i != v.size() - 1) {
-                    result << ", ";
-                }
-            }
-            result << "]";
-            break;
+/**
+ *  Runs fn's body and then the calls left in tail_call by its Returns, in one loop. function_env holds
+ *  fn's arguments, see make_function_env. run_body runs a function's body Block in the Env it's passed.
+ *  intercept gets the first go at each tail call and returns true if it made the call itself, for
+ *  callees that have to be called the usual way.
+ */
+template <typename RunBody, typename Intercept>
+KvazzResult run_with_tail_calls(
+        Isolate &isolate,
+        TailCall &tail_call,
+        KvazzFunction &fn,
+        shared_ptr<Env> function_env,
+        RunBody run_body,
+        Intercept intercept) {
+
+    KvazzFunction *callee = &fn;
+    std::unique_ptr<KvazzFunction> function;
+    auto body = static_cast<Block*>(fn.body);
+    auto body_env = body->scoped ? make_env(function_env, body->num_slots) : function_env;
+
+    while (true) {
+        auto result = run_body(*callee, body_env);
+        if (!tail_call.pending) {
+            // the Return flag only unwinds the callee's blocks, the caller sees an ordinary value
+            result.flag = result.flag == KvazzFlag::Return ? KvazzFlag::Good : result.flag;
+            return result;
         }
-        case KvazzType::LValue:
-        {
-            // shouldn't really happen
-            result << "LValue";
-            break;
+
+        tail_call.pending = false;
+        auto args = std::move(tail_call.args);
+        if (tail_call.callee == &tail_call.function) {
+            function = std::make_unique<KvazzFunction>(std::move(tail_call.function));
+            callee = function.get();
         }
-        case KvazzType::Function:
-        {
-            KvazzFunction kf = std::get<KvazzFunction>(item.value);
-            result << "Function<" << kf.name << "(";
-            for(int i = 0; i < kf.args.size(); ++i) {
-                result << kf.args[i];
-                if (i != kf.args.size() - 1) {
-                    result << ", ";
-                }
+        else {
+            callee = tail_call.callee;
+        }
+        KvazzResult intercepted;
+        if (intercept(*callee, args, intercepted))
+            return intercepted;
+
+        // the Envs are reused unless a value still refers to them. A body without a scope runs in function_env
+        bool reuse = body_env == function_env
+            ? function_env.use_count() == 2
+            : body_env.use_count() == 1 && function_env.use_count() == 2;
+        if (reuse) {
+            function_env->slots.resize(callee->args.size(), UNBOUND_ENTRY);
+            for (size_t i = 0; i < callee->args.size(); ++i) {
+                auto value = i < args.size() ? std::move(args[i]) : NOTHING;
+                function_env->slots[i] = EnvEntry { EnvResultType::Value, std::move(value) };
             }
-            result << ")>";
-            break;
         }
-        case KvazzType::Builtin:
-        {
-            result << "Builtin<" << built_in_function_as_string(std::get<int>(item.value)) << ">";
-            break;
+        else {
+            function_env = make_function_env(isolate, *callee, args);
         }
+
+        body = static_cast<Block*>(callee->body);
+        if (!body->scoped)
+            body_env = function_env;
+        else if (reuse && body_env != function_env)
+            body_env->slots.assign(body->num_slots, UNBOUND_ENTRY);
+        else
+            body_env = make_env(function_env, body->num_slots);
     }
-    return result.str();
 }
 
-/////////////////////////////////////////////////////////////////////////////////////
-// MAKE GOOD RESULT
-//
-/////////////////////////////////////////////////////////////////////////////////////
+/**
+ *  Calls the passed KvazzFunction with the specified args
+ */
+KvazzResult call_function(
+        KvazzFunction &fn,
+        vector<KvazzValue> &arg_values,
+        /* shared_ptr<Env> env,    // unused for now since all functions are executed with global scope */
+        Interpreter &interpreter) {
 
-// Int, Real, Bool, String, Hevec
-KvazzResult make_good_result(bool value) {
-    return KvazzResult {
-        KvazzValue {
-            KvazzType::Bool,
-            value
-        },
-        KvazzFlag::Good
-    };
+    auto run_body = [&](vector<KvazzValue> &args) { return interpreter.run_function(fn, args); };
+    return fn.memo != nullptr ? call_memoized(fn, arg_values, run_body) : run_body(arg_values);
 }
 
-KvazzResult make_good_result(int value) {
-    return KvazzResult {
-        KvazzValue {
-            KvazzType::Int,
-            value
-        },
-        KvazzFlag::Good
-    };
-}
+/**
+ *  Assigns value to what lvalue refers to, returns false if it doesn't refer to a value or element
+ */
+bool assign_lvalue(Isolate &isolate, const LValue &lvalue, KvazzValue value) {
+    if (lvalue.env == nullptr)
+        return false;
+    if (lvalue.env == isolate.global_env.get() && !global_assignment_allowed())
+        return false;
+    auto &entry = lvalue.env->slots[lvalue.slot];
+    if (entry.type != EnvResultType::Value)
+        return false;
 
-KvazzResult make_good_result(double value) {
-    return KvazzResult {
-        KvazzValue {
-            KvazzType::Real,
-            value
-        },
-        KvazzFlag::Good
-    };
+    vector<KvazzValue> indices;
+    indices.reserve(lvalue.indices.size());
+    for (auto index : lvalue.indices)
+        indices.push_back(KvazzValue { KvazzType::Int, index });
+    return kvazzvalue_store_index(std::get<KvazzValue>(entry.contents), indices, std::move(value));
 }
 
-KvazzResult make_good_result(string value) {
-    return KvazzResult {
-        KvazzValue {
-            KvazzType::String,
-            value
-        },
-        KvazzFlag::Good
-    };
+/**
+ *  The value lvalue refers to, read without evaluating its indices again, an Error if there is none
+ */
+KvazzResult lvalue_value(const LValue &lvalue) {
+    if (lvalue.env == nullptr)
+        return ERROR_NO_VALUE;
+    auto &entry = lvalue.env->slots[lvalue.slot];
+    if (entry.type != EnvResultType::Value)
+        return ERROR_NO_VALUE;
+
+    auto &value = std::get<KvazzValue>(entry.contents);
+    if (lvalue.indices.empty())
+        return KvazzResult { value, KvazzFlag::Good };
+    vector<KvazzValue> indices;
+    indices.reserve(lvalue.indices.size());
+    for (auto index : lvalue.indices)
+        indices.push_back(KvazzValue { KvazzType::Int, index });
+    return kvazzvalue_index(value, indices.data(), indices.size());
 }
 
-KvazzResult make_good_result(vector<KvazzValue> value) {
-    return KvazzResult {
-        KvazzValue {
-            KvazzType::Hevec,
-            value
-        },
-        KvazzFlag::Good
-    };
+/*
+*  AST-eval Interpreter class methods
+*/
+KvazzResult Interpreter::eval(BaseNode *node, const shared_ptr<Env> &env) {
+    std::cerr << "Eval not implemented for BaseNode\n";
+    return ERROR_NO_VALUE;
 }
 
-KvazzResult make_good_result(LValue value) {
-    return KvazzResult {
-        KvazzValue {
-            KvazzType::LValue,
-            value
-        },
-        KvazzFlag::Good
-    };
+KvazzResult Interpreter::eval(Program *node, const shared_ptr<Env> &env) {
+    env->slots.resize(node->num_slots, UNBOUND_ENTRY);
+    isolate.global_epoch = next_global_epoch();
+    for (auto nd : node->statements()) {
+        nd->eval(*this, env);
+    }
+
+    if (node->main_slot >= 0 && env->slots[node->main_slot].type == EnvResultType::Function) {
+        auto main_method = std::get<KvazzFunction>(env->slots[node->main_slot].contents);
+        vector<KvazzValue> args;
+        call_function(main_method, args, *this);
+    }
+    return GOOD_NO_VALUE;
 }
 
-KvazzResult make_good_result(KvazzFunction value) {
-    return KvazzResult {
-        KvazzValue {
-            KvazzType::Function,
-            value
-        },
-        KvazzFlag::Good
-    };
+KvazzResult Interpreter::eval(Block *node, const shared_ptr<Env> &env) {
+    if (!node->scoped)
+        return run_statements(node, env);
+    auto local_env = make_env(env, node->num_slots);
+    return run_statements(node, local_env);
 }
 
-KvazzResult make_good_result(KvazzValue value) {
-    //switch on every type and then just call make_good_result once you std::get the type
-    switch(value.type) {
-        case KvazzType::Bool:
-            {
-                return make_good_result(std::get<bool>(value.value));
-            }
-        case KvazzType::Int:
-            {
-                return make_good_result(std::get<int>(value.value));
-            }
-        case KvazzType::String:
-            {
-                return make_good_result(std::get<string>(value.value));
-            }
-        case KvazzType::Hevec:
-            {
-                return make_good_result(std::get<vector<KvazzValue>>(value.value));
-            }
-        case KvazzType::Real:
-            {
-                return make_good_result(std::get<double>(value.value));
-            }
-        case KvazzType::Nothing:
-        case KvazzType::Builtin:
-        case KvazzType::LValue:
-        default:
-            {
-                std::cerr << "Attempted to make_good_value on invalid KvazzType.\n";
-            }
+// runs the statements of node in env, which is the Env of the block
+KvazzResult Interpreter::run_statements(Block *node, const shared_ptr<Env> &env) {
+    for (auto nd : node->statements()) {
+        auto result = nd->eval(*this, env);
+        if (result.flag == KvazzFlag::Return)
+            return result;
     }
-    return ERROR_NO_VALUE;
+    return GOOD_NO_VALUE;
 }
 
-/* 
-*   Utility Functions
-*/
-
-// UNUSED
-bool is_gnr(KvazzResult &kr) {
-    return kr.flag == KvazzFlag::Good && kr.kvazz_value.type == KvazzType::Nothing;
+/**
+ *  Runs a call to fn, and the calls its Returns leave in tail_call, without growing the stack
+ */
+KvazzResult Interpreter::run_function(KvazzFunction &fn, vector<KvazzValue> &arg_values) {
+    auto run_body = [this](KvazzFunction &callee, const shared_ptr<Env> &body_env) {
+        return run_statements(static_cast<Block*>(callee.body), body_env);
+    };
+    // memoized callees go through their cache and hot ones may run natively
+    auto intercept = [this](KvazzFunction &callee, vector<KvazzValue> &args, KvazzResult &result) {
+        if (jit != nullptr && jit->try_call(callee, args, result))
+            return true;
+        if (callee.memo == nullptr)
+            return false;
+        result = call_function(callee, args, *this);
+        return true;
+    };
+    return run_with_tail_calls(isolate, tail_call, fn, make_function_env(isolate, fn, arg_values), run_body, intercept);
 }
 
-// UNUSED
-bool is_numeric_type(KvazzType t) {
-    return t == KvazzType::Int || t == KvazzType::Real;
-}
+KvazzResult Interpreter::eval(AssignOp *node, const shared_ptr<Env> &env) {
 
-bool truthy_test(KvazzResult kr) {
-    /*
-     *  Truthy-falsey test for every valid type a kvazz expression could evaluate to.
-    */
-    auto type = kr.kvazz_value.type;
-    auto var_value = kr.kvazz_value.value;
+    // set the lvalue flag so that the next eval will return an lvalue
+    this->lvalue_flag = true;
+    auto lvalue_result = node->lvalue->eval(*this, env);
+    this->lvalue_flag = false;
+    if (lvalue_result.kvazz_value.type != KvazzType::LValue) {
+        return ERROR_NO_VALUE;
+    }
+    LValue lvalue = lvalue_result.kvazz_value.as_lvalue();
+    KvazzValue new_value = node->expr_node->eval(*this, env).kvazz_value;
 
-    switch(type) {
-        case KvazzType::Bool:
-            {
-                return std::get<bool>(var_value);
-            }
-        case KvazzType::Int:
-            {
-                auto int_value = std::get<int>(var_value);
-                return int_value == 0 ? false : true;
-            }
-        case KvazzType::String:
+    if (node->op_type != AssignOpType::assign) {
+        // the indices already ran when the lvalue was evaluated, so the old value is read through it
+        auto old_result = lvalue_value(lvalue);
+        if (old_result.flag != KvazzFlag::Good)
+            return ERROR_NO_VALUE;
+        KvazzValue old_value = std::move(old_result.kvazz_value);
+        switch(node->op_type) {
+            case AssignOpType::plus:
             {
-                auto str_value = std::get<string>(var_value);
-                return str_value.length() < 0 ? false : true;
+                new_value = kvazzvalue_plus(old_value, new_value).kvazz_value;
+                break;
             }
-        case KvazzType::Hevec:
+            case AssignOpType::minus:
             {
-                auto vec_value = std::get<vector<KvazzValue>>(var_value);
-                return vec_value.size() < 0 ? false : true;
+                new_value = kvazzvalue_minus(old_value, new_value).kvazz_value;
+                break;
             }
-        case KvazzType::Real:
+            case AssignOpType::divide:
             {
-                auto real_value = std::get<double>(var_value);
-                // floating point truthyness seems like a bad idea, but
-                // I'll put it here for the sake of completeness
-                return real_value == 0.0 ? false : true;
+                new_value = kvazzvalue_divide(old_value, new_value).kvazz_value;
+                break;
             }
-        case KvazzType::Nothing:
+            case AssignOpType::multiply:
             {
-                return false;
+                new_value = kvazzvalue_multiply(old_value, new_value).kvazz_value;
+                break;
             }
-        case KvazzType::Builtin:
-        case KvazzType::LValue:
-        default:
+            case AssignOpType::modulo:
             {
-                // give more info in the future
-                std::cerr << "Attempted bool test on invalid expression value.\n";
+                new_value = kvazzvalue_modulo(old_value, new_value).kvazz_value;
+                break;
             }
-    }
-    return false;
-}
-
-/////////////////////////////////////////////////////////////////////////////////////
-// KVAZZVALUE OPERATORS
-//
-/////////////////////////////////////////////////////////////////////////////////////
-
-KvazzResult kvazzvalue_plus(KvazzValue &kv1, KvazzValue &kv2) {
-    auto left_type = kv1.type;
-    auto right_type = kv2.type;
-    if(left_type == right_type) {
-        if(left_type == KvazzType::Int) {
-            return make_good_result(std::get<int>(kv1.value) + std::get<int>(kv2.value));
-        }
-        if(left_type == KvazzType::Real) {
-            return make_good_result(std::get<double>(kv1.value) + std::get<double>(kv2.value));
-        }
-        if(left_type == KvazzType::String) {
-            return make_good_result(std::get<string>(kv1.value) + std::get<string>(kv2.value));
-        }
-        if(left_type == KvazzType::Hevec) {
-            auto left_vec = std::get<vector<KvazzValue>>(kv1.value);
-            auto &right_vec = std::get<vector<KvazzValue>>(kv2.value);
-            left_vec.insert( left_vec.end(), right_vec.begin(), right_vec.end() );
-            return make_good_result(left_vec);
-        }
-    }
-    else if (left_type == KvazzType::Int) {
-        if(right_type == KvazzType::Real) {
-            auto left_value = std::get<int>(kv1.value);
-            auto right_value = std::get<double>(kv2.value);
-            return make_good_result(left_value + right_value);
+            default:
+            {}
         }
     }
-    else if (left_type == KvazzType::Real) {
-        if(right_type == KvazzType::Int) {
-            auto left_value = std::get<double>(kv1.value);
-            auto right_value = std::get<int>(kv2.value);
-            return make_good_result(left_value + right_value);
-        }
+
+    // the target is only resolved now, after the expression has run, since that may have copied or
+    // replaced the vector being assigned into
+    if (!assign_lvalue(isolate, std::move(lvalue), std::move(new_value))) {
+        return ERROR_NO_VALUE;
     }
 
-    return ERROR_NO_VALUE;
+    return GOOD_NO_VALUE;
 }
 
-
-KvazzResult kvazzvalue_modulo(KvazzValue &kv1, KvazzValue &kv2) {
-    if (kv1.type == KvazzType::Int && kv2.type == KvazzType::Int) {
-        return make_good_result(std::get<int>(kv1.value) % std::get<int>(kv2.value));
+KvazzResult Interpreter::eval(Declare *node, const shared_ptr<Env> &env) {
+    if (env->slots[node->slot].type == EnvResultType::Unbound) {
+        auto kv = node->expr_node->eval(*this, env).kvazz_value;
+        if (env == isolate.global_env)
+            wait_for_spawned_tasks();
+        env->slots[node->slot] = EnvEntry { EnvResultType::Value, std::move(kv) };
+        return GOOD_NO_VALUE;
     }
+    std::cerr << "Identifier \'" << node->identifier << "\' already defined in this scope\n";
     return ERROR_NO_VALUE;
 }
 
-KvazzResult kvazzvalue_divide(KvazzValue &kv1, KvazzValue &kv2) {
-    auto left_type = kv1.type;
-    auto right_type = kv2.type;
-    if (left_type == KvazzType::Int) {
-        auto left_value = std::get<int>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return make_good_result(left_value / right_value);
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return make_good_result(left_value / right_value);
-        }
-    }
-    else {
-        auto left_value = std::get<double>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return make_good_result(left_value / right_value);
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return make_good_result(left_value / right_value);
-        }
+KvazzResult Interpreter::eval(FunctionDeclare *node, const shared_ptr<Env> &env) {
+    if (env->slots[node->slot].type == EnvResultType::Unbound) {
+        wait_for_spawned_tasks();
+        env->slots[node->slot] = EnvEntry {
+            EnvResultType::Function,
+            // args are copied, the AST may be run again by another Isolate
+            KvazzFunction {
+                node->identifier,
+                node->args,
+                node->body,
+                node->memoized ? std::make_shared<MemoCache>() : nullptr
+            }
+        };
+        isolate.global_epoch = next_global_epoch();
+        return GOOD_NO_VALUE;
     }
+    std::cerr << "Identifier \'" << node->identifier << "\' already defined in this scope\n";
     return ERROR_NO_VALUE;
 }
 
-KvazzResult kvazzvalue_multiply(KvazzValue &kv1, KvazzValue &kv2) {
-    auto left_type = kv1.type;
-    auto right_type = kv2.type;
-    if (left_type == KvazzType::Int) {
-        auto left_value = std::get<int>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return make_good_result(left_value * right_value);
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return make_good_result(left_value * right_value);
-        }
-    }
-    else {
-        auto left_value = std::get<double>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return make_good_result(left_value * right_value);
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return make_good_result(left_value * right_value);
-        }
-    }
-    return ERROR_NO_VALUE;
+KvazzResult Interpreter::eval(Return *node, const shared_ptr<Env> &env) {
+    if (node->tail_call)
+        return eval_tail_call(static_cast<FunctionCall*>(node->expr_node), env);
+    auto expression_result = node->expr_node->eval(*this, env);
+    expression_result.flag = KvazzFlag::Return;
+    return expression_result;
 }
 
-KvazzResult kvazzvalue_minus(KvazzValue &kv1, KvazzValue &kv2) {
-    auto left_type = kv1.type;
-    auto right_type = kv2.type;
-    if (left_type == KvazzType::Int) {
-        auto left_value = std::get<int>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return make_good_result(left_value - right_value);
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return make_good_result(left_value - right_value);
-        }
-    }
-    else {
-        auto left_value = std::get<double>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return make_good_result(left_value - right_value);
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return make_good_result(left_value - right_value);
-        }
+/**
+ *  Evaluates the returned call node. A call to a Kvazz function is left in tail_call for the call running
+ *  the current function to make, anything else is called straight away.
+ */
+KvazzResult Interpreter::eval_tail_call(FunctionCall *node, const shared_ptr<Env> &env) {
+    auto callee = cached_global_callee(isolate, node);
+    KvazzResult callee_expr_result;
+    if (callee == nullptr) {
+        callee_expr_result = node->callee->eval(*this, env);
+        if (callee_expr_result.flag == KvazzFlag::Error)
+            return KvazzResult { NOTHING, KvazzFlag::Return };
     }
-    return ERROR_NO_VALUE;
-}
 
-bool kvazzvalue_less_equals(KvazzValue &kv1, KvazzValue &kv2) {
-    auto left_type = kv1.type;
-    auto right_type = kv2.type;
-    if (left_type == KvazzType::Int) {
-        auto left_value = std::get<int>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return left_value <= right_value;
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return left_value <= right_value;
-        }
-    }
-    else {
-        auto left_value = std::get<double>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return left_value <= right_value;
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return left_value <= right_value;
+    vector<KvazzValue> arg_values;
+    arg_values.reserve(node->expr_args.size());
+    for (auto &expr_arg : node->expr_args)
+        arg_values.push_back(expr_arg->eval(*this, env).kvazz_value);
+
+    if (callee == nullptr) {
+        auto &callee_value = callee_expr_result.kvazz_value;
+        if (callee_value.type == KvazzType::Builtin) {
+            auto result = call_builtin_function(callee_value.as_int(), arg_values);
+            result.flag = KvazzFlag::Return;
+            return result;
         }
+        if (callee_value.type != KvazzType::Function)
+            return KvazzResult { NOTHING, KvazzFlag::Return };
+        tail_call.function = callee_value.as_function();
+        callee = &tail_call.function;
     }
-    return false;
+    tail_call.callee = callee;
+    tail_call.args = std::move(arg_values);
+    tail_call.pending = true;
+    return KvazzResult { NOTHING, KvazzFlag::Return };
 }
 
-bool kvazzvalue_less_than(KvazzValue &kv1, KvazzValue &kv2) {
-    auto left_type = kv1.type;
-    auto right_type = kv2.type;
-    if (left_type == KvazzType::Int) {
-        auto left_value = std::get<int>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return left_value < right_value;
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return left_value < right_value;
-        }
-    }
-    else {
-        auto left_value = std::get<double>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return left_value < right_value;
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return left_value < right_value;
-        }
+KvazzResult Interpreter::eval(IfThen *node, const shared_ptr<Env> &env) {
+    if (truthy_test(node->condition->eval(*this, env))) {
+        return node->body->eval(*this, env);
     }
-    return false;
+    return GOOD_NO_VALUE;
 }
 
-bool kvazzvalue_greater_equals(KvazzValue &kv1, KvazzValue &kv2) {
-    auto left_type = kv1.type;
-    auto right_type = kv2.type;
-    if (left_type == KvazzType::Int) {
-        auto left_value = std::get<int>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return left_value >= right_value;
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return left_value >= right_value;
-        }
+KvazzResult Interpreter::eval(IfElse *node, const shared_ptr<Env> &env) {
+    if (truthy_test(node->condition->eval(*this, env))) {
+        return node->then_body->eval(*this, env);
     }
     else {
-        auto left_value = std::get<double>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return left_value >= right_value;
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return left_value >= right_value;
-        }
+        return node->else_body->eval(*this, env);
     }
-    return false;
 }
 
-bool kvazzvalue_greater_than(KvazzValue &kv1, KvazzValue &kv2) {
-    auto left_type = kv1.type;
-    auto right_type = kv2.type;
-    if (left_type == KvazzType::Int) {
-        auto left_value = std::get<int>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return left_value > right_value;
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return left_value > right_value;
-        }
-    }
-    else {
-        auto left_value = std::get<double>(kv1.value);
-        if(right_type == KvazzType::Int) {
-            auto right_value = std::get<int>(kv2.value);
-            return left_value > right_value;
-        }
-        else {
-            auto right_value = std::get<double>(kv2.value);
-            return left_value > right_value;
-        }
-    }
-    return false;
-}
-
-bool kvazzvalue_equals(KvazzValue &kv1, KvazzValue &kv2) {
-    auto left_type = kv1.type;
-    auto right_type = kv2.type;
-
-    if (left_type != right_type) {
-        if (left_type == KvazzType::Int && right_type == KvazzType::Real) {
-            auto left_value = std::get<int>(kv1.value);
-            auto right_value = std::get<double>(kv2.value);
-            return left_value == right_value;
-        }
-        else if (left_type == KvazzType::Real && right_type == KvazzType::Int) {
-            auto left_value = std::get<double>(kv1.value);
-            auto right_value = std::get<int>(kv2.value);
-            return left_value == right_value;
-        }
-        return false;
-    }
-
-    // from here on out left_type == right_type
-
-    if (left_type == KvazzType::Int) {
-        auto left_value = std::get<int>(kv1.value);
-        auto right_value = std::get<int>(kv2.value);
-        return left_value == right_value;
-    }
-
-    if (left_type == KvazzType::Real) {
-        auto left_value = std::get<double>(kv1.value);
-        auto right_value = std::get<double>(kv2.value);
-        return left_value == right_value;
-    }
-
-    if (left_type == KvazzType::String) {
-        auto left_value = std::get<string>(kv1.value);
-        auto right_value = std::get<string>(kv2.value);
-        return left_value == right_value;
-    }
-
-    if (left_type == KvazzType::Hevec) {
-        auto vec1 = std::get<vector<KvazzValue>>(kv1.value);
-        auto vec2 = std::get<vector<KvazzValue>>(kv2.value);
-        if(vec1.size() != vec2.size()) {
-            return false;
-        }
-
-        for (int i = 0; i < vec1.size(); ++i) {
-            if (!kvazzvalue_equals(vec1[i], vec2[i])) {
-                return false;
-            }
-        }
-        return true;
-    }
-    // last compare case for now. Not sure if I want to be able to compare functions or
-    // built ins... comparing AST might be interesting. Another compare operator x =@= y
-    // that checks whether or not x and y are the same object might be useful but hard to
-    // implement.
-    return false;
-}
-
-KvazzResult Kvazzvalue_unary_minus(KvazzValue &kv) {
-    if (kv.type == KvazzType::Int) {
-        return make_good_result( -std::get<int>(kv.value));
-    }
-    if(kv.type == KvazzType::Real) {
-       return make_good_result( -std::get<double>(kv.value));
-    }
-    return ERROR_NO_VALUE;
-}
-
-/////////////////////////////////////////////////////////////////////////////////////
-// BUILT-IN FUNCTIONS
-//
-/////////////////////////////////////////////////////////////////////////////////////
-
-KvazzResult execute_built_in_print(vector<KvazzValue> &args) {
-    // emulate python's print for now to keep both interpreters acting the same.
-    // Other print functions can act different.
-    int i = 0;
-    while (i < args.size() - 1) {
-        auto &item = args[i];
-        std::cout << kvazzvalue_as_string(item);
-        std::cout << " ";
-        ++i;
-    }
-    auto &last = args[i];
-    std::cout << kvazzvalue_as_string(last);
-    std::cout << "\n";
-    return GOOD_NO_VALUE;
-}
-
-KvazzResult execute_built_in_lengthof(vector<KvazzValue> &args) {
-    // number of args must equal 1
-    if (args.size() != 1) {
-        std::cerr
-            << "Wrong number of arguments passed to built-in function lengthof."
-            << "Expected: 1, Received: " << args.size() << "\n";
-    }
-    else {
-        auto &arg = args[0];
-
-        // arg must be some non-scalar type (only vector or string for now)
-        if (arg.type == KvazzType::Hevec) {
-            vector<KvazzValue> the_vector = std::get<vector<KvazzValue>>(arg.value);
-            int length = the_vector.size();
-            return make_good_result(length);
-        }
-        if (arg.type == KvazzType::String) {
-            string the_string = std::get<string>(arg.value);
-            int length = the_string.size();
-            return make_good_result(length);
-        }
-        std::cerr
-            << "Unsupported type for lengthof. Expected non-scalar type, Received: "
-            << kvazztype_as_string(arg.type) << "\n";
-    }
-    return ERROR_NO_VALUE;
-}
-
-KvazzResult execute_built_in_hevec(vector<KvazzValue> &args) {
-    if (args.size() > 0 && args.size() < 3) {
-        auto length_kvalue = args[0];
-        // length must be of type int
-        if (length_kvalue.type != KvazzType::Int) {
-            std::cerr
-                << "Invalid type given for hevec length. Expected: Int, Received: "
-                << kvazztype_as_string(length_kvalue.type) << "\n";
-            goto _HEVEC_ERROR;
-        }
-        int length = std::get<int>(length_kvalue.value);
-        auto default_kvalue = args.size() == 2 ? args[1] : NOTHING;
-        vector<KvazzValue> new_hevec(length);
-        for (int i = 0; i < length; ++i) {
-            new_hevec[i] = default_kvalue;
-        }
-        return make_good_result(new_hevec);
-    }
-    else {
-        std::cerr
-            << "Invalid number of args passed to built-in-function hevec. "
-            << "Expected: 1 or 2, Received: " << args.size() << "\n";
-    }
-    _HEVEC_ERROR:
-    return ERROR_NO_VALUE;
-}
-
-enum built_in_function_ids {
-    _print,
-    _lengthof,
-    _hevec
-    /*
-    _printf,
-    _println,
-    _hovec
-    */
-};
-
-unordered_map<string, int> built_in_function_table = {
-    {"print", _print},
-    {"lengthof", _lengthof},
-    {"hevec", _hevec},
-};
-
-string built_in_function_as_string(int id) {
-    switch (id) {
-        case _print:
-            return "print";
-        case _lengthof:
-            return "lengthof";
-        case _hevec:
-            return "hevec";
-    }
-    return "INVALID_BUILTIN";
-}
-
-/////////////////////////////////////////////////////////////////////////////////////
-// INTERPRETER
-//
-/////////////////////////////////////////////////////////////////////////////////////
-
-// maybe this should be part of the interpreter class
-
-shared_ptr<Env> null_env = shared_ptr<Env>(nullptr);
-shared_ptr<Env> global_env = std::make_shared<Env>(
-    std::move(null_env),
-    unordered_map<string, EnvEntry>{}
-);
-
-LookupResult lookup(string identifier, shared_ptr<Env> env) {
-    auto result = built_in_function_table.find(identifier);
-    if (result != built_in_function_table.end()) {
-        return LookupResult {
-            EnvEntry {
-                EnvResultType::Builtin,
-                KvazzValue {
-                    KvazzType::Builtin,
-                    result->second
-                }
-            },
-            nullptr
-        };
-    }
-
-    auto curr_env = env;
-    while (curr_env != nullptr) {
-        auto result = curr_env->table.find(identifier);
-        if (result != curr_env->table.end())
-            return LookupResult { result->second, curr_env };
-        curr_env = curr_env->parent;
-    }
-    
-    std::cerr << "Lookup of identifier " << identifier << " failed." << std::endl;
-    return LookupResult {
-        EnvEntry {
-            EnvResultType::Value,
-            NOTHING
-        },
-        curr_env
-    };
-}
-
-
-/**
- *  Calls the passed KvazzFunction with the specified args
- */
-KvazzResult call_function(
-        KvazzFunction &fn,
-        vector<KvazzValue> &arg_values,
-        /* shared_ptr<Env> env,    // unused for now since all functions are executed with global scope */
-        Interpreter &interpreter) {
-
-    unordered_map<string, EnvEntry> function_env_map;
-    auto argv_index = 0;
-    for (auto arg_name : fn.args) {
-        function_env_map.emplace(arg_name, EnvEntry {EnvResultType::Value, arg_values[argv_index]});
-        ++argv_index;
-    }
-    auto function_env = std::make_shared<Env> ( std::move(global_env), function_env_map );
-    return fn.body->eval(interpreter, function_env);
-}
-
-KvazzResult call_builtin_function (
-        int builtin_fn_id,
-        vector<KvazzValue> &arg_values) {
-
-    switch (builtin_fn_id) {
-        case _print:
-            return execute_built_in_print(arg_values);
-        case _lengthof:
-            return execute_built_in_lengthof(arg_values);
-        case _hevec:
-            return execute_built_in_hevec(arg_values);
-        default:{}
-    }
-    std::cerr << "Tried calling unknown built-in function with id: " << builtin_fn_id << " \n";
-    return ERROR_NO_VALUE;
-}
-
-/*
-*  AST-eval Interpreter class methods
-*/
-KvazzResult Interpreter::eval(BaseNode *node, shared_ptr<Env> env) {
-    std::cerr << "Eval not implemented for BaseNode\n";
-    return ERROR_NO_VALUE;
-}
-
-KvazzResult Interpreter::eval(Program *node, shared_ptr<Env> env) {
-    for (auto nd : node->children()) {
-        nd->eval(*this, env);
-    }
-
-    auto main_found = env->table.find("main");
-    if (main_found != env->table.end()) {
-        auto main_method = std::get<KvazzFunction>(main_found->second.contents);
-        vector<KvazzValue> args;
-        call_function(main_method, args, *this);
-    }
-    return GOOD_NO_VALUE;
-}
-
-KvazzResult Interpreter::eval(Block *node, shared_ptr<Env> env) {
-    auto local_env = std::make_shared<Env>(std::move(env), unordered_map<string, EnvEntry>{});
-    for (auto nd : node->children()) {
-        auto result = nd->eval(*this, local_env);
-        if (result.flag == KvazzFlag::Return)
-            return result;
-    }
-    return GOOD_NO_VALUE;
-}
-
-KvazzResult Interpreter::eval(AssignOp *node, shared_ptr<Env> env) {
-
-    // set the lvalue flag so that the next eval will return an lvalue
-    this->lvalue_flag = true;
-    LValue lvalue = std::get<LValue>(node->lvalue->eval(*this, env).kvazz_value.value);
-    KvazzValue new_value = node->expr_node->eval(*this, env).kvazz_value;
-
-    if (node->op_type != AssignOpType::assign) {
-        KvazzValue old_value = node->lvalue->eval(*this, env).kvazz_value;
-        switch(node->op_type) {
-            case AssignOpType::plus:
-            {
-                new_value = kvazzvalue_plus(old_value, new_value).kvazz_value;
-                break;
-            }
-            case AssignOpType::minus:
-            {
-                new_value = kvazzvalue_minus(old_value, new_value).kvazz_value;
-                break;
-            }
-            case AssignOpType::divide:
-            {
-                new_value = kvazzvalue_divide(old_value, new_value).kvazz_value;
-                break;
-            }
-            case AssignOpType::multiply:
-            {
-                new_value = kvazzvalue_multiply(old_value, new_value).kvazz_value;
-                break;
-            }
-            case AssignOpType::modulo:
-            {
-                new_value = kvazzvalue_modulo(old_value, new_value).kvazz_value;
-                break;
-            }
-            default:
-            {}
-        }
-    }
-
-    if (lvalue.type == KvazzType::Hevec) {
-        // not sure if this actually modifies the vector due to c++ copies
-        // may need to change lvalue to pass a reference or pointer
-        auto the_vector = std::get<vector<KvazzValue>*>(lvalue.lvalue);
-        auto index = std::get<int>(lvalue.index);
-        std::cout << "Vector index: " << index << " set to " << kvazzvalue_as_string(new_value) << "\n";
-        the_vector->at(index) = std::move(new_value);
-
-    }
-    else {
-        auto the_env = std::get<shared_ptr<Env>>(lvalue.lvalue);
-        auto index = std::get<string>(lvalue.index);
-        the_env->table[index] = EnvEntry { EnvResultType::Value, new_value };
-    }
-
-    return GOOD_NO_VALUE;
-}
-
-KvazzResult Interpreter::eval(Declare *node, shared_ptr<Env> env) {
-    auto result = env->table.find(node->identifier);
-    if (result == env->table.end()) {
-        auto kv = node->expr_node->eval(*this, env).kvazz_value;
-        env->table[node->identifier] = EnvEntry { EnvResultType::Value, std::move(kv) };
-        return GOOD_NO_VALUE;
-    }
-    std::cerr << "Identifier \'" << node->identifier << "\' already defined in this scope\n";
-    return ERROR_NO_VALUE;
-}
-
-KvazzResult Interpreter::eval(FunctionDeclare *node, shared_ptr<Env> env) {
-    auto result = env->table.find(node->identifier);
-    if (result == env->table.end()) {
-        env->table[node->identifier] = EnvEntry {
-            EnvResultType::Function,
-            KvazzFunction {
-                node->identifier,
-                std::move(node->args),
-                node->body
-            }
-        };
-        return GOOD_NO_VALUE;
-    }
-    std::cerr << "Identifier \'" << node->identifier << "\' already defined in this scope\n";
-    return ERROR_NO_VALUE;
-}
-
-KvazzResult Interpreter::eval(Return *node, shared_ptr<Env> env) {
-    auto expression_result = node->expr_node->eval(*this, env);
-    expression_result.flag = KvazzFlag::Return;
-    return expression_result;
-}
-
-KvazzResult Interpreter::eval(IfThen *node, shared_ptr<Env> env) {
-    if (truthy_test(node->condition->eval(*this, env))) {
-        return node->body->eval(*this, env);
-    }
-    return GOOD_NO_VALUE;
-}
-
-KvazzResult Interpreter::eval(IfElse *node, shared_ptr<Env> env) {
-    if (truthy_test(node->condition->eval(*this, env))) {
-        return node->then_body->eval(*this, env);
-    }
-    else {
-        return node->else_body->eval(*this, env);
-    }
-}
-
-KvazzResult Interpreter::eval(While *node, shared_ptr<Env> env) {
+KvazzResult Interpreter::eval(While *node, const shared_ptr<Env> &env) {
     while (truthy_test(node->condition->eval(*this, env))) {
         auto maybe_result = node->body->eval(*this, env);
         if(maybe_result.flag == KvazzFlag::Return)
@@ -980,21 +461,16 @@ KvazzResult Interpreter::eval(While *node, shared_ptr<Env> env) {
     return GOOD_NO_VALUE;
 }
 
-KvazzResult Interpreter::eval(BinaryOp *node, shared_ptr<Env> env) {
-    auto left = node->left_expr->eval(*this, env);
-    auto right = node->right_expr->eval(*this, env);
-
-    if (left.flag == KvazzFlag::Error || right.flag == KvazzFlag::Error) {
-        // might should do a system exit here... not sure, better error handling will come
-        return KvazzResult { NOTHING, KvazzFlag::Error };
-    }
-
+/**
+ *  Applies op to the operands of a BinaryOp, for any combination of operand types
+ */
+KvazzResult eval_generic_binary_op(BinaryOpType op, KvazzResult &left, KvazzResult &right) {
     // these should mostly all be broken out into their own functions once the logic has been figured out
     // since there's potential for a lot of code to be in here.
     // I want operators to have meaning on various types e.g. '+' is both arithemetic addition as well
     // as string and maybe array concat as well. So lots of type checking code will be involved in
     // operator code.
-    switch(node->op_type) {
+    switch(op) {
         case BinaryOpType::pipe:
         {
             // defined on all types through truthy/falsey -ness
@@ -1066,7 +542,118 @@ KvazzResult Interpreter::eval(BinaryOp *node, shared_ptr<Env> env) {
     return ERROR_NO_VALUE;
 }
 
-KvazzResult Interpreter::eval(UnaryOp *node, shared_ptr<Env> env) {
+/**
+ *  Specialized versions of eval_generic_binary_op for operands of the same type. Each one only handles
+ *  the operators specializable_binary_op allows for its type.
+ */
+inline KvazzResult eval_int_binary_op(BinaryOpType op, int left, int right) {
+    switch(op) {
+        case BinaryOpType::pipe:            return make_good_result(left != 0 || right != 0);
+        case BinaryOpType::amper:           return make_good_result(left != 0 && right != 0);
+        case BinaryOpType::equals:          return make_good_result(left == right);
+        case BinaryOpType::not_equals:      return make_good_result(left != right);
+        case BinaryOpType::less_equals:     return make_good_result(left <= right);
+        case BinaryOpType::greater_equals:  return make_good_result(left >= right);
+        case BinaryOpType::less_than:       return make_good_result(left < right);
+        case BinaryOpType::greater_than:    return make_good_result(left > right);
+        case BinaryOpType::plus:            return make_good_result(left + right);
+        case BinaryOpType::minus:           return make_good_result(left - right);
+        case BinaryOpType::multiply:        return make_good_result(left * right);
+        case BinaryOpType::divide:          return make_good_result(left / right);
+        case BinaryOpType::modulo:          return make_good_result(left % right);
+    }
+    return ERROR_NO_VALUE;
+}
+
+inline KvazzResult eval_real_binary_op(BinaryOpType op, double left, double right) {
+    switch(op) {
+        case BinaryOpType::pipe:            return make_good_result(left != 0.0 || right != 0.0);
+        case BinaryOpType::amper:           return make_good_result(left != 0.0 && right != 0.0);
+        case BinaryOpType::equals:          return make_good_result(left == right);
+        case BinaryOpType::not_equals:      return make_good_result(left != right);
+        case BinaryOpType::less_equals:     return make_good_result(left <= right);
+        case BinaryOpType::greater_equals:  return make_good_result(left >= right);
+        case BinaryOpType::less_than:       return make_good_result(left < right);
+        case BinaryOpType::greater_than:    return make_good_result(left > right);
+        case BinaryOpType::plus:            return make_good_result(left + right);
+        case BinaryOpType::minus:           return make_good_result(left - right);
+        case BinaryOpType::multiply:        return make_good_result(left * right);
+        case BinaryOpType::divide:          return make_good_result(left / right);
+        default:                            return ERROR_NO_VALUE;
+    }
+}
+
+KvazzResult eval_string_binary_op(BinaryOpType op, const string &left, const string &right) {
+    switch(op) {
+        case BinaryOpType::pipe:
+        case BinaryOpType::amper:           return make_good_result(true);
+        case BinaryOpType::equals:          return make_good_result(left == right);
+        case BinaryOpType::not_equals:      return make_good_result(left != right);
+        case BinaryOpType::plus:            return make_good_result(left + right);
+        default:                            return ERROR_NO_VALUE;
+    }
+}
+
+/**
+ *  The state a BinaryOp specializes to after seeing operands of type left and right, Generic if the
+ *  operator isn't defined for them or there's no specialized version
+ */
+BinaryOpState specializable_binary_op(BinaryOpType op, KvazzType left, KvazzType right) {
+    if (left != right)
+        return BinaryOpState::Generic;
+    if (left == KvazzType::Int)
+        return BinaryOpState::IntInt;
+    if (left == KvazzType::Real && op != BinaryOpType::modulo)
+        return BinaryOpState::RealReal;
+    if (left == KvazzType::String && (is_logical_binop(op) || is_equality_binop(op) || op == BinaryOpType::plus))
+        return BinaryOpState::StringString;
+    return BinaryOpState::Generic;
+}
+
+// like the callee caches, the specialization of a BinaryOp is left alone while worker threads run. Other
+// Isolates may run the node meanwhile, every state is safe to run with, so relaxed accesses do
+inline void respecialize(Isolate &isolate, BinaryOp *node, BinaryOpState state) {
+    if (!isolate.multithreaded.load(std::memory_order_relaxed))
+        node->state.store(state, std::memory_order_relaxed);
+}
+
+KvazzResult Interpreter::eval(BinaryOp *node, const shared_ptr<Env> &env) {
+    auto left = node->left_expr->eval(*this, env);
+    auto right = node->right_expr->eval(*this, env);
+
+    if (left.flag == KvazzFlag::Error || right.flag == KvazzFlag::Error) {
+        // might should do a system exit here... not sure, better error handling will come
+        return KvazzResult { NOTHING, KvazzFlag::Error };
+    }
+
+    auto &left_value = left.kvazz_value;
+    auto &right_value = right.kvazz_value;
+    switch(node->state.load(std::memory_order_relaxed)) {
+        case BinaryOpState::IntInt:
+            if (left_value.type == KvazzType::Int && right_value.type == KvazzType::Int)
+                return eval_int_binary_op(node->op_type, left_value.as_int(), right_value.as_int());
+            respecialize(isolate, node, BinaryOpState::Generic);
+            break;
+        case BinaryOpState::RealReal:
+            if (left_value.type == KvazzType::Real && right_value.type == KvazzType::Real)
+                return eval_real_binary_op(node->op_type, left_value.as_real(), right_value.as_real());
+            respecialize(isolate, node, BinaryOpState::Generic);
+            break;
+        case BinaryOpState::StringString:
+            if (left_value.type == KvazzType::String && right_value.type == KvazzType::String)
+                return eval_string_binary_op(node->op_type, left_value.as_string(), right_value.as_string());
+            respecialize(isolate, node, BinaryOpState::Generic);
+            break;
+        case BinaryOpState::Uninitialized:
+            respecialize(isolate, node, specializable_binary_op(node->op_type, left_value.type, right_value.type));
+            break;
+        case BinaryOpState::Generic:
+            break;
+    }
+    return eval_generic_binary_op(node->op_type, left, right);
+}
+
+KvazzResult Interpreter::eval(UnaryOp *node, const shared_ptr<Env> &env) {
     auto right = node->right_expr->eval(*this, env);
     if (right.flag == KvazzFlag::Error) {
         // might should do a system exit here... not sure, better error handling will come
@@ -1076,7 +663,7 @@ KvazzResult Interpreter::eval(UnaryOp *node, shared_ptr<Env> env) {
         case UnaryOpType::bang:
         {
             // defined on all valid types
-            return make_good_result(truthy_test(right));
+            return make_good_result(!truthy_test(right));
         }
         case UnaryOpType::minus:
         {
@@ -1088,7 +675,21 @@ KvazzResult Interpreter::eval(UnaryOp *node, shared_ptr<Env> env) {
 
 }
 
-KvazzResult Interpreter::eval(FunctionCall *node, shared_ptr<Env> env) {
+KvazzResult Interpreter::eval(FunctionCall *node, const shared_ptr<Env> &env) {
+    // calls to declared global functions skip evaluating the callee, which would copy the KvazzFunction
+    auto cached_function = cached_global_callee(isolate, node);
+    if (cached_function != nullptr) {
+        vector<KvazzValue> arg_values;
+        arg_values.reserve(node->expr_args.size());
+        for (auto &expr_arg : node->expr_args)
+            arg_values.push_back(expr_arg->eval(*this, env).kvazz_value);
+
+        KvazzResult jit_result;
+        if (jit != nullptr && jit->try_call(*cached_function, arg_values, jit_result))
+            return jit_result;
+        return call_function(*cached_function, arg_values, *this);
+    }
+
     auto callee_expr_result = node->callee->eval(*this, env);
     if (callee_expr_result.flag != KvazzFlag::Error) {
         vector<KvazzValue> arg_values;
@@ -1096,11 +697,14 @@ KvazzResult Interpreter::eval(FunctionCall *node, shared_ptr<Env> env) {
             arg_values.push_back(expr_arg->eval(*this, env).kvazz_value);
 
         if (callee_expr_result.kvazz_value.type == KvazzType::Function) {
-            auto function = std::get<KvazzFunction>(callee_expr_result.kvazz_value.value);
+            auto function = callee_expr_result.kvazz_value.as_function();
+            KvazzResult jit_result;
+            if (jit != nullptr && jit->try_call(function, arg_values, jit_result))
+                return jit_result;
             return call_function(function, arg_values, *this);
         }
         if (callee_expr_result.kvazz_value.type == KvazzType::Builtin) {
-            auto builtin_function_id = std::get<int>(callee_expr_result.kvazz_value.value);
+            auto builtin_function_id = callee_expr_result.kvazz_value.as_int();
             return call_builtin_function(builtin_function_id, arg_values);
         }
     }
@@ -1108,105 +712,105 @@ KvazzResult Interpreter::eval(FunctionCall *node, shared_ptr<Env> env) {
     return ERROR_NO_VALUE;
 }
 
-KvazzResult Interpreter::eval(Access *node, shared_ptr<Env> env) {
+KvazzResult Interpreter::eval(Access *node, const shared_ptr<Env> &env) {
     // Take note that the lvalue flag was set, and then turn it off so that subsequent eval
     // calls don't return an lvalue, e.g. vector[index1][index2]
     auto was_lvalue_flag_set = this->lvalue_flag;
     this->lvalue_flag = false;
 
-    auto left_expr_result = node->left_expr->eval(*this, env);
-    auto index_expr_result = node->index_expr->eval(*this, env);
-    if (index_expr_result.kvazz_value.type == KvazzType::Int) {
-        if(left_expr_result.kvazz_value.type == KvazzType::Hevec) {
-            vector<KvazzValue> the_vec = std::get<vector<KvazzValue>>(left_expr_result.kvazz_value.value);
-            auto index = std::get<int>(index_expr_result.kvazz_value.value);
-            if (index < the_vec.size()) {
-                if (was_lvalue_flag_set) {
-                    // make an lvalue and return that instead
-                    LValue lvalue { KvazzType::Hevec, &the_vec, index };
-                    return make_good_result(lvalue);
-                } else {
-                    return make_good_result(the_vec[index]);
-                }
-            }
-            else {
-                std::cerr << "Index " << index << " out of bounds for vector";
-            }
-        }
-        if(left_expr_result.kvazz_value.type == KvazzType::String) {
-            string the_string = std::get<string>(left_expr_result.kvazz_value.value);
-            auto index = std::get<int>(index_expr_result.kvazz_value.value);
-            if (index < the_string.length()) {
-                if (was_lvalue_flag_set) {
-                    // make an lvalue and return that instead
-                    std::cerr << "Strings are immutable, assigning to index is not supported.\n";
-                }
-                else {
-                    return make_good_result(the_string.substr(index, 1));
-                }
-            }
-            else {
-                std::cerr << "Index " << index << " out of bounds for \"" << the_string << "\"";
-            }
-        }
+    if (was_lvalue_flag_set) {
+        // evaluate the accessee as an lvalue as well, so that the resulting LValue refers to the
+        // variable being assigned to rather than to a temporary copy
+        auto left_type = node->left_expr->type();
+        if (left_type != NodeType::VariableLookup && left_type != NodeType::Access) {
+            std::cerr << "Invalid assignment target.\n";
+            return ERROR_NO_VALUE;
+        }
+        this->lvalue_flag = true;
+        auto left_lvalue_result = node->left_expr->eval(*this, env);
+        this->lvalue_flag = false;
+        auto index_values = eval_indices(node, env);
+        if (left_lvalue_result.kvazz_value.type != KvazzType::LValue) {
+            return ERROR_NO_VALUE;
+        }
+
+        // indices are only checked against the target when storing, after the right hand side has run
+        auto lvalue = left_lvalue_result.kvazz_value.as_lvalue();
+        for (auto &index_value : index_values) {
+            if (index_value.type != KvazzType::Int)
+                return ERROR_NO_VALUE;
+            lvalue.indices.push_back(index_value.as_int());
+        }
+        return make_good_result(lvalue);
     }
-    // when dictionaries are added, other types of index values may be valid too
 
-    return ERROR_NO_VALUE;
+    auto left_expr_result = node->left_expr->eval(*this, env);
+    auto index_values = eval_indices(node, env);
+    if (index_values.size() == 1)
+        return kvazzvalue_index(left_expr_result.kvazz_value, index_values[0]);
+    return kvazzvalue_index(left_expr_result.kvazz_value, index_values.data(), index_values.size());
+}
+
+vector<KvazzValue> Interpreter::eval_indices(Access *node, const shared_ptr<Env> &env) {
+    vector<KvazzValue> index_values;
+    index_values.reserve(node->index_exprs.size());
+    for (auto &index_expr : node->index_exprs)
+        index_values.push_back(index_expr->eval(*this, env).kvazz_value);
+    return index_values;
 }
 
-KvazzResult Interpreter::eval(VariableLookup *node, shared_ptr<Env> env) {
+KvazzResult Interpreter::eval(VariableLookup *node, const shared_ptr<Env> &env) {
     auto was_lvalue_flag_set = this->lvalue_flag;
     this->lvalue_flag = false;
 
-    auto env_to_use = node->sigil ? global_env : env;
-    auto lookup_result = lookup(node->identifier, env_to_use);
-    if (lookup_result.result.type == EnvResultType::Value) {
+    if (node->resolution == Resolution::Builtin) {
         if (was_lvalue_flag_set) {
-            LValue lvalue {KvazzType::Nothing, lookup_result.env, node->identifier};
-            return make_good_result(lvalue);
+            // Maybe in the future this will change
+            std::cerr << "Built-in functions cannot be reassigned.\n";
+            return ERROR_NO_VALUE;
         }
-        return make_good_result(std::get<KvazzValue>(lookup_result.result.contents));
+        return KvazzResult { KvazzValue { KvazzType::Builtin, node->slot }, KvazzFlag::Good };
+    }
+
+    auto entry = lookup(isolate, node, env.get());
+    if (entry == nullptr) {
+        // a failed lookup evaluates to Nothing, but can't be assigned to
+        return was_lvalue_flag_set ? ERROR_NO_VALUE : GOOD_NO_VALUE;
     }
-    if (lookup_result.result.type == EnvResultType::Function) {
+    if (entry->type == EnvResultType::Value) {
         if (was_lvalue_flag_set) {
-            // Maybe in the future this will change
-            std::cerr << "Functions cannot be reassigned.\n";
-        }
-        else {
-            return make_good_result(std::get<KvazzFunction>(lookup_result.result.contents));
+            LValue lvalue { resolve_env(isolate, node, env.get()), node->slot, {} };
+            return make_good_result(lvalue);
         }
+        return make_good_result(std::get<KvazzValue>(entry->contents));
     }
-    if (lookup_result.result.type == EnvResultType::Builtin) {
+    if (entry->type == EnvResultType::Function) {
         if (was_lvalue_flag_set) {
             // Maybe in the future this will change
-            std::cerr << "Built-in functions cannot be reassigned.\n";
+            std::cerr << "Functions cannot be reassigned.\n";
         }
         else {
-            return KvazzResult {
-                std::get<KvazzValue>(lookup_result.result.contents),
-                KvazzFlag::Good
-            };
+            return make_good_result(std::get<KvazzFunction>(entry->contents));
         }
     }
     return ERROR_NO_VALUE;
 }
 
-KvazzResult Interpreter::eval(IntLiteral *node, shared_ptr<Env> env) {
+KvazzResult Interpreter::eval(IntLiteral *node, const shared_ptr<Env> &env) {
     return make_good_result(node->literal_value);
 }
 
-KvazzResult Interpreter::eval(BoolLiteral *node, shared_ptr<Env> env) {
+KvazzResult Interpreter::eval(BoolLiteral *node, const shared_ptr<Env> &env) {
     return make_good_result(node->literal_value);
 }
 
-KvazzResult Interpreter::eval(RealLiteral *node, shared_ptr<Env> env) {
+KvazzResult Interpreter::eval(RealLiteral *node, const shared_ptr<Env> &env) {
     return make_good_result(node->literal_value);
 }
-KvazzResult Interpreter::eval(StringLiteral *node, shared_ptr<Env> env) {
+KvazzResult Interpreter::eval(StringLiteral *node, const shared_ptr<Env> &env) {
     return make_good_result(node->literal_value);
 }
-KvazzResult Interpreter::eval(VectorLiteral *node, shared_ptr<Env> env) {
+KvazzResult Interpreter::eval(VectorLiteral *node, const shared_ptr<Env> &env) {
     vector<KvazzValue> results;
     for(auto nd : node->contents) {
         auto result = nd->eval(*this, env);
@@ -1214,12 +818,825 @@ KvazzResult Interpreter::eval(VectorLiteral *node, shared_ptr<Env> env) {
             results.push_back(result.kvazz_value);
         }
     }
+    if (node->homogeneous) {
+        return make_hovec(results);
+    }
     return make_good_result(std::move(results));
 }
 
 // Entry point method
-void run_ast_interpreter(std::shared_ptr<BaseNode> ast) {
-    Interpreter i;
-    auto result = ast->eval(i, global_env);
+void run_ast_interpreter(Isolate &isolate, BaseNode *ast, bool use_jit) {
+    IsolateScope scope { isolate };
+    Jit jit { isolate.global_env };
+    Interpreter i { isolate, use_jit ? &jit : nullptr };
+    // callbacks from parallel built-ins run on an Interpreter of their own on each thread
+    isolate.set_function_caller_factory([&isolate] {
+        auto interpreter = std::make_shared<Interpreter>(isolate);
+        return FunctionCaller { [interpreter](KvazzValue &callee, vector<KvazzValue> &args) {
+            return call_function(callee.as_function(), args, *interpreter);
+        } };
+    });
+    auto result = ast->eval(i, isolate.global_env);
+    wait_for_spawned_tasks();
     // Todo: print something about the result?
 }
+
+/////////////////////////////////////////////////////////////////////////////////////
+// CLOSURE COMPILER
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+*  Closures do at compile time whatever the Interpreter decides per visit: variables are read from the
+*  slot their resolution names, operators with Int or Real operands are computed inline like the
+*  Interpreter's specialized BinaryOps, and the generic runtime functions are only the fallback.
+*/
+
+/*
+*  An operand of a BinaryOp. Literals and variables of the operator's own frame are read without calling
+*  a closure, anything else, and a variable that doesn't hold a value, runs the operand's closure.
+*/
+struct Operand
+{
+    enum class Kind { Expression, Constant, Local };
+    Kind kind = Kind::Expression;
+    Closure closure;
+    KvazzValue constant;
+    int slot = 0;
+};
+
+Operand make_operand(BaseNode *node, Closure closure) {
+    Operand operand;
+    operand.closure = std::move(closure);
+    switch (node->type()) {
+        case NodeType::IntLiteral:
+            operand.kind = Operand::Kind::Constant;
+            operand.constant = KvazzValue { KvazzType::Int, static_cast<IntLiteral*>(node)->literal_value };
+            break;
+        case NodeType::RealLiteral:
+            operand.kind = Operand::Kind::Constant;
+            operand.constant = KvazzValue { KvazzType::Real, static_cast<RealLiteral*>(node)->literal_value };
+            break;
+        case NodeType::VariableLookup:
+        {
+            auto variable = static_cast<VariableLookup*>(node);
+            if (variable->resolution == Resolution::Local && variable->depth == 0) {
+                operand.kind = Operand::Kind::Local;
+                operand.slot = variable->slot;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return operand;
+}
+
+// the value of operand if it's a constant or a variable holding a value, otherwise nullptr
+inline KvazzValue *operand_in_place(Operand &operand, const shared_ptr<Env> &env) {
+    if (operand.kind == Operand::Kind::Constant)
+        return &operand.constant;
+    if (operand.kind == Operand::Kind::Local) {
+        auto &entry = env->slots[operand.slot];
+        if (entry.type == EnvResultType::Value)
+            return &std::get<KvazzValue>(entry.contents);
+    }
+    return nullptr;
+}
+
+/**
+ *  The closure for binary operator Op. operation handles the operand types without a fast path
+ */
+template <BinaryOpType Op, typename Operation>
+Closure make_binary_closure(Operand left, Operand right, Operation operation) {
+    // the left operand is only read in place when no expression on the right runs before it is used
+    bool left_in_place = right.kind != Operand::Kind::Expression;
+    return [left = std::move(left), right = std::move(right), left_in_place, operation]
+        (const shared_ptr<Env> &env) mutable -> KvazzResult {
+        auto left_value = left_in_place ? operand_in_place(left, env) : nullptr;
+        auto left_result = left_value == nullptr ? left.closure(env) : KvazzResult { KvazzValue {}, KvazzFlag::Good };
+        auto right_value = operand_in_place(right, env);
+        auto right_result = right_value == nullptr ? right.closure(env) : KvazzResult { KvazzValue {}, KvazzFlag::Good };
+        if (left_result.flag == KvazzFlag::Error || right_result.flag == KvazzFlag::Error) {
+            return KvazzResult { NOTHING, KvazzFlag::Error };
+        }
+        auto &left_operand = left_value != nullptr ? *left_value : left_result.kvazz_value;
+        auto &right_operand = right_value != nullptr ? *right_value : right_result.kvazz_value;
+        if constexpr (Op != BinaryOpType::pipe && Op != BinaryOpType::amper) {
+            if (left_operand.type == KvazzType::Int && right_operand.type == KvazzType::Int)
+                return eval_int_binary_op(Op, left_operand.as_int(), right_operand.as_int());
+            if constexpr (Op != BinaryOpType::modulo) {
+                if (left_operand.type == KvazzType::Real && right_operand.type == KvazzType::Real)
+                    return eval_real_binary_op(Op, left_operand.as_real(), right_operand.as_real());
+            }
+        }
+        return operation(left_operand, right_operand);
+    };
+}
+
+// truthy_test without the call for the Bools conditions usually are
+inline bool condition_holds(KvazzResult &result) {
+    if (result.kvazz_value.type == KvazzType::Bool)
+        return result.kvazz_value.as_bool();
+    return truthy_test(result.kvazz_value);
+}
+
+// the KvazzValue in entry, nullptr for functions and unbound names, which take the slow way with its errors
+inline KvazzValue *entry_value(EnvEntry &entry) {
+    return entry.type == EnvResultType::Value ? std::get_if<KvazzValue>(&entry.contents) : nullptr;
+}
+
+inline Env *frame_at(Env *env, int depth) {
+    for (int i = 0; i < depth; ++i)
+        env = env->parent.get();
+    return env;
+}
+
+Closure constant_closure(KvazzResult result) {
+    return [result = std::move(result)](const shared_ptr<Env> &env) -> KvazzResult {
+        return result;
+    };
+}
+
+Closure ClosureCompiler::compile(BaseNode *node) {
+    switch(node->type()) {
+        case NodeType::Program:         return compile_program(static_cast<Program*>(node));
+        case NodeType::Block:           return compile_block(static_cast<Block*>(node));
+        case NodeType::AssignOp:        return compile_assign(static_cast<AssignOp*>(node));
+        case NodeType::Declare:         return compile_declare(static_cast<Declare*>(node));
+        case NodeType::FunctionDeclare: return compile_function_declare(static_cast<FunctionDeclare*>(node));
+        case NodeType::BinaryOp:        return compile_binary_op(static_cast<BinaryOp*>(node));
+        case NodeType::UnaryOp:         return compile_unary_op(static_cast<UnaryOp*>(node));
+        case NodeType::FunctionCall:    return compile_function_call(static_cast<FunctionCall*>(node));
+        case NodeType::Access:          return compile_access(static_cast<Access*>(node));
+        case NodeType::VariableLookup:  return compile_variable_lookup(static_cast<VariableLookup*>(node));
+        case NodeType::Return:
+        {
+            auto ret = static_cast<Return*>(node);
+            if (ret->tail_call)
+                return compile_tail_call(static_cast<FunctionCall*>(ret->expr_node));
+            auto expr = compile(ret->expr_node);
+            return [expr = std::move(expr)](const shared_ptr<Env> &env) -> KvazzResult {
+                auto expression_result = expr(env);
+                expression_result.flag = KvazzFlag::Return;
+                return expression_result;
+            };
+        }
+        case NodeType::IfThen:
+        {
+            auto if_then = static_cast<IfThen*>(node);
+            auto condition = compile(if_then->condition);
+            auto body = compile(if_then->body);
+            return [condition = std::move(condition), body = std::move(body)](const shared_ptr<Env> &env) -> KvazzResult {
+                auto condition_result = condition(env);
+                if (condition_holds(condition_result)) {
+                    return body(env);
+                }
+                return GOOD_NO_VALUE;
+            };
+        }
+        case NodeType::IfElse:
+        {
+            auto if_else = static_cast<IfElse*>(node);
+            auto condition = compile(if_else->condition);
+            auto then_body = compile(if_else->then_body);
+            auto else_body = compile(if_else->else_body);
+            return [condition = std::move(condition), then_body = std::move(then_body), else_body = std::move(else_body)]
+                (const shared_ptr<Env> &env) -> KvazzResult {
+                auto condition_result = condition(env);
+                if (condition_holds(condition_result)) {
+                    return then_body(env);
+                }
+                return else_body(env);
+            };
+        }
+        case NodeType::While:
+        {
+            auto while_node = static_cast<While*>(node);
+            auto condition = compile(while_node->condition);
+            auto body = compile(while_node->body);
+            return [condition = std::move(condition), body = std::move(body)](const shared_ptr<Env> &env) -> KvazzResult {
+                while (true) {
+                    auto condition_result = condition(env);
+                    if (!condition_holds(condition_result))
+                        break;
+                    auto maybe_result = body(env);
+                    if (maybe_result.flag == KvazzFlag::Return)
+                        return maybe_result;
+                }
+                return GOOD_NO_VALUE;
+            };
+        }
+        case NodeType::IntLiteral:    return constant_closure(make_good_result(static_cast<IntLiteral*>(node)->literal_value));
+        case NodeType::BoolLiteral:   return constant_closure(make_good_result(static_cast<BoolLiteral*>(node)->literal_value));
+        case NodeType::RealLiteral:   return constant_closure(make_good_result(static_cast<RealLiteral*>(node)->literal_value));
+        case NodeType::StringLiteral: return constant_closure(make_good_result(static_cast<StringLiteral*>(node)->literal_value));
+        case NodeType::VectorLiteral:
+        {
+            auto vector_literal = static_cast<VectorLiteral*>(node);
+            vector<Closure> contents;
+            for (auto &nd : vector_literal->contents)
+                contents.push_back(compile(nd));
+            return [contents = std::move(contents), homogeneous = vector_literal->homogeneous](const shared_ptr<Env> &env) -> KvazzResult {
+                vector<KvazzValue> results;
+                results.reserve(contents.size());
+                for (auto &element : contents) {
+                    auto result = element(env);
+                    if (result.flag == KvazzFlag::Good) {
+                        results.push_back(std::move(result.kvazz_value));
+                    }
+                }
+                if (homogeneous)
+                    return make_hovec(results);
+                return make_good_result(std::move(results));
+            };
+        }
+    }
+    std::cerr << "Eval not implemented for BaseNode\n";
+    return constant_closure(ERROR_NO_VALUE);
+}
+
+Closure ClosureCompiler::compile_program(Program *node) {
+    vector<Closure> top_level;
+    for (auto &nd : node->statements())
+        top_level.push_back(compile(nd));
+
+    return [this, top_level = std::move(top_level), num_slots = node->num_slots, main_slot = node->main_slot]
+        (const shared_ptr<Env> &env) -> KvazzResult {
+        env->slots.resize(num_slots, UNBOUND_ENTRY);
+        isolate.global_epoch = next_global_epoch();
+        for (auto &stmt : top_level) {
+            stmt(env);
+        }
+
+        if (main_slot >= 0 && env->slots[main_slot].type == EnvResultType::Function) {
+            auto &main_method = std::get<KvazzFunction>(env->slots[main_slot].contents);
+            vector<KvazzValue> args;
+            call(main_method, args);
+        }
+        return GOOD_NO_VALUE;
+    };
+}
+
+static KvazzResult run_statements(const vector<Closure> &stmts, const shared_ptr<Env> &env) {
+    for (auto &stmt : stmts) {
+        auto result = stmt(env);
+        if (result.flag == KvazzFlag::Return)
+            return result;
+    }
+    return GOOD_NO_VALUE;
+}
+
+Closure ClosureCompiler::compile_block(Block *node) {
+    if (!node->scoped)
+        return compile_statements(node);
+
+    vector<Closure> stmts;
+    for (auto &nd : node->statements())
+        stmts.push_back(compile(nd));
+
+    return [stmts = std::move(stmts), num_slots = node->num_slots](const shared_ptr<Env> &env) -> KvazzResult {
+        auto local_env = make_env(env, num_slots);
+        return run_statements(stmts, local_env);
+    };
+}
+
+// like compile_block, but the closure runs in the Env it's passed instead of making one. Used for function bodies
+// and for blocks without a scope
+Closure ClosureCompiler::compile_statements(Block *node) {
+    vector<Closure> stmts;
+    for (auto &nd : node->statements())
+        stmts.push_back(compile(nd));
+
+    return [stmts = std::move(stmts)](const shared_ptr<Env> &env) -> KvazzResult {
+        return run_statements(stmts, env);
+    };
+}
+
+// the operator a compound assignment applies, nullptr for plain assignment
+KvazzResult (*compound_operation(AssignOpType op_type))(KvazzValue&, KvazzValue&) {
+    switch(op_type) {
+        case AssignOpType::plus:     return kvazzvalue_plus;
+        case AssignOpType::minus:    return kvazzvalue_minus;
+        case AssignOpType::divide:   return kvazzvalue_divide;
+        case AssignOpType::multiply: return kvazzvalue_multiply;
+        case AssignOpType::modulo:   return kvazzvalue_modulo;
+        default:                     return nullptr;
+    }
+}
+
+/**
+ *  target Op= expr, with the same Int and Real fast paths as make_binary_closure
+ */
+template <BinaryOpType Op>
+Closure make_compound_assign(LValueClosure target, Closure expr, KvazzResult (*operation)(KvazzValue&, KvazzValue&)) {
+    return [target = std::move(target), expr = std::move(expr), operation](const shared_ptr<Env> &env) -> KvazzResult {
+        auto new_value = expr(env).kvazz_value;
+        auto target_value = target(env);
+        if (target_value == nullptr)
+            return ERROR_NO_VALUE;
+        if (target_value->type == KvazzType::Int && new_value.type == KvazzType::Int) {
+            *target_value = eval_int_binary_op(Op, target_value->as_int(), new_value.as_int()).kvazz_value;
+            return GOOD_NO_VALUE;
+        }
+        if constexpr (Op != BinaryOpType::modulo) {
+            if (target_value->type == KvazzType::Real && new_value.type == KvazzType::Real) {
+                *target_value = eval_real_binary_op(Op, target_value->as_real(), new_value.as_real()).kvazz_value;
+                return GOOD_NO_VALUE;
+            }
+        }
+        *target_value = operation(*target_value, new_value).kvazz_value;
+        return GOOD_NO_VALUE;
+    };
+}
+
+Closure ClosureCompiler::compile_assign(AssignOp *node) {
+    if (node->lvalue->type() == NodeType::Access)
+        return compile_index_assign(node);
+    auto target = compile_lvalue(node->lvalue);
+    auto expr = compile(node->expr_node);
+
+    // the new value is computed before the target is resolved, so a call in the expression that
+    // reassigns the variable can't leave the target pointing at a replaced vector
+    if (node->op_type == AssignOpType::assign) {
+        return [target = std::move(target), expr = std::move(expr)](const shared_ptr<Env> &env) -> KvazzResult {
+            auto new_value = expr(env).kvazz_value;
+            auto target_value = target(env);
+            if (target_value == nullptr)
+                return ERROR_NO_VALUE;
+            *target_value = std::move(new_value);
+            return GOOD_NO_VALUE;
+        };
+    }
+
+    auto operation = compound_operation(node->op_type);
+    switch(node->op_type) {
+        case AssignOpType::plus:     return make_compound_assign<BinaryOpType::plus>(std::move(target), std::move(expr), operation);
+        case AssignOpType::minus:    return make_compound_assign<BinaryOpType::minus>(std::move(target), std::move(expr), operation);
+        case AssignOpType::multiply: return make_compound_assign<BinaryOpType::multiply>(std::move(target), std::move(expr), operation);
+        case AssignOpType::divide:   return make_compound_assign<BinaryOpType::divide>(std::move(target), std::move(expr), operation);
+        default:                     return make_compound_assign<BinaryOpType::modulo>(std::move(target), std::move(expr), operation);
+    }
+}
+
+/**
+ *  Assignment to variable[i][j, k]... The Access chain is flattened to the variable and its indices,
+ *  and the value stored through them by the runtime, since Hovec elements aren't KvazzValues that a
+ *  pointer could refer to.
+ */
+Closure ClosureCompiler::compile_index_assign(AssignOp *node) {
+    vector<Closure> indices;
+    auto target_node = node->lvalue;
+    while (target_node->type() == NodeType::Access) {
+        auto access = static_cast<Access*>(target_node);
+        for (auto it = access->index_exprs.rbegin(); it != access->index_exprs.rend(); ++it)
+            indices.insert(indices.begin(), compile(*it));
+        target_node = access->left_expr;
+    }
+    auto target = compile_lvalue(target_node);
+    auto expr = compile(node->expr_node);
+    auto operation = compound_operation(node->op_type);
+    return [target = std::move(target), indices = std::move(indices), expr = std::move(expr), operation]
+        (const shared_ptr<Env> &env) -> KvazzResult {
+        // the indices run before the right hand side, like the Interpreter's lvalue
+        vector<KvazzValue> index_values;
+        index_values.reserve(indices.size());
+        for (auto &index : indices)
+            index_values.push_back(index(env).kvazz_value);
+        auto new_value = expr(env).kvazz_value;
+        auto target_value = target(env);
+        if (target_value == nullptr)
+            return ERROR_NO_VALUE;
+        if (operation != nullptr) {
+            auto old_result = kvazzvalue_index(*target_value, index_values.data(), index_values.size());
+            if (old_result.flag != KvazzFlag::Good)
+                return ERROR_NO_VALUE;
+            new_value = operation(old_result.kvazz_value, new_value).kvazz_value;
+        }
+        if (!kvazzvalue_store_index(*target_value, index_values, std::move(new_value)))
+            return ERROR_NO_VALUE;
+        return GOOD_NO_VALUE;
+    };
+}
+
+Closure ClosureCompiler::compile_declare(Declare *node) {
+    auto expr = compile(node->expr_node);
+    return [this, identifier = node->identifier, slot = node->slot, expr = std::move(expr)](const shared_ptr<Env> &env) -> KvazzResult {
+        if (env->slots[slot].type == EnvResultType::Unbound) {
+            auto kv = expr(env).kvazz_value;
+            if (env == isolate.global_env)
+                wait_for_spawned_tasks();
+            env->slots[slot] = EnvEntry { EnvResultType::Value, std::move(kv) };
+            return GOOD_NO_VALUE;
+        }
+        std::cerr << "Identifier \'" << identifier << "\' already defined in this scope\n";
+        return ERROR_NO_VALUE;
+    };
+}
+
+Closure ClosureCompiler::compile_function_declare(FunctionDeclare *node) {
+    function_bodies.emplace(node->body, compile_statements(static_cast<Block*>(node->body)));
+    KvazzFunction function {
+        node->identifier, node->args, node->body, node->memoized ? std::make_shared<MemoCache>() : nullptr
+    };
+    return [this, function = std::move(function), slot = node->slot](const shared_ptr<Env> &env) -> KvazzResult {
+        if (env->slots[slot].type == EnvResultType::Unbound) {
+            wait_for_spawned_tasks();
+            env->slots[slot] = EnvEntry { EnvResultType::Function, function };
+            isolate.global_epoch = next_global_epoch();
+            return GOOD_NO_VALUE;
+        }
+        std::cerr << "Identifier \'" << function.name << "\' already defined in this scope\n";
+        return ERROR_NO_VALUE;
+    };
+}
+
+Closure ClosureCompiler::compile_binary_op(BinaryOp *node) {
+    auto left = make_operand(node->left_expr, compile(node->left_expr));
+    auto right = make_operand(node->right_expr, compile(node->right_expr));
+
+    switch(node->op_type) {
+        case BinaryOpType::pipe:
+            return make_binary_closure<BinaryOpType::pipe>(std::move(left), std::move(right), [](KvazzValue &l, KvazzValue &r) {
+                return make_good_result(truthy_test(l) || truthy_test(r));
+            });
+        case BinaryOpType::amper:
+            return make_binary_closure<BinaryOpType::amper>(std::move(left), std::move(right), [](KvazzValue &l, KvazzValue &r) {
+                return make_good_result(truthy_test(l) && truthy_test(r));
+            });
+        case BinaryOpType::equals:
+            return make_binary_closure<BinaryOpType::equals>(std::move(left), std::move(right), [](KvazzValue &l, KvazzValue &r) {
+                return make_good_result(kvazzvalue_equals(l, r));
+            });
+        case BinaryOpType::not_equals:
+            return make_binary_closure<BinaryOpType::not_equals>(std::move(left), std::move(right), [](KvazzValue &l, KvazzValue &r) {
+                return make_good_result(!kvazzvalue_equals(l, r));
+            });
+        case BinaryOpType::less_equals:
+            return make_binary_closure<BinaryOpType::less_equals>(std::move(left), std::move(right), [](KvazzValue &l, KvazzValue &r) {
+                return make_good_result(kvazzvalue_less_equals(l, r));
+            });
+        case BinaryOpType::greater_equals:
+            return make_binary_closure<BinaryOpType::greater_equals>(std::move(left), std::move(right), [](KvazzValue &l, KvazzValue &r) {
+                return make_good_result(kvazzvalue_greater_equals(l, r));
+            });
+        case BinaryOpType::less_than:
+            return make_binary_closure<BinaryOpType::less_than>(std::move(left), std::move(right), [](KvazzValue &l, KvazzValue &r) {
+                return make_good_result(kvazzvalue_less_than(l, r));
+            });
+        case BinaryOpType::greater_than:
+            return make_binary_closure<BinaryOpType::greater_than>(std::move(left), std::move(right), [](KvazzValue &l, KvazzValue &r) {
+                return make_good_result(kvazzvalue_greater_than(l, r));
+            });
+        case BinaryOpType::plus:     return make_binary_closure<BinaryOpType::plus>(std::move(left), std::move(right), kvazzvalue_plus);
+        case BinaryOpType::minus:    return make_binary_closure<BinaryOpType::minus>(std::move(left), std::move(right), kvazzvalue_minus);
+        case BinaryOpType::multiply: return make_binary_closure<BinaryOpType::multiply>(std::move(left), std::move(right), kvazzvalue_multiply);
+        case BinaryOpType::divide:   return make_binary_closure<BinaryOpType::divide>(std::move(left), std::move(right), kvazzvalue_divide);
+        case BinaryOpType::modulo:   return make_binary_closure<BinaryOpType::modulo>(std::move(left), std::move(right), kvazzvalue_modulo);
+    }
+    return constant_closure(ERROR_NO_VALUE);
+}
+
+Closure ClosureCompiler::compile_unary_op(UnaryOp *node) {
+    auto right = compile(node->right_expr);
+    if (node->op_type == UnaryOpType::bang) {
+        return [right = std::move(right)](const shared_ptr<Env> &env) -> KvazzResult {
+            auto right_result = right(env);
+            if (right_result.flag == KvazzFlag::Error)
+                return KvazzResult { NOTHING, KvazzFlag::Error };
+            return make_good_result(!truthy_test(right_result.kvazz_value));
+        };
+    }
+    return [right = std::move(right)](const shared_ptr<Env> &env) -> KvazzResult {
+        auto right_result = right(env);
+        if (right_result.flag == KvazzFlag::Error)
+            return KvazzResult { NOTHING, KvazzFlag::Error };
+        return Kvazzvalue_unary_minus(right_result.kvazz_value);
+    };
+}
+
+/**
+ *  Evaluates args into a vector from spare_args, calls hand it back with recycle_args when they're done
+ */
+vector<KvazzValue> ClosureCompiler::eval_args(const vector<Closure> &args, const shared_ptr<Env> &env) {
+    vector<KvazzValue> values;
+    if (!spare_args.empty()) {
+        values = std::move(spare_args.back());
+        spare_args.pop_back();
+    }
+    values.reserve(args.size());
+    for (auto &arg : args)
+        values.push_back(arg(env).kvazz_value);
+    return values;
+}
+
+void ClosureCompiler::recycle_args(vector<KvazzValue> &values) {
+    // enough for the calls in progress at any depth a program usually reaches
+    const size_t MAX_SPARE_ARGS = 64;
+    values.clear();
+    if (spare_args.size() < MAX_SPARE_ARGS)
+        spare_args.push_back(std::move(values));
+}
+
+Closure ClosureCompiler::compile_function_call(FunctionCall *node) {
+    vector<Closure> args;
+    for (auto &expr_arg : node->expr_args)
+        args.push_back(compile(expr_arg));
+
+    // built-ins can't be shadowed, so calls to them are bound here
+    if (node->callee->type() == NodeType::VariableLookup) {
+        auto variable = static_cast<VariableLookup*>(node->callee);
+        if (variable->resolution == Resolution::Builtin) {
+            return [this, builtin_fn_id = variable->slot, args = std::move(args)](const shared_ptr<Env> &env) -> KvazzResult {
+                auto arg_values = eval_args(args, env);
+                auto result = call_builtin_function(builtin_fn_id, arg_values);
+                recycle_args(arg_values);
+                return result;
+            };
+        }
+    }
+
+    auto callee = compile(node->callee);
+    return [this, node, callee = std::move(callee), args = std::move(args)](const shared_ptr<Env> &env) -> KvazzResult {
+        auto cached_function = cached_global_callee(isolate, node);
+        if (cached_function != nullptr && cached_function->memo == nullptr) {
+            // the arguments go straight into the callee's frame, like make_function_env would put them
+            auto function_env = make_env(isolate.global_env, 0);
+            auto &slots = function_env->slots;
+            for (auto &arg : args)
+                slots.push_back(EnvEntry { EnvResultType::Value, arg(env).kvazz_value });
+            if (slots.size() != cached_function->args.size())
+                slots.resize(cached_function->args.size(), EnvEntry { EnvResultType::Value, NOTHING });
+            return call_in_frame(*cached_function, std::move(function_env));
+        }
+        if (cached_function != nullptr) {
+            auto arg_values = eval_args(args, env);
+            auto result = call(*cached_function, arg_values);
+            recycle_args(arg_values);
+            return result;
+        }
+
+        auto callee_expr_result = callee(env);
+        if (callee_expr_result.flag == KvazzFlag::Error)
+            return ERROR_NO_VALUE;
+
+        auto arg_values = eval_args(args, env);
+        auto result = ERROR_NO_VALUE;
+        if (callee_expr_result.kvazz_value.type == KvazzType::Function) {
+            result = call(callee_expr_result.kvazz_value.as_function(), arg_values);
+        }
+        else if (callee_expr_result.kvazz_value.type == KvazzType::Builtin) {
+            result = call_builtin_function(callee_expr_result.kvazz_value.as_int(), arg_values);
+        }
+        recycle_args(arg_values);
+        return result;
+    };
+}
+
+/**
+ *  Compiles the returned call node, see Interpreter::eval_tail_call
+ */
+Closure ClosureCompiler::compile_tail_call(FunctionCall *node) {
+    vector<Closure> args;
+    for (auto &expr_arg : node->expr_args)
+        args.push_back(compile(expr_arg));
+
+    if (node->callee->type() == NodeType::VariableLookup) {
+        auto variable = static_cast<VariableLookup*>(node->callee);
+        if (variable->resolution == Resolution::Builtin) {
+            return [builtin_fn_id = variable->slot, args = std::move(args)](const shared_ptr<Env> &env) -> KvazzResult {
+                vector<KvazzValue> arg_values;
+                arg_values.reserve(args.size());
+                for (auto &arg : args)
+                    arg_values.push_back(arg(env).kvazz_value);
+                auto result = call_builtin_function(builtin_fn_id, arg_values);
+                result.flag = KvazzFlag::Return;
+                return result;
+            };
+        }
+    }
+
+    auto callee = compile(node->callee);
+    return [this, node, callee = std::move(callee), args = std::move(args)](const shared_ptr<Env> &env) -> KvazzResult {
+        auto cached_function = cached_global_callee(isolate, node);
+        KvazzResult callee_expr_result;
+        if (cached_function == nullptr) {
+            callee_expr_result = callee(env);
+            if (callee_expr_result.flag == KvazzFlag::Error)
+                return KvazzResult { NOTHING, KvazzFlag::Return };
+        }
+
+        vector<KvazzValue> arg_values;
+        arg_values.reserve(args.size());
+        for (auto &arg : args)
+            arg_values.push_back(arg(env).kvazz_value);
+
+        if (cached_function == nullptr) {
+            auto &callee_value = callee_expr_result.kvazz_value;
+            if (callee_value.type == KvazzType::Builtin) {
+                auto result = call_builtin_function(callee_value.as_int(), arg_values);
+                result.flag = KvazzFlag::Return;
+                return result;
+            }
+            if (callee_value.type != KvazzType::Function)
+                return KvazzResult { NOTHING, KvazzFlag::Return };
+            tail_call.function = callee_value.as_function();
+            cached_function = &tail_call.function;
+        }
+        tail_call.callee = cached_function;
+        tail_call.args = std::move(arg_values);
+        tail_call.pending = true;
+        return KvazzResult { NOTHING, KvazzFlag::Return };
+    };
+}
+
+Closure ClosureCompiler::compile_access(Access *node) {
+    auto left = compile(node->left_expr);
+    if (node->index_exprs.size() == 1) {
+        auto index = compile(node->index_exprs[0]);
+        return [left = std::move(left), index = std::move(index)](const shared_ptr<Env> &env) -> KvazzResult {
+            auto left_expr_result = left(env);
+            auto index_expr_result = index(env);
+            return kvazzvalue_index(left_expr_result.kvazz_value, index_expr_result.kvazz_value);
+        };
+    }
+
+    vector<Closure> indices;
+    for (auto &index_expr : node->index_exprs)
+        indices.push_back(compile(index_expr));
+    return [left = std::move(left), indices = std::move(indices)](const shared_ptr<Env> &env) -> KvazzResult {
+        auto left_expr_result = left(env);
+        vector<KvazzValue> index_values;
+        index_values.reserve(indices.size());
+        for (auto &index : indices)
+            index_values.push_back(index(env).kvazz_value);
+        return kvazzvalue_index(left_expr_result.kvazz_value, index_values.data(), index_values.size());
+    };
+}
+
+Closure ClosureCompiler::compile_variable_lookup(VariableLookup *node) {
+    if (node->resolution == Resolution::Builtin) {
+        return constant_closure(KvazzResult { KvazzValue { KvazzType::Builtin, node->slot }, KvazzFlag::Good });
+    }
+
+    auto lookup_entry = [this, node](const shared_ptr<Env> &env) -> KvazzResult {
+        auto entry = lookup(isolate, node, env.get());
+        if (entry == nullptr) {
+            return GOOD_NO_VALUE;
+        }
+        if (entry->type == EnvResultType::Function) {
+            return make_good_result(std::get<KvazzFunction>(entry->contents));
+        }
+        return KvazzResult { std::get<KvazzValue>(entry->contents), KvazzFlag::Good };
+    };
+
+    // values are read straight from the slot, lookup_entry is left for functions and unbound names
+    if (node->resolution == Resolution::Global) {
+        return [this, slot = node->slot, lookup_entry](const shared_ptr<Env> &env) -> KvazzResult {
+            if (auto value = entry_value(isolate.global_env->slots[slot]))
+                return KvazzResult { *value, KvazzFlag::Good };
+            return lookup_entry(env);
+        };
+    }
+    if (node->resolution == Resolution::Local && node->depth == 0) {
+        return [slot = node->slot, lookup_entry](const shared_ptr<Env> &env) -> KvazzResult {
+            if (auto value = entry_value(env->slots[slot]))
+                return KvazzResult { *value, KvazzFlag::Good };
+            return lookup_entry(env);
+        };
+    }
+    if (node->resolution == Resolution::Local) {
+        return [slot = node->slot, depth = node->depth, lookup_entry](const shared_ptr<Env> &env) -> KvazzResult {
+            if (auto value = entry_value(frame_at(env.get(), depth)->slots[slot]))
+                return KvazzResult { *value, KvazzFlag::Good };
+            return lookup_entry(env);
+        };
+    }
+    return lookup_entry;
+}
+
+// the value variable refers to, or nullptr after printing why it can't be assigned
+KvazzValue *lvalue_entry(Isolate &isolate, VariableLookup *variable, const shared_ptr<Env> &env) {
+    auto entry = lookup(isolate, variable, env.get());
+    if (entry == nullptr) {
+        return nullptr;
+    }
+    if (entry->type != EnvResultType::Value) {
+        std::cerr << "Functions cannot be reassigned.\n";
+        return nullptr;
+    }
+    return &std::get<KvazzValue>(entry->contents);
+}
+
+/**
+ *  Compiles an assignment target into a closure that returns the KvazzValue to overwrite
+ */
+LValueClosure ClosureCompiler::compile_lvalue(BaseNode *node) {
+    if (node->type() == NodeType::VariableLookup) {
+        auto variable = static_cast<VariableLookup*>(node);
+        if (variable->resolution == Resolution::Builtin) {
+            return [](const shared_ptr<Env> &env) -> KvazzValue* {
+                std::cerr << "Built-in functions cannot be reassigned.\n";
+                return nullptr;
+            };
+        }
+        if (variable->resolution == Resolution::Local) {
+            return [this, variable](const shared_ptr<Env> &env) -> KvazzValue* {
+                if (auto value = entry_value(frame_at(env.get(), variable->depth)->slots[variable->slot]))
+                    return value;
+                return lvalue_entry(isolate, variable, env);
+            };
+        }
+        return [this, variable](const shared_ptr<Env> &env) -> KvazzValue* {
+            if (variable->resolution == Resolution::Global && !global_assignment_allowed())
+                return nullptr;
+            return lvalue_entry(isolate, variable, env);
+        };
+    }
+
+    return [](const shared_ptr<Env> &env) -> KvazzValue* {
+        std::cerr << "Invalid assignment target.\n";
+        return nullptr;
+    };
+}
+
+Closure *ClosureCompiler::function_body(KvazzFunction &fn) {
+    // every call looks its body up, most find it in the small direct-mapped cache before the map
+    auto &cached = body_cache[(reinterpret_cast<uintptr_t>(fn.body) >> 4) % body_cache.size()];
+    if (cached.first == fn.body)
+        return cached.second;
+
+    auto found = function_bodies.find(fn.body);
+    if (found == function_bodies.end()) {
+        auto body = compile_statements(static_cast<Block*>(fn.body));
+        found = function_bodies.emplace(fn.body, std::move(body)).first;
+    }
+    // unordered_map elements stay where they are, so the pointer is good for the compiler's lifetime
+    cached = { fn.body, &found->second };
+    return &found->second;
+}
+
+/**
+ *  Calls the passed KvazzFunction with the specified args, like call_function but with the compiled body
+ */
+KvazzResult ClosureCompiler::call(KvazzFunction &fn, vector<KvazzValue> &arg_values) {
+    auto run_function = [&](vector<KvazzValue> &args) {
+        return call_in_frame(fn, make_function_env(isolate, fn, args));
+    };
+    return fn.memo != nullptr ? call_memoized(fn, arg_values, run_function) : run_function(arg_values);
+}
+
+/**
+ *  Runs fn, which isn't memoized, in function_env, the frame already holding its arguments
+ */
+KvazzResult ClosureCompiler::call_in_frame(KvazzFunction &fn, shared_ptr<Env> function_env) {
+    auto run_body = [this](KvazzFunction &callee, const shared_ptr<Env> &body_env) {
+        return (*function_body(callee))(body_env);
+    };
+    auto intercept = [this](KvazzFunction &callee, vector<KvazzValue> &args, KvazzResult &result) {
+        if (callee.memo == nullptr)
+            return false;
+        result = call(callee, args);
+        return true;
+    };
+    return run_with_tail_calls(isolate, tail_call, fn, std::move(function_env), run_body, intercept);
+}
+
+/*
+*  The AstEvaluator entry points compile the node they're given and run it straight away
+*/
+KvazzResult ClosureCompiler::eval(BaseNode *node, const shared_ptr<Env> &env)        { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(Program *node, const shared_ptr<Env> &env)         { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(Block *node, const shared_ptr<Env> &env)           { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(AssignOp *node, const shared_ptr<Env> &env)        { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(Declare *node, const shared_ptr<Env> &env)         { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(FunctionDeclare *node, const shared_ptr<Env> &env) { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(Return *node, const shared_ptr<Env> &env)          { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(IfThen *node, const shared_ptr<Env> &env)          { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(IfElse *node, const shared_ptr<Env> &env)          { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(While *node, const shared_ptr<Env> &env)           { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(BinaryOp *node, const shared_ptr<Env> &env)        { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(UnaryOp *node, const shared_ptr<Env> &env)         { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(FunctionCall *node, const shared_ptr<Env> &env)    { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(Access *node, const shared_ptr<Env> &env)          { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(VariableLookup *node, const shared_ptr<Env> &env)  { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(IntLiteral *node, const shared_ptr<Env> &env)      { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(BoolLiteral *node, const shared_ptr<Env> &env)     { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(RealLiteral *node, const shared_ptr<Env> &env)     { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(StringLiteral *node, const shared_ptr<Env> &env)   { return compile(node)(env); }
+KvazzResult ClosureCompiler::eval(VectorLiteral *node, const shared_ptr<Env> &env)   { return compile(node)(env); }
+
+// Entry point method
+void run_closure_interpreter(Isolate &isolate, BaseNode *ast) {
+    IsolateScope scope { isolate };
+    ClosureCompiler compiler { isolate };
+    isolate.set_function_caller_factory([&isolate] {
+        auto compiler = std::make_shared<ClosureCompiler>(isolate);
+        return FunctionCaller { [compiler](KvazzValue &callee, vector<KvazzValue> &args) {
+            return compiler->call(callee.as_function(), args);
+        } };
+    });
+    auto program = compiler.compile(ast);
+    program(isolate.global_env);
+    wait_for_spawned_tasks();
+}
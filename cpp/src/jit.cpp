@@ -0,0 +1,755 @@
+#include "jit.h"
+#include "interpreter.h"
+#include "ast.h"
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#include <sys/mman.h>
+#include <unistd.h>
+#define KVAZZ_JIT_SUPPORTED 1
+#endif
+
+using std::unordered_map;
+using std::unordered_set;
+using std::shared_ptr;
+using std::vector;
+using std::string;
+
+/////////////////////////////////////////////////////////////////////////////////////
+// X86-64 EMITTER
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+*  Only the handful of instructions the code generator needs. Values live in eax, the right operand of
+*  a binary operation in ecx, locals in rbp-relative slots and temporaries on the machine stack.
+*/
+class X64Emitter {
+public:
+    vector<uint8_t> code;
+
+    size_t offset() { return code.size(); }
+    void byte(uint8_t b) { code.push_back(b); }
+    void bytes(std::initializer_list<uint8_t> bs) { code.insert(code.end(), bs); }
+
+    void u32(uint32_t value) {
+        for (int i = 0; i < 4; ++i)
+            code.push_back((value >> (8 * i)) & 0xff);
+    }
+
+    void u64(uint64_t value) {
+        for (int i = 0; i < 8; ++i)
+            code.push_back((value >> (8 * i)) & 0xff);
+    }
+
+    void patch_u32(size_t position, uint32_t value) {
+        for (int i = 0; i < 4; ++i)
+            code[position + i] = (value >> (8 * i)) & 0xff;
+    }
+
+    // rel32 jumps: return the position of the displacement so it can be patched once the target is known
+    size_t jmp()  { bytes({0xE9}); size_t position = offset(); u32(0); return position; }
+    size_t jz()   { bytes({0x0F, 0x84}); size_t position = offset(); u32(0); return position; }
+    size_t jne()  { bytes({0x0F, 0x85}); size_t position = offset(); u32(0); return position; }
+
+    void patch_jump(size_t position, size_t target) {
+        patch_u32(position, static_cast<uint32_t>(static_cast<int32_t>(target - (position + 4))));
+    }
+
+    void prologue()                  { bytes({0x55, 0x48, 0x89, 0xE5}); }   // push rbp; mov rbp, rsp
+    size_t sub_rsp_imm32()           { bytes({0x48, 0x81, 0xEC}); size_t position = offset(); u32(0); return position; }
+    void epilogue()                  { bytes({0xC9, 0xC3}); }               // leave; ret
+    void leave()                     { byte(0xC9); }
+
+    void mov_eax_imm(int32_t value)  { byte(0xB8); u32(static_cast<uint32_t>(value)); }
+    void load_eax(int32_t disp)      { bytes({0x8B, 0x85}); u32(static_cast<uint32_t>(disp)); }
+    void store_eax(int32_t disp)     { bytes({0x89, 0x85}); u32(static_cast<uint32_t>(disp)); }
+
+    // stores the low 32 bits of the n-th System V integer argument register into [rbp + disp]
+    void store_arg(int n, int32_t disp) {
+        static const uint8_t regs[] = { 7, 6, 2, 1, 0, 1 }; // edi, esi, edx, ecx, r8d, r9d
+        if (n >= 4)
+            byte(0x44);
+        bytes({0x89, static_cast<uint8_t>(0x80 | (regs[n] << 3) | 5)});
+        u32(static_cast<uint32_t>(disp));
+    }
+
+    // pops a temporary into the n-th System V integer argument register
+    void pop_arg(int n) {
+        static const uint8_t pops[] = { 0x5F, 0x5E, 0x5A, 0x59, 0x58, 0x59 }; // rdi, rsi, rdx, rcx, r8, r9
+        if (n >= 4)
+            byte(0x41);
+        byte(pops[n]);
+    }
+
+    void push_rax()                  { byte(0x50); }
+    void pop_rax()                   { byte(0x58); }
+    void mov_ecx_eax()               { bytes({0x89, 0xC1}); }
+    void add_eax_ecx()               { bytes({0x01, 0xC8}); }
+    void sub_eax_ecx()               { bytes({0x29, 0xC8}); }
+    void imul_eax_ecx()              { bytes({0x0F, 0xAF, 0xC1}); }
+    void idiv_ecx()                  { bytes({0x99, 0xF7, 0xF9}); }         // cdq; idiv ecx
+    void mov_eax_edx()               { bytes({0x89, 0xD0}); }
+    void neg_eax()                   { bytes({0xF7, 0xD8}); }
+    void test_eax_eax()              { bytes({0x85, 0xC0}); }
+    void test_ecx_ecx()              { bytes({0x85, 0xC9}); }
+    void cmp_eax_ecx()               { bytes({0x39, 0xC8}); }
+    void cmp_ecx_minus_one()         { bytes({0x83, 0xF9, 0xFF}); }
+    void cmp_eax_int_min()           { bytes({0x3D, 0x00, 0x00, 0x00, 0x80}); }
+    void setcc_al(uint8_t cc)        { bytes({0x0F, cc, 0xC0}); }
+    void setne_cl()                  { bytes({0x0F, 0x95, 0xC1}); }
+    void and_al_cl()                 { bytes({0x20, 0xC8}); }
+    void or_al_cl()                  { bytes({0x08, 0xC8}); }
+    void movzx_eax_al()              { bytes({0x0F, 0xB6, 0xC0}); }
+    void sub_rsp_8()                 { bytes({0x48, 0x83, 0xEC, 0x08}); }
+    void add_rsp_8()                 { bytes({0x48, 0x83, 0xC4, 0x08}); }
+
+    // mov rax, imm64; call rax (or jmp rax). Returns the position of the imm64 so the target can be patched in later.
+    size_t call_absolute() { bytes({0x48, 0xB8}); size_t position = offset(); u64(0); bytes({0xFF, 0xD0}); return position; }
+    size_t jmp_absolute()  { bytes({0x48, 0xB8}); size_t position = offset(); u64(0); bytes({0xFF, 0xE0}); return position; }
+
+    void mov_rcx_imm64(uint64_t value) { bytes({0x48, 0xB9}); u64(value); }
+    void cmp_byte_rcx_zero()           { bytes({0x80, 0x39, 0x00}); }
+    void mov_byte_rcx_one()            { bytes({0xC6, 0x01, 0x01}); }
+};
+
+// condition codes for setcc
+const uint8_t SETE = 0x94, SETNE = 0x95, SETL = 0x9C, SETGE = 0x9D, SETLE = 0x9E, SETG = 0x9F;
+
+/////////////////////////////////////////////////////////////////////////////////////
+// CODE GENERATION
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+struct JitCallPatch
+{
+    size_t    position;
+    BaseNode *callee;
+};
+
+/*
+*  A group of functions compiled together into one block of executable memory: the function that got
+*  hot plus every function it calls that isn't compiled yet.
+*/
+struct JitUnit
+{
+    X64Emitter                         emitter;
+    // a deque, so the function being compiled stays put while the functions it calls are queued
+    std::deque<KvazzFunction>          pending;
+    unordered_set<BaseNode*>           queued;
+    unordered_map<BaseNode*, size_t>   offsets;
+    unordered_map<BaseNode*, JitType>  return_types;
+    vector<JitCallPatch>               calls;
+
+    // return types assumed for calls to functions that hadn't been compiled yet at the call site
+    vector<std::pair<BaseNode*, JitType>> assumptions;
+};
+
+struct JitLocal
+{
+    int     slot;
+    JitType type;
+};
+
+class JitFunctionCompiler {
+private:
+    Jit &jit;
+    JitUnit &unit;
+    X64Emitter &e;
+    KvazzFunction &fn;
+
+    vector<unordered_map<string, JitLocal>> scopes;
+    int next_slot = 0;
+    int max_slots = 0;
+    int depth = 0; // temporaries currently pushed on the machine stack
+    bool has_return_type = false;
+    JitType return_type = JitType::Int;
+    vector<size_t> bailouts;
+    size_t body_start = 0; // where the body starts, after the arguments are stored
+
+    static int32_t slot_disp(int slot) { return -8 * (slot + 1); }
+
+    JitLocal *resolve(const string &identifier) {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+            auto found = scope->find(identifier);
+            if (found != scope->end())
+                return &found->second;
+        }
+        return nullptr;
+    }
+
+    int declare(const string &identifier, JitType type) {
+        int slot = next_slot++;
+        if (next_slot > max_slots)
+            max_slots = next_slot;
+        scopes.back()[identifier] = JitLocal { slot, type };
+        return slot;
+    }
+
+    // eax = eax <op> ecx for Int operands, bailing out where C++ would trap
+    void emit_arithmetic(BinaryOpType op) {
+        switch(op) {
+            case BinaryOpType::plus:     e.add_eax_ecx(); break;
+            case BinaryOpType::minus:    e.sub_eax_ecx(); break;
+            case BinaryOpType::multiply: e.imul_eax_ecx(); break;
+            case BinaryOpType::divide:
+            case BinaryOpType::modulo:
+            {
+                e.test_ecx_ecx();
+                bailouts.push_back(e.jz());
+                e.cmp_ecx_minus_one();
+                size_t not_minus_one = e.jne();
+                e.cmp_eax_int_min();
+                bailouts.push_back(e.jz());
+                e.patch_jump(not_minus_one, e.offset());
+                e.idiv_ecx();
+                if (op == BinaryOpType::modulo)
+                    e.mov_eax_edx();
+                break;
+            }
+            default: {}
+        }
+    }
+
+    KvazzFunction *native_callee(FunctionCall *node);
+    bool emit_arguments(FunctionCall *node);
+    JitType callee_return_type(KvazzFunction &callee);
+    bool emit_call(FunctionCall *node, JitType &type);
+    bool is_self_call(FunctionCall *node);
+    bool emit_self_tail_call(FunctionCall *node);
+    bool emit_tail_call(FunctionCall *node);
+    bool emit_expr(BaseNode *node, JitType &type);
+    bool emit_stmt(BaseNode *node);
+
+public:
+    JitFunctionCompiler(Jit &jit_, JitUnit &unit_, KvazzFunction &fn_)
+        : jit { jit_ }, unit { unit_ }, e { unit_.emitter }, fn { fn_ } {}
+
+    bool compile();
+};
+
+bool JitFunctionCompiler::compile() {
+    if (fn.args.size() > 6)
+        return false;
+
+    unit.offsets[fn.body] = e.offset();
+    e.prologue();
+    size_t frame_size_position = e.sub_rsp_imm32();
+
+    scopes.emplace_back();
+    for (int i = 0; i < fn.args.size(); ++i)
+        e.store_arg(i, slot_disp(declare(fn.args[i], JitType::Int)));
+    body_start = e.offset();
+
+    if (!emit_stmt(fn.body))
+        return false;
+
+    // falling off the end returns Nothing, which only the interpreter can represent
+    size_t bail_label = e.offset();
+    e.mov_rcx_imm64(reinterpret_cast<uint64_t>(&jit.bailed));
+    e.mov_byte_rcx_one();
+    e.epilogue();
+    for (auto position : bailouts)
+        e.patch_jump(position, bail_label);
+
+    // keep rsp 16-byte aligned inside the function body
+    e.patch_u32(frame_size_position, ((max_slots * 8) + 15) & ~15);
+    unit.return_types[fn.body] = return_type;
+    return true;
+}
+
+bool JitFunctionCompiler::is_self_call(FunctionCall *node) {
+    if (node->callee->type() != NodeType::VariableLookup || node->expr_args.size() != fn.args.size())
+        return false;
+    auto variable = static_cast<VariableLookup*>(node->callee);
+    if (variable->resolution != Resolution::Global)
+        return false;
+    auto &entry = jit.globals->slots[variable->slot];
+    return entry.type == EnvResultType::Function && std::get<KvazzFunction>(entry.contents).body == fn.body;
+}
+
+/**
+ *  A function returning a call to itself stores the new arguments in place of its own and jumps back to
+ *  the start of its body, so tail recursion doesn't grow the machine stack
+ */
+bool JitFunctionCompiler::emit_self_tail_call(FunctionCall *node) {
+    for (auto &arg : node->expr_args) {
+        JitType arg_type;
+        if (!emit_expr(arg, arg_type) || arg_type != JitType::Int)
+            return false;
+        e.push_rax();
+        ++depth;
+    }
+    for (int i = node->expr_args.size() - 1; i >= 0; --i) {
+        e.pop_rax();
+        e.store_eax(slot_disp(i));
+    }
+    depth -= node->expr_args.size();
+    e.patch_jump(e.jmp(), body_start);
+    return true;
+}
+
+/**
+ *  Returns the declared function node calls if the call can be made natively, nullptr if it can't
+ */
+KvazzFunction *JitFunctionCompiler::native_callee(FunctionCall *node) {
+    if (node->callee->type() != NodeType::VariableLookup)
+        return nullptr;
+    auto variable = static_cast<VariableLookup*>(node->callee);
+    if (variable->resolution != Resolution::Global)
+        return nullptr;
+
+    auto &entry = jit.globals->slots[variable->slot];
+    if (entry.type != EnvResultType::Function)
+        return nullptr;
+    auto &callee = std::get<KvazzFunction>(entry.contents);
+    if (callee.args.size() != node->expr_args.size() || callee.args.size() > 6)
+        return nullptr;
+    // native calls would bypass the memo cache
+    if (callee.memo != nullptr)
+        return nullptr;
+    if (jit.functions[callee.body].status == JitStatus::Ineligible)
+        return nullptr;
+    return &callee;
+}
+
+// evaluates the arguments of node into the argument registers
+bool JitFunctionCompiler::emit_arguments(FunctionCall *node) {
+    for (auto &arg : node->expr_args) {
+        JitType arg_type;
+        if (!emit_expr(arg, arg_type) || arg_type != JitType::Int)
+            return false;
+        e.push_rax();
+        ++depth;
+    }
+    for (int i = node->expr_args.size() - 1; i >= 0; --i)
+        e.pop_arg(i);
+    depth -= node->expr_args.size();
+    return true;
+}
+
+/**
+ *  The type a call to callee returns. A callee that isn't compiled yet is queued to be compiled in this
+ *  unit, and if its return type isn't known yet Int is assumed and checked once the unit is done.
+ */
+JitType JitFunctionCompiler::callee_return_type(KvazzFunction &callee) {
+    auto &callee_state = jit.functions[callee.body];
+    if (callee_state.status == JitStatus::Compiled)
+        return callee_state.return_type;
+    auto known = unit.return_types.find(callee.body);
+    if (known != unit.return_types.end())
+        return known->second;
+
+    unit.assumptions.emplace_back(callee.body, JitType::Int);
+    if (unit.queued.count(callee.body) == 0) {
+        unit.queued.insert(callee.body);
+        unit.pending.push_back(callee);
+    }
+    return JitType::Int;
+}
+
+bool JitFunctionCompiler::emit_call(FunctionCall *node, JitType &type) {
+    auto callee = native_callee(node);
+    if (callee == nullptr || !emit_arguments(node))
+        return false;
+
+    bool realign = depth % 2 == 1;
+    if (realign)
+        e.sub_rsp_8();
+    unit.calls.push_back(JitCallPatch { e.call_absolute(), callee->body });
+    if (realign)
+        e.add_rsp_8();
+
+    // unwind straight away if the callee bailed out
+    e.mov_rcx_imm64(reinterpret_cast<uint64_t>(&jit.bailed));
+    e.cmp_byte_rcx_zero();
+    bailouts.push_back(e.jne());
+
+    type = callee_return_type(*callee);
+    return true;
+}
+
+/**
+ *  A returned call replaces the current frame: the callee is jumped to with this function's return address,
+ *  so it returns (or bails out) straight to this function's caller
+ */
+bool JitFunctionCompiler::emit_tail_call(FunctionCall *node) {
+    if (is_self_call(node))
+        return emit_self_tail_call(node);
+    auto callee = native_callee(node);
+    if (callee == nullptr || !emit_arguments(node))
+        return false;
+
+    auto type = callee_return_type(*callee);
+    if (has_return_type && type != return_type)
+        return false;
+    has_return_type = true;
+    return_type = type;
+    e.leave();
+    unit.calls.push_back(JitCallPatch { e.jmp_absolute(), callee->body });
+    return true;
+}
+
+bool JitFunctionCompiler::emit_expr(BaseNode *node, JitType &type) {
+    switch(node->type()) {
+        case NodeType::IntLiteral:
+        {
+            e.mov_eax_imm(static_cast<IntLiteral*>(node)->literal_value);
+            type = JitType::Int;
+            return true;
+        }
+        case NodeType::BoolLiteral:
+        {
+            e.mov_eax_imm(static_cast<BoolLiteral*>(node)->literal_value ? 1 : 0);
+            type = JitType::Bool;
+            return true;
+        }
+        case NodeType::VariableLookup:
+        {
+            auto variable = static_cast<VariableLookup*>(node);
+            auto local = variable->sigil ? nullptr : resolve(variable->identifier);
+            if (local == nullptr)
+                return false;
+            e.load_eax(slot_disp(local->slot));
+            type = local->type;
+            return true;
+        }
+        case NodeType::UnaryOp:
+        {
+            auto unop = static_cast<UnaryOp*>(node);
+            JitType operand_type;
+            if (!emit_expr(unop->right_expr, operand_type))
+                return false;
+            if (unop->op_type == UnaryOpType::minus) {
+                if (operand_type != JitType::Int)
+                    return false;
+                e.neg_eax();
+                type = JitType::Int;
+            }
+            else {
+                e.test_eax_eax();
+                e.setcc_al(SETE);
+                e.movzx_eax_al();
+                type = JitType::Bool;
+            }
+            return true;
+        }
+        case NodeType::BinaryOp:
+        {
+            auto binop = static_cast<BinaryOp*>(node);
+            JitType left_type, right_type;
+            if (!emit_expr(binop->left_expr, left_type))
+                return false;
+            e.push_rax();
+            ++depth;
+            if (!emit_expr(binop->right_expr, right_type))
+                return false;
+            e.mov_ecx_eax();
+            e.pop_rax();
+            --depth;
+
+            if (is_logical_binop(binop->op_type)) {
+                // both sides are always evaluated, like in the interpreter
+                e.test_eax_eax();
+                e.setcc_al(SETNE);
+                e.test_ecx_ecx();
+                e.setne_cl();
+                if (binop->op_type == BinaryOpType::pipe)
+                    e.or_al_cl();
+                else
+                    e.and_al_cl();
+                e.movzx_eax_al();
+                type = JitType::Bool;
+                return true;
+            }
+
+            // Bools only support == and !=, mixed operands are left to the interpreter
+            if (left_type != right_type)
+                return false;
+            if (left_type == JitType::Bool && !is_equality_binop(binop->op_type))
+                return false;
+
+            if (is_arithmetic_binop(binop->op_type)) {
+                emit_arithmetic(binop->op_type);
+                type = JitType::Int;
+                return true;
+            }
+
+            uint8_t cc = SETE;
+            switch(binop->op_type) {
+                case BinaryOpType::equals:         cc = SETE; break;
+                case BinaryOpType::not_equals:     cc = SETNE; break;
+                case BinaryOpType::less_than:      cc = SETL; break;
+                case BinaryOpType::less_equals:    cc = SETLE; break;
+                case BinaryOpType::greater_than:   cc = SETG; break;
+                case BinaryOpType::greater_equals: cc = SETGE; break;
+                default: return false;
+            }
+            e.cmp_eax_ecx();
+            e.setcc_al(cc);
+            e.movzx_eax_al();
+            type = JitType::Bool;
+            return true;
+        }
+        case NodeType::FunctionCall:
+        {
+            return emit_call(static_cast<FunctionCall*>(node), type);
+        }
+        default:
+            return false;
+    }
+}
+
+bool JitFunctionCompiler::emit_stmt(BaseNode *node) {
+    switch(node->type()) {
+        case NodeType::Block:
+        {
+            int scope_start = next_slot;
+            scopes.emplace_back();
+            for (auto &nd : static_cast<Block*>(node)->statements()) {
+                if (!emit_stmt(nd))
+                    return false;
+            }
+            scopes.pop_back();
+            next_slot = scope_start;
+            return true;
+        }
+        case NodeType::Declare:
+        {
+            auto decl = static_cast<Declare*>(node);
+            if (scopes.back().count(decl->identifier) > 0)
+                return false;
+            JitType type;
+            if (!emit_expr(decl->expr_node, type))
+                return false;
+            e.store_eax(slot_disp(declare(decl->identifier, type)));
+            return true;
+        }
+        case NodeType::AssignOp:
+        {
+            auto assign = static_cast<AssignOp*>(node);
+            if (assign->lvalue->type() != NodeType::VariableLookup)
+                return false;
+            auto variable = static_cast<VariableLookup*>(assign->lvalue);
+            auto local = variable->sigil ? nullptr : resolve(variable->identifier);
+            if (local == nullptr)
+                return false;
+
+            JitType type;
+            if (!emit_expr(assign->expr_node, type) || type != local->type)
+                return false;
+
+            if (assign->op_type != AssignOpType::assign) {
+                if (local->type != JitType::Int)
+                    return false;
+                e.mov_ecx_eax();
+                e.load_eax(slot_disp(local->slot));
+                switch(assign->op_type) {
+                    case AssignOpType::plus:     emit_arithmetic(BinaryOpType::plus); break;
+                    case AssignOpType::minus:    emit_arithmetic(BinaryOpType::minus); break;
+                    case AssignOpType::multiply: emit_arithmetic(BinaryOpType::multiply); break;
+                    case AssignOpType::divide:   emit_arithmetic(BinaryOpType::divide); break;
+                    case AssignOpType::modulo:   emit_arithmetic(BinaryOpType::modulo); break;
+                    default: {}
+                }
+            }
+            e.store_eax(slot_disp(local->slot));
+            return true;
+        }
+        case NodeType::Return:
+        {
+            auto ret = static_cast<Return*>(node);
+            if (ret->tail_call)
+                return emit_tail_call(static_cast<FunctionCall*>(ret->expr_node));
+            JitType type;
+            if (!emit_expr(ret->expr_node, type))
+                return false;
+            if (has_return_type && type != return_type)
+                return false;
+            has_return_type = true;
+            return_type = type;
+            e.epilogue();
+            return true;
+        }
+        case NodeType::IfThen:
+        {
+            auto if_then = static_cast<IfThen*>(node);
+            JitType type;
+            if (!emit_expr(if_then->condition, type))
+                return false;
+            e.test_eax_eax();
+            size_t skip_body = e.jz();
+            if (!emit_stmt(if_then->body))
+                return false;
+            e.patch_jump(skip_body, e.offset());
+            return true;
+        }
+        case NodeType::IfElse:
+        {
+            auto if_else = static_cast<IfElse*>(node);
+            JitType type;
+            if (!emit_expr(if_else->condition, type))
+                return false;
+            e.test_eax_eax();
+            size_t to_else = e.jz();
+            if (!emit_stmt(if_else->then_body))
+                return false;
+            size_t to_end = e.jmp();
+            e.patch_jump(to_else, e.offset());
+            if (!emit_stmt(if_else->else_body))
+                return false;
+            e.patch_jump(to_end, e.offset());
+            return true;
+        }
+        case NodeType::While:
+        {
+            auto while_node = static_cast<While*>(node);
+            size_t loop_start = e.offset();
+            JitType type;
+            if (!emit_expr(while_node->condition, type))
+                return false;
+            e.test_eax_eax();
+            size_t to_end = e.jz();
+            if (!emit_stmt(while_node->body))
+                return false;
+            e.patch_jump(e.jmp(), loop_start);
+            e.patch_jump(to_end, e.offset());
+            return true;
+        }
+        case NodeType::FunctionCall:
+        {
+            JitType type;
+            return emit_expr(node, type);
+        }
+        default:
+            return false;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// JIT
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+Jit::Jit(shared_ptr<Env> globals_)
+    : globals { std::move(globals_) } {}
+
+Jit::~Jit() {
+#ifdef KVAZZ_JIT_SUPPORTED
+    for (auto &page : code_pages)
+        munmap(page.first, page.second);
+#endif
+}
+
+/**
+ *  Compiles fn together with the functions it calls that haven't been compiled yet
+ */
+bool Jit::compile(KvazzFunction &fn) {
+#ifdef KVAZZ_JIT_SUPPORTED
+    JitUnit unit;
+    unit.pending.push_back(fn);
+    unit.queued.insert(fn.body);
+
+    for (size_t i = 0; i < unit.pending.size(); ++i) {
+        JitFunctionCompiler compiler { *this, unit, unit.pending[i] };
+        if (!compiler.compile()) {
+            functions[unit.pending[i].body].status = JitStatus::Ineligible;
+            return false;
+        }
+    }
+    for (auto &assumption : unit.assumptions) {
+        if (unit.return_types[assumption.first] != assumption.second)
+            return false;
+    }
+
+    auto &code = unit.emitter.code;
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t size = ((code.size() + page_size - 1) / page_size) * page_size;
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return false;
+    auto base = static_cast<uint8_t*>(memory);
+
+    for (auto &call : unit.calls) {
+        auto in_unit = unit.offsets.find(call.callee);
+        uint64_t target = in_unit != unit.offsets.end()
+            ? reinterpret_cast<uint64_t>(base + in_unit->second)
+            : reinterpret_cast<uint64_t>(functions[call.callee].entry);
+        for (int i = 0; i < 8; ++i)
+            code[call.position + i] = (target >> (8 * i)) & 0xff;
+    }
+    std::memcpy(base, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return false;
+    }
+    code_pages.emplace_back(memory, size);
+
+    for (auto &compiled : unit.pending) {
+        auto &state = functions[compiled.body];
+        state.status = JitStatus::Compiled;
+        state.arity = compiled.args.size();
+        state.return_type = unit.return_types[compiled.body];
+        state.entry = base + unit.offsets[compiled.body];
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ *  Runs fn natively if it's been compiled (or just got hot enough to be) and every argument is an Int.
+ *  Returns false when the call has to be done by the interpreter instead.
+ */
+bool Jit::try_call(KvazzFunction &fn, vector<KvazzValue> &arg_values, KvazzResult &result) {
+#ifdef KVAZZ_JIT_SUPPORTED
+    // memoized functions are left to the interpreter, which goes through their cache
+    if (fn.memo != nullptr)
+        return false;
+    auto &state = functions[fn.body];
+    if (state.status == JitStatus::Ineligible)
+        return false;
+    if (arg_values.size() != fn.args.size() || arg_values.size() > 6)
+        return false;
+    for (auto &arg : arg_values) {
+        if (arg.type != KvazzType::Int)
+            return false;
+    }
+
+    if (state.status == JitStatus::Interpreted) {
+        if (++state.hot_count < JIT_HOT_THRESHOLD)
+            return false;
+        if (!compile(fn)) {
+            state.status = JitStatus::Ineligible;
+            return false;
+        }
+    }
+
+    int64_t args[6] = { 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < arg_values.size(); ++i)
+        args[i] = arg_values[i].as_int();
+
+    bailed = 0;
+    auto native = reinterpret_cast<int (*)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t)>(state.entry);
+    int value = native(args[0], args[1], args[2], args[3], args[4], args[5]);
+    if (bailed) {
+        bailed = 0;
+        if (++state.bailouts >= JIT_MAX_BAILOUTS)
+            state.status = JitStatus::Ineligible;
+        return false;
+    }
+
+    result = state.return_type == JitType::Int ? make_good_result(value) : make_good_result(value != 0);
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,605 @@
+#include "kernels.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KVAZZ_X86_KERNELS
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+// CPU DISPATCH
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+size_t detect_thread_count() {
+    auto requested = std::getenv("KVAZZ_THREADS");
+    if (requested != nullptr && std::atoi(requested) > 0)
+        return std::atoi(requested);
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+size_t kernel_thread_count() {
+    static const size_t count = detect_thread_count();
+    return count;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// ELEMENTWISE OPERATIONS
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+template <typename T>
+inline T operand_at(const KernelOperand<T> &operand, size_t i) {
+    return operand.data != nullptr ? operand.data[i] : operand.scalar;
+}
+
+template <KernelOp Op>
+inline int scalar_int_op(int left, int right) {
+    // through uint32_t, so overflow wraps instead of being undefined
+    if constexpr (Op == KernelOp::Add)
+        return static_cast<int>(static_cast<uint32_t>(left) + static_cast<uint32_t>(right));
+    else if constexpr (Op == KernelOp::Subtract)
+        return static_cast<int>(static_cast<uint32_t>(left) - static_cast<uint32_t>(right));
+    else if constexpr (Op == KernelOp::Multiply)
+        return static_cast<int>(static_cast<uint32_t>(left) * static_cast<uint32_t>(right));
+    else
+        return left / right;
+}
+
+template <KernelOp Op>
+inline double scalar_real_op(double left, double right) {
+    if constexpr (Op == KernelOp::Add)
+        return left + right;
+    else if constexpr (Op == KernelOp::Subtract)
+        return left - right;
+    else if constexpr (Op == KernelOp::Multiply)
+        return left * right;
+    else
+        return left / right;
+}
+
+#ifdef KVAZZ_X86_KERNELS
+
+// the AVX2 and SSE2 loops return how many elements they did, the rest is left to the scalar loop
+
+template <KernelOp Op>
+AVX2_TARGET size_t avx2_int_op(KernelOperand<int> left, KernelOperand<int> right, int *out, size_t n) {
+    auto left_splat = _mm256_set1_epi32(left.scalar);
+    auto right_splat = _mm256_set1_epi32(right.scalar);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        auto l = left.data != nullptr ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left.data + i)) : left_splat;
+        auto r = right.data != nullptr ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right.data + i)) : right_splat;
+        __m256i result;
+        if constexpr (Op == KernelOp::Add)
+            result = _mm256_add_epi32(l, r);
+        else if constexpr (Op == KernelOp::Subtract)
+            result = _mm256_sub_epi32(l, r);
+        else
+            result = _mm256_mullo_epi32(l, r);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+    }
+    return i;
+}
+
+// SSE2 has no 32 bit multiply, so only Add and Subtract
+template <KernelOp Op>
+size_t sse2_int_op(KernelOperand<int> left, KernelOperand<int> right, int *out, size_t n) {
+    auto left_splat = _mm_set1_epi32(left.scalar);
+    auto right_splat = _mm_set1_epi32(right.scalar);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        auto l = left.data != nullptr ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(left.data + i)) : left_splat;
+        auto r = right.data != nullptr ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(right.data + i)) : right_splat;
+        auto result = Op == KernelOp::Add ? _mm_add_epi32(l, r) : _mm_sub_epi32(l, r);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), result);
+    }
+    return i;
+}
+
+template <KernelOp Op>
+AVX2_TARGET size_t avx2_real_op(KernelOperand<double> left, KernelOperand<double> right, double *out, size_t n) {
+    auto left_splat = _mm256_set1_pd(left.scalar);
+    auto right_splat = _mm256_set1_pd(right.scalar);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        auto l = left.data != nullptr ? _mm256_loadu_pd(left.data + i) : left_splat;
+        auto r = right.data != nullptr ? _mm256_loadu_pd(right.data + i) : right_splat;
+        __m256d result;
+        if constexpr (Op == KernelOp::Add)
+            result = _mm256_add_pd(l, r);
+        else if constexpr (Op == KernelOp::Subtract)
+            result = _mm256_sub_pd(l, r);
+        else if constexpr (Op == KernelOp::Multiply)
+            result = _mm256_mul_pd(l, r);
+        else
+            result = _mm256_div_pd(l, r);
+        _mm256_storeu_pd(out + i, result);
+    }
+    return i;
+}
+
+template <KernelOp Op>
+size_t sse2_real_op(KernelOperand<double> left, KernelOperand<double> right, double *out, size_t n) {
+    auto left_splat = _mm_set1_pd(left.scalar);
+    auto right_splat = _mm_set1_pd(right.scalar);
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        auto l = left.data != nullptr ? _mm_loadu_pd(left.data + i) : left_splat;
+        auto r = right.data != nullptr ? _mm_loadu_pd(right.data + i) : right_splat;
+        __m128d result;
+        if constexpr (Op == KernelOp::Add)
+            result = _mm_add_pd(l, r);
+        else if constexpr (Op == KernelOp::Subtract)
+            result = _mm_sub_pd(l, r);
+        else if constexpr (Op == KernelOp::Multiply)
+            result = _mm_mul_pd(l, r);
+        else
+            result = _mm_div_pd(l, r);
+        _mm_storeu_pd(out + i, result);
+    }
+    return i;
+}
+
+#endif
+
+template <KernelOp Op>
+void int_op(KernelOperand<int> left, KernelOperand<int> right, int *out, size_t n) {
+    size_t done = 0;
+#ifdef KVAZZ_X86_KERNELS
+    // there is no SIMD integer division
+    if constexpr (Op != KernelOp::Divide) {
+        if (simd_level() == SimdLevel::AVX2)
+            done = avx2_int_op<Op>(left, right, out, n);
+        else if constexpr (Op != KernelOp::Multiply) {
+            if (simd_level() == SimdLevel::SSE2)
+                done = sse2_int_op<Op>(left, right, out, n);
+        }
+    }
+#endif
+    for (size_t i = done; i < n; ++i)
+        out[i] = scalar_int_op<Op>(operand_at(left, i), operand_at(right, i));
+}
+
+template <KernelOp Op>
+void real_op(KernelOperand<double> left, KernelOperand<double> right, double *out, size_t n) {
+    size_t done = 0;
+#ifdef KVAZZ_X86_KERNELS
+    if (simd_level() == SimdLevel::AVX2)
+        done = avx2_real_op<Op>(left, right, out, n);
+    else if (simd_level() == SimdLevel::SSE2)
+        done = sse2_real_op<Op>(left, right, out, n);
+#endif
+    for (size_t i = done; i < n; ++i)
+        out[i] = scalar_real_op<Op>(operand_at(left, i), operand_at(right, i));
+}
+
+void kernel_int_op(KernelOp op, KernelOperand<int> left, KernelOperand<int> right, int *out, size_t n) {
+    switch(op) {
+        case KernelOp::Add:      return int_op<KernelOp::Add>(left, right, out, n);
+        case KernelOp::Subtract: return int_op<KernelOp::Subtract>(left, right, out, n);
+        case KernelOp::Multiply: return int_op<KernelOp::Multiply>(left, right, out, n);
+        case KernelOp::Divide:   return int_op<KernelOp::Divide>(left, right, out, n);
+    }
+}
+
+void kernel_real_op(KernelOp op, KernelOperand<double> left, KernelOperand<double> right, double *out, size_t n) {
+    switch(op) {
+        case KernelOp::Add:      return real_op<KernelOp::Add>(left, right, out, n);
+        case KernelOp::Subtract: return real_op<KernelOp::Subtract>(left, right, out, n);
+        case KernelOp::Multiply: return real_op<KernelOp::Multiply>(left, right, out, n);
+        case KernelOp::Divide:   return real_op<KernelOp::Divide>(left, right, out, n);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// REDUCTIONS
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+*  Every reduction runs over 8 lanes, lane k taking elements k, k + 8, k + 16, ...: one __m256i, two
+*  __m256d, four __m128d or eight scalars. Dot products reduce left[i] * right[i] with Sum.
+*/
+
+enum class ReduceOp {
+    Sum, Min, Max
+};
+
+const size_t REDUCE_LANES = 8;
+
+template <ReduceOp Op, typename T>
+inline T scalar_reduce(T acc, T x) {
+    // same operand order as _mm_min_pd(x, acc), which returns acc if either is NaN
+    if constexpr (Op == ReduceOp::Sum) {
+        if constexpr (std::is_same_v<T, int>)
+            return static_cast<int>(static_cast<uint32_t>(acc) + static_cast<uint32_t>(x));
+        else
+            return acc + x;
+    }
+    else if constexpr (Op == ReduceOp::Min)
+        return x < acc ? x : acc;
+    else
+        return x > acc ? x : acc;
+}
+
+template <ReduceOp Op, typename T>
+T combine_lanes(T lanes[REDUCE_LANES]) {
+    return scalar_reduce<Op>(
+        scalar_reduce<Op>(scalar_reduce<Op>(lanes[0], lanes[1]), scalar_reduce<Op>(lanes[2], lanes[3])),
+        scalar_reduce<Op>(scalar_reduce<Op>(lanes[4], lanes[5]), scalar_reduce<Op>(lanes[6], lanes[7])));
+}
+
+#ifdef KVAZZ_X86_KERNELS
+
+template <ReduceOp Op>
+AVX2_TARGET size_t avx2_int_reduce(const int *left, const int *right, size_t n, int lanes[REDUCE_LANES]) {
+    auto acc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i));
+        if (right != nullptr)
+            x = _mm256_mullo_epi32(x, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i)));
+        if constexpr (Op == ReduceOp::Sum)
+            acc = _mm256_add_epi32(acc, x);
+        else if constexpr (Op == ReduceOp::Min)
+            acc = _mm256_min_epi32(x, acc);
+        else
+            acc = _mm256_max_epi32(x, acc);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    return i;
+}
+
+// SSE2 has no 32 bit multiply, min or max, so it only does plain sums
+size_t sse2_int_sum(const int *data, size_t n, int lanes[REDUCE_LANES]) {
+    auto acc_low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes));
+    auto acc_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lanes + 4));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc_low = _mm_add_epi32(acc_low, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+        acc_high = _mm_add_epi32(acc_high, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 4)));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc_low);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + 4), acc_high);
+    return i;
+}
+
+template <ReduceOp Op>
+AVX2_TARGET inline __m256d avx2_reduce_step(__m256d acc, __m256d x) {
+    if constexpr (Op == ReduceOp::Sum)
+        return _mm256_add_pd(acc, x);
+    else if constexpr (Op == ReduceOp::Min)
+        return _mm256_min_pd(x, acc);
+    else
+        return _mm256_max_pd(x, acc);
+}
+
+template <ReduceOp Op>
+AVX2_TARGET size_t avx2_real_reduce(const double *left, const double *right, size_t n, double lanes[REDUCE_LANES]) {
+    auto acc_low = _mm256_loadu_pd(lanes);
+    auto acc_high = _mm256_loadu_pd(lanes + 4);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        auto x_low = _mm256_loadu_pd(left + i);
+        auto x_high = _mm256_loadu_pd(left + i + 4);
+        if (right != nullptr) {
+            x_low = _mm256_mul_pd(x_low, _mm256_loadu_pd(right + i));
+            x_high = _mm256_mul_pd(x_high, _mm256_loadu_pd(right + i + 4));
+        }
+        acc_low = avx2_reduce_step<Op>(acc_low, x_low);
+        acc_high = avx2_reduce_step<Op>(acc_high, x_high);
+    }
+    _mm256_storeu_pd(lanes, acc_low);
+    _mm256_storeu_pd(lanes + 4, acc_high);
+    return i;
+}
+
+template <ReduceOp Op>
+inline __m128d sse2_reduce_step(__m128d acc, __m128d x) {
+    if constexpr (Op == ReduceOp::Sum)
+        return _mm_add_pd(acc, x);
+    else if constexpr (Op == ReduceOp::Min)
+        return _mm_min_pd(x, acc);
+    else
+        return _mm_max_pd(x, acc);
+}
+
+template <ReduceOp Op>
+size_t sse2_real_reduce(const double *left, const double *right, size_t n, double lanes[REDUCE_LANES]) {
+    __m128d acc[4];
+    for (int k = 0; k < 4; ++k)
+        acc[k] = _mm_loadu_pd(lanes + 2 * k);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        for (int k = 0; k < 4; ++k) {
+            auto x = _mm_loadu_pd(left + i + 2 * k);
+            if (right != nullptr)
+                x = _mm_mul_pd(x, _mm_loadu_pd(right + i + 2 * k));
+            acc[k] = sse2_reduce_step<Op>(acc[k], x);
+        }
+    }
+    for (int k = 0; k < 4; ++k)
+        _mm_storeu_pd(lanes + 2 * k, acc[k]);
+    return i;
+}
+
+#endif
+
+template <ReduceOp Op>
+int int_reduce(const int *left, const int *right, size_t n, int init) {
+    int lanes[REDUCE_LANES];
+    for (auto &lane : lanes)
+        lane = init;
+
+    size_t done = 0;
+#ifdef KVAZZ_X86_KERNELS
+    if (simd_level() == SimdLevel::AVX2)
+        done = avx2_int_reduce<Op>(left, right, n, lanes);
+    else if (simd_level() == SimdLevel::SSE2 && Op == ReduceOp::Sum && right == nullptr)
+        done = sse2_int_sum(left, n, lanes);
+#endif
+    for (size_t i = done; i < n; ++i) {
+        auto x = right != nullptr ? scalar_int_op<KernelOp::Multiply>(left[i], right[i]) : left[i];
+        lanes[i % REDUCE_LANES] = scalar_reduce<Op>(lanes[i % REDUCE_LANES], x);
+    }
+    return combine_lanes<Op>(lanes);
+}
+
+template <ReduceOp Op>
+double real_reduce(const double *left, const double *right, size_t n, double init) {
+    double lanes[REDUCE_LANES];
+    for (auto &lane : lanes)
+        lane = init;
+
+    size_t done = 0;
+#ifdef KVAZZ_X86_KERNELS
+    if (simd_level() == SimdLevel::AVX2)
+        done = avx2_real_reduce<Op>(left, right, n, lanes);
+    else if (simd_level() == SimdLevel::SSE2)
+        done = sse2_real_reduce<Op>(left, right, n, lanes);
+#endif
+    for (size_t i = done; i < n; ++i) {
+        auto x = right != nullptr ? left[i] * right[i] : left[i];
+        lanes[i % REDUCE_LANES] = scalar_reduce<Op>(lanes[i % REDUCE_LANES], x);
+    }
+    return combine_lanes<Op>(lanes);
+}
+
+int kernel_int_sum(const int *data, size_t n) {
+    return int_reduce<ReduceOp::Sum>(data, nullptr, n, 0);
+}
+
+double kernel_real_sum(const double *data, size_t n) {
+    return real_reduce<ReduceOp::Sum>(data, nullptr, n, 0.0);
+}
+
+int kernel_int_dot(const int *left, const int *right, size_t n) {
+    return int_reduce<ReduceOp::Sum>(left, right, n, 0);
+}
+
+double kernel_real_dot(const double *left, const double *right, size_t n) {
+    return real_reduce<ReduceOp::Sum>(left, right, n, 0.0);
+}
+
+int kernel_int_min(const int *data, size_t n) {
+    return int_reduce<ReduceOp::Min>(data, nullptr, n, data[0]);
+}
+
+int kernel_int_max(const int *data, size_t n) {
+    return int_reduce<ReduceOp::Max>(data, nullptr, n, data[0]);
+}
+
+double kernel_real_min(const double *data, size_t n) {
+    return real_reduce<ReduceOp::Min>(data, nullptr, n, data[0]);
+}
+
+double kernel_real_max(const double *data, size_t n) {
+    return real_reduce<ReduceOp::Max>(data, nullptr, n, data[0]);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// MATRIX MULTIPLY
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+*  c = a * b is computed in blocks of MATMUL_BLOCK_K rows of b by MATMUL_BLOCK_J columns, so the part of b
+*  in use stays in cache while every row of a passes over it. Within a block, tiles of 4 rows of c by one
+*  or two SIMD registers of columns are kept in registers across the whole depth of the block.
+*
+*  Every c[i, j] is accumulated as c + a[i, 0] * b[0, j] + a[i, 1] * b[1, j] + ... in that order, whether
+*  it's done by a tile, the scalar loop or another thread, so the result doesn't depend on the SIMD level
+*  or the number of threads.
+*/
+
+const size_t MATMUL_BLOCK_K = 64;
+const size_t MATMUL_BLOCK_J = 256;
+const size_t MATMUL_TILE_ROWS = 4;
+
+// below this many multiply-adds a product isn't worth splitting between threads
+const size_t MATMUL_PARALLEL_WORK = size_t(1) << 21;
+
+template <typename T>
+inline T multiply_add(T acc, T x, T y) {
+    if constexpr (std::is_same_v<T, int>)
+        return scalar_int_op<KernelOp::Add>(acc, scalar_int_op<KernelOp::Multiply>(x, y));
+    else
+        return acc + x * y;
+}
+
+/**
+ *  The tiles of one block: rows [i, i + Rows) of c, columns from j_begin towards j_end, for depth
+ *  [p_begin, p_end). Returns the column the tiles stopped at, the rest is left to the scalar loop.
+ */
+template <typename T>
+using MatmulTiles = size_t (*)(const T *a, const T *b, T *c, size_t k, size_t m,
+                               size_t i, size_t j_begin, size_t j_end, size_t p_begin, size_t p_end);
+
+template <typename T>
+size_t no_tiles(const T *, const T *, T *, size_t, size_t, size_t, size_t j_begin, size_t, size_t, size_t) {
+    return j_begin;
+}
+
+#ifdef KVAZZ_X86_KERNELS
+
+template <size_t Rows>
+AVX2_TARGET size_t avx2_int_tiles(const int *a, const int *b, int *c, size_t k, size_t m,
+                                  size_t i, size_t j_begin, size_t j_end, size_t p_begin, size_t p_end) {
+    size_t j = j_begin;
+    for (; j + 8 <= j_end; j += 8) {
+        __m256i acc[Rows];
+        for (size_t r = 0; r < Rows; ++r)
+            acc[r] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(c + (i + r) * m + j));
+        for (size_t p = p_begin; p < p_end; ++p) {
+            auto row = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + p * m + j));
+            for (size_t r = 0; r < Rows; ++r)
+                acc[r] = _mm256_add_epi32(acc[r], _mm256_mullo_epi32(_mm256_set1_epi32(a[(i + r) * k + p]), row));
+        }
+        for (size_t r = 0; r < Rows; ++r)
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(c + (i + r) * m + j), acc[r]);
+    }
+    return j;
+}
+
+template <size_t Rows>
+AVX2_TARGET size_t avx2_real_tiles(const double *a, const double *b, double *c, size_t k, size_t m,
+                                   size_t i, size_t j_begin, size_t j_end, size_t p_begin, size_t p_end) {
+    size_t j = j_begin;
+    for (; j + 8 <= j_end; j += 8) {
+        __m256d acc[Rows][2];
+        for (size_t r = 0; r < Rows; ++r) {
+            acc[r][0] = _mm256_loadu_pd(c + (i + r) * m + j);
+            acc[r][1] = _mm256_loadu_pd(c + (i + r) * m + j + 4);
+        }
+        for (size_t p = p_begin; p < p_end; ++p) {
+            auto row_low = _mm256_loadu_pd(b + p * m + j);
+            auto row_high = _mm256_loadu_pd(b + p * m + j + 4);
+            for (size_t r = 0; r < Rows; ++r) {
+                auto x = _mm256_set1_pd(a[(i + r) * k + p]);
+                acc[r][0] = _mm256_add_pd(acc[r][0], _mm256_mul_pd(x, row_low));
+                acc[r][1] = _mm256_add_pd(acc[r][1], _mm256_mul_pd(x, row_high));
+            }
+        }
+        for (size_t r = 0; r < Rows; ++r) {
+            _mm256_storeu_pd(c + (i + r) * m + j, acc[r][0]);
+            _mm256_storeu_pd(c + (i + r) * m + j + 4, acc[r][1]);
+        }
+    }
+    return j;
+}
+
+// SSE2 has no 32 bit multiply, so Int products are left to the scalar loop
+template <size_t Rows>
+size_t sse2_real_tiles(const double *a, const double *b, double *c, size_t k, size_t m,
+                       size_t i, size_t j_begin, size_t j_end, size_t p_begin, size_t p_end) {
+    size_t j = j_begin;
+    for (; j + 4 <= j_end; j += 4) {
+        __m128d acc[Rows][2];
+        for (size_t r = 0; r < Rows; ++r) {
+            acc[r][0] = _mm_loadu_pd(c + (i + r) * m + j);
+            acc[r][1] = _mm_loadu_pd(c + (i + r) * m + j + 2);
+        }
+        for (size_t p = p_begin; p < p_end; ++p) {
+            auto row_low = _mm_loadu_pd(b + p * m + j);
+            auto row_high = _mm_loadu_pd(b + p * m + j + 2);
+            for (size_t r = 0; r < Rows; ++r) {
+                auto x = _mm_set1_pd(a[(i + r) * k + p]);
+                acc[r][0] = _mm_add_pd(acc[r][0], _mm_mul_pd(x, row_low));
+                acc[r][1] = _mm_add_pd(acc[r][1], _mm_mul_pd(x, row_high));
+            }
+        }
+        for (size_t r = 0; r < Rows; ++r) {
+            _mm_storeu_pd(c + (i + r) * m + j, acc[r][0]);
+            _mm_storeu_pd(c + (i + r) * m + j + 2, acc[r][1]);
+        }
+    }
+    return j;
+}
+
+#endif
+
+template <typename T>
+struct MatmulKernel
+{
+    MatmulTiles<T> tiles;       // MATMUL_TILE_ROWS rows at a time
+    MatmulTiles<T> single_row;  // for the rows left over
+};
+
+MatmulKernel<int> int_matmul_kernel() {
+#ifdef KVAZZ_X86_KERNELS
+    if (simd_level() == SimdLevel::AVX2)
+        return MatmulKernel<int> { avx2_int_tiles<MATMUL_TILE_ROWS>, avx2_int_tiles<1> };
+#endif
+    return MatmulKernel<int> { no_tiles<int>, no_tiles<int> };
+}
+
+MatmulKernel<double> real_matmul_kernel() {
+#ifdef KVAZZ_X86_KERNELS
+    if (simd_level() == SimdLevel::AVX2)
+        return MatmulKernel<double> { avx2_real_tiles<MATMUL_TILE_ROWS>, avx2_real_tiles<1> };
+    if (simd_level() == SimdLevel::SSE2)
+        return MatmulKernel<double> { sse2_real_tiles<MATMUL_TILE_ROWS>, sse2_real_tiles<1> };
+#endif
+    return MatmulKernel<double> { no_tiles<double>, no_tiles<double> };
+}
+
+// rows [row_begin, row_end) of c = a * b, with c already zeroed
+template <typename T>
+void matmul_rows(MatmulKernel<T> kernel, const T *a, const T *b, T *c, size_t k, size_t m,
+                 size_t row_begin, size_t row_end) {
+    for (size_t j_block = 0; j_block < m; j_block += MATMUL_BLOCK_J) {
+        size_t j_end = std::min(j_block + MATMUL_BLOCK_J, m);
+        for (size_t p_block = 0; p_block < k; p_block += MATMUL_BLOCK_K) {
+            size_t p_end = std::min(p_block + MATMUL_BLOCK_K, k);
+            size_t i = row_begin;
+            for (; i < row_end; ) {
+                size_t rows = row_end - i >= MATMUL_TILE_ROWS ? MATMUL_TILE_ROWS : 1;
+                auto tiles = rows == MATMUL_TILE_ROWS ? kernel.tiles : kernel.single_row;
+                size_t j_done = tiles(a, b, c, k, m, i, j_block, j_end, p_block, p_end);
+                for (size_t r = i; r < i + rows; ++r) {
+                    for (size_t j = j_done; j < j_end; ++j) {
+                        T acc = c[r * m + j];
+                        for (size_t p = p_block; p < p_end; ++p)
+                            acc = multiply_add(acc, a[r * k + p], b[p * m + j]);
+                        c[r * m + j] = acc;
+                    }
+                }
+                i += rows;
+            }
+        }
+    }
+}
+
+template <typename T>
+void matmul(MatmulKernel<T> kernel, const T *a, const T *b, T *c, size_t n, size_t k, size_t m) {
+    std::fill(c, c + n * m, T(0));
+    size_t threads = std::min(kernel_thread_count(), (n + MATMUL_TILE_ROWS - 1) / MATMUL_TILE_ROWS);
+    if (threads <= 1 || n * k * m < MATMUL_PARALLEL_WORK) {
+        matmul_rows(kernel, a, b, c, k, m, 0, n);
+        return;
+    }
+
+    // bands of whole tiles, one per thread
+    size_t tiles = (n + MATMUL_TILE_ROWS - 1) / MATMUL_TILE_ROWS;
+    size_t band = (tiles + threads - 1) / threads * MATMUL_TILE_ROWS;
+    ThreadPool::instance().run((n + band - 1) / band, [&](size_t i) {
+        matmul_rows(kernel, a, b, c, k, m, i * band, std::min((i + 1) * band, n));
+    });
+}
+
+void kernel_int_matmul(const int *a, const int *b, int *c, size_t n, size_t k, size_t m) {
+    matmul(int_matmul_kernel(), a, b, c, n, k, m);
+}
+
+void kernel_real_matmul(const double *a, const double *b, double *c, size_t n, size_t k, size_t m) {
+    matmul(real_matmul_kernel(), a, b, c, n, k, m);
+}
@@ -1,33 +1,364 @@
 #include "lexer.h"
 #include "token.h"
+#include "simd.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
-#include <unordered_set> 
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KVAZZ_X86_LEXER
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
 
 using std::string;
+using std::string_view;
 using std::vector;
-using std::unordered_set;
 
-unordered_set<string> keywords        ( {"var", "if", "then", "else", "for", "while", "do", "in", "function", "return"} );
-unordered_set<string> symbols         ( {"{", "}", "(", ")", "[", "]", "<", ">", "+", "-", "*", "/", "%", "!", "?", "=", ".", ",", "&", "|", ";", ":", "$"  } );
-unordered_set<string> multi           ( { "==", "!=", ">=", "<=", "+=", "-=", "*=", "/=", "%=", "<[", "]>" } );
+/////////////////////////////////////////////////////////////////////////////////////
+// KEYWORDS AND SYMBOLS
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+struct KeywordEntry {
+    string_view word;
+    TokenKind kind;
+};
+
+constexpr KeywordEntry keyword_list[] = {
+    {"var", TokenKind::kw_var}, {"if", TokenKind::kw_if}, {"then", TokenKind::kw_then},
+    {"else", TokenKind::kw_else}, {"for", TokenKind::kw_for}, {"while", TokenKind::kw_while},
+    {"do", TokenKind::kw_do}, {"in", TokenKind::kw_in}, {"function", TokenKind::kw_function},
+    {"return", TokenKind::kw_return}, {"spawn", TokenKind::kw_spawn}, {"sync", TokenKind::kw_sync},
+    {"memo", TokenKind::kw_memo}, {"true", TokenKind::lit_true}, {"false", TokenKind::lit_false}
+};
+
+/*
+*  Words are looked up in a table indexed by a hash of their first and last character and length,
+*  which has no collisions for the words above, so classifying one is a single string comparison.
+*  Adding a keyword may need other multipliers, the static_assert below says so.
+*/
+constexpr size_t KEYWORD_TABLE_SIZE = 32;
+
+constexpr size_t keyword_hash(string_view word) {
+    return (3 * static_cast<unsigned char>(word.front()) + static_cast<unsigned char>(word.back()) + word.size())
+        % KEYWORD_TABLE_SIZE;
+}
+
+struct KeywordTable {
+    KeywordEntry entries[KEYWORD_TABLE_SIZE] {};
+    bool perfect = true;
+};
+
+constexpr KeywordTable make_keyword_table() {
+    KeywordTable table;
+    for (auto &entry : keyword_list) {
+        auto &slot = table.entries[keyword_hash(entry.word)];
+        if (!slot.word.empty())
+            table.perfect = false;
+        slot = entry;
+    }
+    return table;
+}
+
+constexpr KeywordTable keyword_table = make_keyword_table();
+static_assert(keyword_table.perfect, "keyword_hash has collisions, pick other multipliers");
+
+TokenKind classify_word(string_view word) {
+    auto &entry = keyword_table.entries[keyword_hash(word)];
+    return entry.word == word ? entry.kind : TokenKind::none;
+}
+
+// single-character symbols, indexed by the character
+constexpr std::array<TokenKind, 256> make_symbol_table() {
+    std::array<TokenKind, 256> table {};
+    table['{'] = TokenKind::lbrace;    table['}'] = TokenKind::rbrace;
+    table['('] = TokenKind::lparen;    table[')'] = TokenKind::rparen;
+    table['['] = TokenKind::lbracket;  table[']'] = TokenKind::rbracket;
+    table['<'] = TokenKind::less;      table['>'] = TokenKind::greater;
+    table['+'] = TokenKind::plus;      table['-'] = TokenKind::minus;
+    table['*'] = TokenKind::star;      table['/'] = TokenKind::slash;
+    table['%'] = TokenKind::percent;   table['!'] = TokenKind::bang;
+    table['?'] = TokenKind::question;  table['='] = TokenKind::assign;
+    table['.'] = TokenKind::dot;       table[','] = TokenKind::comma;
+    table['&'] = TokenKind::amper;     table['|'] = TokenKind::pipe;
+    table[';'] = TokenKind::semicolon; table[':'] = TokenKind::colon;
+    table['$'] = TokenKind::dollar;
+    return table;
+}
+
+constexpr std::array<TokenKind, 256> symbol_table = make_symbol_table();
+
+// the two-character symbol starting with first and second, none if there isn't one
+TokenKind classify_pair(char first, char second) {
+    if (second == '=') {
+        switch (first) {
+            case '=': return TokenKind::equals;
+            case '!': return TokenKind::not_equals;
+            case '>': return TokenKind::greater_equals;
+            case '<': return TokenKind::less_equals;
+            case '+': return TokenKind::plus_assign;
+            case '-': return TokenKind::minus_assign;
+            case '*': return TokenKind::star_assign;
+            case '/': return TokenKind::slash_assign;
+            case '%': return TokenKind::percent_assign;
+            default:  return TokenKind::none;
+        }
+    }
+    if (first == '<' && second == '[')
+        return TokenKind::hovec_open;
+    if (first == ']' && second == '>')
+        return TokenKind::hovec_close;
+    return TokenKind::none;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// CHARACTER SCANNING
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+*  Most of lexing is finding where a run of whitespace, identifier characters or digits ends, and counting
+*  the newlines passed on the way. The SSE2 and AVX2 scanners turn 16 or 32 bytes at a time into a bitmap
+*  of the bytes in the class, and the run ends at its first zero bit. Classes are the C locale ones, so
+*  bytes outside ASCII are in none of them. Blocks never read past the end of the text, the last few
+*  bytes are done one at a time.
+*/
+enum class CharClass {
+    Space, Digit, IdChar
+};
 
 bool is_id_char(char c) {
     return isdigit(c) || isalpha(c) || c == '_';
 }
 
-vector<Token> lex_string ( string &source ) {
+template <CharClass Class>
+inline bool in_class(char c) {
+    auto u = static_cast<unsigned char>(c);
+    if constexpr (Class == CharClass::Space)
+        return u == ' ' || (u >= '\t' && u <= '\r');
+    else if constexpr (Class == CharClass::Digit)
+        return u >= '0' && u <= '9';
+    else
+        return (u >= '0' && u <= '9') || ((u | 0x20) >= 'a' && (u | 0x20) <= 'z') || u == '_';
+}
 
-    vector<Token> tokens;
-    int index = 0;
+// adds the newlines in bitmap found, whose bit 0 is the byte at offset
+inline void count_newlines(LexPosition &pos, uint32_t found, size_t offset) {
+    if (found != 0) {
+        pos.line += __builtin_popcount(found);
+        pos.line_start = offset + 32 - __builtin_clz(found);
+    }
+}
 
-    while ( index < source.size() ) {
-        
-        if ( isspace(source[index]) ) {
+template <CharClass Class>
+inline size_t scalar_scan(const char *text, size_t index, size_t size) {
+    while (index < size && in_class<Class>(text[index]))
+        ++index;
+    return index;
+}
+
+inline void scalar_skip_to(const char *text, LexPosition &pos, size_t end) {
+    for (; pos.index < end; ++pos.index) {
+        if (text[pos.index] == '\n') {
+            ++pos.line;
+            pos.line_start = pos.index + 1;
+        }
+    }
+}
+
+inline void scalar_skip_space(const char *text, LexPosition &pos, size_t size) {
+    scalar_skip_to(text, pos, scalar_scan<CharClass::Space>(text, pos.index, size));
+}
+
+#ifdef KVAZZ_X86_LEXER
+// bytes of x in [lo, hi], compared unsigned by shifting the range down to start at 0
+inline __m128i sse2_in_range(__m128i x, char lo, char hi) {
+    auto shifted = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(hi - lo)), shifted);
+}
+
+// bit i is set if byte i of the 16 at text is outside Class
+template <CharClass Class>
+inline uint32_t sse2_outside(const char *text) {
+    auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text));
+    __m128i inside;
+    if constexpr (Class == CharClass::Space)
+        inside = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), sse2_in_range(x, '\t', '\r'));
+    else if constexpr (Class == CharClass::Digit)
+        inside = sse2_in_range(x, '0', '9');
+    else {
+        auto letter = sse2_in_range(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z');
+        inside = _mm_or_si128(letter, _mm_or_si128(sse2_in_range(x, '0', '9'), _mm_cmpeq_epi8(x, _mm_set1_epi8('_'))));
+    }
+    return ~_mm_movemask_epi8(inside) & 0xFFFF;
+}
+
+inline uint32_t sse2_newlines(const char *text) {
+    auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+}
+
+template <CharClass Class>
+inline size_t sse2_scan(const char *text, size_t index, size_t size) {
+    for (; index + 16 <= size; index += 16) {
+        auto outside = sse2_outside<Class>(text + index);
+        if (outside != 0)
+            return index + __builtin_ctz(outside);
+    }
+    return scalar_scan<Class>(text, index, size);
+}
+
+inline void sse2_skip_to(const char *text, LexPosition &pos, size_t end) {
+    for (; pos.index + 16 <= end; pos.index += 16)
+        count_newlines(pos, sse2_newlines(text + pos.index), pos.index);
+    scalar_skip_to(text, pos, end);
+}
+
+// whitespace and the newlines in it in one pass, only the newlines before the run's end are counted
+inline void sse2_skip_space(const char *text, LexPosition &pos, size_t size) {
+    for (; pos.index + 16 <= size; pos.index += 16) {
+        auto outside = sse2_outside<CharClass::Space>(text + pos.index);
+        auto newlines = sse2_newlines(text + pos.index);
+        if (outside != 0) {
+            count_newlines(pos, newlines & ((outside & -outside) - 1), pos.index);
+            pos.index += __builtin_ctz(outside);
+            return;
+        }
+        count_newlines(pos, newlines, pos.index);
+    }
+    scalar_skip_space(text, pos, size);
+}
+
+AVX2_TARGET inline __m256i avx2_in_range(__m256i x, char lo, char hi) {
+    auto shifted = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(hi - lo)), shifted);
+}
+
+template <CharClass Class>
+AVX2_TARGET inline uint32_t avx2_outside(const char *text) {
+    auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text));
+    __m256i inside;
+    if constexpr (Class == CharClass::Space)
+        inside = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), avx2_in_range(x, '\t', '\r'));
+    else if constexpr (Class == CharClass::Digit)
+        inside = avx2_in_range(x, '0', '9');
+    else {
+        auto letter = avx2_in_range(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z');
+        inside = _mm256_or_si256(letter, _mm256_or_si256(avx2_in_range(x, '0', '9'), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_'))));
+    }
+    return ~static_cast<uint32_t>(_mm256_movemask_epi8(inside));
+}
+
+AVX2_TARGET inline uint32_t avx2_newlines(const char *text) {
+    auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text));
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+}
+
+template <CharClass Class>
+AVX2_TARGET inline size_t avx2_scan(const char *text, size_t index, size_t size) {
+    for (; index + 32 <= size; index += 32) {
+        auto outside = avx2_outside<Class>(text + index);
+        if (outside != 0)
+            return index + __builtin_ctz(outside);
+    }
+    return sse2_scan<Class>(text, index, size);
+}
+
+AVX2_TARGET inline void avx2_skip_to(const char *text, LexPosition &pos, size_t end) {
+    for (; pos.index + 32 <= end; pos.index += 32)
+        count_newlines(pos, avx2_newlines(text + pos.index), pos.index);
+    sse2_skip_to(text, pos, end);
+}
+
+AVX2_TARGET inline void avx2_skip_space(const char *text, LexPosition &pos, size_t size) {
+    for (; pos.index + 32 <= size; pos.index += 32) {
+        auto outside = avx2_outside<CharClass::Space>(text + pos.index);
+        auto newlines = avx2_newlines(text + pos.index);
+        if (outside != 0) {
+            count_newlines(pos, newlines & ((outside & -outside) - 1), pos.index);
+            pos.index += __builtin_ctz(outside);
+            return;
+        }
+        count_newlines(pos, newlines, pos.index);
+    }
+    sse2_skip_space(text, pos, size);
+}
+#endif
+
+// the end of the run of Class characters starting at index
+template <SimdLevel Level, CharClass Class>
+inline size_t scan(const char *text, size_t index, size_t size) {
+#ifdef KVAZZ_X86_LEXER
+    if constexpr (Level == SimdLevel::AVX2)
+        return avx2_scan<Class>(text, index, size);
+    else if constexpr (Level == SimdLevel::SSE2)
+        return sse2_scan<Class>(text, index, size);
+#endif
+    return scalar_scan<Class>(text, index, size);
+}
+
+// moves pos to end, keeping track of the lines passed
+template <SimdLevel Level>
+inline void skip_to(const char *text, LexPosition &pos, size_t end) {
+#ifdef KVAZZ_X86_LEXER
+    if constexpr (Level == SimdLevel::AVX2)
+        return avx2_skip_to(text, pos, end);
+    else if constexpr (Level == SimdLevel::SSE2)
+        return sse2_skip_to(text, pos, end);
+#endif
+    scalar_skip_to(text, pos, end);
+}
+
+// moves pos past the whitespace it's at
+template <SimdLevel Level>
+inline void skip_space(const char *text, LexPosition &pos, size_t size) {
+#ifdef KVAZZ_X86_LEXER
+    if constexpr (Level == SimdLevel::AVX2)
+        return avx2_skip_space(text, pos, size);
+    else if constexpr (Level == SimdLevel::SSE2)
+        return sse2_skip_space(text, pos, size);
+#endif
+    scalar_skip_space(text, pos, size);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// LEXER
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+*  lex_token is the whole lexer, the same for every SimdLevel apart from how runs are scanned. It's always
+*  inlined into the entry points for its level, so the AVX2 ones are compiled for AVX2 as a whole and its
+*  scanners inline like the others do.
+*/
+
+// lexes the token at pos into token and moves past it, false at the end of the text or an invalid character
+template <SimdLevel Level>
+__attribute__((always_inline)) inline bool lex_token ( string_view text, LexPosition &pos, Token &token ) {
+
+    const char *data = text.data();
+    const size_t size = text.size();
+
+    auto make_token = [&](size_t start, size_t length, TokenType type, TokenKind kind) {
+        return Token { text.substr(start, length), type, kind, pos.line, static_cast<int>(pos.index - pos.line_start) + 1 };
+    };
+
+    while ( pos.index < size ) {
+        auto c = static_cast<unsigned char>(data[pos.index]);
+
+        if ( in_class<CharClass::Space>(c) ) {
             // could treat newlines special, but don't feel like it yet
-            while( index < source.size() && isspace(source[index]) ) {
-                ++index;
-            }
+            skip_space<Level>(data, pos, size);
+            continue;
         }
         else {
             /*
@@ -35,131 +366,208 @@ vector<Token> lex_string ( string &source ) {
             *   Handle identifiers and reserved words
             *
             */
-            if ( isalpha(source[index]) || source[index] == '_' ) {
-                int end = index + 1;
-
+            if ( isalpha(c) || c == '_' ) {
                 // move ahead until the end of the identifier
-                while ( end < source.size() && is_id_char(source[end]) ) {
-                    ++end;
-                }
-                string word = source.substr(index, end - index);
-                Token token;
+                size_t end = scan<Level, CharClass::IdChar>(data, pos.index + 1, size);
+                auto kind = classify_word(text.substr(pos.index, end - pos.index));
+                TokenType type = TokenType::identifier;
+                if ( kind == TokenKind::lit_true || kind == TokenKind::lit_false )
+                    type = TokenType::bool_literal;
+                else if ( kind != TokenKind::none )
+                    type = TokenType::keyword;
 
-                // unordered_set.contains() only came out in c++20, so count > 0 is a less-readable way to check set membership
-                if ( keywords.count(word) > 0 ) {
-                    token = Token { word, TokenType::keyword };
-                }
-                else if (word == "true" || word == "false") {
-                    token = Token { word, TokenType::bool_literal };
-                }
-                else {
-                    token = Token { word, TokenType::identifier };
-                }
-                tokens.push_back(token);
-                index = end;
+                token = make_token(pos.index, end - pos.index, type, kind);
+                pos.index = end;
+                return true;
             }
             /*
             *
             *   Handle numeric literals (ints & floats)
             *
             */
-            else if ( isdigit(source[index]) ) {
-                int end = index + 1;
+            else if ( isdigit(c) ) {
+                size_t end = scan<Level, CharClass::Digit>(data, pos.index + 1, size);
+                TokenType type = TokenType::int_literal;
 
-                while ( end < source.size() && isdigit(source[end]) ) {
-                    ++end;
-                }
-                Token token;
-
-                if ( source[end] == '.' ) {
-                    ++end;
-                    while ( end < source.size() && isdigit(source[end]) ) {
-                        ++end;
-                    }
-                    string real = source.substr(index, end - index);
-                    token = Token { real, TokenType::real_literal };
+                if ( end < size && data[end] == '.' ) {
+                    end = scan<Level, CharClass::Digit>(data, end + 1, size);
+                    type = TokenType::real_literal;
                 }
-                else {
-                    string integer = source.substr(index, end - index);
-                    token = Token { integer, TokenType::int_literal };
-                }
-                tokens.push_back(token);
-                index = end;
+                token = make_token(pos.index, end - pos.index, type, TokenKind::none);
+                pos.index = end;
+                return true;
             }
             /*
             *
             *   Handle single and double-quoted strings
             *
             */
-            else if ( source[index] == '\"' || source[index] == '\'' ) {
-                char quote = source[index];
-                int end = index + 1;
-                while ( end < source.size() && source[end] != quote ) {
-                    ++end;
-                }
-                string string_value = source.substr(index + 1, end - (index + 1));
-                Token token = Token { string_value, TokenType::string_literal };
-                tokens.push_back(token);
-                index = end + 1;
+            else if ( c == '\"' || c == '\'' ) {
+                // find is memchr, which is vectorized already
+                auto end = text.find(static_cast<char>(c), pos.index + 1);
+                end = end == string_view::npos ? size : end;
+                token = make_token(pos.index + 1, end - (pos.index + 1), TokenType::string_literal, TokenKind::none);
+                skip_to<Level>(data, pos, std::min(end + 1, size));
+                return true;
             }
             /*
             *
             *   Handle operators and other punctuation-based symbols
             *
             */
-            else if (symbols.count(string(1, source[index])) > 0) {
-                int end = index + 2;
-                Token token;
-                if ( end <= source.size() && ( multi.count(source.substr(index, end - index)) > 0) ) {
-                    string symbol_value = source.substr(index, end - index);
-                    token = Token { symbol_value, TokenType::symbol };
-                    index = end;
-                }
-                else {
-                    token =  Token { string(1, source[index]), TokenType::symbol };
-                    ++index;
+            else if ( symbol_table[c] != TokenKind::none ) {
+                auto kind = pos.index + 1 < size ? classify_pair(data[pos.index], data[pos.index + 1]) : TokenKind::none;
+                size_t length = 2;
+                if ( kind == TokenKind::none ) {
+                    kind = symbol_table[c];
+                    length = 1;
                 }
-                tokens.push_back(token);
+                token = make_token(pos.index, length, TokenType::symbol, kind);
+                pos.index += length;
+                return true;
             }
             /*
             *
             *   Handle single and multiline comments
             *
             */
-            else if ( source[index] == '~' ) {
-                int comment_index = index + 1;
-                if ( source[comment_index] == '~' ) {
+            else if ( c == '~' ) {
+                size_t comment_index = pos.index + 1;
+                if ( comment_index < size && data[comment_index] == '~' ) {
                     // multiline comment
-                    ++comment_index;
-                    while (source.substr(comment_index, 2) != "~~") {
-                        ++comment_index;
-                    }
-                    index = comment_index + 2;
+                    auto close = text.find("~~", comment_index + 1);
+                    skip_to<Level>(data, pos, close == string_view::npos ? size : close + 2);
                 }
                 else {
-                    while ( source[comment_index] != '\n' ) {
-                        comment_index += 1;
-                    }
-                    index = comment_index;
+                    auto newline = text.find('\n', comment_index);
+                    pos.index = newline == string_view::npos ? size : newline;
                 }
             }
             else {
                 // not even going to think about error recovery
-                std::cout << "Invalid start of token " << source[index] << std::endl;
-                break;
+                std::cout << "Invalid start of token " << data[pos.index] << " at line " << pos.line
+                    << ", column " << pos.index - pos.line_start + 1 << std::endl;
+                pos.index = size;
+                return false;
             }
 
         }
     }
+    return false;
+}
+
+template <SimdLevel Level>
+__attribute__((always_inline)) inline vector<Token> lex_text ( string_view text ) {
+    vector<Token> tokens;
+    // about one token per four bytes in typical code, growing the vector is a copy of every token so far
+    tokens.reserve(text.size() / 4);
+    LexPosition pos;
+    Token token { {}, TokenType::eof };
+    while ( lex_token<Level>(text, pos, token) )
+        tokens.push_back(token);
     return tokens;
 }
 
-void tuple_print( vector<Token> &tokens ) {
+vector<Token> scalar_lex(string_view text) {
+    return lex_text<SimdLevel::Scalar>(text);
+}
+
+bool scalar_next(string_view text, LexPosition &pos, Token &token) {
+    return lex_token<SimdLevel::Scalar>(text, pos, token);
+}
+
+#ifdef KVAZZ_X86_LEXER
+vector<Token> sse2_lex(string_view text) {
+    return lex_text<SimdLevel::SSE2>(text);
+}
+
+bool sse2_next(string_view text, LexPosition &pos, Token &token) {
+    return lex_token<SimdLevel::SSE2>(text, pos, token);
+}
+
+AVX2_TARGET vector<Token> avx2_lex(string_view text) {
+    return lex_text<SimdLevel::AVX2>(text);
+}
+
+AVX2_TARGET bool avx2_next(string_view text, LexPosition &pos, Token &token) {
+    return lex_token<SimdLevel::AVX2>(text, pos, token);
+}
+#endif
+
+vector<Token> lex_string ( string_view source, SimdLevel level ) {
+#ifdef KVAZZ_X86_LEXER
+    if (level == SimdLevel::AVX2)
+        return avx2_lex(source);
+    if (level == SimdLevel::SSE2)
+        return sse2_lex(source);
+#endif
+    return scalar_lex(source);
+}
+
+vector<Token> lex_string ( string_view source ) {
+    return lex_string(source, simd_level());
+}
+
+Lexer::Lexer(string_view source_, SimdLevel level) : source { source_ }, next_token { scalar_next } {
+#ifdef KVAZZ_X86_LEXER
+    if (level == SimdLevel::AVX2)
+        next_token = avx2_next;
+    else if (level == SimdLevel::SSE2)
+        next_token = sse2_next;
+#endif
+}
+
+Token Lexer::next() {
+    Token token { {}, TokenType::eof };
+    if ( next_token(source, pos, token) )
+        return token;
+    return EOF_TOKEN;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// SOURCE FILES
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+SourceFile::SourceFile(const string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            void *memory = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (memory != MAP_FAILED) {
+                // the lexer reads front to back, so the kernel can read ahead and drop pages behind it
+                madvise(memory, info.st_size, MADV_SEQUENTIAL);
+                mapping = memory;
+                mapping_size = info.st_size;
+            }
+        }
+        close(fd);
+    }
+    if (mapping != nullptr) {
+        view = string_view { static_cast<const char*>(mapping), mapping_size };
+        return;
+    }
+
+    // pipes, empty files and anything else mmap won't take are read the old way. A file that can't be
+    // opened reads as empty, like it always has
+    std::ifstream ifs(path);
+    contents.assign( (std::istreambuf_iterator<char>(ifs) ), (std::istreambuf_iterator<char>() ) );
+    view = contents;
+}
+
+SourceFile::~SourceFile() {
+    if (mapping != nullptr)
+        munmap(mapping, mapping_size);
+}
+
+void tuple_print( Lexer &lexer ) {
     std::cout << "[" << std::endl;
     int i = 0;
-    for (auto &tok : tokens) {
+    for (auto tok = lexer.next(); tok.type != TokenType::eof; tok = lexer.next()) {
+        // '\n' rather than endl, flushing for every token of a large file costs more than lexing it
         if ( i != 0) {
-            std::cout << "," << std::endl;
+            std::cout << ",\n";
         }
         std::cout << "(\"" << tok.sval << "\", \"" << tokenTypeString(tok.type) << "\")";
         ++i;
@@ -172,18 +580,16 @@ int main( int argc, const char* argv[] ) {
     if( argc > 1 ) {
         string source = argv[1];
 
-        // if file flag is used, read from file instead 
+        // if file flag is used, lex the file instead, mapped rather than read into memory
         if( source == "-f" && argc > 2 ) {
-            /* at some point, should read files in chunks since in practice putting a whole file in memory could
-            *  get impractical.
-            */
-            string source_file = argv[2];
-            std::ifstream ifs(source_file);
-            source.assign( (std::istreambuf_iterator<char>(ifs) ), (std::istreambuf_iterator<char>() ) );
+            SourceFile source_file { argv[2] };
+            Lexer lexer { source_file.text() };
+            tuple_print(lexer);
+            return 0;
         } 
 
-        vector<Token> tokens = lex_string(source);
-        tuple_print(tokens);
+        Lexer lexer { source };
+        tuple_print(lexer);
     }
     return 0;
 };
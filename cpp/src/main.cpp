@@ -4,71 +4,226 @@
 #include "lexer.h"
 #include "parser.h"
 #include "interpreter.h"
+#include "resolver.h"
+#include "optimizer.h"
+#include "purity.h"
+#include "bytecode.h"
+#include "vm.h"
+#include "transpiler.h"
+#include "runtime.h"
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <memory>
-#include <fstream>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 using std::string;
 
 enum Command { lex, parse, exec, compile };
 
-void do_main(int argc, const char* argv[], Command cmd) {
-    if ( !(argc > 2) ) return;
+struct Options {
+    bool vm = false;
+    bool closure = false;
+    bool jit = false;
+    bool optimized = false;
+    bool bench = false;
+    string output;
+};
 
-    string source;
-    string source_file = argv[2];
-    std::ifstream ifs(source_file);
-    source.assign( (std::istreambuf_iterator<char>(ifs) ), (std::istreambuf_iterator<char>() ) );
+/**
+ *  Runs a resolved program with the engine options selects, on an Isolate of its own
+ */
+void run_program(BaseNode *ast, const Options &options) {
+    Isolate isolate;
+    if (options.vm) {
+        BytecodeProgram program = compile_program(ast);
+        run_bytecode_vm(isolate, program);
+    }
+    else if (options.closure) {
+        run_closure_interpreter(isolate, ast);
+    }
+    else {
+        run_ast_interpreter(isolate, ast, options.jit);
+    }
+}
+
+/**
+ *  Prints the lexer's throughput on source at every SimdLevel the CPU supports, the best of several
+ *  runs each, and checks the faster levels produce exactly the tokens the scalar one does
+ */
+void bench_lexer(std::string_view source) {
+    const char *level_names[] = { "scalar", "sse2", "avx2" };
+    std::vector<Token> expected = lex_string(source, SimdLevel::Scalar);
 
-    std::vector<Token> tokens = lex_string(source);
+    for (int level = 0; level <= static_cast<int>(simd_level()); ++level) {
+        double best = 0.0;
+        std::vector<Token> tokens;
+        // at least 5 runs and half a second, so small files still get a stable number
+        double total = 0.0;
+        for (int run = 0; run < 5 || total < 0.5; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            tokens = lex_string(source, static_cast<SimdLevel>(level));
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            total += elapsed.count();
+            best = run == 0 ? elapsed.count() : std::min(best, elapsed.count());
+        }
+
+        bool same = tokens.size() == expected.size();
+        for (size_t i = 0; same && i < tokens.size(); ++i) {
+            same = tokens[i].sval.data() == expected[i].sval.data() && tokens[i].sval.size() == expected[i].sval.size()
+                && tokens[i].type == expected[i].type && tokens[i].kind == expected[i].kind
+                && tokens[i].line == expected[i].line && tokens[i].column == expected[i].column;
+        }
+        std::cout << level_names[level] << ": " << source.size() / best / 1e6 << " MB/s, "
+            << tokens.size() << " tokens" << (same ? "" : " (DIFFERENT FROM SCALAR)") << std::endl;
+    }
+}
+
+void exec_file(const string &source_file, const Options &options) {
+    SourceFile source { source_file };
+    ParsedProgram program = parse_source(source.text());
+    optimize_ast(program);
+    resolve_scopes(program.root);
+    analyze_purity(program.root);
+    run_program(program.root, options);
+}
+
+// returns the exit status
+int do_main(int argc, const char* argv[], Command cmd) {
+    // options start with "--", the other arguments are source files
+    Options options;
+    std::vector<string> source_files;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if ( arg == "--vm" ) {
+            options.vm = true;
+        }
+        else if ( arg == "--closure" ) {
+            options.closure = true;
+        }
+        else if ( arg == "--jit" ) {
+            options.jit = true;
+        }
+        else if ( arg == "--optimized" ) {
+            options.optimized = true;
+        }
+        else if ( arg == "--bench" ) {
+            options.bench = true;
+        }
+        else if ( arg == "-o" && i + 1 < argc ) {
+            options.output = argv[++i];
+        }
+        else if ( arg.rfind("--", 0) == 0 ) {
+            std::cout << "Unknown option " << arg << std::endl;
+            return 0;
+        }
+        else {
+            source_files.push_back(arg);
+        }
+    }
+    if ( source_files.empty() ) return 0;
+
+    // exec with several files runs them all at once, each on a thread and Isolate of its own. Every
+    // other command only looks at the first file
+    if ( cmd == exec && source_files.size() > 1 ) {
+        std::vector<std::thread> threads;
+        for (auto &source_file : source_files)
+            threads.emplace_back(exec_file, std::cref(source_file), std::cref(options));
+        for (auto &thread : threads)
+            thread.join();
+        return 0;
+    }
+
+    // mapped, not read, and lexed as it's parsed, so memory stays around the file's size plus the AST
+    SourceFile source_file { source_files[0] };
+    auto source = source_file.text();
+
+    // compile -o builds a native executable, which doesn't need lexing or parsing if it's already cached
+    if ( cmd == compile && !options.output.empty() ) {
+        return compile_native_program(source, options.output) ? 0 : 1;
+    }
+
+    if ( cmd == lex && options.bench ) {
+        bench_lexer(source);
+        return 0;
+    }
 
     // if selected command is lex, print the tokens and then exit
     if ( cmd == lex ) {
-        tuple_print(tokens);
-        return;
+        Lexer lexer { source };
+        tuple_print(lexer);
+        return 0;
     }
 
-    // parse_tokens will print the AST if selected command is parse
-    std::shared_ptr<BaseNode> ast = parse_tokens(tokens, cmd == parse);
-    if (cmd == parse) return;
+    // parse_source will print the AST if selected command is parse, parse --optimized prints it after
+    // the optimizer has run instead
+    ParsedProgram parsed = parse_source(source, cmd == parse && !options.optimized);
+    if (cmd == parse && !options.optimized) return 0;
 
-    // run the interpreter if exec is selected
-    if (cmd == exec) {
-        run_ast_interpreter(ast);
-        return;
+    optimize_ast(parsed);
+    auto ast = parsed.root;
+    if (cmd == parse) {
+        pretty_print_ast(ast);
+        return 0;
+    }
+
+    resolve_scopes(ast);
+    analyze_purity(ast);
+
+    // compile prints the bytecode
+    if (cmd == compile) {
+        BytecodeProgram program = compile_program(ast);
+        disassemble_program(program);
+        return 0;
     }
 
+    // run the program if exec is selected
+    if (cmd == exec) {
+        run_program(ast, options);
+        return 0;
+    }
+    return 0;
 }
 
 /*
 *
-*  args: [ lex | parse | exec | compile | help ] "path/to/file"
+*  args: [ lex | parse | exec | compile | help ] [ options ] "path/to/file" [ "path/to/file" ... ]
+*  options:
+*      --bench      (lex) print the lexer's throughput in MB/s with and without SIMD scanning
+*      --optimized  (parse) print the AST after constant folding and dead code removal
+*      --vm         (exec) run the compiled bytecode instead of walking the AST
+*      --closure    (exec) compile the AST into closures before running it
+*      --jit        (exec) compile hot integer-only functions to native x86-64 code
+*      -o path      (compile) transpile to C++ and build a native executable at path
+*  exec runs every file it's given at the same time, each in an Isolate of its own. The other commands
+*  only take one.
 *  (More options to come, but I like this for now) 
 *
 */
 int main( int argc, const char* argv[] ) {
+    int status = 0;
     if ( argc > 1 ) {
         string primary_cmd = argv[1];
 
         // should be refactored at some point
         if ( primary_cmd == "lex" ) {
-            do_main(argc, argv, lex);
+            status = do_main(argc, argv, lex);
             
         } else
         if ( primary_cmd == "parse" ) {
-            do_main(argc, argv, parse);
+            status = do_main(argc, argv, parse);
 
         } else
         if ( primary_cmd == "exec" ) {
-            do_main(argc, argv, exec);
+            status = do_main(argc, argv, exec);
         } else 
         if ( primary_cmd == "compile" ) {
-            std::cout << "Not implemented" << std::endl;
-            return -1;
+            status = do_main(argc, argv, compile);
         } else {
-            std::cout << "Structure args in the form of: [ lex | parse | exec | compile | help ] \"path/to/file\" " << std::endl;
+            std::cout << "Structure args in the form of: [ lex | parse | exec | compile | help ] [ --bench | --optimized | --vm | --closure | --jit | -o path ] \"path/to/file\" " << std::endl;
         }
     }
-    return 0;
+    return status;
 }
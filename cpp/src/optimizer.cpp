@@ -0,0 +1,313 @@
+#include "optimizer.h"
+#include "interpreter.h"
+#include "ast.h"
+#include <cmath>
+#include <climits>
+#include <string>
+#include <vector>
+#include <memory>
+
+using std::vector;
+using std::string;
+
+/////////////////////////////////////////////////////////////////////////////////////
+// CONSTANT FOLDING
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+bool is_literal_node(BaseNode *node) {
+    auto type = node->type();
+    return type == NodeType::IntLiteral || type == NodeType::RealLiteral
+        || type == NodeType::BoolLiteral || type == NodeType::StringLiteral;
+}
+
+bool is_numeric(KvazzValue &kv) {
+    return kv.type == KvazzType::Int || kv.type == KvazzType::Real;
+}
+
+/**
+ *  Whether applying op to the literal values left and right gives a value without reporting an error or
+ *  hitting undefined behaviour, i.e. whether it's safe to do it now instead of at runtime
+ */
+bool is_foldable(BinaryOpType op, KvazzValue &left, KvazzValue &right) {
+    if (is_logical_binop(op) || is_equality_binop(op))
+        return true;
+
+    if (op == BinaryOpType::plus && left.type == KvazzType::String && right.type == KvazzType::String)
+        return true;
+    if (!is_numeric(left) || !is_numeric(right))
+        return false;
+    if (is_comparison_binop(op))
+        return true;
+
+    // Int results are checked for overflow, Real ones for becoming inf or nan in the caller
+    if (left.type == KvazzType::Int && right.type == KvazzType::Int) {
+        auto l = left.as_int();
+        auto r = right.as_int();
+        int unused;
+        switch(op) {
+            case BinaryOpType::plus:     return !__builtin_add_overflow(l, r, &unused);
+            case BinaryOpType::minus:    return !__builtin_sub_overflow(l, r, &unused);
+            case BinaryOpType::multiply: return !__builtin_mul_overflow(l, r, &unused);
+            case BinaryOpType::divide:
+            case BinaryOpType::modulo:   return r != 0 && !(l == INT_MIN && r == -1);
+            default:                     return false;
+        }
+    }
+    return op != BinaryOpType::modulo;
+}
+
+/**
+ *  Turns a folded value back into a literal node, nullptr if it has no literal form
+ */
+BaseNode *make_literal(AstArena &arena, KvazzValue &kv) {
+    switch(kv.type) {
+        case KvazzType::Int:    return arena.make<IntLiteral>(kv.as_int());
+        case KvazzType::Bool:   return arena.make<BoolLiteral>(kv.as_bool());
+        case KvazzType::String: return arena.make<StringLiteral>(kv.as_string());
+        case KvazzType::Real:
+        {
+            auto value = kv.as_real();
+            return std::isfinite(value) ? static_cast<BaseNode*>(arena.make<RealLiteral>(value)) : nullptr;
+        }
+        default:                return nullptr;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// OPTIMIZER
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+*  Literals and folded operators are evaluated with an Interpreter, so folded results are exactly what
+*  running the nodes would have produced. It has an Isolate of its own, though folding never touches globals.
+*  Folded literals and rebuilt blocks are made in the arena of the program being optimized.
+*/
+class AstOptimizer {
+private:
+    AstArena &arena;
+    Isolate isolate;
+    Interpreter interpreter { isolate };
+
+    KvazzValue literal_value(BaseNode *node) {
+        return node->eval(interpreter, nullptr).kvazz_value;
+    }
+
+    // evaluates an operator node whose operands are literals, nullptr if the result has no literal form
+    BaseNode *fold(BaseNode *node) {
+        auto result = node->eval(interpreter, nullptr);
+        if (result.flag != KvazzFlag::Good)
+            return nullptr;
+        return make_literal(arena, result.kvazz_value);
+    }
+
+    BaseNode *optimize_binary_op(BaseNode *node);
+    BaseNode *optimize_unary_op(BaseNode *node);
+    void optimize_statements(const vector<BaseNode*> &stmts, vector<BaseNode*> &optimized);
+
+public:
+    AstOptimizer(AstArena &arena_)
+        : arena { arena_ } {}
+
+    BaseNode *optimize(BaseNode *node);
+    BaseNode *optimize_expr(BaseNode *node);
+    Block *optimize_block(Block *node);
+    void optimize_program(Program *node);
+};
+
+BaseNode *AstOptimizer::optimize_binary_op(BaseNode *node) {
+    auto binop = static_cast<BinaryOp*>(node);
+    binop->left_expr = optimize_expr(binop->left_expr);
+    binop->right_expr = optimize_expr(binop->right_expr);
+    if (!is_literal_node(binop->left_expr) || !is_literal_node(binop->right_expr))
+        return node;
+
+    auto left = literal_value(binop->left_expr);
+    auto right = literal_value(binop->right_expr);
+    if (!is_foldable(binop->op_type, left, right))
+        return node;
+    auto folded = fold(binop);
+    return folded != nullptr ? folded : node;
+}
+
+BaseNode *AstOptimizer::optimize_unary_op(BaseNode *node) {
+    auto unop = static_cast<UnaryOp*>(node);
+    unop->right_expr = optimize_expr(unop->right_expr);
+    if (!is_literal_node(unop->right_expr))
+        return node;
+
+    auto right = literal_value(unop->right_expr);
+    if (unop->op_type == UnaryOpType::minus) {
+        if (!is_numeric(right) || (right.type == KvazzType::Int && right.as_int() == INT_MIN))
+            return node;
+    }
+    auto folded = fold(unop);
+    return folded != nullptr ? folded : node;
+}
+
+/**
+ *  Optimizes an expression, returning the node to replace it with
+ */
+BaseNode *AstOptimizer::optimize_expr(BaseNode *node) {
+    switch(node->type()) {
+        case NodeType::BinaryOp:
+            return optimize_binary_op(node);
+        case NodeType::UnaryOp:
+            return optimize_unary_op(node);
+        case NodeType::FunctionCall:
+        {
+            auto call = static_cast<FunctionCall*>(node);
+            call->callee = optimize_expr(call->callee);
+            for (auto &arg : call->expr_args)
+                arg = optimize_expr(arg);
+            return node;
+        }
+        case NodeType::Access:
+        {
+            auto access = static_cast<Access*>(node);
+            access->left_expr = optimize_expr(access->left_expr);
+            for (auto &index : access->index_exprs)
+                index = optimize_expr(index);
+            return node;
+        }
+        case NodeType::VectorLiteral:
+        {
+            for (auto &element : static_cast<VectorLiteral*>(node)->contents)
+                element = optimize_expr(element);
+            return node;
+        }
+        default:
+            return node;
+    }
+}
+
+/**
+ *  Optimizes a statement, returning the node to replace it with or nullptr if it can be dropped
+ */
+BaseNode *AstOptimizer::optimize(BaseNode *node) {
+    switch(node->type()) {
+        case NodeType::Block:
+        {
+            auto block = optimize_block(static_cast<Block*>(node));
+            return block->statements().empty() ? nullptr : block;
+        }
+        case NodeType::AssignOp:
+        {
+            auto assign = static_cast<AssignOp*>(node);
+            assign->lvalue = optimize_expr(assign->lvalue);
+            assign->expr_node = optimize_expr(assign->expr_node);
+            return node;
+        }
+        case NodeType::Declare:
+        {
+            auto decl = static_cast<Declare*>(node);
+            decl->expr_node = optimize_expr(decl->expr_node);
+            return node;
+        }
+        case NodeType::Return:
+        {
+            auto ret = static_cast<Return*>(node);
+            ret->expr_node = optimize_expr(ret->expr_node);
+            return node;
+        }
+        case NodeType::IfThen:
+        {
+            auto if_then = static_cast<IfThen*>(node);
+            if_then->condition = optimize_expr(if_then->condition);
+            if (is_literal_node(if_then->condition)) {
+                auto condition = literal_value(if_then->condition);
+                return truthy_test(condition) ? optimize(if_then->body) : nullptr;
+            }
+            if_then->body = optimize_block(static_cast<Block*>(if_then->body));
+            return node;
+        }
+        case NodeType::IfElse:
+        {
+            auto if_else = static_cast<IfElse*>(node);
+            if_else->condition = optimize_expr(if_else->condition);
+            if (is_literal_node(if_else->condition)) {
+                auto condition = literal_value(if_else->condition);
+                return optimize(truthy_test(condition) ? if_else->then_body : if_else->else_body);
+            }
+            if_else->then_body = optimize_block(static_cast<Block*>(if_else->then_body));
+            if_else->else_body = optimize_block(static_cast<Block*>(if_else->else_body));
+            return node;
+        }
+        case NodeType::While:
+        {
+            auto loop = static_cast<While*>(node);
+            loop->condition = optimize_expr(loop->condition);
+            if (is_literal_node(loop->condition)) {
+                auto condition = literal_value(loop->condition);
+                if (!truthy_test(condition))
+                    return nullptr;
+            }
+            loop->body = optimize_block(static_cast<Block*>(loop->body));
+            return node;
+        }
+        default:
+            return optimize_expr(node);
+    }
+}
+
+/**
+ *  Optimizes stmts into optimized. Nested blocks that don't declare anything are spliced into the
+ *  enclosing one and everything after a return is dropped.
+ */
+void AstOptimizer::optimize_statements(const vector<BaseNode*> &stmts, vector<BaseNode*> &optimized) {
+    for (auto &stmt : stmts) {
+        auto new_stmt = optimize(stmt);
+        if (new_stmt == nullptr)
+            continue;
+
+        if (new_stmt->type() == NodeType::Block) {
+            auto &nested = static_cast<Block*>(new_stmt)->statements();
+            bool declares = false;
+            for (auto &nd : nested)
+                declares = declares || nd->type() == NodeType::Declare;
+            if (!declares) {
+                optimized.insert(optimized.end(), nested.begin(), nested.end());
+                if (optimized.back()->type() == NodeType::Return)
+                    return;
+                continue;
+            }
+        }
+
+        optimized.push_back(new_stmt);
+        if (new_stmt->type() == NodeType::Return)
+            return;
+    }
+}
+
+Block *AstOptimizer::optimize_block(Block *node) {
+    vector<BaseNode*> optimized;
+    optimize_statements(node->statements(), optimized);
+    return arena.make<Block>(std::move(optimized));
+}
+
+void AstOptimizer::optimize_program(Program *node) {
+    // top-level statements are only declarations, so they are optimized in place
+    for (auto nd : node->statements()) {
+        if (nd->type() == NodeType::FunctionDeclare) {
+            auto fd = static_cast<FunctionDeclare*>(nd);
+            fd->body = optimize_block(static_cast<Block*>(fd->body));
+        }
+        else if (nd->type() == NodeType::Declare) {
+            auto decl = static_cast<Declare*>(nd);
+            decl->expr_node = optimize_expr(decl->expr_node);
+        }
+    }
+}
+
+// entry-point for the optimizer
+void optimize_ast(ParsedProgram &program) {
+    AstOptimizer optimizer { program.arena };
+    auto ast = program.root;
+    if (ast->type() == NodeType::Program) {
+        optimizer.optimize_program(static_cast<Program*>(ast));
+        return;
+    }
+    auto optimized = optimizer.optimize(ast);
+    program.root = optimized != nullptr ? optimized : program.arena.make<Block>(vector<BaseNode*>{});
+}
@@ -4,51 +4,50 @@
 
 #include <string>
 #include <iostream>
-#include <memory> 
 
 using std::vector;
 using std::string;
-using std::shared_ptr;
 
 /*
 *   ParseState Methods
 */
 
-Token ParseState::currentToken () {
-    if (index >= tokens.size())
-        return EOF_TOKEN;
-    return tokens[index];
+const Token &ParseState::currentToken () {
+    return current;
 }
 
-Token ParseState::peekToken (int n) {
-    int i { n + 1 };
-    if ( i >= tokens.size())
-        return EOF_TOKEN;
-    return tokens[i];
+const Token &ParseState::peekToken (int n) {
+    while ( lookahead.size() <= static_cast<size_t>(n) )
+        lookahead.push_back(lexer.next());
+    return lookahead[n];
 }
 
 Token ParseState::advance() {
-    Token ct = currentToken();
-    ++index;
+    Token ct = current;
+    if ( !lookahead.empty() ) {
+        current = lookahead.front();
+        lookahead.pop_front();
+    }
+    else {
+        current = lexer.next();
+    }
     return ct;
 }
 
-Token ParseState::matchKeyword(string kwrd) {
-    Token ct = currentToken();
-    string tv = ct.sval;
-    TokenType   tt = ct.type;
+Token ParseState::matchKeyword(TokenKind kind) {
+    const Token &ct = currentToken();
     
-    if ( tt == TokenType::keyword && kwrd == tv )
+    if ( ct.type == TokenType::keyword && ct.kind == kind )
         return advance();
 
-    std::cout << "Expected keyword " << kwrd <<  " , encountered " 
-        << tokenTypeString(tt) << " with value " << tv << std::endl;
+    std::cout << "Expected keyword " << tokenKindString(kind) <<  " , encountered " 
+        << tokenTypeString(ct.type) << " with value " << ct.sval << std::endl;
     parsingError();
     return EOF_TOKEN;
 }
 
 Token ParseState::matchTokenType(TokenType ttype) {
-    Token ct = currentToken();
+    const Token &ct = currentToken();
 
     if ( ct.type == ttype )
         return advance();
@@ -59,20 +58,20 @@ Token ParseState::matchTokenType(TokenType ttype) {
     return EOF_TOKEN;
 }
 
-Token ParseState::matchSymbol(string smbl) {
-    Token ct = currentToken();
+Token ParseState::matchSymbol(TokenKind kind) {
+    const Token &ct = currentToken();
 
-    if ( ct.type == TokenType::symbol && ct.sval == smbl ) 
+    if ( ct.type == TokenType::symbol && ct.kind == kind ) 
         return advance();
     
-    std::cout << "Expected symbol " << smbl <<  " , encountered " 
+    std::cout << "Expected symbol " << tokenKindString(kind) <<  " , encountered " 
         << tokenTypeString(ct.type) << " with value " << ct.sval << std::endl;
     parsingError();
     return EOF_TOKEN;
 }
 
 Token ParseState::matchLiteral() {
-    Token ct = currentToken();
+    const Token &ct = currentToken();
     TokenType tt = ct.type;
     if ( tt == TokenType::bool_literal || tt == TokenType::int_literal || tt == TokenType::real_literal || tt == TokenType::string_literal )
         return advance();
@@ -84,6 +83,9 @@ Token ParseState::matchLiteral() {
 }
 
 void ParseState::parsingError() {
+    const Token &ct = currentToken();
+    if ( ct.type != TokenType::eof )
+        std::cout << "At line " << ct.line << ", column " << ct.column << ":" << std::endl;
     std::cout << "Parsing error encountered, terminating." << std::endl;
     exit(-1);
 }
@@ -92,16 +94,16 @@ void ParseState::parsingError() {
 *  Recursive-descent parsing methods
 */
 
-shared_ptr<BaseNode> parse_program(ParseState &parse_state) {
-    auto ast_root = std::make_shared<Program>();
+BaseNode *parse_program(ParseState &parse_state) {
+    auto ast_root = parse_state.make_node<Program>();
 
     Token ct = parse_state.currentToken(); 
     while (ct.type != TokenType::eof) {
-        if ( ct.sval == "var" ) {
+        if ( ct.kind == TokenKind::kw_var ) {
             auto ast_node = parse_declare(parse_state);
             ast_root->add_top_level_stmt(ast_node);
         }
-        else if (ct.sval == "function") {
+        else if (ct.kind == TokenKind::kw_function || ct.kind == TokenKind::kw_memo) {
             auto ast_node = parse_function_declare(parse_state);
             ast_root->add_top_level_stmt(ast_node);
         }
@@ -115,68 +117,78 @@ shared_ptr<BaseNode> parse_program(ParseState &parse_state) {
     return ast_root;
 }
 
-shared_ptr<BaseNode> parse_function_declare(ParseState &parse_state) {
-    parse_state.matchKeyword( "function" );
+BaseNode *parse_function_declare(ParseState &parse_state) {
+    // memo function f(...) asks for f's results to be cached, which happens if it turns out to be pure
+    bool memo = parse_state.currentToken().kind == TokenKind::kw_memo;
+    if ( memo )
+        parse_state.matchKeyword(TokenKind::kw_memo);
+    parse_state.matchKeyword(TokenKind::kw_function);
     Token identifier_token = parse_state.matchTokenType( TokenType::identifier );
-    parse_state.matchSymbol( "(" );
+    parse_state.matchSymbol(TokenKind::lparen);
 
     vector<string> arg_names;
-    if ( parse_state.currentToken().sval != ")" ) {
+    if ( parse_state.currentToken().kind != TokenKind::rparen ) {
         do {
             Token arg = parse_state.matchTokenType( TokenType::identifier );
-            arg_names.push_back(arg.sval);
+            arg_names.emplace_back(arg.sval);
         } 
         while ( 
             // use short-circuiting here to advance the parser state only if the comma is encountered
-            ( parse_state.currentToken().sval == "," ) && 
+            ( parse_state.currentToken().kind == TokenKind::comma ) && 
             ( parse_state.advance().type != TokenType::eof ) 
         );
     }
 
-    parse_state.matchSymbol( ")" );
+    parse_state.matchSymbol(TokenKind::rparen);
     auto body = parse_block(parse_state);
-    return std::make_shared<FunctionDeclare>(identifier_token.sval, arg_names, body);
+    auto function_declare = parse_state.make_node<FunctionDeclare>(string(identifier_token.sval), arg_names, body);
+    function_declare->memo = memo;
+    return function_declare;
 }
 
-shared_ptr<BaseNode> parse_block(ParseState &parse_state) {
-    parse_state.matchSymbol( "{" );
-    vector<shared_ptr<BaseNode>> stmts { parse_statement(parse_state) };
+BaseNode *parse_block(ParseState &parse_state) {
+    parse_state.matchSymbol(TokenKind::lbrace);
+    vector<BaseNode*> stmts { parse_statement(parse_state) };
 
-    while ( parse_state.currentToken().sval != "}" )
+    while ( parse_state.currentToken().kind != TokenKind::rbrace )
         stmts.push_back( parse_statement(parse_state) );
 
-    parse_state.matchSymbol( "}" );
-    return std::make_shared<Block>(stmts);
+    parse_state.matchSymbol(TokenKind::rbrace);
+    return parse_state.make_node<Block>(stmts);
 }
 
-shared_ptr<BaseNode> parse_statement(ParseState &parse_state) {
+BaseNode *parse_statement(ParseState &parse_state) {
     auto current_token = parse_state.currentToken();
 
-    if ( current_token.type == TokenType::identifier || current_token.sval == "$" ) {
+    if ( current_token.type == TokenType::identifier || current_token.kind == TokenKind::dollar ) {
         auto lvalue = parse_primary(parse_state);
 
         if ( lvalue->type() == NodeType::FunctionCall ) {
-            parse_state.matchSymbol( ";" );
+            parse_state.matchSymbol(TokenKind::semicolon);
             return lvalue;
         }
         return parse_assignment(parse_state, lvalue);
     }
 
-    shared_ptr<BaseNode> statement;
-    if ( current_token.sval == "var" ) { 
+    BaseNode *statement = nullptr;
+    if ( current_token.kind == TokenKind::kw_var ) { 
         statement =  parse_declare(parse_state);
     }
-    else if ( current_token.sval == "if" ) {
+    else if ( current_token.kind == TokenKind::kw_if ) {
         statement = parse_if(parse_state);
     }          
-    else if ( current_token.sval == "while" ) {
+    else if ( current_token.kind == TokenKind::kw_while ) {
         statement =  parse_while(parse_state);
     }           
-    else if ( current_token.sval == "return" ) {
-        parse_state.matchKeyword( "return" );
+    else if ( current_token.type == TokenType::keyword && (current_token.kind == TokenKind::kw_spawn || current_token.kind == TokenKind::kw_sync) ) {
+        statement = parse_primary(parse_state);
+        parse_state.matchSymbol(TokenKind::semicolon);
+    }
+    else if ( current_token.kind == TokenKind::kw_return ) {
+        parse_state.matchKeyword(TokenKind::kw_return);
         auto expr = parse_expr(parse_state);
-        parse_state.matchSymbol( ";" );
-        statement = std::make_shared<Return>(expr);
+        parse_state.matchSymbol(TokenKind::semicolon);
+        statement = parse_state.make_node<Return>(expr);
     } 
     else {
         std::cout << "Invalid start of statement, encountered " << current_token.sval << std::endl;
@@ -186,61 +198,61 @@ shared_ptr<BaseNode> parse_statement(ParseState &parse_state) {
     return statement;
 }
 
-shared_ptr<BaseNode> parse_if(ParseState &parse_state){
-    parse_state.matchKeyword( "if" );
+BaseNode *parse_if(ParseState &parse_state){
+    parse_state.matchKeyword(TokenKind::kw_if);
     auto condition = parse_expr(parse_state);
-    parse_state.matchKeyword("then");
+    parse_state.matchKeyword(TokenKind::kw_then);
     auto then_body = parse_block(parse_state);
 
-    if( parse_state.currentToken().sval == "else"  ) {
-        parse_state.matchKeyword("else");
+    if( parse_state.currentToken().kind == TokenKind::kw_else  ) {
+        parse_state.matchKeyword(TokenKind::kw_else);
         auto else_body = parse_block(parse_state);
-        return std::make_shared<IfElse>(condition, then_body, else_body);
+        return parse_state.make_node<IfElse>(condition, then_body, else_body);
     }
     
-    return std::make_shared<IfThen>(condition, then_body);
+    return parse_state.make_node<IfThen>(condition, then_body);
 }
 
-shared_ptr<BaseNode> parse_while(ParseState &parse_state) {
-    parse_state.matchKeyword( "while" );
+BaseNode *parse_while(ParseState &parse_state) {
+    parse_state.matchKeyword(TokenKind::kw_while);
     auto condition = parse_expr(parse_state);
-    parse_state.matchKeyword( "do" );
+    parse_state.matchKeyword(TokenKind::kw_do);
     auto body = parse_block(parse_state);
-    return std::make_shared<While>(condition, body);
+    return parse_state.make_node<While>(condition, body);
 }
 
-shared_ptr<BaseNode> parse_assignment(ParseState &parse_state, shared_ptr<BaseNode> lvalue) {
+BaseNode *parse_assignment(ParseState &parse_state, BaseNode *lvalue) {
 
     if (lvalue->type() != NodeType::VariableLookup && lvalue->type() != NodeType::Access) {
         std::cout << "Invalid L value:  " << lvalue->value() << std::endl;
         parse_state.parsingError();
     }
 
-    auto token_value = parse_state.currentToken().sval;
-    if ( !(token_value == "="  || token_value == "+=" || token_value == "-=" || 
-        token_value == "/=" || token_value == "*=" || token_value == "%=" ) ) 
+    auto op = parse_state.currentToken();
+    if ( !(op.kind == TokenKind::assign || op.kind == TokenKind::plus_assign || op.kind == TokenKind::minus_assign || 
+        op.kind == TokenKind::slash_assign || op.kind == TokenKind::star_assign || op.kind == TokenKind::percent_assign ) ) 
     {
-        std::cout << "Expected assignment operator, encountered  " << token_value << std::endl;
+        std::cout << "Expected assignment operator, encountered  " << op.sval << std::endl;
         parse_state.parsingError();
     }
     
-    parse_state.matchSymbol(token_value);
+    parse_state.matchSymbol(op.kind);
     auto expr = parse_expr(parse_state);
-    parse_state.matchSymbol(";");
-    return std::make_shared<AssignOp>(lvalue, token_value, expr);
+    parse_state.matchSymbol(TokenKind::semicolon);
+    return parse_state.make_node<AssignOp>(lvalue, string(op.sval), expr);
 }
 
-shared_ptr<BaseNode> parse_declare(ParseState &parse_state) {
+BaseNode *parse_declare(ParseState &parse_state) {
 
-    parse_state.matchKeyword("var");
+    parse_state.matchKeyword(TokenKind::kw_var);
     auto id = parse_state.matchTokenType(TokenType::identifier);
-    parse_state.matchSymbol("=");
+    parse_state.matchSymbol(TokenKind::assign);
     auto expr = parse_expr(parse_state);
-    parse_state.matchSymbol(";");
-    return std::make_shared<Declare>(id.sval, expr);
+    parse_state.matchSymbol(TokenKind::semicolon);
+    return parse_state.make_node<Declare>(string(id.sval), expr);
 }
 
-shared_ptr<BaseNode> parse_expr(ParseState &parse_state, int rbp) {
+BaseNode *parse_expr(ParseState &parse_state, int rbp) {
     auto left_expr = parse_primary(parse_state);
 
     // use Pratt parsing for operator precedence in expressions
@@ -248,82 +260,99 @@ shared_ptr<BaseNode> parse_expr(ParseState &parse_state, int rbp) {
         auto op = parse_state.currentToken();
         parse_state.advance();
         // last arg, right_expr, stores the result of the recursive call here
-        left_expr = std::make_shared<BinaryOp>(op.sval, left_expr, parse_expr(parse_state, binding_power(op)));
+        left_expr = parse_state.make_node<BinaryOp>(string(op.sval), left_expr, parse_expr(parse_state, binding_power(op)));
     }
     return left_expr;
 }
 
-shared_ptr<BaseNode> parse_unary(ParseState &parse_state) {
-    auto token_value = parse_state.currentToken().sval;
-    parse_state.matchSymbol(token_value);
+BaseNode *parse_unary(ParseState &parse_state) {
+    auto op = parse_state.currentToken();
+    parse_state.matchSymbol(op.kind);
     auto expr_node = parse_primary(parse_state);
-    return std::make_shared<UnaryOp>(token_value, expr_node);
+    return parse_state.make_node<UnaryOp>(string(op.sval), expr_node);
+}
+
+/*
+*  spawn f(a, b) and sync e become calls to the built-ins spawn(f, a, b) and sync(e), which run the call
+*  as a task and wait for its result. Being keywords, they can't be shadowed like other built-ins.
+*/
+BaseNode *parse_fork_join(ParseState &parse_state) {
+    auto keyword = parse_state.matchTokenType(TokenType::keyword);
+    auto operand = parse_primary(parse_state);
+
+    vector<BaseNode*> args { operand };
+    if ( keyword.kind == TokenKind::kw_spawn ) {
+        if ( operand->type() != NodeType::FunctionCall ) {
+            std::cout << "Expected a function call after spawn" << std::endl;
+            parse_state.parsingError();
+        }
+        auto call = static_cast<FunctionCall*>(operand);
+        args = call->expr_args;
+        args.insert(args.begin(), call->callee);
+    }
+    return parse_state.make_node<FunctionCall>(parse_state.make_node<VariableLookup>(string(keyword.sval), false), args);
 }
 
-shared_ptr<BaseNode> parse_primary(ParseState &parse_state) {
+BaseNode *parse_primary(ParseState &parse_state) {
     auto current_token = parse_state.currentToken();
 
+    // fork/join
+    if ( current_token.type == TokenType::keyword && (current_token.kind == TokenKind::kw_spawn || current_token.kind == TokenKind::kw_sync) ) {
+        return parse_fork_join(parse_state);
+    }
+
     // vector literals
-    if ( current_token.sval == "[" || current_token.sval == "<[" ) {
-        // parsing both heterogeneous and homogenous vectors the same way, since type enforcement won't happen until later
-        auto token_value =  current_token.sval;
-        parse_state.matchSymbol(token_value);
-
-        // vector_type unnecessary right now, so commented out for now
-        //string vector_type;
-        string closing;
-        if ( token_value == "[" ) {
-            //vector_type = "Heterogeneous";
-            closing = "]";
-        }
-        else {
-            //vector_type = "Homogenous";
-            closing = "]>";   
-        }
+    if ( current_token.kind == TokenKind::lbracket || current_token.kind == TokenKind::hovec_open ) {
+        // parsing both heterogeneous and homogenous vectors the same way, since the element types are checked
+        // when a homogeneous one is built
+        parse_state.matchSymbol(current_token.kind);
+
+        bool homogeneous = current_token.kind == TokenKind::hovec_open;
+        auto closing = homogeneous ? TokenKind::hovec_close : TokenKind::rbracket;
         auto vector_contents = parse_expr_list(parse_state);
         parse_state.matchSymbol(closing);
-        return std::make_shared<VectorLiteral>(vector_contents);
+        return parse_state.make_node<VectorLiteral>(vector_contents, homogeneous);
     }
 
     // unary ops
-    if ( current_token.sval == "!" || current_token.sval == "-" ) {
+    if ( current_token.kind == TokenKind::bang || current_token.kind == TokenKind::minus ) {
         return parse_unary(parse_state);
     }
 
-    shared_ptr<BaseNode> primary_expr;
+    BaseNode *primary_expr = nullptr;
 
     // parenthesized expression
-    if ( current_token.sval == "(" ) {
-        parse_state.matchSymbol("(");
+    if ( current_token.kind == TokenKind::lparen ) {
+        parse_state.matchSymbol(TokenKind::lparen);
         auto parenthesized_expr = parse_expr(parse_state);
-        parse_state.matchSymbol(")");
+        parse_state.matchSymbol(TokenKind::rparen);
         primary_expr = parenthesized_expr;
     }
     // identifier
     else if (current_token.type == TokenType::identifier) {
-        auto id = parse_state.matchTokenType(TokenType::identifier).sval;
-        primary_expr = std::make_shared<VariableLookup>(id, false);
+        auto id = string(parse_state.matchTokenType(TokenType::identifier).sval);
+        primary_expr = parse_state.make_node<VariableLookup>(id, false);
     }
     // sigiled identifier (global lookup)
-    else if ( current_token.sval == "$" ) {
-        parse_state.matchSymbol("$");
-        auto id = parse_state.matchTokenType(TokenType::identifier).sval;
-        primary_expr = std::make_shared<VariableLookup>(id, true);
+    else if ( current_token.kind == TokenKind::dollar ) {
+        parse_state.matchSymbol(TokenKind::dollar);
+        auto id = string(parse_state.matchTokenType(TokenType::identifier).sval);
+        primary_expr = parse_state.make_node<VariableLookup>(id, true);
     }
 
     if ( primary_expr != nullptr ) {
         // both an identifier or a parenthesized expression could be followed by access brackets or fn call
         auto current_token = parse_state.currentToken();
         while ( true ) {
-            if ( current_token.sval == "(" ) {
+            if ( current_token.kind == TokenKind::lparen ) {
                 auto fn_call_args = parse_function_call(parse_state);
-                primary_expr =  std::make_shared<FunctionCall>(primary_expr, fn_call_args);
+                primary_expr =  parse_state.make_node<FunctionCall>(primary_expr, fn_call_args);
             }   
-            else if ( current_token.sval == "[" ) {
-                parse_state.matchSymbol("[");
-                auto index_expr = parse_expr(parse_state);
-                parse_state.matchSymbol("]");
-                primary_expr = std::make_shared<Access>(primary_expr, index_expr);
+            else if ( current_token.kind == TokenKind::lbracket ) {
+                parse_state.matchSymbol(TokenKind::lbracket);
+                auto index_exprs = parse_expr_list(parse_state);
+                parse_state.matchSymbol(TokenKind::rbracket);
+                primary_expr = parse_state.make_node<Access>(primary_expr, index_exprs);
             }
             else {
                 return primary_expr;
@@ -336,42 +365,42 @@ shared_ptr<BaseNode> parse_primary(ParseState &parse_state) {
     return parse_literal(parse_state);
 }
 
-vector<shared_ptr<BaseNode>> parse_function_call(ParseState &parse_state) {
-    parse_state.matchSymbol("(");
+vector<BaseNode*> parse_function_call(ParseState &parse_state) {
+    parse_state.matchSymbol(TokenKind::lparen);
 
-    vector<shared_ptr<BaseNode>> expr_args;
-    if ( parse_state.currentToken().sval != ")" ) {
+    vector<BaseNode*> expr_args;
+    if ( parse_state.currentToken().kind != TokenKind::rparen ) {
         expr_args = parse_expr_list(parse_state);
     }
-    parse_state.matchSymbol(")");
+    parse_state.matchSymbol(TokenKind::rparen);
     return expr_args;
 }
 
-vector<shared_ptr<BaseNode>> parse_expr_list(ParseState &parse_state) {
-    vector<shared_ptr<BaseNode>> expr_list;
+vector<BaseNode*> parse_expr_list(ParseState &parse_state) {
+    vector<BaseNode*> expr_list;
 
     do {
         auto expr = parse_expr(parse_state);
         expr_list.push_back(expr);
 
         // again, use short circuiting to advance over comma token if it's encountered
-    } while (parse_state.currentToken().sval == "," && parse_state.advance().type != TokenType::eof );
+    } while (parse_state.currentToken().kind == TokenKind::comma && parse_state.advance().type != TokenType::eof );
 
     return expr_list;
 }
 
-shared_ptr<BaseNode> parse_literal(ParseState &parse_state) {
+BaseNode *parse_literal(ParseState &parse_state) {
     Token literal_token = parse_state.matchLiteral();
-    shared_ptr<BaseNode> result;
+    BaseNode *result = nullptr;
     switch(literal_token.type) {
         case TokenType::bool_literal:
             {
                 // might be overkill, but don't want to fail silently
                 bool bool_value = false;
-                if ( literal_token.sval == "true") {
+                if ( literal_token.kind == TokenKind::lit_true) {
                     bool_value = true;
                 }
-                else if (literal_token.sval == "false") {
+                else if (literal_token.kind == TokenKind::lit_false) {
                     bool_value = false;
                 }
                 else {
@@ -379,24 +408,24 @@ shared_ptr<BaseNode> parse_literal(ParseState &parse_state) {
                     parse_state.parsingError();
                 }
 
-                result = std::make_shared<BoolLiteral>(bool_value);
+                result = parse_state.make_node<BoolLiteral>(bool_value);
                 break;
             }
         case TokenType::int_literal:
             {
-                int int_value = std::stoi(literal_token.sval);
-                result = std::make_shared<IntLiteral>(int_value);
+                int int_value = std::stoi(string(literal_token.sval));
+                result = parse_state.make_node<IntLiteral>(int_value);
                 break;
             }
         case TokenType::real_literal:
             {
-                double double_value = std::stod(literal_token.sval);
-                result = std::make_shared<RealLiteral>(double_value);
+                double double_value = std::stod(string(literal_token.sval));
+                result = parse_state.make_node<RealLiteral>(double_value);
                 break;
             }
         case TokenType::string_literal:
             {
-                result = std::make_shared<StringLiteral>(literal_token.sval);
+                result = parse_state.make_node<StringLiteral>(string(literal_token.sval));
                 break;
             }
         default:
@@ -409,14 +438,15 @@ shared_ptr<BaseNode> parse_literal(ParseState &parse_state) {
 }
 
 // entry-point for parsing
-shared_ptr<BaseNode> parse_tokens(vector<Token> tokens, bool printout) {
-    ParseState parse_state { tokens };
-    shared_ptr<BaseNode> ast = parse_program(parse_state);
+ParsedProgram parse_source(std::string_view source, bool printout) {
+    ParsedProgram program;
+    ParseState parse_state { Lexer { source }, program.arena };
+    program.root = parse_program(parse_state);
     
     if (printout)
-        pretty_print_ast(ast);
+        pretty_print_ast(program.root);
 
-    return ast;
+    return program;
 }
 
 /*
@@ -424,24 +454,35 @@ shared_ptr<BaseNode> parse_tokens(vector<Token> tokens, bool printout) {
 */
 
 // operator-precedence lookup 
-int binding_power(Token tok) {
-    auto tv = tok.sval;
-    if ( tv == "|" || tv == "&" ) 
-        return 1;
-    if ( tv == "==" || tv ==  "!=" || tv ==  "<=" || tv ==  ">=" || tv ==  "<" || tv ==  ">" ) 
-        return 3;
-    if ( tv == "+" || tv == "-" ) 
-        return 4;
-    if ( tv == "*" || tv == "/" || tv == "%" ) 
-        return 5;
-    return -1;
+int binding_power(const Token &tok) {
+    switch (tok.kind) {
+        case TokenKind::pipe:
+        case TokenKind::amper:
+            return 1;
+        case TokenKind::equals:
+        case TokenKind::not_equals:
+        case TokenKind::less_equals:
+        case TokenKind::greater_equals:
+        case TokenKind::less:
+        case TokenKind::greater:
+            return 3;
+        case TokenKind::plus:
+        case TokenKind::minus:
+            return 4;
+        case TokenKind::star:
+        case TokenKind::slash:
+        case TokenKind::percent:
+            return 5;
+        default:
+            return -1;
+    }
 }
 
 // adapted from https://vallentin.dev/2016/11/29/pretty-print-tree
-void pretty_print_ast(shared_ptr<BaseNode> node, string _prefix, bool _last) {
+void pretty_print_ast(BaseNode *node, string _prefix, bool _last) {
     std::cout << _prefix << ( _last ? "`- " : "|- ") << node->value() << std::endl;
     _prefix = _prefix + ( _last ? "   " : "|  " );
-    vector<shared_ptr<BaseNode>> children = node->children();
+    vector<BaseNode*> children = node->children();
     int child_count = children.size();
     int i = 0;
     for (auto ch : children) {
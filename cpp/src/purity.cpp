@@ -0,0 +1,146 @@
+#include "purity.h"
+#include "runtime.h"
+#include "ast.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+using std::unordered_map;
+using std::shared_ptr;
+using std::vector;
+using std::string;
+
+class PurityAnalyzer {
+private:
+    // the top-level functions by global slot
+    unordered_map<int, FunctionDeclare*> functions;
+    // whether each function's own code is pure, and the declared functions it calls
+    unordered_map<FunctionDeclare*, bool> pure;
+    unordered_map<FunctionDeclare*, vector<FunctionDeclare*>> callees;
+
+    bool is_pure(BaseNode *node, vector<FunctionDeclare*> &called);
+    bool calls_itself_in_tail_position(BaseNode *node, FunctionDeclare *fd);
+
+public:
+    void analyze(Program *node);
+};
+
+/**
+ *  Whether the code of node is pure, not counting the functions it calls, which are added to called
+ */
+bool PurityAnalyzer::is_pure(BaseNode *node, vector<FunctionDeclare*> &called) {
+    switch(node->type()) {
+        case NodeType::VariableLookup:
+        {
+            // any global but a declared function may be assigned, so reading one is as impure as writing it
+            auto variable = static_cast<VariableLookup*>(node);
+            if (variable->resolution == Resolution::Global)
+                return functions.count(variable->slot) > 0;
+            return variable->resolution != Resolution::Unresolved;
+        }
+        case NodeType::FunctionCall:
+        {
+            auto call = static_cast<FunctionCall*>(node);
+            bool args_pure = true;
+            for (auto &arg : call->expr_args)
+                args_pure = is_pure(arg, called) && args_pure;
+            if (call->callee->type() != NodeType::VariableLookup)
+                return false;
+
+            // only calls by name are known, a local may hold any function
+            auto variable = static_cast<VariableLookup*>(call->callee);
+            if (variable->resolution == Resolution::Builtin)
+                return args_pure && built_in_is_pure(variable->slot);
+            auto found = variable->resolution == Resolution::Global ? functions.find(variable->slot) : functions.end();
+            if (found == functions.end())
+                return false;
+            called.push_back(found->second);
+            return args_pure;
+        }
+        default:
+        {
+            bool children_pure = true;
+            for (auto &nd : node->children())
+                children_pure = is_pure(nd, called) && children_pure;
+            return children_pure;
+        }
+    }
+}
+
+/**
+ *  Whether node returns a call of fd, the top-level function it's part of
+ */
+bool PurityAnalyzer::calls_itself_in_tail_position(BaseNode *node, FunctionDeclare *fd) {
+    if (node->type() == NodeType::Return && static_cast<Return*>(node)->tail_call) {
+        auto callee = static_cast<FunctionCall*>(static_cast<Return*>(node)->expr_node)->callee;
+        if (callee->type() == NodeType::VariableLookup) {
+            auto variable = static_cast<VariableLookup*>(callee);
+            if (variable->resolution == Resolution::Global && variable->slot == fd->slot)
+                return true;
+        }
+    }
+    for (auto &nd : node->children()) {
+        if (calls_itself_in_tail_position(nd, fd))
+            return true;
+    }
+    return false;
+}
+
+void PurityAnalyzer::analyze(Program *node) {
+    for (auto &nd : node->statements()) {
+        if (nd->type() == NodeType::FunctionDeclare) {
+            auto fd = static_cast<FunctionDeclare*>(nd);
+            functions[fd->slot] = fd;
+        }
+    }
+    for (auto &entry : functions) {
+        auto fd = entry.second;
+        pure[fd] = is_pure(fd->body, callees[fd]);
+    }
+
+    // a function calling an impure one is impure too. Recursive calls are assumed pure until shown otherwise
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto &entry : pure) {
+            if (!entry.second)
+                continue;
+            for (auto callee : callees[entry.first]) {
+                if (!pure[callee]) {
+                    entry.second = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (auto &nd : node->statements()) {
+        if (nd->type() != NodeType::FunctionDeclare)
+            continue;
+        auto fd = static_cast<FunctionDeclare*>(nd);
+        if (!fd->memo)
+            continue;
+        fd->memoized = pure[fd];
+        if (!fd->memoized) {
+            std::cerr << "memo function \'" << fd->identifier << "\' is not pure, so its results won't be cached\n";
+            continue;
+        }
+        // a cached call has to wait for the result to store it, so its tail calls would each take a stack frame
+        if (calls_itself_in_tail_position(fd->body, fd)) {
+            fd->memoized = false;
+            std::cerr << "memo function \'" << fd->identifier << "\' returns a call of itself, which only runs in "
+                << "constant stack uncached, so its results won't be cached\n";
+        }
+    }
+}
+
+// entry-point for purity analysis
+void analyze_purity(BaseNode *ast) {
+    if (ast->type() != NodeType::Program)
+        return;
+    PurityAnalyzer analyzer;
+    analyzer.analyze(static_cast<Program*>(ast));
+}
@@ -0,0 +1,169 @@
+#include "resolver.h"
+#include "interpreter.h"
+#include "ast.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+using std::unordered_map;
+using std::shared_ptr;
+using std::vector;
+using std::string;
+
+/*
+*  Scopes mirror the Envs the evaluators create at runtime: global_env, then for code inside a function
+*  the call's Env holding the arguments, then one Env per Block that declares variables. Blocks without
+*  a Declare of their own get no scope, so lookups from inside them don't count an Env that would be empty.
+*/
+class ScopeResolver {
+private:
+    vector<unordered_map<string, int>> scopes;
+    vector<int> scope_sizes;
+
+    void push_scope() {
+        scopes.emplace_back();
+        scope_sizes.push_back(0);
+    }
+
+    int pop_scope() {
+        int size = scope_sizes.back();
+        scopes.pop_back();
+        scope_sizes.pop_back();
+        return size;
+    }
+
+    // redeclaring a name in the same scope reuses its slot, so the runtime reports it as already defined
+    int declare(const string &identifier) {
+        auto found = scopes.back().find(identifier);
+        if (found != scopes.back().end())
+            return found->second;
+        int slot = scope_sizes.back()++;
+        scopes.back()[identifier] = slot;
+        return slot;
+    }
+
+    // whether any statement directly in block is a Declare, nested blocks have their own scopes
+    static bool declares_variables(Block *block) {
+        for (auto &nd : block->statements()) {
+            if (nd->type() == NodeType::Declare)
+                return true;
+        }
+        return false;
+    }
+
+    void resolve_variable(VariableLookup *node);
+
+public:
+    void resolve(BaseNode *node);
+    void resolve_program(Program *node);
+};
+
+void ScopeResolver::resolve_program(Program *node) {
+    push_scope();
+
+    // every top-level name gets its slot up front, so functions can refer to globals declared after them
+    for (auto &nd : node->statements()) {
+        if (nd->type() == NodeType::FunctionDeclare) {
+            auto fd = static_cast<FunctionDeclare*>(nd);
+            fd->slot = declare(fd->identifier);
+            if (fd->identifier == "main")
+                node->main_slot = fd->slot;
+        }
+        else if (nd->type() == NodeType::Declare) {
+            auto decl = static_cast<Declare*>(nd);
+            decl->slot = declare(decl->identifier);
+        }
+    }
+
+    for (auto &nd : node->statements()) {
+        if (nd->type() == NodeType::FunctionDeclare) {
+            auto fd = static_cast<FunctionDeclare*>(nd);
+            push_scope();
+            for (auto &arg : fd->args)
+                declare(arg);
+            resolve(fd->body);
+            pop_scope();
+        }
+        else {
+            resolve(static_cast<Declare*>(nd)->expr_node);
+        }
+    }
+
+    node->num_slots = scope_sizes.back();
+}
+
+void ScopeResolver::resolve_variable(VariableLookup *node) {
+    int innermost = node->sigil ? 0 : scopes.size() - 1;
+    for (int i = innermost; i >= 0; --i) {
+        auto found = scopes[i].find(node->identifier);
+        if (found != scopes[i].end()) {
+            node->resolution = i == 0 ? Resolution::Global : Resolution::Local;
+            node->depth = innermost - i;
+            node->slot = found->second;
+            return;
+        }
+    }
+
+    // built-ins are only used for names that aren't declared, so a program can still have its own max
+    auto builtin = built_in_function_table.find(node->identifier);
+    if (builtin != built_in_function_table.end()) {
+        node->resolution = Resolution::Builtin;
+        node->slot = builtin->second;
+        return;
+    }
+    node->resolution = Resolution::Unresolved;
+}
+
+void ScopeResolver::resolve(BaseNode *node) {
+    switch(node->type()) {
+        case NodeType::Program:
+        {
+            resolve_program(static_cast<Program*>(node));
+            break;
+        }
+        case NodeType::Block:
+        {
+            auto block = static_cast<Block*>(node);
+            block->scoped = declares_variables(block);
+            if (block->scoped)
+                push_scope();
+            for (auto &nd : block->statements())
+                resolve(nd);
+            block->num_slots = block->scoped ? pop_scope() : 0;
+            break;
+        }
+        case NodeType::Declare:
+        {
+            // the initializer is resolved before the name is declared, so it still sees any outer variable
+            auto decl = static_cast<Declare*>(node);
+            resolve(decl->expr_node);
+            decl->slot = declare(decl->identifier);
+            break;
+        }
+        case NodeType::Return:
+        {
+            // nothing is left to do after a returned call, so its caller's frame can be reused for it
+            auto ret = static_cast<Return*>(node);
+            ret->tail_call = ret->expr_node->type() == NodeType::FunctionCall;
+            resolve(ret->expr_node);
+            break;
+        }
+        case NodeType::VariableLookup:
+        {
+            resolve_variable(static_cast<VariableLookup*>(node));
+            break;
+        }
+        default:
+        {
+            for (auto &nd : node->children())
+                resolve(nd);
+        }
+    }
+}
+
+// entry-point for scope resolution
+void resolve_scopes(BaseNode *ast) {
+    ScopeResolver resolver;
+    resolver.resolve(ast);
+}
@@ -0,0 +1,1842 @@
+#include "runtime.h"
+#include "asteval.h"
+#include "hovec.h"
+#include "kernels.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <variant>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <iostream>
+#include <unordered_map>
+#include <sstream>
+
+using std::unordered_map; 
+using std::shared_ptr;
+using std::vector;
+using std::string;
+
+/*
+*  Value operations shared by every execution engine, and by the programs `kvazz compile -o` produces,
+*  which link against this file as the kvazzrt library.
+*/
+
+/////////////////////////////////////////////////////////////////////////////////////
+// USEFUL CONSTANTS
+//
+/////////////////////////////////////////////////////////////////////////////////////
+KvazzValue NOTHING = KvazzValue { KvazzType::Nothing, 0 };
+
+KvazzResult ERROR_NO_VALUE = KvazzResult { NOTHING, KvazzFlag::Error };
+
+KvazzResult GOOD_NO_VALUE = KvazzResult { NOTHING, KvazzFlag::Good };
+
+KvazzResult GOOD_BOOL_TRUE = KvazzResult {
+    KvazzValue {
+        KvazzType::Bool,
+        true
+    },
+    KvazzFlag::Good
+};
+
+KvazzResult GOOD_BOOL_FALSE = KvazzResult {
+    KvazzValue {
+        KvazzType::Bool,
+        false
+    },
+    KvazzFlag::Good
+};
+
+// enum-to-string function for KvazzType
+string kvazztype_as_string(KvazzType t) {
+    // could probably be rewritten into table lookup
+    switch(t) {
+        case KvazzType::Bool:
+        {
+           return "Bool";
+        }
+        case KvazzType::Nothing:
+        {
+            return "Nothing";
+        }
+        case KvazzType::Int:
+        {
+            return "Int";
+        }
+        case KvazzType::Real:
+        {
+            return "Real";
+        }
+        case KvazzType::String:
+        {
+            return "String";
+        }
+        case KvazzType::Hevec:
+        {
+            return "Hevec";
+        }
+        case KvazzType::Hovec:
+        {
+            return "Hovec";
+        }
+        case KvazzType::LValue:
+        {
+            return "LValue";
+        }
+        case KvazzType::Function:
+        {
+            return "Function";
+        }
+        case KvazzType::Builtin:
+        {
+            return "Builtin";
+        }
+        case KvazzType::Future:
+        {
+            return "Future";
+        }
+    }
+    return "";
+}
+
+string kvazzvalue_as_string(const KvazzValue &item) {
+    std::stringstream result;
+
+    switch(item.type) {
+        case KvazzType::Bool:
+        {
+            result << (item.as_bool() ? "true" : "false");
+            break;
+        }
+        case KvazzType::Nothing:
+        {
+            result << "Nothing";
+            break;
+        }
+        case KvazzType::Int:
+        {
+            result << item.as_int();
+            break;
+        }
+        case KvazzType::Real:
+        {
+            result << item.as_real();
+            break;
+        }
+        case KvazzType::String:
+        {
+            result << item.as_string();
+            break;
+        }
+        case KvazzType::Hevec:
+        {
+            auto &v = item.as_vector();
+            result << "[";
+            for(int i = 0; i < v.size(); ++i) {
+                result << kvazzvalue_as_string(v[i]);
+                if (i != v.size() - 1) {
+                    result << ", ";
+                }
+            }
+            result << "]";
+            break;
+        }
+        case KvazzType::Hovec:
+        {
+            result << hovec_as_string(item.as_hovec());
+            break;
+        }
+        case KvazzType::LValue:
+        {
+            // shouldn't really happen
+            result << "LValue";
+            break;
+        }
+        case KvazzType::Function:
+        {
+            KvazzFunction kf = item.as_function();
+            result << "Function<" << kf.name << "(";
+            for(int i = 0; i < kf.args.size(); ++i) {
+                result << kf.args[i];
+                if (i != kf.args.size() - 1) {
+                    result << ", ";
+                }
+            }
+            result << ")>";
+            break;
+        }
+        case KvazzType::Builtin:
+        {
+            result << "Builtin<" << built_in_function_as_string(item.as_int()) << ">";
+            break;
+        }
+        case KvazzType::Future:
+        {
+            result << "Future";
+            break;
+        }
+    }
+    return result.str();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// MAKE GOOD RESULT
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+// Int, Real, Bool, String, Hevec
+KvazzResult make_good_result(bool value) {
+    return KvazzResult {
+        KvazzValue {
+            KvazzType::Bool,
+            value
+        },
+        KvazzFlag::Good
+    };
+}
+
+KvazzResult make_good_result(int value) {
+    return KvazzResult {
+        KvazzValue {
+            KvazzType::Int,
+            value
+        },
+        KvazzFlag::Good
+    };
+}
+
+KvazzResult make_good_result(double value) {
+    return KvazzResult {
+        KvazzValue {
+            KvazzType::Real,
+            value
+        },
+        KvazzFlag::Good
+    };
+}
+
+KvazzResult make_good_result(string value) {
+    return KvazzResult {
+        KvazzValue {
+            KvazzType::String,
+            value
+        },
+        KvazzFlag::Good
+    };
+}
+
+KvazzResult make_good_result(vector<KvazzValue> value) {
+    return KvazzResult {
+        KvazzValue {
+            KvazzType::Hevec,
+            value
+        },
+        KvazzFlag::Good
+    };
+}
+
+KvazzResult make_good_result(Hovec value) {
+    return KvazzResult {
+        KvazzValue {
+            KvazzType::Hovec,
+            std::move(value)
+        },
+        KvazzFlag::Good
+    };
+}
+
+KvazzResult make_good_result(LValue value) {
+    return KvazzResult {
+        KvazzValue {
+            KvazzType::LValue,
+            value
+        },
+        KvazzFlag::Good
+    };
+}
+
+KvazzResult make_good_result(KvazzFunction value) {
+    return KvazzResult {
+        KvazzValue {
+            KvazzType::Function,
+            value
+        },
+        KvazzFlag::Good
+    };
+}
+
+KvazzResult make_good_result(KvazzValue value) {
+    // every other type is already a complete value, which the result can take over as is
+    if (value.type == KvazzType::LValue) {
+        std::cerr << "Attempted to make_good_value on invalid KvazzType.\n";
+        return ERROR_NO_VALUE;
+    }
+    return KvazzResult { std::move(value), KvazzFlag::Good };
+}
+
+/* 
+*   Utility Functions
+*/
+
+// UNUSED
+bool is_gnr(KvazzResult &kr) {
+    return kr.flag == KvazzFlag::Good && kr.kvazz_value.type == KvazzType::Nothing;
+}
+
+// UNUSED
+bool is_numeric_type(KvazzType t) {
+    return t == KvazzType::Int || t == KvazzType::Real;
+}
+
+bool truthy_test(KvazzValue &kv) {
+    /*
+     *  Truthy-falsey test for every valid type a kvazz expression could evaluate to.
+    */
+    auto type = kv.type;
+
+    switch(type) {
+        case KvazzType::Bool:
+            {
+                return kv.as_bool();
+            }
+        case KvazzType::Int:
+            {
+                auto int_value = kv.as_int();
+                return int_value == 0 ? false : true;
+            }
+        case KvazzType::String:
+            {
+                auto &str_value = kv.as_string();
+                return str_value.length() < 0 ? false : true;
+            }
+        case KvazzType::Hevec:
+            {
+                auto &vec_value = kv.as_vector();
+                return vec_value.size() < 0 ? false : true;
+            }
+        case KvazzType::Hovec:
+            {
+                return true;
+            }
+        case KvazzType::Real:
+            {
+                auto real_value = kv.as_real();
+                // floating point truthyness seems like a bad idea, but
+                // I'll put it here for the sake of completeness
+                return real_value == 0.0 ? false : true;
+            }
+        case KvazzType::Nothing:
+            {
+                return false;
+            }
+        case KvazzType::Builtin:
+        case KvazzType::LValue:
+        default:
+            {
+                // give more info in the future
+                std::cerr << "Attempted bool test on invalid expression value.\n";
+            }
+    }
+    return false;
+}
+
+bool truthy_test(KvazzResult kr) {
+    return truthy_test(kr.kvazz_value);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// KVAZZVALUE OPERATORS
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+KvazzResult kvazzvalue_plus(KvazzValue &kv1, KvazzValue &kv2) {
+    auto left_type = kv1.type;
+    auto right_type = kv2.type;
+    if (left_type == KvazzType::Hovec || right_type == KvazzType::Hovec) {
+        return hovec_arithmetic(KernelOp::Add, kv1, kv2);
+    }
+    if(left_type == right_type) {
+        if(left_type == KvazzType::Int) {
+            return make_good_result(kv1.as_int() + kv2.as_int());
+        }
+        if(left_type == KvazzType::Real) {
+            return make_good_result(kv1.as_real() + kv2.as_real());
+        }
+        if(left_type == KvazzType::String) {
+            return make_good_result(kv1.as_string() + kv2.as_string());
+        }
+        if(left_type == KvazzType::Hevec) {
+            auto left_vec = kv1.as_vector();
+            auto &right_vec = kv2.as_vector();
+            left_vec.insert( left_vec.end(), right_vec.begin(), right_vec.end() );
+            return make_good_result(left_vec);
+        }
+    }
+    else if (left_type == KvazzType::Int) {
+        if(right_type == KvazzType::Real) {
+            auto left_value = kv1.as_int();
+            auto right_value = kv2.as_real();
+            return make_good_result(left_value + right_value);
+        }
+    }
+    else if (left_type == KvazzType::Real) {
+        if(right_type == KvazzType::Int) {
+            auto left_value = kv1.as_real();
+            auto right_value = kv2.as_int();
+            return make_good_result(left_value + right_value);
+        }
+    }
+
+    return ERROR_NO_VALUE;
+}
+
+
+KvazzResult kvazzvalue_modulo(KvazzValue &kv1, KvazzValue &kv2) {
+    if (kv1.type == KvazzType::Int && kv2.type == KvazzType::Int) {
+        return make_good_result(kv1.as_int() % kv2.as_int());
+    }
+    return ERROR_NO_VALUE;
+}
+
+KvazzResult kvazzvalue_divide(KvazzValue &kv1, KvazzValue &kv2) {
+    auto left_type = kv1.type;
+    auto right_type = kv2.type;
+    if (left_type == KvazzType::Hovec || right_type == KvazzType::Hovec) {
+        return hovec_arithmetic(KernelOp::Divide, kv1, kv2);
+    }
+    if (left_type == KvazzType::Int) {
+        auto left_value = kv1.as_int();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return make_good_result(left_value / right_value);
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return make_good_result(left_value / right_value);
+        }
+    }
+    else {
+        auto left_value = kv1.as_real();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return make_good_result(left_value / right_value);
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return make_good_result(left_value / right_value);
+        }
+    }
+    return ERROR_NO_VALUE;
+}
+
+KvazzResult kvazzvalue_multiply(KvazzValue &kv1, KvazzValue &kv2) {
+    auto left_type = kv1.type;
+    auto right_type = kv2.type;
+    if (left_type == KvazzType::Hovec || right_type == KvazzType::Hovec) {
+        return hovec_arithmetic(KernelOp::Multiply, kv1, kv2);
+    }
+    if (left_type == KvazzType::Int) {
+        auto left_value = kv1.as_int();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return make_good_result(left_value * right_value);
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return make_good_result(left_value * right_value);
+        }
+    }
+    else {
+        auto left_value = kv1.as_real();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return make_good_result(left_value * right_value);
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return make_good_result(left_value * right_value);
+        }
+    }
+    return ERROR_NO_VALUE;
+}
+
+KvazzResult kvazzvalue_minus(KvazzValue &kv1, KvazzValue &kv2) {
+    auto left_type = kv1.type;
+    auto right_type = kv2.type;
+    if (left_type == KvazzType::Hovec || right_type == KvazzType::Hovec) {
+        return hovec_arithmetic(KernelOp::Subtract, kv1, kv2);
+    }
+    if (left_type == KvazzType::Int) {
+        auto left_value = kv1.as_int();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return make_good_result(left_value - right_value);
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return make_good_result(left_value - right_value);
+        }
+    }
+    else {
+        auto left_value = kv1.as_real();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return make_good_result(left_value - right_value);
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return make_good_result(left_value - right_value);
+        }
+    }
+    return ERROR_NO_VALUE;
+}
+
+bool kvazzvalue_less_equals(KvazzValue &kv1, KvazzValue &kv2) {
+    auto left_type = kv1.type;
+    auto right_type = kv2.type;
+    if (left_type == KvazzType::Int) {
+        auto left_value = kv1.as_int();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return left_value <= right_value;
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return left_value <= right_value;
+        }
+    }
+    else {
+        auto left_value = kv1.as_real();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return left_value <= right_value;
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return left_value <= right_value;
+        }
+    }
+    return false;
+}
+
+bool kvazzvalue_less_than(KvazzValue &kv1, KvazzValue &kv2) {
+    auto left_type = kv1.type;
+    auto right_type = kv2.type;
+    if (left_type == KvazzType::Int) {
+        auto left_value = kv1.as_int();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return left_value < right_value;
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return left_value < right_value;
+        }
+    }
+    else {
+        auto left_value = kv1.as_real();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return left_value < right_value;
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return left_value < right_value;
+        }
+    }
+    return false;
+}
+
+bool kvazzvalue_greater_equals(KvazzValue &kv1, KvazzValue &kv2) {
+    auto left_type = kv1.type;
+    auto right_type = kv2.type;
+    if (left_type == KvazzType::Int) {
+        auto left_value = kv1.as_int();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return left_value >= right_value;
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return left_value >= right_value;
+        }
+    }
+    else {
+        auto left_value = kv1.as_real();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return left_value >= right_value;
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return left_value >= right_value;
+        }
+    }
+    return false;
+}
+
+bool kvazzvalue_greater_than(KvazzValue &kv1, KvazzValue &kv2) {
+    auto left_type = kv1.type;
+    auto right_type = kv2.type;
+    if (left_type == KvazzType::Int) {
+        auto left_value = kv1.as_int();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return left_value > right_value;
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return left_value > right_value;
+        }
+    }
+    else {
+        auto left_value = kv1.as_real();
+        if(right_type == KvazzType::Int) {
+            auto right_value = kv2.as_int();
+            return left_value > right_value;
+        }
+        else {
+            auto right_value = kv2.as_real();
+            return left_value > right_value;
+        }
+    }
+    return false;
+}
+
+bool kvazzvalue_equals(const KvazzValue &kv1, const KvazzValue &kv2) {
+    auto left_type = kv1.type;
+    auto right_type = kv2.type;
+
+    if (left_type != right_type) {
+        if (left_type == KvazzType::Int && right_type == KvazzType::Real) {
+            auto left_value = kv1.as_int();
+            auto right_value = kv2.as_real();
+            return left_value == right_value;
+        }
+        else if (left_type == KvazzType::Real && right_type == KvazzType::Int) {
+            auto left_value = kv1.as_real();
+            auto right_value = kv2.as_int();
+            return left_value == right_value;
+        }
+        return false;
+    }
+
+    // from here on out left_type == right_type
+
+    if (left_type == KvazzType::Int) {
+        auto left_value = kv1.as_int();
+        auto right_value = kv2.as_int();
+        return left_value == right_value;
+    }
+
+    if (left_type == KvazzType::Real) {
+        auto left_value = kv1.as_real();
+        auto right_value = kv2.as_real();
+        return left_value == right_value;
+    }
+
+    if (left_type == KvazzType::String) {
+        auto &left_value = kv1.as_string();
+        auto &right_value = kv2.as_string();
+        return left_value == right_value;
+    }
+
+    if (left_type == KvazzType::Hevec) {
+        auto &vec1 = kv1.as_vector();
+        auto &vec2 = kv2.as_vector();
+        if(vec1.size() != vec2.size()) {
+            return false;
+        }
+
+        for (int i = 0; i < vec1.size(); ++i) {
+            if (!kvazzvalue_equals(vec1[i], vec2[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (left_type == KvazzType::Hovec) {
+        return hovec_equals(kv1.as_hovec(), kv2.as_hovec());
+    }
+    // last compare case for now. Not sure if I want to be able to compare functions or
+    // built ins... comparing AST might be interesting. Another compare operator x =@= y
+    // that checks whether or not x and y are the same object might be useful but hard to
+    // implement.
+    return false;
+}
+
+KvazzResult kvazzvalue_index(KvazzValue &container, KvazzValue &index_value) {
+    if (index_value.type == KvazzType::Int) {
+        auto index = index_value.as_int();
+        if(container.type == KvazzType::Hevec) {
+            auto &the_vec = container.as_vector();
+            if (index < the_vec.size()) {
+                return make_good_result(the_vec[index]);
+            }
+            else {
+                std::cerr << "Index " << index << " out of bounds for vector" << std::endl;
+            }
+        }
+        if(container.type == KvazzType::Hovec) {
+            return hovec_index(container.as_hovec(), &index_value, 1);
+        }
+        if(container.type == KvazzType::String) {
+            auto &the_string = container.as_string();
+            if (index < the_string.length()) {
+                return make_good_result(the_string.substr(index, 1));
+            }
+            else {
+                std::cerr << "Index " << index << " out of bounds for \"" << the_string << "\"" << std::endl;
+            }
+        }
+    }
+    // when dictionaries are added, other types of index values may be valid too
+
+    return ERROR_NO_VALUE;
+}
+
+KvazzResult Kvazzvalue_unary_minus(KvazzValue &kv) {
+    if (kv.type == KvazzType::Int) {
+        return make_good_result( -kv.as_int());
+    }
+    if(kv.type == KvazzType::Real) {
+       return make_good_result( -kv.as_real());
+    }
+    return ERROR_NO_VALUE;
+}
+
+KvazzValue *kvazzvalue_element_ref(KvazzValue &container, KvazzValue &index_value) {
+    if (container.type != KvazzType::Hevec || index_value.type != KvazzType::Int) {
+        if (container.type == KvazzType::String)
+            std::cerr << "Strings are immutable, assigning to index is not supported.\n";
+        return nullptr;
+    }
+    auto &the_vec = container.mutable_vector();
+    auto index = index_value.as_int();
+    if (index < 0 || index >= the_vec.size()) {
+        std::cerr << "Index " << index << " out of bounds for vector" << std::endl;
+        return nullptr;
+    }
+    return &the_vec[index];
+}
+
+KvazzResult kvazzvalue_index(KvazzValue &container, KvazzValue *indices, size_t count) {
+    KvazzValue current = container;
+    for (size_t i = 0; i < count; ++i) {
+        // a hovec takes all the remaining indices itself
+        if (current.type == KvazzType::Hovec)
+            return hovec_index(current.as_hovec(), indices + i, count - i);
+        auto result = kvazzvalue_index(current, indices[i]);
+        if (result.flag != KvazzFlag::Good)
+            return result;
+        current = std::move(result.kvazz_value);
+    }
+    return make_good_result(std::move(current));
+}
+
+bool kvazzvalue_store_index(KvazzValue &target, KvazzValue *indices, size_t count, KvazzValue value) {
+    KvazzValue *element = &target;
+    for (size_t i = 0; i < count; ++i) {
+        if (element->type == KvazzType::Hovec)
+            return hovec_store_index(element->mutable_hovec(), indices + i, count - i, value);
+        element = kvazzvalue_element_ref(*element, indices[i]);
+        if (element == nullptr)
+            return false;
+    }
+    *element = std::move(value);
+    return true;
+}
+
+bool kvazzvalue_store_index(KvazzValue &target, vector<KvazzValue> &indices, KvazzValue value) {
+    return kvazzvalue_store_index(target, indices.data(), indices.size(), std::move(value));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// BUILT-IN FUNCTIONS
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+KvazzResult execute_built_in_print(vector<KvazzValue> &args) {
+    // emulate python's print for now to keep both interpreters acting the same.
+    // Other print functions can act different.
+    int i = 0;
+    while (i < args.size() - 1) {
+        auto &item = args[i];
+        std::cout << kvazzvalue_as_string(item);
+        std::cout << " ";
+        ++i;
+    }
+    auto &last = args[i];
+    std::cout << kvazzvalue_as_string(last);
+    std::cout << "\n";
+    return GOOD_NO_VALUE;
+}
+
+KvazzResult execute_built_in_lengthof(vector<KvazzValue> &args) {
+    // number of args must equal 1
+    if (args.size() != 1) {
+        std::cerr
+            << "Wrong number of arguments passed to built-in function lengthof."
+            << "Expected: 1, Received: " << args.size() << "\n";
+    }
+    else {
+        auto &arg = args[0];
+
+        // arg must be some non-scalar type (only vector or string for now)
+        if (arg.type == KvazzType::Hevec) {
+            auto &the_vector = arg.as_vector();
+            int length = the_vector.size();
+            return make_good_result(length);
+        }
+        if (arg.type == KvazzType::Hovec) {
+            // the length of the first axis, like a Hevec of rows
+            int length = arg.as_hovec().shape[0];
+            return make_good_result(length);
+        }
+        if (arg.type == KvazzType::String) {
+            auto &the_string = arg.as_string();
+            int length = the_string.size();
+            return make_good_result(length);
+        }
+        std::cerr
+            << "Unsupported type for lengthof. Expected non-scalar type, Received: "
+            << kvazztype_as_string(arg.type) << "\n";
+    }
+    return ERROR_NO_VALUE;
+}
+
+KvazzResult execute_built_in_hevec(vector<KvazzValue> &args) {
+    if (args.size() > 0 && args.size() < 3) {
+        auto length_kvalue = args[0];
+        // length must be of type int
+        if (length_kvalue.type != KvazzType::Int) {
+            std::cerr
+                << "Invalid type given for hevec length. Expected: Int, Received: "
+                << kvazztype_as_string(length_kvalue.type) << "\n";
+            goto _HEVEC_ERROR;
+        }
+        int length = length_kvalue.as_int();
+        auto default_kvalue = args.size() == 2 ? args[1] : NOTHING;
+        vector<KvazzValue> new_hevec(length);
+        for (int i = 0; i < length; ++i) {
+            new_hevec[i] = default_kvalue;
+        }
+        return make_good_result(new_hevec);
+    }
+    else {
+        std::cerr
+            << "Invalid number of args passed to built-in-function hevec. "
+            << "Expected: 1 or 2, Received: " << args.size() << "\n";
+    }
+    _HEVEC_ERROR:
+    return ERROR_NO_VALUE;
+}
+
+/**
+ *  Reads a hovec shape argument: a non-negative Int for one axis, or a vector of them. Returns false
+ *  after printing an error if arg isn't a shape.
+ */
+bool shape_argument(const string &fn_name, KvazzValue &arg, vector<size_t> &shape) {
+    vector<KvazzValue> dims;
+    if (arg.type == KvazzType::Int)
+        dims.push_back(arg);
+    else if (arg.type == KvazzType::Hevec)
+        dims = arg.as_vector();
+    else if (arg.type == KvazzType::Hovec && arg.as_hovec().rank() == 1) {
+        auto &hovec = arg.as_hovec();
+        for_each_position(hovec, [&](size_t position) { dims.push_back(hovec_element(hovec, position)); });
+    }
+
+    shape.clear();
+    for (auto &dim : dims) {
+        if (dim.type != KvazzType::Int || dim.as_int() < 0) {
+            shape.clear();
+            break;
+        }
+        shape.push_back(dim.as_int());
+    }
+    if (shape.empty()) {
+        std::cerr
+            << "Invalid shape for " << fn_name << ". Expected: non-negative Int or vector of them, Received: "
+            << kvazzvalue_as_string(arg) << "\n";
+        return false;
+    }
+    return true;
+}
+
+KvazzResult execute_built_in_hovec(vector<KvazzValue> &args) {
+    if (args.size() > 0 && args.size() < 3) {
+        vector<size_t> shape;
+        if (!shape_argument("hovec", args[0], shape))
+            return ERROR_NO_VALUE;
+        auto fill = args.size() == 2 ? args[1] : KvazzValue { KvazzType::Int, 0 };
+        if (fill.type != KvazzType::Int && fill.type != KvazzType::Real && fill.type != KvazzType::Bool) {
+            std::cerr
+                << "Invalid hovec fill value. Expected: Int, Real or Bool, Received: "
+                << kvazztype_as_string(fill.type) << "\n";
+            return ERROR_NO_VALUE;
+        }
+        return make_good_result(make_filled_hovec(fill.type, std::move(shape), fill));
+    }
+    std::cerr
+        << "Invalid number of args passed to built-in-function hovec. "
+        << "Expected: 1 or 2, Received: " << args.size() << "\n";
+    return ERROR_NO_VALUE;
+}
+
+bool check_arg_count(const string &fn_name, vector<KvazzValue> &args, size_t expected) {
+    if (args.size() == expected)
+        return true;
+    std::cerr
+        << "Wrong number of arguments passed to built-in function " << fn_name << ". "
+        << "Expected: " << expected << ", Received: " << args.size() << "\n";
+    return false;
+}
+
+/**
+ *  The argument of a numeric built-in as a hovec of Ints or Reals. A Hevec of numbers is converted, into
+ *  converted. Returns nullptr after printing an error for anything else.
+ */
+const Hovec *numeric_vector_argument(const string &fn_name, KvazzValue &arg, KvazzValue &converted) {
+    const KvazzValue *vector_value = &arg;
+    if (arg.type == KvazzType::Hevec) {
+        auto result = make_hovec(arg.as_vector());
+        if (result.flag != KvazzFlag::Good)
+            return nullptr;
+        converted = std::move(result.kvazz_value);
+        vector_value = &converted;
+    }
+
+    auto element_type = numeric_type(*vector_value);
+    if (vector_value->type != KvazzType::Hovec || (element_type != KvazzType::Int && element_type != KvazzType::Real)) {
+        std::cerr
+            << "Invalid argument for " << fn_name << ". Expected: vector of Int or Real, Received: "
+            << describe_type(*vector_value) << "\n";
+        return nullptr;
+    }
+    return &vector_value->as_hovec();
+}
+
+KvazzResult execute_built_in_sum(vector<KvazzValue> &args) {
+    KvazzValue converted;
+    auto hovec = check_arg_count("sum", args, 1) ? numeric_vector_argument("sum", args[0], converted) : nullptr;
+    if (hovec == nullptr)
+        return ERROR_NO_VALUE;
+    if (hovec->element_type == KvazzType::Int) {
+        vector<int> scratch;
+        return make_good_result(kernel_int_sum(hovec_ints(*hovec, scratch), hovec->size()));
+    }
+    vector<double> scratch;
+    return make_good_result(kernel_real_sum(hovec_reals(*hovec, scratch), hovec->size()));
+}
+
+KvazzResult execute_built_in_mean(vector<KvazzValue> &args) {
+    KvazzValue converted;
+    auto hovec = check_arg_count("mean", args, 1) ? numeric_vector_argument("mean", args[0], converted) : nullptr;
+    if (hovec == nullptr)
+        return ERROR_NO_VALUE;
+    if (hovec->size() == 0) {
+        std::cerr << "Cannot take the mean of an empty vector.\n";
+        return ERROR_NO_VALUE;
+    }
+
+    // Int elements are summed as Reals, so the mean of large Ints doesn't wrap around
+    vector<double> scratch;
+    auto reals = hovec_reals(*hovec, scratch);
+    return make_good_result(kernel_real_sum(reals, hovec->size()) / hovec->size());
+}
+
+KvazzResult execute_built_in_min_max(const string &fn_name, vector<KvazzValue> &args) {
+    KvazzValue converted;
+    auto hovec = check_arg_count(fn_name, args, 1) ? numeric_vector_argument(fn_name, args[0], converted) : nullptr;
+    if (hovec == nullptr)
+        return ERROR_NO_VALUE;
+    if (hovec->size() == 0) {
+        std::cerr << "Cannot take the " << fn_name << " of an empty vector.\n";
+        return ERROR_NO_VALUE;
+    }
+
+    bool is_min = fn_name == "min";
+    if (hovec->element_type == KvazzType::Int) {
+        vector<int> scratch;
+        auto data = hovec_ints(*hovec, scratch);
+        return make_good_result(is_min ? kernel_int_min(data, hovec->size()) : kernel_int_max(data, hovec->size()));
+    }
+    vector<double> scratch;
+    auto data = hovec_reals(*hovec, scratch);
+    return make_good_result(is_min ? kernel_real_min(data, hovec->size()) : kernel_real_max(data, hovec->size()));
+}
+
+KvazzResult execute_built_in_dot(vector<KvazzValue> &args) {
+    if (!check_arg_count("dot", args, 2))
+        return ERROR_NO_VALUE;
+    KvazzValue left_converted, right_converted;
+    auto left = numeric_vector_argument("dot", args[0], left_converted);
+    auto right = left != nullptr ? numeric_vector_argument("dot", args[1], right_converted) : nullptr;
+    if (right == nullptr)
+        return ERROR_NO_VALUE;
+    if (left->rank() != 1 || right->rank() != 1) {
+        std::cerr
+            << "dot expects two vectors, Received shapes: "
+            << shape_as_string(left->shape) << " and " << shape_as_string(right->shape) << "\n";
+        return ERROR_NO_VALUE;
+    }
+    if (left->size() != right->size()) {
+        std::cerr << "Vector lengths differ in dot: " << left->size() << " and " << right->size() << "\n";
+        return ERROR_NO_VALUE;
+    }
+
+    if (left->element_type == KvazzType::Int && right->element_type == KvazzType::Int) {
+        vector<int> left_scratch, right_scratch;
+        auto left_ints = hovec_ints(*left, left_scratch);
+        auto right_ints = hovec_ints(*right, right_scratch);
+        return make_good_result(kernel_int_dot(left_ints, right_ints, left->size()));
+    }
+    vector<double> left_scratch, right_scratch;
+    auto left_reals = hovec_reals(*left, left_scratch);
+    auto right_reals = hovec_reals(*right, right_scratch);
+    return make_good_result(kernel_real_dot(left_reals, right_reals, left->size()));
+}
+
+// the argument of a shape built-in, which must be a Hovec. Returns nullptr after printing an error otherwise
+const Hovec *hovec_argument(const string &fn_name, KvazzValue &arg) {
+    if (arg.type != KvazzType::Hovec) {
+        std::cerr
+            << "Invalid argument for " << fn_name << ". Expected: Hovec, Received: "
+            << kvazztype_as_string(arg.type) << "\n";
+        return nullptr;
+    }
+    return &arg.as_hovec();
+}
+
+KvazzResult execute_built_in_shape(vector<KvazzValue> &args) {
+    auto hovec = check_arg_count("shape", args, 1) ? hovec_argument("shape", args[0]) : nullptr;
+    if (hovec == nullptr)
+        return ERROR_NO_VALUE;
+    vector<KvazzValue> shape;
+    for (auto dim : hovec->shape)
+        shape.push_back(KvazzValue { KvazzType::Int, static_cast<int>(dim) });
+    return make_good_result(shape);
+}
+
+KvazzResult execute_built_in_transpose(vector<KvazzValue> &args) {
+    auto hovec = check_arg_count("transpose", args, 1) ? hovec_argument("transpose", args[0]) : nullptr;
+    if (hovec == nullptr)
+        return ERROR_NO_VALUE;
+    return make_good_result(hovec_transpose(*hovec));
+}
+
+KvazzResult execute_built_in_reshape(vector<KvazzValue> &args) {
+    auto hovec = check_arg_count("reshape", args, 2) ? hovec_argument("reshape", args[0]) : nullptr;
+    vector<size_t> shape;
+    if (hovec == nullptr || !shape_argument("reshape", args[1], shape))
+        return ERROR_NO_VALUE;
+    return hovec_reshape(*hovec, std::move(shape));
+}
+
+// a built-in taking two numeric vectors, converting Hevecs of numbers like numeric_vector_argument
+KvazzResult execute_built_in_linear_algebra(
+        const string &fn_name,
+        vector<KvazzValue> &args,
+        KvazzResult (*operation)(const Hovec&, const Hovec&)) {
+    if (!check_arg_count(fn_name, args, 2))
+        return ERROR_NO_VALUE;
+    KvazzValue left_converted, right_converted;
+    auto left = numeric_vector_argument(fn_name, args[0], left_converted);
+    auto right = left != nullptr ? numeric_vector_argument(fn_name, args[1], right_converted) : nullptr;
+    if (right == nullptr)
+        return ERROR_NO_VALUE;
+    return operation(*left, *right);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// MEMOIZATION
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+void hash_combine(size_t &seed, size_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2);
+}
+
+size_t real_bits(double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+/**
+ *  Hashes a memo argument into seed, returns false for the types that can't be compared (Futures and
+ *  LValues)
+ */
+bool memo_hash(const KvazzValue &value, size_t &seed) {
+    hash_combine(seed, static_cast<size_t>(value.type));
+    switch(value.type) {
+        case KvazzType::Nothing:  return true;
+        case KvazzType::Int:
+        case KvazzType::Builtin:  hash_combine(seed, std::hash<int>{}(value.int_value)); return true;
+        case KvazzType::Bool:     hash_combine(seed, value.as_bool()); return true;
+        case KvazzType::Real:     hash_combine(seed, real_bits(value.as_real())); return true;
+        case KvazzType::String:   hash_combine(seed, std::hash<string>{}(value.as_string())); return true;
+        case KvazzType::Function: hash_combine(seed, std::hash<string>{}(value.as_function().name)); return true;
+        case KvazzType::Hevec:
+        {
+            for (auto &element : value.as_vector()) {
+                if (!memo_hash(element, seed))
+                    return false;
+            }
+            return true;
+        }
+        case KvazzType::Hovec:
+        {
+            auto &hovec = value.as_hovec();
+            for (auto dim : hovec.shape)
+                hash_combine(seed, dim);
+            for_each_position(hovec, [&](size_t position) { memo_hash(hovec_element(hovec, position), seed); });
+            return true;
+        }
+        default:                  return false;
+    }
+}
+
+/**
+ *  Whether two memo arguments are the same value of the same type. Reals compare by their bits, so
+ *  0.0 and -0.0 differ and NaN matches itself.
+ */
+bool memo_equals(const KvazzValue &left, const KvazzValue &right) {
+    if (left.type != right.type)
+        return false;
+    switch(left.type) {
+        case KvazzType::Nothing:  return true;
+        case KvazzType::Int:
+        case KvazzType::Builtin:  return left.int_value == right.int_value;
+        case KvazzType::Bool:     return left.as_bool() == right.as_bool();
+        case KvazzType::Real:     return real_bits(left.as_real()) == real_bits(right.as_real());
+        case KvazzType::String:   return left.as_string() == right.as_string();
+        case KvazzType::Function:
+        {
+            auto &left_function = left.as_function();
+            auto &right_function = right.as_function();
+            return left_function.body == right_function.body && left_function.name == right_function.name;
+        }
+        case KvazzType::Hevec:
+        {
+            auto &left_vector = left.as_vector();
+            auto &right_vector = right.as_vector();
+            if (left_vector.size() != right_vector.size())
+                return false;
+            for (size_t i = 0; i < left_vector.size(); ++i) {
+                if (!memo_equals(left_vector[i], right_vector[i]))
+                    return false;
+            }
+            return true;
+        }
+        case KvazzType::Hovec:
+        {
+            auto &left_hovec = left.as_hovec();
+            auto &right_hovec = right.as_hovec();
+            if (left_hovec.element_type != right_hovec.element_type || left_hovec.shape != right_hovec.shape)
+                return false;
+            vector<size_t> right_positions;
+            right_positions.reserve(right_hovec.size());
+            for_each_position(right_hovec, [&](size_t position) { right_positions.push_back(position); });
+            size_t n = 0;
+            bool equal = true;
+            for_each_position(left_hovec, [&](size_t position) {
+                equal = equal && memo_equals(hovec_element(left_hovec, position), hovec_element(right_hovec, right_positions[n]));
+                ++n;
+            });
+            return equal;
+        }
+        default:                  return false;
+    }
+}
+
+bool memo_hash(const KvazzValue *args, size_t count, size_t &hash) {
+    hash = count;
+    for (size_t i = 0; i < count; ++i) {
+        if (!memo_hash(args[i], hash))
+            return false;
+    }
+    return true;
+}
+
+bool MemoCache::KeyEqual::operator()(const Key &left, const Key &right) const {
+    if (left.count != right.count)
+        return false;
+    for (size_t i = 0; i < left.count; ++i) {
+        if (!memo_equals(left.args[i], right.args[i]))
+            return false;
+    }
+    return true;
+}
+
+bool MemoCache::find(const KvazzValue *args, size_t count, KvazzValue &result) {
+    size_t hash;
+    if (!memo_hash(args, count, hash))
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(Key { args, count, hash });
+    if (found == index.end())
+        return false;
+    entries.splice(entries.begin(), entries, found->second);
+    result = found->second->result;
+    return true;
+}
+
+void MemoCache::insert(vector<KvazzValue> args, KvazzValue result) {
+    size_t hash;
+    if (!memo_hash(args.data(), args.size(), hash))
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // another thread may have cached the same call meanwhile
+    auto found = index.find(Key { args.data(), args.size(), hash });
+    if (found != index.end()) {
+        entries.splice(entries.begin(), entries, found->second);
+        return;
+    }
+    entries.push_front(Entry { std::move(args), hash, std::move(result) });
+    auto &entry = entries.front();
+    index.emplace(Key { entry.args.data(), entry.args.size(), hash }, entries.begin());
+
+    if (entries.size() > capacity) {
+        auto &oldest = entries.back();
+        index.erase(Key { oldest.args.data(), oldest.args.size(), oldest.hash });
+        entries.pop_back();
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// ENV POOL
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+*  Every block entry and call makes an Env, so make_env keeps them off the heap once a program has
+*  warmed up: the block holding an Env and its control block goes back on a per-thread free list when
+*  it's destroyed, and the emptied slots vector is kept for the next Env, its capacity only growing.
+*  An Env may die on another thread than the one that made it, the memory then goes to that thread.
+*/
+
+// blocks and slot vectors kept per thread, any more are freed as usual
+const size_t MAX_POOLED_ENVS = 4096;
+// slots start with room for a few variables, so recycled vectors rarely have to grow
+const size_t MIN_SLOTS_CAPACITY = 4;
+
+// set once this thread's pool is gone, Envs destroyed after that (by thread_local destructors) are freed
+thread_local bool env_pool_destroyed = false;
+
+struct EnvPool
+{
+    size_t block_size = 0;
+    vector<void*> blocks;
+    vector<vector<EnvEntry>> slots;
+
+    ~EnvPool() {
+        env_pool_destroyed = true;
+        for (auto block : blocks)
+            ::operator delete(block);
+    }
+};
+
+thread_local EnvPool env_pool_here;
+
+EnvPool *env_pool() {
+    return env_pool_destroyed ? nullptr : &env_pool_here;
+}
+
+// allocator make_env passes to allocate_shared, Envs always take blocks of the same size
+template <typename T>
+struct EnvAllocator
+{
+    using value_type = T;
+
+    EnvAllocator() = default;
+    template <typename U>
+    EnvAllocator(const EnvAllocator<U>&) {}
+
+    T *allocate(size_t n) {
+        auto size = n * sizeof(T);
+        auto pool = env_pool();
+        if (pool != nullptr && size == pool->block_size && !pool->blocks.empty()) {
+            auto block = pool->blocks.back();
+            pool->blocks.pop_back();
+            return static_cast<T*>(block);
+        }
+        return static_cast<T*>(::operator new(size));
+    }
+
+    void deallocate(T *block, size_t n) {
+        auto size = n * sizeof(T);
+        auto pool = env_pool();
+        if (pool != nullptr && pool->blocks.size() < MAX_POOLED_ENVS && (pool->block_size == 0 || size == pool->block_size)) {
+            pool->block_size = size;
+            pool->blocks.push_back(block);
+            return;
+        }
+        ::operator delete(block);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const EnvAllocator<T>&, const EnvAllocator<U>&) { return true; }
+template <typename T, typename U>
+bool operator!=(const EnvAllocator<T>&, const EnvAllocator<U>&) { return false; }
+
+shared_ptr<Env> make_env(shared_ptr<Env> parent, size_t num_slots) {
+    vector<EnvEntry> slots;
+    auto pool = env_pool();
+    if (pool != nullptr && !pool->slots.empty()) {
+        slots = std::move(pool->slots.back());
+        pool->slots.pop_back();
+    }
+    else {
+        slots.reserve(std::max(num_slots, MIN_SLOTS_CAPACITY));
+    }
+    slots.assign(num_slots, EnvEntry { EnvResultType::Unbound, NOTHING });
+    return std::allocate_shared<Env>(EnvAllocator<Env>{}, std::move(parent), std::move(slots));
+}
+
+Env::~Env() {
+    auto pool = env_pool();
+    if (pool == nullptr || pool->slots.size() >= MAX_POOLED_ENVS || slots.capacity() == 0)
+        return;
+    slots.clear();
+    pool->slots.push_back(std::move(slots));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// ISOLATES
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+bool kvazz_multithreaded = false;
+
+// the number of Isolates with multithreaded set, kvazz_multithreaded is set while it's nonzero
+size_t multithreaded_isolates = 0;
+std::mutex multithreaded_mutex;
+
+// keys are never reused, so a thread can't mistake a new Isolate's callers for those of a destroyed one
+std::atomic<uint64_t> next_callers_key { 1 };
+
+// 0 is the epoch of call sites that have never been cached
+std::atomic<uint64_t> global_epochs { 1 };
+
+uint64_t next_global_epoch() {
+    return global_epochs.fetch_add(1, std::memory_order_relaxed);
+}
+
+thread_local Isolate *isolate_here = nullptr;
+
+Isolate::Isolate()
+    : global_env { std::make_shared<Env>(nullptr, vector<EnvEntry>{}) },
+      callers_key { next_callers_key++ } {}
+
+Isolate::~Isolate() {
+    IsolateScope scope { *this };
+    wait_for_spawned_tasks();
+}
+
+void Isolate::set_function_caller_factory(std::function<FunctionCaller()> factory) {
+    std::lock_guard<std::mutex> lock(callers_mutex);
+    function_caller_factory = std::move(factory);
+    callers.clear();
+    callers_key = next_callers_key++;
+}
+
+FunctionCaller *Isolate::caller() {
+    // the caller this thread used last, and the callers_key it was found under
+    thread_local uint64_t cached_key = 0;
+    thread_local FunctionCaller *cached_caller = nullptr;
+    auto key = callers_key.load(std::memory_order_relaxed);
+    if (cached_key == key)
+        return cached_caller;
+
+    std::lock_guard<std::mutex> lock(callers_mutex);
+    if (!function_caller_factory)
+        return nullptr;
+    auto found = callers.find(std::this_thread::get_id());
+    if (found == callers.end())
+        found = callers.emplace(std::this_thread::get_id(), function_caller_factory()).first;
+    cached_key = key;
+    cached_caller = &found->second;
+    return cached_caller;
+}
+
+Isolate &current_isolate() {
+    if (isolate_here != nullptr)
+        return *isolate_here;
+    // never destroyed, like the thread pool its tasks would run on
+    static Isolate *default_isolate = new Isolate();
+    return *default_isolate;
+}
+
+IsolateScope::IsolateScope(Isolate &isolate)
+    : outer { isolate_here } {
+    isolate_here = &isolate;
+}
+
+IsolateScope::~IsolateScope() {
+    isolate_here = outer;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// PARALLEL BUILT-INS
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+*  par_sum, par_map and par_reduce split their vector into chunks of a fixed size and run the chunks on
+*  the thread pool. Partial results are combined in chunk order, so results don't depend on the number
+*  of threads. spawn f(x) queues the call as a task, and sync waits for the Future it returns.
+*
+*  Callbacks and spawned calls run on an interpreter per thread, in the order the scheduler picks. They
+*  may read globals but not assign them, and an assignment to a global outside them first waits for the
+*  spawned tasks still running, so no task sees a global change under it.
+*/
+
+// set on a thread while it runs a callback or a spawned call
+thread_local bool in_parallel_task = false;
+
+struct ParallelTaskScope
+{
+    bool outer = in_parallel_task;
+    ParallelTaskScope() { in_parallel_task = true; }
+    ~ParallelTaskScope() { in_parallel_task = outer; }
+};
+
+struct FutureState
+{
+    std::atomic<bool> ready { false };
+    KvazzResult result;
+};
+
+// elements per chunk for native reductions, and for callbacks
+const size_t PAR_NATIVE_CHUNK = size_t(1) << 16;
+const size_t PAR_CALLBACK_CHUNK = 256;
+// once this many tasks wait on a thread's deque, it runs further spawned calls itself straight away
+const size_t SPAWN_QUEUE_LIMIT = 16;
+
+KvazzResult call_function_value(KvazzValue &callee, vector<KvazzValue> &args) {
+    if (callee.type == KvazzType::Builtin)
+        return call_builtin_function(callee.as_int(), args);
+    auto caller = callee.type == KvazzType::Function ? current_isolate().caller() : nullptr;
+    if (caller == nullptr) {
+        std::cerr << "Cannot call a value of type " << kvazztype_as_string(callee.type) << "\n";
+        return ERROR_NO_VALUE;
+    }
+    return (*caller)(callee, args);
+}
+
+// makes refcounting atomic before the Isolate's values are handed to other threads
+void start_multithreading(Isolate &isolate) {
+    // while it's unset only this thread runs the Isolate's code, so nobody else sets it meanwhile
+    if (isolate.multithreaded.load(std::memory_order_relaxed) || ThreadPool::instance().size() == 1)
+        return;
+    isolate.multithreaded.store(true, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(multithreaded_mutex);
+    if (multithreaded_isolates++ == 0)
+        __atomic_store_n(&kvazz_multithreaded, true, __ATOMIC_RELAXED);
+}
+
+// makes refcounting plain again if this thread is the only one left running the Isolate's code
+void finish_multithreading(Isolate &isolate) {
+    if (!isolate.multithreaded.load(std::memory_order_relaxed) || in_parallel_task
+            || isolate.spawned_tasks.load(std::memory_order_acquire) != 0)
+        return;
+    isolate.multithreaded.store(false, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(multithreaded_mutex);
+    if (--multithreaded_isolates == 0)
+        __atomic_store_n(&kvazz_multithreaded, false, __ATOMIC_RELAXED);
+}
+
+void wait_for_spawned_tasks() {
+    auto &isolate = current_isolate();
+    if (!isolate.multithreaded.load(std::memory_order_relaxed) || in_parallel_task)
+        return;
+    ThreadPool::instance().help_until([&isolate] {
+        return isolate.spawned_tasks.load(std::memory_order_acquire) == 0;
+    });
+    finish_multithreading(isolate);
+}
+
+bool global_assignment_allowed() {
+    if (in_parallel_task) {
+        std::cerr << "Global variables cannot be assigned from a spawned call or parallel callback.\n";
+        return false;
+    }
+    wait_for_spawned_tasks();
+    return true;
+}
+
+/**
+ *  Calls task(begin, end) for the chunks of [0, count) on the thread pool, as parallel tasks if they
+ *  call back into Kvazz code
+ */
+void run_chunks(size_t count, size_t chunk_size, bool callbacks, const std::function<void(size_t, size_t)> &task) {
+    auto &isolate = current_isolate();
+    if (callbacks)
+        start_multithreading(isolate);
+    ThreadPool::instance().run((count + chunk_size - 1) / chunk_size, [&](size_t chunk) {
+        if (callbacks) {
+            IsolateScope isolate_scope { isolate };
+            ParallelTaskScope scope;
+            task(chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size));
+        }
+        else {
+            task(chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size));
+        }
+    });
+    if (callbacks)
+        finish_multithreading(isolate);
+}
+
+// the elements a callback runs on: those of a Hevec, or the rows of a Hovec along its first axis
+bool callback_elements(const string &fn_name, KvazzValue &arg, vector<KvazzValue> &elements) {
+    if (arg.type == KvazzType::Hevec) {
+        elements = arg.as_vector();
+        return true;
+    }
+    if (arg.type == KvazzType::Hovec) {
+        size_t rows = arg.as_hovec().shape[0];
+        elements.reserve(rows);
+        for (size_t i = 0; i < rows; ++i) {
+            KvazzValue index { KvazzType::Int, static_cast<int>(i) };
+            elements.push_back(kvazzvalue_index(arg, index).kvazz_value);
+        }
+        return true;
+    }
+    std::cerr
+        << "Invalid argument for " << fn_name << ". Expected: Hevec or Hovec, Received: "
+        << kvazztype_as_string(arg.type) << "\n";
+    return false;
+}
+
+bool callback_argument(const string &fn_name, KvazzValue &arg) {
+    if (arg.type == KvazzType::Function || arg.type == KvazzType::Builtin)
+        return true;
+    std::cerr
+        << "Invalid callback for " << fn_name << ". Expected: Function, Received: "
+        << kvazztype_as_string(arg.type) << "\n";
+    return false;
+}
+
+template <typename T>
+T parallel_sum(const T *data, size_t count, T (*sum)(const T*, size_t)) {
+    vector<T> partial((count + PAR_NATIVE_CHUNK - 1) / PAR_NATIVE_CHUNK);
+    run_chunks(count, PAR_NATIVE_CHUNK, false, [&](size_t begin, size_t end) {
+        partial[begin / PAR_NATIVE_CHUNK] = sum(data + begin, end - begin);
+    });
+    return sum(partial.data(), partial.size());
+}
+
+KvazzResult execute_built_in_par_sum(vector<KvazzValue> &args) {
+    KvazzValue converted;
+    auto hovec = check_arg_count("par_sum", args, 1) ? numeric_vector_argument("par_sum", args[0], converted) : nullptr;
+    if (hovec == nullptr)
+        return ERROR_NO_VALUE;
+    if (hovec->element_type == KvazzType::Int) {
+        vector<int> scratch;
+        return make_good_result(parallel_sum(hovec_ints(*hovec, scratch), hovec->size(), kernel_int_sum));
+    }
+    vector<double> scratch;
+    return make_good_result(parallel_sum(hovec_reals(*hovec, scratch), hovec->size(), kernel_real_sum));
+}
+
+KvazzResult execute_built_in_par_map(vector<KvazzValue> &args) {
+    vector<KvazzValue> elements;
+    if (!check_arg_count("par_map", args, 2)
+            || !callback_elements("par_map", args[0], elements)
+            || !callback_argument("par_map", args[1]))
+        return ERROR_NO_VALUE;
+
+    auto &fn = args[1];
+    vector<KvazzValue> results(elements.size());
+    std::atomic<bool> failed { false };
+    run_chunks(elements.size(), PAR_CALLBACK_CHUNK, true, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            vector<KvazzValue> call_args;
+            call_args.push_back(std::move(elements[i]));
+            auto result = call_function_value(fn, call_args);
+            if (result.flag == KvazzFlag::Error)
+                failed = true;
+            results[i] = std::move(result.kvazz_value);
+        }
+    });
+    if (failed)
+        return ERROR_NO_VALUE;
+    if (args[0].type == KvazzType::Hovec)
+        return make_hovec(results);
+    return make_good_result(std::move(results));
+}
+
+/**
+ *  par_reduce(v, fn, init): each chunk is folded with fn starting from its first element, then the chunk
+ *  results are folded into init in order. The same as a left fold when fn is associative.
+ */
+KvazzResult execute_built_in_par_reduce(vector<KvazzValue> &args) {
+    vector<KvazzValue> elements;
+    if (!check_arg_count("par_reduce", args, 3)
+            || !callback_elements("par_reduce", args[0], elements)
+            || !callback_argument("par_reduce", args[1]))
+        return ERROR_NO_VALUE;
+
+    auto &fn = args[1];
+    auto fold = [&fn](KvazzValue acc, KvazzValue element) {
+        vector<KvazzValue> call_args;
+        call_args.push_back(std::move(acc));
+        call_args.push_back(std::move(element));
+        return call_function_value(fn, call_args);
+    };
+
+    vector<KvazzValue> partial((elements.size() + PAR_CALLBACK_CHUNK - 1) / PAR_CALLBACK_CHUNK);
+    std::atomic<bool> failed { false };
+    run_chunks(elements.size(), PAR_CALLBACK_CHUNK, true, [&](size_t begin, size_t end) {
+        auto acc = std::move(elements[begin]);
+        for (size_t i = begin + 1; i < end && !failed; ++i) {
+            auto result = fold(std::move(acc), std::move(elements[i]));
+            if (result.flag == KvazzFlag::Error)
+                failed = true;
+            acc = std::move(result.kvazz_value);
+        }
+        partial[begin / PAR_CALLBACK_CHUNK] = std::move(acc);
+    });
+
+    auto acc = args[2];
+    for (size_t i = 0; i < partial.size() && !failed; ++i) {
+        auto result = fold(std::move(acc), std::move(partial[i]));
+        if (result.flag == KvazzFlag::Error)
+            failed = true;
+        acc = std::move(result.kvazz_value);
+    }
+    if (failed)
+        return ERROR_NO_VALUE;
+    return make_good_result(std::move(acc));
+}
+
+/**
+ *  spawn(fn, args...), which spawn fn(args...) is parsed into: queues the call as a task and returns a
+ *  Future for its result
+ */
+KvazzResult execute_built_in_spawn(vector<KvazzValue> &args) {
+    if (args.empty() || !callback_argument("spawn", args[0]))
+        return ERROR_NO_VALUE;
+
+    auto state = std::make_shared<FutureState>();
+    auto callee = std::move(args[0]);
+    vector<KvazzValue> call_args;
+    for (size_t i = 1; i < args.size(); ++i)
+        call_args.push_back(std::move(args[i]));
+
+    auto &isolate = current_isolate();
+    auto &pool = ThreadPool::instance();
+    if (pool.size() == 1 || pool.queued_here() >= SPAWN_QUEUE_LIMIT) {
+        ParallelTaskScope scope;
+        state->result = call_function_value(callee, call_args);
+        state->ready = true;
+    }
+    else {
+        start_multithreading(isolate);
+        isolate.spawned_tasks.fetch_add(1);
+        pool.spawn([&isolate, state, callee = std::move(callee), call_args = std::move(call_args)]() mutable {
+            {
+                IsolateScope isolate_scope { isolate };
+                ParallelTaskScope scope;
+                // moved out of the task so they're released before it stops counting as spawned
+                auto task_state = std::move(state);
+                auto task_callee = std::move(callee);
+                auto task_args = std::move(call_args);
+                task_state->result = call_function_value(task_callee, task_args);
+                task_state->ready.store(true, std::memory_order_release);
+            }
+            isolate.spawned_tasks.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    return KvazzResult { KvazzValue { KvazzType::Future, KvazzFuture { state } }, KvazzFlag::Good };
+}
+
+/**
+ *  sync(value), which sync value is parsed into: the result of a Future once its task has finished,
+ *  running other tasks on this thread in the meantime. Any other value is returned as it is.
+ */
+KvazzResult execute_built_in_sync(vector<KvazzValue> &args) {
+    if (!check_arg_count("sync", args, 1))
+        return ERROR_NO_VALUE;
+    if (args[0].type != KvazzType::Future)
+        return make_good_result(std::move(args[0]));
+
+    auto &state = *args[0].as_future().state;
+    if (!state.ready.load(std::memory_order_acquire))
+        ThreadPool::instance().help_until([&state] { return state.ready.load(std::memory_order_acquire); });
+    finish_multithreading(current_isolate());
+    return state.result;
+}
+
+enum built_in_function_ids {
+    _print,
+    _lengthof,
+    _hevec,
+    _hovec,
+    _sum,
+    _min,
+    _max,
+    _dot,
+    _mean,
+    _shape,
+    _transpose,
+    _reshape,
+    _matmul,
+    _matvec,
+    _outer,
+    _par_sum,
+    _par_map,
+    _par_reduce,
+    _spawn,
+    _sync
+    /*
+    _printf,
+    _println
+    */
+};
+
+unordered_map<string, int> built_in_function_table = {
+    {"print", _print},
+    {"lengthof", _lengthof},
+    {"hevec", _hevec},
+    {"hovec", _hovec},
+    {"sum", _sum},
+    {"min", _min},
+    {"max", _max},
+    {"dot", _dot},
+    {"mean", _mean},
+    {"shape", _shape},
+    {"transpose", _transpose},
+    {"reshape", _reshape},
+    {"matmul", _matmul},
+    {"matvec", _matvec},
+    {"outer", _outer},
+    {"par_sum", _par_sum},
+    {"par_map", _par_map},
+    {"par_reduce", _par_reduce},
+    {"spawn", _spawn},
+    {"sync", _sync},
+};
+
+string built_in_function_as_string(int id) {
+    switch (id) {
+        case _print:
+            return "print";
+        case _lengthof:
+            return "lengthof";
+        case _hevec:
+            return "hevec";
+        case _hovec:
+            return "hovec";
+        case _sum:
+            return "sum";
+        case _min:
+            return "min";
+        case _max:
+            return "max";
+        case _dot:
+            return "dot";
+        case _mean:
+            return "mean";
+        case _shape:
+            return "shape";
+        case _transpose:
+            return "transpose";
+        case _reshape:
+            return "reshape";
+        case _matmul:
+            return "matmul";
+        case _matvec:
+            return "matvec";
+        case _outer:
+            return "outer";
+        case _par_sum:
+            return "par_sum";
+        case _par_map:
+            return "par_map";
+        case _par_reduce:
+            return "par_reduce";
+        case _spawn:
+            return "spawn";
+        case _sync:
+            return "sync";
+    }
+    return "INVALID_BUILTIN";
+}
+
+bool built_in_is_pure(int builtin_fn_id) {
+    switch (builtin_fn_id) {
+        case _print:
+        case _par_map:
+        case _par_reduce:
+        case _spawn:
+        case _sync:
+            return false;
+        default:
+            return true;
+    }
+}
+
+KvazzResult call_builtin_function (
+        int builtin_fn_id,
+        vector<KvazzValue> &arg_values) {
+
+    switch (builtin_fn_id) {
+        case _print:
+            return execute_built_in_print(arg_values);
+        case _lengthof:
+            return execute_built_in_lengthof(arg_values);
+        case _hevec:
+            return execute_built_in_hevec(arg_values);
+        case _hovec:
+            return execute_built_in_hovec(arg_values);
+        case _sum:
+            return execute_built_in_sum(arg_values);
+        case _min:
+            return execute_built_in_min_max("min", arg_values);
+        case _max:
+            return execute_built_in_min_max("max", arg_values);
+        case _dot:
+            return execute_built_in_dot(arg_values);
+        case _mean:
+            return execute_built_in_mean(arg_values);
+        case _shape:
+            return execute_built_in_shape(arg_values);
+        case _transpose:
+            return execute_built_in_transpose(arg_values);
+        case _reshape:
+            return execute_built_in_reshape(arg_values);
+        case _matmul:
+            return execute_built_in_linear_algebra("matmul", arg_values, hovec_matmul);
+        case _matvec:
+            return execute_built_in_linear_algebra("matvec", arg_values, hovec_matvec);
+        case _outer:
+            return execute_built_in_linear_algebra("outer", arg_values, hovec_outer);
+        case _par_sum:
+            return execute_built_in_par_sum(arg_values);
+        case _par_map:
+            return execute_built_in_par_map(arg_values);
+        case _par_reduce:
+            return execute_built_in_par_reduce(arg_values);
+        case _spawn:
+            return execute_built_in_spawn(arg_values);
+        case _sync:
+            return execute_built_in_sync(arg_values);
+        default:{}
+    }
+    std::cerr << "Tried calling unknown built-in function with id: " << builtin_fn_id << " \n";
+    return ERROR_NO_VALUE;
+}
@@ -0,0 +1,148 @@
+#include "threadpool.h"
+#include "kernels.h"
+
+// the deque this thread pushes to and pops from, 0 outside the pool
+thread_local size_t deque_index = 0;
+
+ThreadPool &ThreadPool::instance() {
+    // never destroyed: the workers sleep until the process exits
+    static ThreadPool *pool = new ThreadPool(kernel_thread_count());
+    return *pool;
+}
+
+ThreadPool::ThreadPool(size_t threads) {
+    for (size_t i = 0; i < threads; ++i)
+        deques.push_back(std::make_unique<WorkDeque>());
+    for (size_t i = 1; i < threads; ++i)
+        workers.emplace_back(&ThreadPool::work_loop, this, i);
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)> &task) {
+    if (count <= 1 || workers.empty()) {
+        for (size_t i = 0; i < count; ++i)
+            task(i);
+        return;
+    }
+
+    std::atomic<size_t> remaining { count };
+    std::vector<std::function<void()>> tasks;
+    tasks.reserve(count);
+    // pushed last to first, so this thread starts at 0 and thieves take the end of the range
+    for (size_t i = count; i-- > 0;) {
+        tasks.push_back([&task, &remaining, i] {
+            task(i);
+            remaining.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    push(count, tasks.data());
+    help_until([&] { return remaining.load(std::memory_order_acquire) == 0; });
+}
+
+void ThreadPool::spawn(std::function<void()> task) {
+    push(1, &task);
+}
+
+void ThreadPool::push(size_t count, std::function<void()> *tasks) {
+    auto &deque = *deques[deque_index];
+    {
+        std::lock_guard<std::mutex> lock(deque.mutex);
+        for (size_t i = 0; i < count; ++i)
+            deque.tasks.push_back(std::move(tasks[i]));
+    }
+    queued.fetch_add(count);
+
+    // a worker going to sleep increments sleeping before it checks queued, so it can't miss this
+    if (sleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        if (count == 1)
+            wake.notify_one();
+        else
+            wake.notify_all();
+    }
+    notify_blocked();
+}
+
+/**
+ *  Wakes the threads blocked in help_until, so they check their condition and the deques again. Like
+ *  sleeping, blocked is incremented before they check, the fence orders it after what they're waiting for
+ */
+void ThreadPool::notify_blocked() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (blocked.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        progress.notify_all();
+    }
+}
+
+size_t ThreadPool::queued_here() {
+    auto &deque = *deques[deque_index];
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    return deque.tasks.size();
+}
+
+/**
+ *  Runs the newest task on deque self, or else steals the oldest task of another deque. Returns false
+ *  if there was nothing to run.
+ */
+bool ThreadPool::run_one(size_t self) {
+    if (queued.load() == 0)
+        return false;
+
+    std::function<void()> task;
+    for (size_t n = 0; n < deques.size() && !task; ++n) {
+        auto &deque = *deques[(self + n) % deques.size()];
+        std::lock_guard<std::mutex> lock(deque.mutex);
+        if (deque.tasks.empty())
+            continue;
+        if (n == 0) {
+            task = std::move(deque.tasks.back());
+            deque.tasks.pop_back();
+        }
+        else {
+            task = std::move(deque.tasks.front());
+            deque.tasks.pop_front();
+        }
+    }
+    if (!task)
+        return false;
+
+    queued.fetch_sub(1);
+    task();
+    notify_blocked();
+    return true;
+}
+
+void ThreadPool::help_until(const std::function<bool()> &done) {
+    // short waits are spun out, yielding between steal attempts, longer ones sleep until there's progress
+    const int SPIN_ATTEMPTS = 64;
+    int failed = 0;
+    while (!done()) {
+        if (run_one(deque_index)) {
+            failed = 0;
+            continue;
+        }
+        if (++failed < SPIN_ATTEMPTS) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        blocked.fetch_add(1);
+        progress.wait(lock, [&] { return queued.load() > 0 || done(); });
+        blocked.fetch_sub(1);
+        failed = 0;
+    }
+}
+
+void ThreadPool::work_loop(size_t index) {
+    deque_index = index;
+    while (true) {
+        if (run_one(index))
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleeping.fetch_add(1);
+        wake.wait(lock, [this] { return queued.load() > 0; });
+        sleeping.fetch_sub(1);
+    }
+}
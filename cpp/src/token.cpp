@@ -30,3 +30,22 @@ std::string tokenTypeString(TokenType tt) {
     }
     return str_repr;
 }
+
+std::string_view tokenKindString(TokenKind kind) {
+    // in the order of TokenKind
+    static constexpr std::string_view kind_strings[] = {
+        "",
+        "var", "if", "then", "else", "for", "while", "do", "in", "function", "return",
+        "spawn", "sync", "memo",
+        "true", "false",
+        "{", "}", "(", ")", "[", "]", "<", ">",
+        "+", "-", "*", "/", "%", "!", "?", "=", ".", ",",
+        "&", "|", ";", ":", "$",
+        "==", "!=", ">=", "<=",
+        "+=", "-=", "*=", "/=", "%=",
+        "<[", "]>"
+    };
+    static_assert(sizeof(kind_strings) / sizeof(kind_strings[0]) == static_cast<size_t>(TokenKind::hovec_close) + 1,
+        "kind_strings is missing a TokenKind");
+    return kind_strings[static_cast<size_t>(kind)];
+}
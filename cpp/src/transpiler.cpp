@@ -0,0 +1,1099 @@
+#include "transpiler.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+#include "optimizer.h"
+#include "resolver.h"
+#include "purity.h"
+#include "ast.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <climits>
+#include <iomanip>
+#include <iostream>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+#include <unistd.h>
+
+using std::unordered_map;
+using std::unordered_set;
+using std::shared_ptr;
+using std::vector;
+using std::string;
+
+namespace fs = std::filesystem;
+
+// CMake points these at the source tree and the kvazzrt it built, the defaults suit a build by hand from
+// the cpp directory, see the notes
+#ifndef KVAZZ_RUNTIME_INCLUDE_DIR
+#define KVAZZ_RUNTIME_INCLUDE_DIR "include"
+#endif
+#ifndef KVAZZ_RUNTIME_LIBRARY
+#define KVAZZ_RUNTIME_LIBRARY "build/libkvazzrt.a"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////
+// CODE GENERATION
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+// helpers every generated program starts with, after the global and constant tables
+const string PRELUDE = R"(
+// Int/Int arithmetic and comparisons are inlined, everything else goes through the runtime operators.
+// Operators fail with an error mark when one of their operands is one, see runtime.h
+#define KVAZZ_ARITHMETIC(name, int_op, generic_fn)                                              \
+    static inline KvazzValue name(KvazzValue &left, KvazzValue &right) {                        \
+        if (left.type == KvazzType::Int && right.type == KvazzType::Int)                        \
+            return KvazzValue { KvazzType::Int, left.as_int() int_op right.as_int() };          \
+        if (is_error_mark(left) || is_error_mark(right))                                        \
+            return error_mark();                                                                \
+        return marked_value(generic_fn(left, right));                                           \
+    }
+
+#define KVAZZ_COMPARISON(name, int_op, generic_expr)                                            \
+    static inline KvazzValue name(KvazzValue &left, KvazzValue &right) {                        \
+        if (left.type == KvazzType::Int && right.type == KvazzType::Int)                        \
+            return KvazzValue { KvazzType::Bool, left.as_int() int_op right.as_int() };         \
+        if (is_error_mark(left) || is_error_mark(right))                                        \
+            return error_mark();                                                                \
+        return KvazzValue { KvazzType::Bool, generic_expr };                                    \
+    }
+
+KVAZZ_ARITHMETIC(kvazz_add, +, kvazzvalue_plus)
+KVAZZ_ARITHMETIC(kvazz_subtract, -, kvazzvalue_minus)
+KVAZZ_ARITHMETIC(kvazz_multiply, *, kvazzvalue_multiply)
+KVAZZ_ARITHMETIC(kvazz_divide, /, kvazzvalue_divide)
+KVAZZ_ARITHMETIC(kvazz_modulo, %, kvazzvalue_modulo)
+KVAZZ_COMPARISON(kvazz_equals, ==, kvazzvalue_equals(left, right))
+KVAZZ_COMPARISON(kvazz_not_equals, !=, !kvazzvalue_equals(left, right))
+KVAZZ_COMPARISON(kvazz_less_equals, <=, kvazzvalue_less_equals(left, right))
+KVAZZ_COMPARISON(kvazz_greater_equals, >=, kvazzvalue_greater_equals(left, right))
+KVAZZ_COMPARISON(kvazz_less_than, <, kvazzvalue_less_than(left, right))
+KVAZZ_COMPARISON(kvazz_greater_than, >, kvazzvalue_greater_than(left, right))
+
+static inline KvazzValue kvazz_or(KvazzValue &left, KvazzValue &right) {
+    if (is_error_mark(left) || is_error_mark(right))
+        return error_mark();
+    return KvazzValue { KvazzType::Bool, truthy_test(left) || truthy_test(right) };
+}
+static inline KvazzValue kvazz_and(KvazzValue &left, KvazzValue &right) {
+    if (is_error_mark(left) || is_error_mark(right))
+        return error_mark();
+    return KvazzValue { KvazzType::Bool, truthy_test(left) && truthy_test(right) };
+}
+static inline KvazzValue kvazz_negate(KvazzValue &right) {
+    return is_error_mark(right) ? error_mark() : marked_value(Kvazzvalue_unary_minus(right));
+}
+static inline KvazzValue kvazz_not(KvazzValue &right) {
+    return is_error_mark(right) ? error_mark() : KvazzValue { KvazzType::Bool, !truthy_test(right) };
+}
+static inline KvazzValue kvazz_index(KvazzValue &left, KvazzValue &right) { return marked_value(kvazzvalue_index(left, right)); }
+static inline KvazzValue kvazz_multi_index(KvazzValue &left, std::vector<KvazzValue> indices) {
+    return marked_value(kvazzvalue_index(left, indices.data(), indices.size()));
+}
+
+// vector literals leave out the elements that failed, like the Interpreter
+static inline std::vector<KvazzValue> kvazz_elements(std::vector<KvazzValue> elements) {
+    elements.erase(std::remove_if(elements.begin(), elements.end(), is_error_mark), elements.end());
+    return elements;
+}
+
+static KvazzValue &kvazz_load_global(int index) {
+    if (!kvazz_defined[index]) {
+        std::cerr << "Lookup of identifier " << kvazz_global_names[index] << " failed." << std::endl;
+        return NOTHING;
+    }
+    return kvazz_globals[index];
+}
+
+static KvazzValue *kvazz_global_target(int index) {
+    if (!kvazz_defined[index]) {
+        std::cerr << "Lookup of identifier " << kvazz_global_names[index] << " failed." << std::endl;
+        return nullptr;
+    }
+    if (kvazz_globals[index].type == KvazzType::Function) {
+        std::cerr << "Functions cannot be reassigned.\n";
+        return nullptr;
+    }
+    if (!global_assignment_allowed())
+        return nullptr;
+    return &kvazz_globals[index];
+}
+
+static void kvazz_define_global(int index, KvazzValue value) {
+    if (kvazz_defined[index]) {
+        std::cerr << "Identifier \'" << kvazz_global_names[index] << "\' already defined in this scope\n";
+        return;
+    }
+    wait_for_spawned_tasks();
+    kvazz_globals[index] = std::move(value);
+    kvazz_defined[index] = true;
+}
+)";
+
+string cpp_string_literal(const string &value) {
+    std::stringstream result;
+    result << "\"";
+    for (unsigned char c : value) {
+        if (c == '"' || c == '\\')
+            result << '\\' << c;
+        else if (c == '\n')
+            result << "\\n";
+        else if (c == '\t')
+            result << "\\t";
+        else if (c < 0x20 || c >= 0x7f)
+            // always three octal digits, so a following digit can't be taken as part of the escape
+            result << '\\' << std::oct << std::setw(3) << std::setfill('0') << (int) c << std::dec;
+        else
+            result << c;
+    }
+    result << "\"";
+    return result.str();
+}
+
+class Transpiler {
+private:
+    unordered_map<string, int> globals;
+    vector<string> global_names;
+    unordered_map<string, FunctionDeclare*> declared_functions;
+    unordered_set<string> top_level_names;
+    vector<FunctionDeclare*> function_nodes;
+    // functions that tail call each other in a cycle run as one C++ function, see generate_group
+    vector<vector<FunctionDeclare*>> groups;
+    unordered_map<FunctionDeclare*, int> group_of;
+    unordered_map<string, int> constant_keys;
+    vector<string> constants;
+
+    // state of the function currently being generated
+    std::stringstream body;
+    int indent = 0;
+    int next_temp = 0;
+    int next_local = 0;
+    vector<unordered_map<string, string>> scopes;
+    FunctionDeclare *function = nullptr;
+    vector<string> param_names;
+    bool restarts = false; // whether the function calls itself in tail position
+    int group = -1;        // the group of the function, if it's generated as part of one
+
+    void line(const string &text) { body << string(4 * indent, ' ') << text << "\n"; }
+
+    string new_temp(const string &init) {
+        string name = "t" + std::to_string(next_temp++);
+        line("KvazzValue " + name + " = " + init + ";");
+        return name;
+    }
+
+    // temporaries are dead after their single use, so they can be moved out of
+    static string take(const string &operand) {
+        return operand[0] == 't' ? "std::move(" + operand + ")" : operand;
+    }
+
+    string constant(const string &key, const string &init) {
+        auto found = constant_keys.find(key);
+        if (found != constant_keys.end())
+            return "kvazz_constants[" + std::to_string(found->second) + "]";
+        int index = constants.size();
+        constants.push_back(init);
+        constant_keys[key] = index;
+        return "kvazz_constants[" + std::to_string(index) + "]";
+    }
+
+    string function_constant(FunctionDeclare *node) {
+        string args;
+        for (auto &arg : node->args)
+            args += (args.empty() ? "" : ", ") + cpp_string_literal(arg);
+        return constant("f" + node->identifier, "KvazzValue { KvazzType::Function, KvazzFunction { "
+            + cpp_string_literal(node->identifier) + ", { " + args + " }, nullptr } }");
+    }
+
+    int global_index(const string &name) {
+        auto found = globals.find(name);
+        if (found != globals.end())
+            return found->second;
+        int index = global_names.size();
+        global_names.push_back(name);
+        globals[name] = index;
+        return index;
+    }
+
+    // returns the id of the built-in node refers to, or -1. Declared names shadow built-ins, like in the resolver
+    int builtin_id(VariableLookup *node) {
+        if ((!node->sigil && !resolve_local(node->identifier).empty()) || top_level_names.count(node->identifier))
+            return -1;
+        auto builtin = built_in_function_table.find(node->identifier);
+        return builtin != built_in_function_table.end() ? builtin->second : -1;
+    }
+
+    // returns the C++ name of identifier, or "" if it's not a local of the current function
+    string resolve_local(const string &identifier) {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+            auto found = scope->find(identifier);
+            if (found != scope->end())
+                return found->second;
+        }
+        return "";
+    }
+
+    // every local gets its own C++ name, so `var x = x;` in an inner block still sees the outer x
+    string declare_local(const string &identifier) {
+        string name = "k_" + identifier + "_" + std::to_string(next_local++);
+        scopes.back()[identifier] = name;
+        return name;
+    }
+
+    static string function_name(const string &identifier) { return "kvazz_fn_" + identifier; }
+
+    void begin_function(FunctionDeclare *node = nullptr) {
+        body.str("");
+        indent = 1;
+        next_temp = 0;
+        next_local = 0;
+        scopes.clear();
+        scopes.emplace_back();
+        function = node;
+        param_names.clear();
+        restarts = false;
+        group = -1;
+    }
+
+    // the top-level function node calls by its name, nullptr if it calls anything else
+    FunctionDeclare *called_function(FunctionCall *node) {
+        if (node->callee->type() != NodeType::VariableLookup)
+            return nullptr;
+        auto callee = static_cast<VariableLookup*>(node->callee);
+        if ((!callee->sigil && !resolve_local(callee->identifier).empty()) || builtin_id(callee) >= 0)
+            return nullptr;
+        auto declared = declared_functions.find(callee->identifier);
+        return declared != declared_functions.end() ? declared->second : nullptr;
+    }
+
+    // whether node calls the function being generated by its name. A memoized one has to go through its cache
+    bool is_self_call(FunctionCall *node) {
+        return function != nullptr && !function->memoized && called_function(node) == function;
+    }
+
+    // the member of the current group node calls by its name, nullptr if it calls anything else
+    FunctionDeclare *group_callee(FunctionCall *node) {
+        if (group < 0)
+            return nullptr;
+        auto callee = called_function(node);
+        auto found = group_of.find(callee);
+        return found != group_of.end() && found->second == group ? callee : nullptr;
+    }
+
+    static string entry_label(FunctionDeclare *node) { return "kvazz_enter_" + node->identifier; }
+
+    void collect_tail_callees(BaseNode *node, unordered_set<FunctionDeclare*> &callees);
+    void find_groups();
+
+    void generate_function(FunctionDeclare *node, std::stringstream &out);
+    void generate_group(int id, std::stringstream &out);
+    void generate_statement(BaseNode *node);
+    void generate_body(BaseNode *node);
+    void generate_block(Block *node);
+    void generate_assign(AssignOp *node);
+    string generate_expr(BaseNode *node);
+    string generate_operand(BaseNode *node);
+    string generate_call(FunctionCall *node);
+    string generate_variable(VariableLookup *node);
+    string generate_arguments(FunctionCall *node, int arity);
+
+public:
+    string generate(Program *node);
+};
+
+string Transpiler::generate(Program *node) {
+    auto &top_level = node->statements();
+
+    // declare every top-level name up front, so function bodies can refer to functions declared after them
+    for (auto &nd : top_level) {
+        if (nd->type() == NodeType::FunctionDeclare) {
+            auto fd = static_cast<FunctionDeclare*>(nd);
+            global_index(fd->identifier);
+            top_level_names.insert(fd->identifier);
+            if (declared_functions.count(fd->identifier) == 0) {
+                declared_functions[fd->identifier] = fd;
+                function_nodes.push_back(fd);
+            }
+        }
+        else if (nd->type() == NodeType::Declare) {
+            global_index(static_cast<Declare*>(nd)->identifier);
+            top_level_names.insert(static_cast<Declare*>(nd)->identifier);
+        }
+    }
+
+    find_groups();
+    std::stringstream functions;
+    for (int id = 0; id < groups.size(); ++id)
+        generate_group(id, functions);
+    for (auto fd : function_nodes) {
+        if (group_of.count(fd) == 0)
+            generate_function(fd, functions);
+    }
+
+    // main() runs the top-level declarations and then calls the Kvazz main, like Interpreter::eval(Program*)
+    begin_function();
+    for (auto &nd : top_level) {
+        if (nd->type() == NodeType::FunctionDeclare) {
+            auto fd = static_cast<FunctionDeclare*>(nd);
+            line("kvazz_define_global(" + std::to_string(global_index(fd->identifier)) + ", " + function_constant(fd) + ");");
+        }
+        else if (nd->type() == NodeType::Declare) {
+            auto decl = static_cast<Declare*>(nd);
+            auto value = generate_expr(decl->expr_node);
+            line("kvazz_define_global(" + std::to_string(global_index(decl->identifier)) + ", " + take(value) + ");");
+        }
+    }
+    if (declared_functions.count("main") > 0)
+        line(function_name("main") + "(" + generate_arguments(nullptr, declared_functions["main"]->args.size()) + ");");
+    line("wait_for_spawned_tasks();");
+    line("return 0;");
+    string main_body = body.str();
+
+    // function values are called through a dispatcher on their name
+    begin_function();
+    int max_arity = 0;
+    for (auto fd : function_nodes)
+        max_arity = std::max(max_arity, (int) fd->args.size());
+    line("if (callee.type == KvazzType::Builtin)");
+    line("    return marked_value(call_builtin_function(callee.as_int(), args));");
+    line("if (callee.type != KvazzType::Function)");
+    line("    return error_mark();");
+    line("// missing arguments are Nothing, extra ones are dropped");
+    line("if (args.size() < " + std::to_string(max_arity) + ")");
+    line("    args.resize(" + std::to_string(max_arity) + ", NOTHING);");
+    line("auto &name = callee.as_function().name;");
+    for (auto fd : function_nodes) {
+        string args;
+        for (int i = 0; i < fd->args.size(); ++i)
+            args += (i == 0 ? "" : ", ") + string("std::move(args[") + std::to_string(i) + "])";
+        line("if (name == " + cpp_string_literal(fd->identifier) + ")");
+        line("    return " + function_name(fd->identifier) + "(" + args + ");");
+    }
+    line("return NOTHING;");
+    string dispatch_body = body.str();
+
+    std::stringstream out;
+    out << "// Generated by kvazz compile, do not edit.\n";
+    out << "#include \"runtime.h\"\n#include <algorithm>\n#include <string>\n#include <vector>\n#include <iostream>\n\n";
+
+    int table_size = std::max<int>(1, global_names.size());
+    out << "static KvazzValue kvazz_globals[" << table_size << "];\n";
+    out << "static bool kvazz_defined[" << table_size << "];\n";
+    out << "static const char *kvazz_global_names[" << table_size << "] = {";
+    for (int i = 0; i < global_names.size(); ++i)
+        out << (i == 0 ? " " : ", ") << cpp_string_literal(global_names[i]);
+    out << " };\n";
+    out << "static KvazzValue kvazz_constants[" << std::max<int>(1, constants.size()) << "] = {\n";
+    for (auto &init : constants)
+        out << "    " << init << ",\n";
+    out << "};\n";
+    out << PRELUDE << "\n";
+
+    for (auto fd : function_nodes) {
+        out << "static KvazzValue " << function_name(fd->identifier) << "(";
+        for (int i = 0; i < fd->args.size(); ++i)
+            out << (i == 0 ? "" : ", ") << "KvazzValue";
+        out << ");\n";
+    }
+    out << "\nstatic KvazzValue kvazz_call_value(KvazzValue &callee, std::vector<KvazzValue> &args) {\n"
+        << dispatch_body << "}\n\n";
+    out << functions.str();
+    // generated functions keep no state, so callbacks from parallel built-ins call them on any thread. The
+    // program's globals are those of the process, so it runs on the default Isolate
+    out << "int main() {\n"
+        << "    current_isolate().set_function_caller_factory([] {\n"
+        << "        return FunctionCaller { [](KvazzValue &callee, std::vector<KvazzValue> &args) {\n"
+        << "            return make_good_result(kvazz_call_value(callee, args));\n"
+        << "        } };\n"
+        << "    });\n"
+        << main_body << "}\n";
+    return out.str();
+}
+
+/**
+ *  Adds the functions the Returns in node call by name to callees, leaving out memoized ones, which
+ *  have to go through their cache
+ */
+void Transpiler::collect_tail_callees(BaseNode *node, unordered_set<FunctionDeclare*> &callees) {
+    if (node->type() == NodeType::Return && static_cast<Return*>(node)->tail_call) {
+        auto callee = static_cast<FunctionCall*>(static_cast<Return*>(node)->expr_node)->callee;
+        if (callee->type() == NodeType::VariableLookup) {
+            auto variable = static_cast<VariableLookup*>(callee);
+            auto declared = declared_functions.find(variable->identifier);
+            if (variable->resolution == Resolution::Global && declared != declared_functions.end()
+                    && !declared->second->memoized)
+                callees.insert(declared->second);
+        }
+    }
+    for (auto &nd : node->children())
+        collect_tail_callees(nd, callees);
+}
+
+/**
+ *  Groups the functions that can reach each other through tail calls. A function that only tail calls
+ *  itself already loops, see the Return case of generate_statement
+ */
+void Transpiler::find_groups() {
+    unordered_map<FunctionDeclare*, unordered_set<FunctionDeclare*>> reachable;
+    for (auto fd : function_nodes) {
+        if (!fd->memoized)
+            collect_tail_callees(fd->body, reachable[fd]);
+    }
+    // the closure of the tail call graph, there are few enough functions to do it naively
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto &entry : reachable) {
+            vector<FunctionDeclare*> next;
+            for (auto callee : entry.second) {
+                for (auto indirect : reachable[callee]) {
+                    if (entry.second.count(indirect) == 0)
+                        next.push_back(indirect);
+                }
+            }
+            changed = changed || !next.empty();
+            entry.second.insert(next.begin(), next.end());
+        }
+    }
+    for (auto fd : function_nodes) {
+        if (fd->memoized || group_of.count(fd) > 0)
+            continue;
+        vector<FunctionDeclare*> members;
+        for (auto other : function_nodes) {
+            if (other == fd || (reachable[fd].count(other) > 0 && reachable[other].count(fd) > 0))
+                members.push_back(other);
+        }
+        if (members.size() < 2)
+            continue;
+        for (auto member : members)
+            group_of[member] = groups.size();
+        groups.push_back(members);
+    }
+}
+
+/**
+ *  Generates the members of a group as blocks of one C++ function, so a tail call from one member to
+ *  another passes its arguments in kvazz_args and jumps to the callee's block, in constant stack like on
+ *  the other engines. Each member's own C++ function enters the group at its block
+ */
+void Transpiler::generate_group(int id, std::stringstream &out) {
+    auto &members = groups[id];
+    string group_name = "kvazz_group_" + std::to_string(id);
+    int arity = 1;
+    for (auto member : members)
+        arity = std::max(arity, (int) member->args.size());
+
+    std::stringstream blocks;
+    for (auto member : members) {
+        begin_function(member);
+        group = id;
+        indent = 2;
+        for (int i = 0; i < member->args.size(); ++i) {
+            param_names.push_back(declare_local(member->args[i]));
+            line("KvazzValue " + param_names.back() + " = std::move(kvazz_args[" + std::to_string(i) + "]);");
+        }
+        generate_statement(member->body);
+        line("return NOTHING;");
+        blocks << entry_label(member) << ":\n    {\n" << body.str() << "    }\n";
+    }
+
+    out << "static KvazzValue " << group_name << "(int kvazz_entry, KvazzValue *kvazz_args) {\n";
+    out << "    switch (kvazz_entry) {\n";
+    for (int i = 0; i < members.size(); ++i) {
+        out << (i + 1 < members.size() ? "        case " + std::to_string(i) + ": " : string("        default: "))
+            << "goto " << entry_label(members[i]) << ";\n";
+    }
+    out << "    }\n" << blocks.str() << "}\n\n";
+
+    for (int i = 0; i < members.size(); ++i) {
+        string params, args;
+        for (int j = 0; j < members[i]->args.size(); ++j) {
+            string param = "kvazz_arg_" + std::to_string(j);
+            params += (j == 0 ? "" : ", ") + string("KvazzValue ") + param;
+            args += (j == 0 ? "" : ", ") + string("std::move(") + param + ")";
+        }
+        out << "static KvazzValue " << function_name(members[i]->identifier) << "(" << params << ") {\n"
+            << "    KvazzValue kvazz_args[" << arity << "] = { " << args << " };\n"
+            << "    return " << group_name << "(" << i << ", kvazz_args);\n}\n\n";
+    }
+}
+
+void Transpiler::generate_function(FunctionDeclare *node, std::stringstream &out) {
+    begin_function(node);
+    string params;
+    for (auto &arg : node->args) {
+        param_names.push_back(declare_local(arg));
+        params += (params.empty() ? "" : ", ") + string("KvazzValue ") + param_names.back();
+    }
+
+    generate_statement(node->body);
+
+    // falling off the end of a function returns Nothing
+    line("return NOTHING;");
+    if (!node->memoized) {
+        out << "static KvazzValue " << function_name(node->identifier) << "(" << params << ") {\n"
+            << (restarts ? "kvazz_restart:\n" : "") << body.str() << "}\n\n";
+        return;
+    }
+
+    // a memoized function's body gets a name of its own, behind a wrapper that goes through its cache
+    string body_name = "kvazz_body_" + node->identifier;
+    string memo_name = "kvazz_memo_" + node->identifier;
+    string wrapper_params, key, body_args;
+    for (int i = 0; i < node->args.size(); ++i) {
+        string arg = "kvazz_arg_" + std::to_string(i);
+        wrapper_params += (i == 0 ? "" : ", ") + string("KvazzValue ") + arg;
+        key += (i == 0 ? "" : ", ") + string("std::move(") + arg + ")";
+        body_args += (i == 0 ? "" : ", ") + string("kvazz_args[") + std::to_string(i) + "]";
+    }
+    out << "static MemoCache " << memo_name << ";\n\n";
+    out << "static KvazzValue " << body_name << "(" << params << ") {\n" << body.str() << "}\n\n";
+    out << "static KvazzValue " << function_name(node->identifier) << "(" << wrapper_params << ") {\n"
+        << "    std::vector<KvazzValue> kvazz_args { " << key << " };\n"
+        << "    KvazzValue kvazz_result;\n"
+        << "    if (" << memo_name << ".find(kvazz_args.data(), kvazz_args.size(), kvazz_result))\n"
+        << "        return kvazz_result;\n"
+        << "    kvazz_result = " << body_name << "(" << body_args << ");\n"
+        << "    " << memo_name << ".insert(std::move(kvazz_args), kvazz_result);\n"
+        << "    return kvazz_result;\n"
+        << "}\n\n";
+}
+
+void Transpiler::generate_block(Block *node) {
+    line("{");
+    ++indent;
+    scopes.emplace_back();
+    for (auto &nd : node->statements())
+        generate_statement(nd);
+    scopes.pop_back();
+    --indent;
+    line("}");
+}
+
+// bodies of if/while always get braces, since a single Kvazz statement can become several C++ ones
+void Transpiler::generate_body(BaseNode *node) {
+    if (node->type() == NodeType::Block) {
+        generate_block(static_cast<Block*>(node));
+        return;
+    }
+    line("{");
+    ++indent;
+    generate_statement(node);
+    --indent;
+    line("}");
+}
+
+void Transpiler::generate_statement(BaseNode *node) {
+    switch(node->type()) {
+        case NodeType::Block:
+        {
+            generate_block(static_cast<Block*>(node));
+            break;
+        }
+        case NodeType::Declare:
+        {
+            auto decl = static_cast<Declare*>(node);
+            if (scopes.back().count(decl->identifier) > 0) {
+                line("std::cerr << " + cpp_string_literal("Identifier \'" + decl->identifier + "\' already defined in this scope\n") + ";");
+                break;
+            }
+            // the initializer is generated before the name is declared, so it still sees any outer variable
+            auto value = generate_expr(decl->expr_node);
+            line("KvazzValue " + declare_local(decl->identifier) + " = " + take(value) + ";");
+            break;
+        }
+        case NodeType::AssignOp:
+        {
+            generate_assign(static_cast<AssignOp*>(node));
+            break;
+        }
+        case NodeType::Return:
+        {
+            // returning a call of the function itself starts it over with the new arguments, so tail
+            // recursion runs in constant stack, like on the other engines
+            auto ret = static_cast<Return*>(node);
+            // in a group, a call of any member passes its arguments in kvazz_args and jumps to its block
+            auto callee = ret->tail_call ? group_callee(static_cast<FunctionCall*>(ret->expr_node)) : nullptr;
+            if (callee != nullptr) {
+                vector<string> values;
+                for (auto &arg : static_cast<FunctionCall*>(ret->expr_node)->expr_args) {
+                    auto value = generate_expr(arg);
+                    values.push_back(value[0] == 't' ? value : new_temp(value));
+                }
+                for (int i = 0; i < callee->args.size(); ++i)
+                    line("kvazz_args[" + std::to_string(i) + "] = " + (i < values.size() ? take(values[i]) : string("NOTHING")) + ";");
+                line("goto " + entry_label(callee) + ";");
+                break;
+            }
+            if (ret->tail_call && is_self_call(static_cast<FunctionCall*>(ret->expr_node))) {
+                // every argument is evaluated before the parameters they may read are assigned
+                vector<string> values;
+                for (auto &arg : static_cast<FunctionCall*>(ret->expr_node)->expr_args) {
+                    auto value = generate_expr(arg);
+                    values.push_back(value[0] == 't' ? value : new_temp(value));
+                }
+                for (int i = 0; i < param_names.size(); ++i)
+                    line(param_names[i] + " = " + (i < values.size() ? take(values[i]) : string("NOTHING")) + ";");
+                line("goto kvazz_restart;");
+                restarts = true;
+                break;
+            }
+            auto value = generate_expr(ret->expr_node);
+            line("return " + take(value) + ";");
+            break;
+        }
+        case NodeType::IfThen:
+        {
+            auto if_then = static_cast<IfThen*>(node);
+            auto condition = generate_expr(if_then->condition);
+            line("if (truthy_test(" + condition + "))");
+            generate_body(if_then->body);
+            break;
+        }
+        case NodeType::IfElse:
+        {
+            auto if_else = static_cast<IfElse*>(node);
+            auto condition = generate_expr(if_else->condition);
+            line("if (truthy_test(" + condition + "))");
+            generate_body(if_else->then_body);
+            line("else");
+            generate_body(if_else->else_body);
+            break;
+        }
+        case NodeType::While:
+        {
+            // the condition may need statements of its own, so it's evaluated inside the loop
+            auto while_node = static_cast<While*>(node);
+            line("while (true) {");
+            ++indent;
+            auto condition = generate_expr(while_node->condition);
+            line("if (!truthy_test(" + condition + "))");
+            line("    break;");
+            generate_body(while_node->body);
+            --indent;
+            line("}");
+            break;
+        }
+        default:
+        {
+            // expression statements (function calls), the value is discarded
+            generate_expr(node);
+        }
+    }
+}
+
+void Transpiler::generate_assign(AssignOp *node) {
+    string compound_fn;
+    switch(node->op_type) {
+        case AssignOpType::plus:     compound_fn = "kvazz_add"; break;
+        case AssignOpType::minus:    compound_fn = "kvazz_subtract"; break;
+        case AssignOpType::divide:   compound_fn = "kvazz_divide"; break;
+        case AssignOpType::multiply: compound_fn = "kvazz_multiply"; break;
+        case AssignOpType::modulo:   compound_fn = "kvazz_modulo"; break;
+        case AssignOpType::assign:   break;
+    }
+
+    // unwind an access chain like v[i][j] down to the variable it starts from
+    vector<BaseNode*> indices;
+    BaseNode *base = node->lvalue;
+    while (base->type() == NodeType::Access) {
+        auto access = static_cast<Access*>(base);
+        for (auto it = access->index_exprs.rbegin(); it != access->index_exprs.rend(); ++it)
+            indices.insert(indices.begin(), *it);
+        base = access->left_expr;
+    }
+    if (base->type() != NodeType::VariableLookup) {
+        std::cerr << "Invalid assignment target.\n";
+        return;
+    }
+    auto variable = static_cast<VariableLookup*>(base);
+
+    // the indices run once, before the right hand side. A compound assignment reads the old value after it
+    string index_values;
+    for (auto index : indices)
+        index_values += (index_values.empty() ? "" : ", ") + take(generate_expr(index));
+    auto value = generate_expr(node->expr_node);
+
+    string local = variable->sigil ? "" : resolve_local(variable->identifier);
+    string target = local;
+    if (local.empty()) {
+        target = "(*kvazz_target)";
+        line("if (auto kvazz_target = kvazz_global_target(" + std::to_string(global_index(variable->identifier)) + "))");
+        ++indent;
+    }
+    if (indices.empty() && compound_fn.empty()) {
+        line(target + " = " + take(value) + ";");
+    }
+    else if (indices.empty()) {
+        line("{");
+        line("    KvazzValue kvazz_new = " + compound_fn + "(" + target + ", " + value + ");");
+        line("    clear_error_mark(kvazz_new);");
+        line("    " + target + " = std::move(kvazz_new);");
+        line("}");
+    }
+    else {
+        line("{");
+        line("    std::vector<KvazzValue> kvazz_indices { " + index_values + " };");
+        if (compound_fn.empty()) {
+            line("    kvazzvalue_store_index(" + target + ", kvazz_indices, " + take(value) + ");");
+        }
+        else {
+            // nothing is stored if there is no old value
+            line("    auto kvazz_old = kvazzvalue_index(" + target + ", kvazz_indices.data(), kvazz_indices.size());");
+            line("    if (kvazz_old.flag == KvazzFlag::Good) {");
+            line("        KvazzValue kvazz_new = " + compound_fn + "(kvazz_old.kvazz_value, " + value + ");");
+            line("        clear_error_mark(kvazz_new);");
+            line("        kvazzvalue_store_index(" + target + ", kvazz_indices, std::move(kvazz_new));");
+            line("    }");
+        }
+        line("}");
+    }
+    if (local.empty())
+        --indent;
+}
+
+/**
+ *  Generates node as the value of a statement, an argument or an index, which is never an error mark
+ */
+string Transpiler::generate_expr(BaseNode *node) {
+    auto value = generate_operand(node);
+    auto type = node->type();
+    bool may_fail = type == NodeType::BinaryOp || type == NodeType::UnaryOp
+        || type == NodeType::FunctionCall || type == NodeType::Access;
+    if (may_fail && value[0] == 't')
+        line("clear_error_mark(" + value + ");");
+    return value;
+}
+
+/**
+ *  Generates node as an operand of an operator or an element of a vector literal, where its value is
+ *  an error mark if it failed
+ */
+string Transpiler::generate_operand(BaseNode *node) {
+    switch(node->type()) {
+        case NodeType::BinaryOp:
+        {
+            auto binop = static_cast<BinaryOp*>(node);
+            auto left = generate_operand(binop->left_expr);
+            // a global read on the left has to be copied before the right side can call anything
+            if (left.rfind("kvazz_load_global", 0) == 0)
+                left = new_temp(left);
+            auto right = generate_operand(binop->right_expr);
+            string fn;
+            switch(binop->op_type) {
+                case BinaryOpType::pipe:           fn = "kvazz_or"; break;
+                case BinaryOpType::amper:          fn = "kvazz_and"; break;
+                case BinaryOpType::equals:         fn = "kvazz_equals"; break;
+                case BinaryOpType::not_equals:     fn = "kvazz_not_equals"; break;
+                case BinaryOpType::less_equals:    fn = "kvazz_less_equals"; break;
+                case BinaryOpType::greater_equals: fn = "kvazz_greater_equals"; break;
+                case BinaryOpType::less_than:      fn = "kvazz_less_than"; break;
+                case BinaryOpType::greater_than:   fn = "kvazz_greater_than"; break;
+                case BinaryOpType::plus:           fn = "kvazz_add"; break;
+                case BinaryOpType::minus:          fn = "kvazz_subtract"; break;
+                case BinaryOpType::multiply:       fn = "kvazz_multiply"; break;
+                case BinaryOpType::divide:         fn = "kvazz_divide"; break;
+                case BinaryOpType::modulo:         fn = "kvazz_modulo"; break;
+            }
+            return new_temp(fn + "(" + left + ", " + right + ")");
+        }
+        case NodeType::UnaryOp:
+        {
+            auto unop = static_cast<UnaryOp*>(node);
+            auto right = generate_operand(unop->right_expr);
+            return new_temp(string(unop->op_type == UnaryOpType::minus ? "kvazz_negate" : "kvazz_not") + "(" + right + ")");
+        }
+        case NodeType::FunctionCall:
+        {
+            return generate_call(static_cast<FunctionCall*>(node));
+        }
+        case NodeType::Access:
+        {
+            auto access = static_cast<Access*>(node);
+            auto left = generate_expr(access->left_expr);
+            if (left.rfind("kvazz_load_global", 0) == 0)
+                left = new_temp(left);
+            if (access->index_exprs.size() == 1) {
+                auto index = generate_expr(access->index_exprs[0]);
+                return new_temp("kvazz_index(" + left + ", " + index + ")");
+            }
+            string indices;
+            for (auto &index_expr : access->index_exprs)
+                indices += (indices.empty() ? "" : ", ") + take(generate_expr(index_expr));
+            return new_temp("kvazz_multi_index(" + left + ", std::vector<KvazzValue> { " + indices + " })");
+        }
+        case NodeType::VariableLookup:
+        {
+            return generate_variable(static_cast<VariableLookup*>(node));
+        }
+        case NodeType::IntLiteral:
+        {
+            auto literal = static_cast<IntLiteral*>(node)->literal_value;
+            auto value = std::to_string(literal);
+            // -2147483648 would be the negation of a literal too big for an int
+            auto cpp_value = literal == INT_MIN ? "(-2147483647 - 1)" : value;
+            return constant("i" + value, "KvazzValue { KvazzType::Int, " + cpp_value + " }");
+        }
+        case NodeType::BoolLiteral:
+        {
+            auto value = static_cast<BoolLiteral*>(node)->literal_value ? string("true") : string("false");
+            return constant("b" + value, "KvazzValue { KvazzType::Bool, " + value + " }");
+        }
+        case NodeType::RealLiteral:
+        {
+            // hexfloat round-trips exactly and is always a double literal
+            std::stringstream value;
+            value << std::hexfloat << static_cast<RealLiteral*>(node)->literal_value;
+            return constant("r" + value.str(), "KvazzValue { KvazzType::Real, " + value.str() + " }");
+        }
+        case NodeType::StringLiteral:
+        {
+            auto &value = static_cast<StringLiteral*>(node)->literal_value;
+            return constant("s" + value, "KvazzValue { KvazzType::String, std::string { " + cpp_string_literal(value) + " } }");
+        }
+        case NodeType::VectorLiteral:
+        {
+            auto vector_literal = static_cast<VectorLiteral*>(node);
+            string elements;
+            for (auto &element : vector_literal->contents) {
+                auto value = generate_operand(element);
+                if (value.rfind("kvazz_load_global", 0) == 0)
+                    value = new_temp(value);
+                elements += (elements.empty() ? "" : ", ") + take(value);
+            }
+            if (vector_literal->homogeneous)
+                return new_temp("make_hovec(kvazz_elements({ " + elements + " })).kvazz_value");
+            return new_temp("KvazzValue { KvazzType::Hevec, kvazz_elements({ " + elements + " }) }");
+        }
+        default:
+        {
+            std::cerr << "Cannot compile " << node->value() << " as an expression.\n";
+            return "NOTHING";
+        }
+    }
+}
+
+/**
+ *  Generates the arguments of a direct call to a function with the given arity. Missing arguments are
+ *  Nothing, extra ones are still evaluated but dropped.
+ */
+string Transpiler::generate_arguments(FunctionCall *node, int arity) {
+    vector<string> values;
+    if (node != nullptr) {
+        for (auto &arg : node->expr_args) {
+            auto value = generate_expr(arg);
+            if (value.rfind("kvazz_load_global", 0) == 0)
+                value = new_temp(value);
+            values.push_back(value);
+        }
+    }
+    string args;
+    for (int i = 0; i < arity; ++i)
+        args += (i == 0 ? "" : ", ") + (i < values.size() ? take(values[i]) : string("NOTHING"));
+    return args;
+}
+
+string Transpiler::generate_call(FunctionCall *node) {
+    if (node->callee->type() == NodeType::VariableLookup) {
+        auto callee = static_cast<VariableLookup*>(node->callee);
+
+        auto builtin = builtin_id(callee);
+        if (builtin >= 0) {
+            string args;
+            for (auto &arg : node->expr_args) {
+                auto value = generate_expr(arg);
+                if (value.rfind("kvazz_load_global", 0) == 0)
+                    value = new_temp(value);
+                args += (args.empty() ? "" : ", ") + take(value);
+            }
+            string arg_vector = "a" + std::to_string(next_temp++);
+            line("std::vector<KvazzValue> " + arg_vector + " { " + args + " };");
+            return new_temp("marked_value(call_builtin_function(" + std::to_string(builtin) + ", " + arg_vector + "))");
+        }
+
+        // top-level functions can't be reassigned, so a call that resolves to one becomes a direct C++ call
+        bool is_local = !callee->sigil && !resolve_local(callee->identifier).empty();
+        auto declared = declared_functions.find(callee->identifier);
+        if (!is_local && declared != declared_functions.end()) {
+            auto args = generate_arguments(node, declared->second->args.size());
+            return new_temp(function_name(callee->identifier) + "(" + args + ")");
+        }
+    }
+
+    auto callee = generate_expr(node->callee);
+    if (callee.rfind("kvazz_load_global", 0) == 0)
+        callee = new_temp(callee);
+    string args;
+    for (auto &arg : node->expr_args) {
+        auto value = generate_expr(arg);
+        if (value.rfind("kvazz_load_global", 0) == 0)
+            value = new_temp(value);
+        args += (args.empty() ? "" : ", ") + take(value);
+    }
+    string arg_vector = "a" + std::to_string(next_temp++);
+    line("std::vector<KvazzValue> " + arg_vector + " { " + args + " };");
+    return new_temp("kvazz_call_value(" + callee + ", " + arg_vector + ")");
+}
+
+string Transpiler::generate_variable(VariableLookup *node) {
+    auto builtin = builtin_id(node);
+    if (builtin >= 0) {
+        auto id = std::to_string(builtin);
+        return constant("B" + id, "KvazzValue { KvazzType::Builtin, " + id + " }");
+    }
+
+    auto local = node->sigil ? "" : resolve_local(node->identifier);
+    if (!local.empty())
+        return local;
+    return "kvazz_load_global(" + std::to_string(global_index(node->identifier)) + ")";
+}
+
+// entry-point for transpiling
+string transpile_program(BaseNode *ast) {
+    Transpiler transpiler;
+    return transpiler.generate(static_cast<Program*>(ast));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// NATIVE BUILD
+//
+/////////////////////////////////////////////////////////////////////////////////////
+
+uint64_t fnv1a_hash(const string &data) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+fs::path native_cache_directory() {
+    if (auto dir = std::getenv("KVAZZ_CACHE_DIR"))
+        return fs::path(dir);
+    if (auto dir = std::getenv("XDG_CACHE_HOME"))
+        return fs::path(dir) / "kvazz";
+    if (auto dir = std::getenv("HOME"))
+        return fs::path(dir) / ".cache" / "kvazz";
+    return fs::temp_directory_path() / "kvazz";
+}
+
+string shell_quote(const string &value) {
+    string result = "'";
+    for (char c : value) {
+        if (c == '\'')
+            result += "'\\''";
+        else
+            result += c;
+    }
+    return result + "'";
+}
+
+// a name in the cache directory no other build, in this process or another, is using
+string unique_suffix() {
+    static std::atomic<unsigned> counter { 0 };
+    return "." + std::to_string(getpid()) + "." + std::to_string(counter++);
+}
+
+// whether the executable cached at binary was built for key, which is kept next to it at key_path. The
+// file names are only a 64-bit hash of the key, so two keys may share them
+bool cache_entry_matches(const fs::path &binary, const fs::path &key_path, const string &key) {
+    std::error_code ec;
+    if (!fs::exists(binary, ec))
+        return false;
+    std::ifstream key_file(key_path, std::ios::binary);
+    std::stringstream cached_key;
+    cached_key << key_file.rdbuf();
+    return key_file && cached_key.str() == key;
+}
+
+bool compile_native_program(std::string_view source, const string &output_path) {
+    const char *cxx_env = std::getenv("CXX");
+    string cxx = cxx_env != nullptr ? cxx_env : "c++";
+    std::error_code ec;
+
+    if (!fs::exists(KVAZZ_RUNTIME_LIBRARY)) {
+        std::cerr << "The runtime library " << KVAZZ_RUNTIME_LIBRARY << " doesn't exist.\n";
+        return false;
+    }
+
+    // the key covers everything that affects the executable, not just the Kvazz source
+    auto runtime_time = fs::last_write_time(KVAZZ_RUNTIME_LIBRARY, ec).time_since_epoch().count();
+    std::stringstream key;
+    key << KVAZZ_TRANSPILER_VERSION << "\n" << cxx << "\n" << runtime_time << "\n" << source;
+    std::stringstream hash;
+    hash << std::hex << std::setw(16) << std::setfill('0') << fnv1a_hash(key.str());
+
+    auto cache_dir = native_cache_directory();
+    auto cached = cache_dir / hash.str();
+    auto cached_key = cache_dir / (hash.str() + ".key");
+
+    if (!cache_entry_matches(cached, cached_key, key.str())) {
+        fs::create_directories(cache_dir, ec);
+        if (ec) {
+            std::cerr << "Could not create cache directory " << cache_dir << "\n";
+            return false;
+        }
+
+        auto program = parse_source(source);
+        optimize_ast(program);
+        auto ast = program.root;
+        resolve_scopes(ast);
+        analyze_purity(ast);
+
+        // built under names of its own and renamed, so a failed or concurrent build never leaves a broken entry
+        auto suffix = unique_suffix();
+        auto cpp_path = cache_dir / (hash.str() + suffix + ".cpp");
+        auto partial = cache_dir / (hash.str() + suffix + ".partial");
+        auto partial_key = cache_dir / (hash.str() + suffix + ".key");
+        std::ofstream cpp_file(cpp_path);
+        cpp_file << transpile_program(ast);
+        cpp_file.close();
+
+        string command = cxx + " -std=c++17 -O2"
+            + " -I" + shell_quote(KVAZZ_RUNTIME_INCLUDE_DIR)
+            + " " + shell_quote(cpp_path.string())
+            + " " + shell_quote(KVAZZ_RUNTIME_LIBRARY) + " -pthread"
+            + " -o " + shell_quote(partial.string());
+        if (std::system(command.c_str()) != 0) {
+            std::cerr << "Compiling " << cpp_path.string() << " failed.\n";
+            fs::remove(partial, ec);
+            return false;
+        }
+        std::ofstream key_file(partial_key, std::ios::binary);
+        key_file << key.str();
+        key_file.close();
+        fs::rename(partial, cached, ec);
+        if (!ec && key_file)
+            fs::rename(partial_key, cached_key, ec);
+        if (ec || !key_file) {
+            std::cerr << "Could not write " << cached.string() << "\n";
+            fs::remove(partial, ec);
+            fs::remove(partial_key, ec);
+            return false;
+        }
+        // the source is kept for reference next to the executable it built
+        fs::rename(cpp_path, cache_dir / (hash.str() + ".cpp"), ec);
+    }
+
+    // whatever is at output_path is only replaced once the executable is complete, so a failed build
+    // leaves it as it was
+    auto output_partial = output_path + unique_suffix() + ".partial";
+    fs::copy_file(cached, output_partial, fs::copy_options::overwrite_existing, ec);
+    if (!ec)
+        fs::rename(output_partial, output_path, ec);
+    if (ec) {
+        std::cerr << "Could not write " << output_path << "\n";
+        fs::remove(output_partial, ec);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,575 @@
+#include "vm.h"
+#include "bytecode.h"
+#include "interpreter.h"
+#include <algorithm>
+#include <string>
+#include <variant>
+#include <vector>
+#include <iostream>
+#include <memory>
+
+using std::vector;
+using std::string;
+
+static inline int read_u16(const uint8_t *&ip) {
+    int value = ip[0] | (ip[1] << 8);
+    ip += 2;
+    return value;
+}
+
+static inline uint32_t read_u32(const uint8_t *&ip) {
+    uint32_t value = ip[0] | (ip[1] << 8) | (ip[2] << 16) | (static_cast<uint32_t>(ip[3]) << 24);
+    ip += 4;
+    return value;
+}
+
+VM::VM(BytecodeProgram &program_, VMGlobals &globals_)
+    : program { program_ },
+      globals { globals_ } {
+    stack.reserve(1024);
+}
+
+/**
+ *  Pushes a frame for a compiled function whose argc arguments are on top of the stack. A memoized
+ *  function whose result is cached gets no frame, its result replaces the call straight away.
+ */
+void VM::push_frame(int function_index, int argc, size_t return_to) {
+    auto &fn = program.functions[function_index];
+    size_t base = stack.size() - argc;
+
+    // missing arguments are Nothing, extra ones are dropped
+    if (argc > fn.arity)
+        stack.resize(base + fn.arity);
+    for (size_t i = base; i < stack.size(); ++i)
+        clear_error_mark(stack[i]);
+    if (fn.memo != nullptr) {
+        stack.resize(base + fn.arity, NOTHING);
+        KvazzValue cached;
+        if (fn.memo->find(stack.data() + base, fn.arity, cached)) {
+            stack.resize(return_to);
+            stack.push_back(std::move(cached));
+            return;
+        }
+        memo_keys.emplace_back(stack.begin() + base, stack.end());
+    }
+    stack.resize(base + fn.num_locals, NOTHING);
+    frames.push_back(CallFrame { &fn, fn.code.data(), base, return_to, fn.memo.get() });
+}
+
+/**
+ *  Calls the value that sits below the argc arguments on top of the stack
+ */
+void VM::call_value(int argc) {
+    size_t callee_position = stack.size() - argc - 1;
+    auto &callee = stack[callee_position];
+
+    if (callee.type == KvazzType::Function) {
+        auto &function = callee.as_function();
+        auto found = program.function_index.find(function.body);
+        if (found != program.function_index.end()) {
+            push_frame(found->second, argc, callee_position);
+            return;
+        }
+    }
+    else if (callee.type == KvazzType::Builtin) {
+        int builtin_fn_id = callee.as_int();
+        vector<KvazzValue> arg_values;
+        for (size_t i = callee_position + 1; i < stack.size(); ++i) {
+            clear_error_mark(stack[i]);
+            arg_values.push_back(std::move(stack[i]));
+        }
+        auto result = call_builtin_function(builtin_fn_id, arg_values);
+        stack.resize(callee_position);
+        stack.push_back(marked_value(std::move(result)));
+        return;
+    }
+
+    stack.resize(callee_position);
+    stack.push_back(error_mark());
+}
+
+/**
+ *  Assigns the value on top of the stack to target[i0][i1]..., where the indices are below the value
+ */
+void VM::store_index(KvazzValue &target, int num_indices) {
+    size_t first_index = stack.size() - num_indices - 1;
+    clear_error_mark(stack.back());
+    kvazzvalue_store_index(target, &stack[first_index], num_indices, std::move(stack.back()));
+    stack.resize(first_index);
+}
+
+/**
+ *  Replaces the two operands on top of the stack with generic_fn of them. A failed operation leaves an
+ *  error mark, and so does one with a marked operand, without running
+ */
+template <typename GenericFn>
+inline void generic_binary_op(vector<KvazzValue> &stack, GenericFn generic_fn) {
+    auto &right = stack.back();
+    auto &left = stack[stack.size() - 2];
+    auto result = is_error_mark(left) || is_error_mark(right) ? error_mark() : marked_value(generic_fn(left, right));
+    stack.pop_back();
+    stack.back() = std::move(result);
+}
+
+/**
+ *  left op right for the operator of a compound assignment. A failed operation gives Nothing, like the
+ *  Interpreter's compound assignment
+ */
+static KvazzValue compound_result(OpCode op, KvazzValue &left, KvazzValue &right) {
+    if (left.type == KvazzType::Int && right.type == KvazzType::Int && op != OpCode::Divide && op != OpCode::Modulo) {
+        int l = left.as_int();
+        int r = right.as_int();
+        switch(op) {
+            case OpCode::Add:      return KvazzValue { KvazzType::Int, l + r };
+            case OpCode::Subtract: return KvazzValue { KvazzType::Int, l - r };
+            default:               return KvazzValue { KvazzType::Int, l * r };
+        }
+    }
+    switch(op) {
+        case OpCode::Add:      return kvazzvalue_plus(left, right).kvazz_value;
+        case OpCode::Subtract: return kvazzvalue_minus(left, right).kvazz_value;
+        case OpCode::Multiply: return kvazzvalue_multiply(left, right).kvazz_value;
+        case OpCode::Divide:   return kvazzvalue_divide(left, right).kvazz_value;
+        default:               return kvazzvalue_modulo(left, right).kvazz_value;
+    }
+}
+
+/**
+ *  target[i0][i1]... op= the value on top of the stack, where the indices are below the value. The old
+ *  value is read now, after the right hand side has run
+ */
+void VM::update(KvazzValue &target, int num_indices, OpCode op) {
+    size_t first_index = stack.size() - num_indices - 1;
+    for (size_t i = first_index; i < stack.size(); ++i)
+        clear_error_mark(stack[i]);
+    auto &right = stack.back();
+    if (num_indices == 0) {
+        target = compound_result(op, target, right);
+    }
+    else {
+        auto old_result = kvazzvalue_index(target, &stack[first_index], num_indices);
+        if (old_result.flag == KvazzFlag::Good)
+            kvazzvalue_store_index(target, &stack[first_index], num_indices, compound_result(op, old_result.kvazz_value, right));
+    }
+    stack.resize(first_index);
+}
+
+// Int/Int arithmetic and comparisons are handled inline, everything else goes through the shared operators
+#define ARITHMETIC_OP(int_op, generic_fn)                                                   \
+    {                                                                                       \
+        auto &right = stack.back();                                                         \
+        auto &left = stack[stack.size() - 2];                                               \
+        if (left.type == KvazzType::Int && right.type == KvazzType::Int) {                  \
+            int result = left.as_int() int_op right.as_int();                               \
+            stack.pop_back();                                                               \
+            stack.back().int_value = result;                                                \
+        }                                                                                   \
+        else {                                                                              \
+            generic_binary_op(stack, generic_fn);                                           \
+        }                                                                                   \
+        break;                                                                              \
+    }
+
+#define COMPARISON_OP(int_op, generic_expr)                                                 \
+    {                                                                                       \
+        auto &right = stack.back();                                                         \
+        auto &left = stack[stack.size() - 2];                                               \
+        bool result;                                                                        \
+        if (left.type == KvazzType::Int && right.type == KvazzType::Int) {                  \
+            result = left.as_int() int_op right.as_int();                                   \
+        }                                                                                   \
+        else if (is_error_mark(left) || is_error_mark(right)) {                             \
+            stack.pop_back();                                                               \
+            stack.back() = error_mark();                                                    \
+            break;                                                                          \
+        }                                                                                   \
+        else {                                                                              \
+            result = generic_expr;                                                          \
+        }                                                                                   \
+        stack.pop_back();                                                                   \
+        stack.back() = KvazzValue { KvazzType::Bool, result };                              \
+        break;                                                                              \
+    }
+
+void VM::run() {
+    push_frame(program.script_index, 0, 0);
+    execute(0);
+}
+
+/**
+ *  Calls a Function or Builtin value for a built-in, running until the frame it pushes returns
+ */
+KvazzResult VM::call(KvazzValue &callee, vector<KvazzValue> &args) {
+    size_t depth = frames.size();
+    size_t callee_position = stack.size();
+    stack.push_back(callee);
+    for (auto &arg : args)
+        stack.push_back(std::move(arg));
+    call_value(args.size());
+    if (frames.size() > depth)
+        execute(depth);
+
+    auto result = std::move(stack.back());
+    stack.resize(callee_position);
+    return make_good_result(std::move(result));
+}
+
+/**
+ *  Runs the top frame until Halt, or until a Return leaves stop_depth frames
+ */
+void VM::execute(size_t stop_depth) {
+    CallFrame *frame = &frames.back();
+    const uint8_t *ip = frame->ip;
+
+    while (true) {
+        auto op = static_cast<OpCode>(*ip++);
+        switch(op) {
+            case OpCode::Constant:
+            {
+                stack.push_back(frame->function->constants[read_u32(ip)]);
+                break;
+            }
+            case OpCode::Nothing:
+            {
+                stack.push_back(NOTHING);
+                break;
+            }
+            case OpCode::Pop:
+            {
+                stack.pop_back();
+                break;
+            }
+            case OpCode::LoadLocal:
+            {
+                stack.push_back(stack[frame->base + read_u16(ip)]);
+                break;
+            }
+            case OpCode::StoreLocal:
+            {
+                clear_error_mark(stack.back());
+                stack[frame->base + read_u16(ip)] = std::move(stack.back());
+                stack.pop_back();
+                break;
+            }
+            case OpCode::LoadGlobal:
+            {
+                auto index = read_u32(ip);
+                if (!globals.defined[index]) {
+                    std::cerr << "Lookup of identifier " << program.global_names[index] << " failed." << std::endl;
+                    stack.push_back(NOTHING);
+                    break;
+                }
+                stack.push_back(globals.values[index]);
+                break;
+            }
+            case OpCode::StoreGlobal:
+            {
+                auto index = read_u32(ip);
+                if (!globals.defined[index]) {
+                    std::cerr << "Lookup of identifier " << program.global_names[index] << " failed." << std::endl;
+                }
+                else if (globals.values[index].type == KvazzType::Function) {
+                    std::cerr << "Functions cannot be reassigned.\n";
+                }
+                else if (global_assignment_allowed()) {
+                    clear_error_mark(stack.back());
+                    globals.values[index] = std::move(stack.back());
+                }
+                stack.pop_back();
+                break;
+            }
+            case OpCode::DefineGlobal:
+            {
+                auto index = read_u32(ip);
+                if (globals.defined[index]) {
+                    std::cerr << "Identifier \'" << program.global_names[index] << "\' already defined in this scope\n";
+                }
+                else {
+                    wait_for_spawned_tasks();
+                    clear_error_mark(stack.back());
+                    globals.values[index] = std::move(stack.back());
+                    globals.defined[index] = true;
+                }
+                stack.pop_back();
+                break;
+            }
+            case OpCode::StoreLocalIndex:
+            {
+                auto slot = read_u16(ip);
+                auto num_indices = read_u16(ip);
+                store_index(stack[frame->base + slot], num_indices);
+                break;
+            }
+            case OpCode::StoreGlobalIndex:
+            {
+                auto index = read_u32(ip);
+                auto num_indices = read_u16(ip);
+                if (!globals.defined[index]) {
+                    std::cerr << "Lookup of identifier " << program.global_names[index] << " failed." << std::endl;
+                    stack.resize(stack.size() - num_indices - 1);
+                    break;
+                }
+                if (!global_assignment_allowed()) {
+                    stack.resize(stack.size() - num_indices - 1);
+                    break;
+                }
+                store_index(globals.values[index], num_indices);
+                break;
+            }
+            case OpCode::UpdateLocal:
+            {
+                auto slot = read_u16(ip);
+                auto num_indices = read_u16(ip);
+                auto compound_op = static_cast<OpCode>(read_u16(ip));
+                update(stack[frame->base + slot], num_indices, compound_op);
+                break;
+            }
+            case OpCode::UpdateGlobal:
+            {
+                auto index = read_u32(ip);
+                auto num_indices = read_u16(ip);
+                auto compound_op = static_cast<OpCode>(read_u16(ip));
+                if (!globals.defined[index]) {
+                    std::cerr << "Lookup of identifier " << program.global_names[index] << " failed." << std::endl;
+                    stack.resize(stack.size() - num_indices - 1);
+                    break;
+                }
+                if (num_indices == 0 && globals.values[index].type == KvazzType::Function) {
+                    std::cerr << "Functions cannot be reassigned.\n";
+                    stack.pop_back();
+                    break;
+                }
+                if (!global_assignment_allowed()) {
+                    stack.resize(stack.size() - num_indices - 1);
+                    break;
+                }
+                update(globals.values[index], num_indices, compound_op);
+                break;
+            }
+            case OpCode::Add:           ARITHMETIC_OP(+, kvazzvalue_plus)
+            case OpCode::Subtract:      ARITHMETIC_OP(-, kvazzvalue_minus)
+            case OpCode::Multiply:      ARITHMETIC_OP(*, kvazzvalue_multiply)
+            case OpCode::Divide:
+            {
+                generic_binary_op(stack, kvazzvalue_divide);
+                break;
+            }
+            case OpCode::Modulo:
+            {
+                generic_binary_op(stack, kvazzvalue_modulo);
+                break;
+            }
+            case OpCode::Equals:        COMPARISON_OP(==, kvazzvalue_equals(left, right))
+            case OpCode::NotEquals:     COMPARISON_OP(!=, !kvazzvalue_equals(left, right))
+            case OpCode::LessEquals:    COMPARISON_OP(<=, kvazzvalue_less_equals(left, right))
+            case OpCode::GreaterEquals: COMPARISON_OP(>=, kvazzvalue_greater_equals(left, right))
+            case OpCode::LessThan:      COMPARISON_OP(<, kvazzvalue_less_than(left, right))
+            case OpCode::GreaterThan:   COMPARISON_OP(>, kvazzvalue_greater_than(left, right))
+            case OpCode::Or:
+            {
+                // both operands have already been evaluated, just like in the AST interpreter
+                if (is_error_mark(stack[stack.size() - 2]) || is_error_mark(stack.back())) {
+                    stack.pop_back();
+                    stack.back() = error_mark();
+                    break;
+                }
+                bool result = truthy_test(stack[stack.size() - 2]) || truthy_test(stack.back());
+                stack.pop_back();
+                stack.back() = KvazzValue { KvazzType::Bool, result };
+                break;
+            }
+            case OpCode::And:
+            {
+                if (is_error_mark(stack[stack.size() - 2]) || is_error_mark(stack.back())) {
+                    stack.pop_back();
+                    stack.back() = error_mark();
+                    break;
+                }
+                bool result = truthy_test(stack[stack.size() - 2]) && truthy_test(stack.back());
+                stack.pop_back();
+                stack.back() = KvazzValue { KvazzType::Bool, result };
+                break;
+            }
+            case OpCode::Negate:
+            {
+                if (!is_error_mark(stack.back()))
+                    stack.back() = marked_value(Kvazzvalue_unary_minus(stack.back()));
+                break;
+            }
+            case OpCode::Not:
+            {
+                if (is_error_mark(stack.back()))
+                    break;
+                bool result = !truthy_test(stack.back());
+                stack.back() = KvazzValue { KvazzType::Bool, result };
+                break;
+            }
+            case OpCode::Jump:
+            {
+                ip = frame->function->code.data() + read_u32(ip);
+                break;
+            }
+            case OpCode::JumpIfFalse:
+            {
+                auto target = read_u32(ip);
+                if (!truthy_test(stack.back()))
+                    ip = frame->function->code.data() + target;
+                stack.pop_back();
+                break;
+            }
+            case OpCode::Call:
+            {
+                auto argc = read_u16(ip);
+                frame->ip = ip;
+                call_value(argc);
+                frame = &frames.back();
+                ip = frame->ip;
+                break;
+            }
+            case OpCode::CallFunction:
+            {
+                auto function_index = read_u32(ip);
+                auto argc = read_u16(ip);
+                frame->ip = ip;
+                push_frame(function_index, argc, stack.size() - argc);
+                frame = &frames.back();
+                ip = frame->ip;
+                break;
+            }
+            case OpCode::TailCallFunction:
+            {
+                auto function_index = read_u32(ip);
+                auto argc = read_u16(ip);
+                // a memoized frame has to return to put its result in the cache, and a memoized callee
+                // goes through push_frame's cache lookup, so those are made as ordinary calls
+                if (frame->memo != nullptr || program.functions[function_index].memo != nullptr) {
+                    frame->ip = ip;
+                    push_frame(function_index, argc, stack.size() - argc);
+                    frame = &frames.back();
+                    ip = frame->ip;
+                    break;
+                }
+                // otherwise the arguments take the place of the current frame's locals
+                size_t base = frame->base;
+                size_t return_to = frame->return_to;
+                size_t first_arg = stack.size() - argc;
+                if (first_arg != base)
+                    std::move(stack.begin() + first_arg, stack.end(), stack.begin() + base);
+                stack.resize(base + argc);
+                frames.pop_back();
+                push_frame(function_index, argc, return_to);
+                frame = &frames.back();
+                ip = frame->ip;
+                break;
+            }
+            case OpCode::CallBuiltin:
+            {
+                auto builtin_fn_id = read_u16(ip);
+                auto argc = read_u16(ip);
+                vector<KvazzValue> arg_values;
+                arg_values.reserve(argc);
+                for (size_t i = stack.size() - argc; i < stack.size(); ++i) {
+                    clear_error_mark(stack[i]);
+                    arg_values.push_back(std::move(stack[i]));
+                }
+                stack.resize(stack.size() - argc);
+                auto result = call_builtin_function(builtin_fn_id, arg_values);
+                stack.push_back(marked_value(std::move(result)));
+                // a callback the built-in ran on this VM may have grown frames
+                frame = &frames.back();
+                break;
+            }
+            case OpCode::Return:
+            {
+                auto result = std::move(stack.back());
+                clear_error_mark(result);
+                if (frame->memo != nullptr) {
+                    frame->memo->insert(std::move(memo_keys.back()), result);
+                    memo_keys.pop_back();
+                }
+                stack.resize(frame->return_to);
+                stack.push_back(std::move(result));
+                frames.pop_back();
+                if (frames.size() == stop_depth)
+                    return;
+                frame = &frames.back();
+                ip = frame->ip;
+                break;
+            }
+            case OpCode::MakeHevec:
+            {
+                auto size = read_u16(ip);
+                vector<KvazzValue> elements;
+                elements.reserve(size);
+                // elements that failed are left out, like in the Interpreter
+                for (size_t i = stack.size() - size; i < stack.size(); ++i) {
+                    if (!is_error_mark(stack[i]))
+                        elements.push_back(std::move(stack[i]));
+                }
+                stack.resize(stack.size() - size);
+                stack.push_back(KvazzValue { KvazzType::Hevec, std::move(elements) });
+                break;
+            }
+            case OpCode::MakeHovec:
+            {
+                auto size = read_u16(ip);
+                vector<KvazzValue> elements;
+                elements.reserve(size);
+                // elements that failed are left out, like in the Interpreter
+                for (size_t i = stack.size() - size; i < stack.size(); ++i) {
+                    if (!is_error_mark(stack[i]))
+                        elements.push_back(std::move(stack[i]));
+                }
+                stack.resize(stack.size() - size);
+                stack.push_back(std::move(make_hovec(elements).kvazz_value));
+                break;
+            }
+            case OpCode::Index:
+            {
+                clear_error_mark(stack[stack.size() - 2]);
+                clear_error_mark(stack.back());
+                auto result = kvazzvalue_index(stack[stack.size() - 2], stack.back());
+                stack.pop_back();
+                stack.back() = marked_value(std::move(result));
+                break;
+            }
+            case OpCode::MultiIndex:
+            {
+                auto num_indices = read_u16(ip);
+                size_t container_position = stack.size() - num_indices - 1;
+                for (size_t i = container_position; i < stack.size(); ++i)
+                    clear_error_mark(stack[i]);
+                auto result = kvazzvalue_index(stack[container_position], &stack[container_position + 1], num_indices);
+                stack.resize(container_position);
+                stack.push_back(marked_value(std::move(result)));
+                break;
+            }
+            case OpCode::Halt:
+            {
+                return;
+            }
+        }
+    }
+}
+
+// Entry point method
+void run_bytecode_vm(Isolate &isolate, BytecodeProgram &program) {
+    IsolateScope scope { isolate };
+    VMGlobals globals {
+        vector<KvazzValue>(program.global_names.size(), NOTHING),
+        vector<bool>(program.global_names.size(), false)
+    };
+    VM vm { program, globals };
+
+    // callbacks from parallel built-ins run on a VM of their own on each thread, sharing the globals
+    isolate.set_function_caller_factory([&program, &globals] {
+        auto vm = std::make_shared<VM>(program, globals);
+        return FunctionCaller { [vm](KvazzValue &callee, vector<KvazzValue> &args) {
+            return vm->call(callee, args);
+        } };
+    });
+    vm.run();
+    wait_for_spawned_tasks();
+    // the callers refer to program and globals, which don't outlive this call
+    isolate.set_function_caller_factory(nullptr);
+}
@@ -0,0 +1,139 @@
+#include "interpreter.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "purity.h"
+#include "resolver.h"
+#include "runtime.h"
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+/*
+*  One parsed program run in several Isolates, one after another and at the same time. The AST is shared,
+*  so the inline caches on its FunctionCall nodes are too: whatever they hold once an Isolate has run has
+*  to be that Isolate's own functions, never those of an Isolate that ran the AST before it.
+*/
+
+const std::string PROGRAM = R"(
+function square(x) { return x * x; }
+function sum_squares(n) {
+    var total = 0;
+    var i = 1;
+    while i <= n do {
+        total += square(i);
+        i += 1;
+    }
+    return total;
+}
+var answer = 0;
+function main() {
+    answer = sum_squares(100);
+}
+)";
+
+const int EXPECTED = 338350;
+
+using Engine = void (*)(Isolate &isolate, BaseNode *ast);
+
+void run_walker(Isolate &isolate, BaseNode *ast) { run_ast_interpreter(isolate, ast); }
+void run_closure(Isolate &isolate, BaseNode *ast) { run_closure_interpreter(isolate, ast); }
+
+void collect_calls(BaseNode *node, std::vector<FunctionCall*> &calls) {
+    if (node == nullptr)
+        return;
+    if (node->type() == NodeType::FunctionCall)
+        calls.push_back(static_cast<FunctionCall*>(node));
+    for (auto child : node->children())
+        collect_calls(child, calls);
+}
+
+bool is_function_of(Isolate &isolate, KvazzFunction *function) {
+    for (auto &entry : isolate.global_env->slots) {
+        if (entry.type == EnvResultType::Function && &std::get<KvazzFunction>(entry.contents) == function)
+            return true;
+    }
+    return false;
+}
+
+// every filled cache points at a function of one of isolates
+bool caches_belong_to(const std::vector<FunctionCall*> &calls, const std::vector<Isolate*> &isolates) {
+    for (auto call : calls) {
+        auto callee = call->cached_callee.load();
+        if (callee == nullptr)
+            continue;
+        bool found = false;
+        for (auto isolate : isolates)
+            found = found || is_function_of(*isolate, callee);
+        if (!found)
+            return false;
+    }
+    return true;
+}
+
+// the value the program left in its global answer, declared by one of the statements of root
+int answer_of(Isolate &isolate, BaseNode *root) {
+    for (auto statement : root->children()) {
+        auto declare = static_cast<Declare*>(statement);
+        if (statement->type() != NodeType::Declare || declare->identifier != "answer")
+            continue;
+        auto &entry = isolate.global_env->slots[declare->slot];
+        if (entry.type == EnvResultType::Value && std::get<KvazzValue>(entry.contents).type == KvazzType::Int)
+            return std::get<KvazzValue>(entry.contents).as_int();
+    }
+    return -1;
+}
+
+bool test_engine(const std::string &name, Engine engine) {
+    auto program = parse_source(PROGRAM);
+    optimize_ast(program);
+    resolve_scopes(program.root);
+    analyze_purity(program.root);
+    std::vector<FunctionCall*> calls;
+    collect_calls(program.root, calls);
+
+    // the first Isolate is gone before the second runs, its functions with it
+    auto first = std::make_unique<Isolate>();
+    engine(*first, program.root);
+    if (answer_of(*first, program.root) != EXPECTED) {
+        std::cerr << name << ": the first Isolate got the wrong answer\n";
+        return false;
+    }
+    first.reset();
+
+    Isolate second;
+    engine(second, program.root);
+    if (answer_of(second, program.root) != EXPECTED) {
+        std::cerr << name << ": the second Isolate got the wrong answer\n";
+        return false;
+    }
+    if (!caches_belong_to(calls, { &second })) {
+        std::cerr << name << ": a call site still caches a function of the first Isolate\n";
+        return false;
+    }
+
+    // two more at the same time, on threads of their own
+    Isolate third;
+    Isolate fourth;
+    std::thread other { [&] { engine(fourth, program.root); } };
+    engine(third, program.root);
+    other.join();
+    if (answer_of(third, program.root) != EXPECTED || answer_of(fourth, program.root) != EXPECTED) {
+        std::cerr << name << ": Isolates running at the same time got the wrong answer\n";
+        return false;
+    }
+    if (!caches_belong_to(calls, { &third, &fourth })) {
+        std::cerr << name << ": a call site caches a function of a finished Isolate\n";
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    bool passed = test_engine("walker", run_walker);
+    passed = test_engine("closure", run_closure) && passed;
+    std::cout << (passed ? "passed" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+#include "runtime.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+*  A MemoCache small enough to fill. Once it's full, every new result evicts the one used least recently,
+*  where finding a result counts as using it, and results keep apart arguments that only differ in type.
+*/
+
+std::vector<KvazzValue> int_args(int value) { return { KvazzValue { KvazzType::Int, value } }; }
+
+// the result cached for f(value), or -1 if there is none
+int cached(MemoCache &cache, const std::vector<KvazzValue> &args) {
+    KvazzValue result;
+    if (!cache.find(args.data(), args.size(), result))
+        return -1;
+    return result.as_int();
+}
+
+bool expect(const std::string &what, int got, int expected) {
+    if (got == expected)
+        return true;
+    std::cerr << what << ": got " << got << ", expected " << expected << "\n";
+    return false;
+}
+
+int main() {
+    bool passed = true;
+    MemoCache cache { 2 };
+    cache.insert(int_args(1), KvazzValue { KvazzType::Int, 10 });
+    cache.insert(int_args(2), KvazzValue { KvazzType::Int, 20 });
+    passed = expect("f(1) once cached", cached(cache, int_args(1)), 10) && passed;
+
+    // f(1) was just found, so f(2) is the least recently used
+    cache.insert(int_args(3), KvazzValue { KvazzType::Int, 30 });
+    passed = expect("f(2) after f(3) filled the cache", cached(cache, int_args(2)), -1) && passed;
+    passed = expect("f(1) after f(3) filled the cache", cached(cache, int_args(1)), 10) && passed;
+    passed = expect("f(3)", cached(cache, int_args(3)), 30) && passed;
+
+    // caching f(1) again only marks it used, it doesn't take a second entry
+    cache.insert(int_args(1), KvazzValue { KvazzType::Int, 10 });
+    cache.insert(int_args(4), KvazzValue { KvazzType::Int, 40 });
+    passed = expect("f(3) after f(1) was cached again", cached(cache, int_args(3)), -1) && passed;
+    passed = expect("f(1) after f(4) filled the cache", cached(cache, int_args(1)), 10) && passed;
+    passed = expect("f(4)", cached(cache, int_args(4)), 40) && passed;
+
+    std::vector<KvazzValue> real_one { KvazzValue { KvazzType::Real, 1.0 } };
+    passed = expect("f(1.0) while f(1) is cached", cached(cache, real_one), -1) && passed;
+
+    std::cout << (passed ? "passed" : "FAILED") << std::endl;
+    return passed ? 0 : 1;
+}
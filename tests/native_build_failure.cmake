@@ -0,0 +1,23 @@
+# Checks that a failed `kvazz compile -o` exits nonzero and leaves what was at the output path, like an
+# executable an earlier build put there, as it was.
+#
+#   cmake -DKVAZZ=path/to/kvazz -DPROGRAM=name.kvz -DWORK_DIR=dir -P native_build_failure.cmake
+#
+# The C++ compiler is replaced by `false`, in a cache directory of its own so nothing cached is reused.
+
+set(executable ${WORK_DIR}/build_failure)
+file(REMOVE_RECURSE ${WORK_DIR}/build_failure_cache)
+file(WRITE ${executable} "stale")
+
+set(ENV{CXX} false)
+set(ENV{KVAZZ_CACHE_DIR} ${WORK_DIR}/build_failure_cache)
+execute_process(COMMAND ${KVAZZ} compile ${PROGRAM} -o ${executable}
+    RESULT_VARIABLE status OUTPUT_VARIABLE output ERROR_VARIABLE output)
+
+if(status EQUAL 0)
+    message(FATAL_ERROR "compile -o exited with 0 although the C++ compiler failed:\n${output}")
+endif()
+file(READ ${executable} contents)
+if(NOT contents STREQUAL "stale")
+    message(FATAL_ERROR "compile -o failed but replaced ${executable}")
+endif()
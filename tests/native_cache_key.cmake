@@ -0,0 +1,38 @@
+# Checks that `kvazz compile -o` only reuses a cached executable that was built for the same program, so
+# a different program whose key hashes alike can't get it.
+#
+#   cmake -DKVAZZ=path/to/kvazz -DPROGRAM=name.kvz -DEXPECTED=name.out -DWORK_DIR=dir -P native_cache_key.cmake
+#
+# The program is built once into a cache directory of its own, then the cached executable and the key
+# next to it are replaced by those of some other program before it's built again.
+
+set(executable ${WORK_DIR}/cache_key)
+set(cache ${WORK_DIR}/cache_key_cache)
+file(REMOVE_RECURSE ${cache})
+set(ENV{KVAZZ_CACHE_DIR} ${cache})
+
+execute_process(COMMAND ${KVAZZ} compile ${PROGRAM} -o ${executable}
+    RESULT_VARIABLE status OUTPUT_VARIABLE output ERROR_VARIABLE output)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "compile -o failed:\n${output}")
+endif()
+
+file(GLOB keys ${cache}/*.key)
+list(LENGTH keys count)
+if(NOT count EQUAL 1)
+    message(FATAL_ERROR "expected one key in ${cache}, found ${count}")
+endif()
+string(REGEX REPLACE "\\.key$" "" cached ${keys})
+file(WRITE ${keys} "some other program")
+file(WRITE ${cached} "#!/bin/sh\necho some other program\n")
+
+execute_process(COMMAND ${KVAZZ} compile ${PROGRAM} -o ${executable}
+    RESULT_VARIABLE status OUTPUT_VARIABLE output ERROR_VARIABLE output)
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "compile -o failed:\n${output}")
+endif()
+execute_process(COMMAND ${executable} OUTPUT_VARIABLE output ERROR_VARIABLE output)
+file(READ ${EXPECTED} expected)
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "the executable of another program was reused\n--- got ---\n${output}--- expected ---\n${expected}")
+endif()
@@ -0,0 +1,32 @@
+# Runs one test program on one engine and compares what it prints with the expected output next to it.
+#
+#   cmake -DKVAZZ=path/to/kvazz -DPROGRAM=name.kvz -DEXPECTED=name.out -DENGINE=walker -P run_program.cmake
+#
+# ENGINE is walker, closure, vm, jit or native. native builds the program with `kvazz compile -o` into
+# NATIVE_DIR first and runs the executable.
+
+if(ENGINE STREQUAL "native")
+    get_filename_component(name ${PROGRAM} NAME_WE)
+    set(executable ${NATIVE_DIR}/${name})
+    execute_process(COMMAND ${KVAZZ} compile ${PROGRAM} -o ${executable}
+        RESULT_VARIABLE status OUTPUT_VARIABLE build_output ERROR_VARIABLE build_output)
+    if(NOT status EQUAL 0)
+        message(FATAL_ERROR "compile -o failed:\n${build_output}")
+    endif()
+    set(command ${executable})
+elseif(ENGINE STREQUAL "walker")
+    set(command ${KVAZZ} exec ${PROGRAM})
+else()
+    set(command ${KVAZZ} exec --${ENGINE} ${PROGRAM})
+endif()
+
+# stdout and stderr merged, errors a program is expected to print are part of its output
+execute_process(COMMAND ${command} RESULT_VARIABLE status OUTPUT_VARIABLE output ERROR_VARIABLE output)
+file(READ ${EXPECTED} expected)
+
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "output differs from ${EXPECTED}\n--- got ---\n${output}--- expected ---\n${expected}")
+endif()
+if(NOT status EQUAL 0)
+    message(FATAL_ERROR "exited with ${status}")
+endif()